@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+
+#include "precision.policy.hpp"
+
+enum class AccelerationStructureKind : uint8_t {
+    Linear,
+    Bvh2,
+    Bvh8,
+};
+
+enum class Bvh8NodeLayout : uint8_t {
+    Full,
+    /// child bounds quantized to 8 bits inside the node box
+    Quantized,
+};
+
+/// Memory order of the nodes. VanEmdeBoas is a post build pass that recursively splits the tree at half its height and
+/// stores every top/bottom subtree contiguously, so nodes traversed together share cache lines and pages whatever the
+/// cache sizes are. Siblings that have to stay adjacent (BVH2 pairs, BVH8 inner children) move as one block.
+enum class BvhNodeOrder : uint8_t {
+    Build,
+    VanEmdeBoas,
+};
+
+enum class BvhBuilder : uint8_t {
+    BinnedSah,
+    Lbvh,
+};
+
+struct AccelerationParameters {
+    AccelerationStructureKind kind{AccelerationStructureKind::Bvh8};
+    BvhBuilder builder{BvhBuilder::BinnedSah};
+    uint32_t bvh_bins{16};
+    uint32_t bvh_max_leaf_size{4};
+    /// 30 (10 bits per axis) or 63 (21 bits per axis)
+    uint32_t lbvh_morton_bits{30};
+    bool lbvh_treelet_rotations{true};
+    Bvh8NodeLayout bvh8_node_layout{Bvh8NodeLayout::Full};
+    BvhNodeOrder node_order{BvhNodeOrder::VanEmdeBoas};
+    /// refit_acceleration() falls back to a full rebuild once the SAH cost grows past the cost at build time times this
+    float refit_rebuild_sah_ratio{1.5f};
+    /// precision of the closest hit queries, Double for scenes with huge or far away primitives (see RayPrecision)
+    RayPrecision ray_precision{RayPrecision::Single};
+};
+
+struct AccelerationBuildStats {
+    AccelerationStructureKind Kind{AccelerationStructureKind::Linear};
+    BvhBuilder Builder{BvhBuilder::BinnedSah};
+    Bvh8NodeLayout NodeLayout{Bvh8NodeLayout::Full};
+    RayPrecision Precision{RayPrecision::Single};
+    uint32_t Threads{1};
+    double Milliseconds{};
+    float SahCost{};
+};
+
+struct AccelerationRefitStats {
+    bool Rebuilt{false};
+    double Milliseconds{};
+    float SahCost{};
+    float BuildSahCost{};
+};
+
+constexpr const char* acceleration_structure_name(const AccelerationStructureKind kind) noexcept {
+    switch (kind) {
+    case AccelerationStructureKind::Linear:
+        return "Linear";
+    case AccelerationStructureKind::Bvh2:
+        return "BVH2";
+    case AccelerationStructureKind::Bvh8:
+        return "BVH8";
+    default:
+        return "Unknown";
+    }
+}
+
+constexpr const char* bvh8_node_layout_name(const Bvh8NodeLayout layout) noexcept {
+    switch (layout) {
+    case Bvh8NodeLayout::Full:
+        return "full precision";
+    case Bvh8NodeLayout::Quantized:
+        return "quantized";
+    default:
+        return "Unknown";
+    }
+}
+
+constexpr const char* bvh_node_order_name(const BvhNodeOrder order) noexcept {
+    switch (order) {
+    case BvhNodeOrder::Build:
+        return "build order";
+    case BvhNodeOrder::VanEmdeBoas:
+        return "van Emde Boas";
+    default:
+        return "Unknown";
+    }
+}
+
+constexpr const char* bvh_builder_name(const BvhBuilder builder) noexcept {
+    switch (builder) {
+    case BvhBuilder::BinnedSah:
+        return "binned SAH";
+    case BvhBuilder::Lbvh:
+        return "LBVH";
+    default:
+        return "Unknown";
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+
+struct BoundingBox {
+    glm::vec3 Min{std::numeric_limits<float>::max()};
+    glm::vec3 Max{std::numeric_limits<float>::lowest()};
+
+    void grow(const glm::vec3& p) noexcept {
+        Min = glm::min(Min, p);
+        Max = glm::max(Max, p);
+    }
+
+    void grow(const BoundingBox& b) noexcept {
+        Min = glm::min(Min, b.Min);
+        Max = glm::max(Max, b.Max);
+    }
+
+    bool is_empty() const noexcept { return Min.x > Max.x || Min.y > Max.y || Min.z > Max.z; }
+    glm::vec3 extent() const noexcept { return Max - Min; }
+    glm::vec3 centroid() const noexcept { return (Min + Max) * 0.5f; }
+
+    float surface_area() const noexcept {
+        if (is_empty()) {
+            return 0.0f;
+        }
+        const glm::vec3 e = extent();
+        return 2.0f * (e.x * e.y + e.y * e.z + e.z * e.x);
+    }
+
+    uint32_t largest_axis() const noexcept {
+        const glm::vec3 e = extent();
+        return e.x > e.y ? (e.x > e.z ? 0 : 2) : (e.y > e.z ? 1 : 2);
+    }
+};
+
+/// Slab test, returns the entry distance or +inf when the ray misses the box inside [tmin, tmax].
+inline float ray_box_entry(const glm::vec3& bmin, const glm::vec3& bmax, const glm::vec3& origin,
+                           const glm::vec3& inv_dir, const float tmin, const float tmax) noexcept {
+    const glm::vec3 t0 = (bmin - origin) * inv_dir;
+    const glm::vec3 t1 = (bmax - origin) * inv_dir;
+    const glm::vec3 tsmaller = glm::min(t0, t1);
+    const glm::vec3 tbigger = glm::max(t0, t1);
+
+    const float tenter = std::max(std::max(tmin, tsmaller.x), std::max(tsmaller.y, tsmaller.z));
+    const float texit = std::min(std::min(tmax, tbigger.x), std::min(tbigger.y, tbigger.z));
+    return tenter <= texit ? tenter : std::numeric_limits<float>::infinity();
+}
@@ -2,6 +2,36 @@
 
 #include <array>
 #include <cstdint>
+#include <limits>
+
+#include "fast.math.hpp"
+#include "ray.tracer.texture.hpp"
+
+/// Recursive follows one path at a time (RayTracingCore::compute_color()), Iterative too but as a loop carrying the
+/// path throughput (RayTracingCore::trace_path()), Wavefront keeps all the paths of a tile in flight and runs every
+/// stage as a batch over all of them (see WavefrontIntegrator).
+enum class IntegratorKind : uint8_t {
+    Recursive,
+    Iterative,
+    Wavefront,
+    /// iterative, compiled for the object and material kinds of the scene (see select_render_kernel())
+    Specialized,
+};
+
+constexpr const char* integrator_kind_name(const IntegratorKind kind) noexcept {
+    switch (kind) {
+    case IntegratorKind::Recursive:
+        return "recursive";
+    case IntegratorKind::Iterative:
+        return "iterative";
+    case IntegratorKind::Wavefront:
+        return "wavefront";
+    case IntegratorKind::Specialized:
+        return "specialized";
+    default:
+        return "Unknown";
+    }
+}
 
 struct CameraParameters {
     float aspect_ratio;
@@ -14,4 +44,21 @@ struct CameraParameters {
     std::array<float, 3> lookfrom;
     std::array<float, 3> lookat;
     std::array<float, 3> world_up;
+    IntegratorKind integrator{IntegratorKind::Recursive};
+    /// bounces before Russian roulette starts terminating paths (iterative and wavefront integrators), max_depth or
+    /// more (the default) turns it off
+    uint16_t russian_roulette_depth{std::numeric_limits<uint16_t>::max()};
+    /// wavefront integrator only, see RaySortParameters
+    bool sort_secondary_rays{false};
+    uint32_t ray_sort_batch_size{4096};
+    /// Fast for previews only, see MathAccuracy
+    MathAccuracy math_accuracy{MathAccuracy::Exact};
+    /// filtering of the material textures
+    TextureFilter texture_filter{TextureFilter::Trilinear};
+    /// memory budget of the cache the texture files (.xtex) are read through, see TextureCache
+    uint32_t texture_cache_megabytes{256};
+    /// next event estimation: a shadow ray to a light (and one to the environment image) at every diffuse or fuzzy
+    /// metallic hit, weighted against the scattered rays that hit the lights by multiple importance sampling
+    /// (iterative, specialized and wavefront integrators), see LightCollection and EnvironmentMap
+    bool light_sampling{false};
 };
@@ -4,15 +4,19 @@
 #include <cmath>
 #include <glm/vec3.hpp>
 #include <glm/vec4.hpp>
+#include "fast.math.hpp"
 #include "ray.tracer.math.hpp"
 
-inline float linear_to_gamma(const float value) noexcept {
+inline float linear_to_gamma(const float value, const MathAccuracy accuracy = MathAccuracy::Exact) noexcept {
     if (value > 0.0f)
-        return std::sqrt(value);
+        return math_sqrt(value, accuracy);
 
     return 0.0f;
 }
 
+/// Rec. 709 luminance of a linear color.
+inline float luminance(const glm::vec3& c) noexcept { return 0.2126f * c.r + 0.7152f * c.g + 0.0722f * c.b; }
+
 struct RGBAColor {
     union {
         struct {
@@ -27,11 +31,12 @@ struct RGBAColor {
     RGBAColor() noexcept = default;
 
     explicit RGBAColor(const uint32_t c) noexcept { this->color = c; }
-    explicit RGBAColor(const glm::vec3& c) noexcept : RGBAColor{glm::vec4{c, 1.0f}} {}
-    explicit RGBAColor(const glm::vec4& c) noexcept {
-        this->r = static_cast<uint8_t>(clamp(linear_to_gamma(c.r), 0.0f, 0.999f) * 256.0f);
-        this->g = static_cast<uint8_t>(clamp(linear_to_gamma(c.g), 0.0f, 0.999f) * 256.0f);
-        this->b = static_cast<uint8_t>(clamp(linear_to_gamma(c.b), 0.0f, 0.999f) * 256.0f);
+    explicit RGBAColor(const glm::vec3& c, const MathAccuracy accuracy = MathAccuracy::Exact) noexcept
+        : RGBAColor{glm::vec4{c, 1.0f}, accuracy} {}
+    explicit RGBAColor(const glm::vec4& c, const MathAccuracy accuracy = MathAccuracy::Exact) noexcept {
+        this->r = static_cast<uint8_t>(clamp(linear_to_gamma(c.r, accuracy), 0.0f, 0.999f) * 256.0f);
+        this->g = static_cast<uint8_t>(clamp(linear_to_gamma(c.g, accuracy), 0.0f, 0.999f) * 256.0f);
+        this->b = static_cast<uint8_t>(clamp(linear_to_gamma(c.b, accuracy), 0.0f, 0.999f) * 256.0f);
         this->a = static_cast<uint8_t>(clamp(c.a, 0.0f, 0.999f) * 256.0f);
     }
 };
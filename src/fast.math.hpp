@@ -0,0 +1,88 @@
+#pragma once
+
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#include <glm/geometric.hpp>
+#include <glm/vec3.hpp>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+#include <xmmintrin.h>
+#define XRAY_HAS_HW_RSQRT_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define XRAY_HAS_HW_RSQRT_NEON
+#endif
+
+/// Accuracy of the shading math (scattering, gamma, random directions). Exact goes through the standard library,
+/// Fast through the approximations below: meant for preview renders, final renders should stay on Exact.
+enum class MathAccuracy : uint8_t {
+    Exact,
+    Fast,
+};
+
+constexpr const char* math_accuracy_name(const MathAccuracy accuracy) noexcept {
+    switch (accuracy) {
+    case MathAccuracy::Exact:
+        return "exact";
+    case MathAccuracy::Fast:
+        return "fast";
+    default:
+        return "Unknown";
+    }
+}
+
+/// 1 / sqrt(x) for x > 0: the hardware estimate (12 bits with SSE, 8 with NEON) refined with Newton-Raphson steps to
+/// about 22 bits. Targets without an estimate instruction start from the integer shift trick.
+inline float fast_rsqrt(const float x) noexcept {
+#if defined(XRAY_HAS_HW_RSQRT_SSE)
+    const float y = _mm_cvtss_f32(_mm_rsqrt_ss(_mm_set_ss(x)));
+#elif defined(XRAY_HAS_HW_RSQRT_NEON)
+    float y = vget_lane_f32(vrsqrte_f32(vdup_n_f32(x)), 0);
+    y = y * (1.5f - 0.5f * x * y * y);
+#else
+    float y = std::bit_cast<float>(0x5F375A86u - (std::bit_cast<uint32_t>(x) >> 1));
+    y = y * (1.5f - 0.5f * x * y * y);
+    y = y * (1.5f - 0.5f * x * y * y);
+#endif
+    return y * (1.5f - 0.5f * x * y * y);
+}
+
+/// sqrt(x) as x * rsqrt(x), 0 for x <= 0.
+inline float fast_sqrt(const float x) noexcept { return x > 0.0f ? x * fast_rsqrt(x) : 0.0f; }
+
+inline glm::vec3 fast_normalize(const glm::vec3& v) noexcept { return v * fast_rsqrt(glm::dot(v, v)); }
+
+/// x^5 as a product chain, what std::pow(x, 5.0f) goes through exp and log for.
+inline float fast_pow5(const float x) noexcept {
+    const float x2 = x * x;
+    return x2 * x2 * x;
+}
+
+/// Same as glm::refract() (unit incident and normal vectors), with fast_sqrt().
+inline glm::vec3 fast_refract(const glm::vec3& i, const glm::vec3& n, const float eta) noexcept {
+    const float cos_i = glm::dot(n, i);
+    const float k = 1.0f - eta * eta * (1.0f - cos_i * cos_i);
+    return k < 0.0f ? glm::vec3{0.0f} : eta * i - (eta * cos_i + fast_sqrt(k)) * n;
+}
+
+//
+// shading code calls these, the branch on the accuracy is the same for every call of a render and predicts well
+
+inline float math_sqrt(const float x, const MathAccuracy accuracy) noexcept {
+    return accuracy == MathAccuracy::Fast ? fast_sqrt(x) : std::sqrt(x);
+}
+
+inline glm::vec3 math_normalize(const glm::vec3& v, const MathAccuracy accuracy) noexcept {
+    return accuracy == MathAccuracy::Fast ? fast_normalize(v) : glm::normalize(v);
+}
+
+inline float math_pow5(const float x, const MathAccuracy accuracy) noexcept {
+    return accuracy == MathAccuracy::Fast ? fast_pow5(x) : std::pow(x, 5.0f);
+}
+
+inline glm::vec3 math_refract(const glm::vec3& i, const glm::vec3& n, const float eta,
+                              const MathAccuracy accuracy) noexcept {
+    return accuracy == MathAccuracy::Fast ? fast_refract(i, n, eta) : glm::refract(i, n, eta);
+}
@@ -2,21 +2,29 @@
 
 #include <limits>
 
-struct Interval {
-    double Min{std::numeric_limits<double>::max()};
-    double Max{std::numeric_limits<double>::min()};
+#include "precision.policy.hpp"
 
-    Interval() noexcept = default;
-    constexpr Interval(const double min_, const double max_) noexcept : Min{min_}, Max{max_} {}
+template <PrecisionPolicy Precision>
+struct BasicInterval {
+    using Scalar = typename Precision::Scalar;
 
-    double size() const noexcept { return Max - Min; }
-    bool contains(const double x) const noexcept { return Min <= x && x <= Max; }
-    bool surrounds(const double x) const noexcept { return Min < x && x < Max; }
+    Scalar Min{std::numeric_limits<Scalar>::max()};
+    Scalar Max{std::numeric_limits<Scalar>::min()};
+
+    BasicInterval() noexcept = default;
+    constexpr BasicInterval(const Scalar min_, const Scalar max_) noexcept : Min{min_}, Max{max_} {}
+
+    Scalar size() const noexcept { return Max - Min; }
+    bool contains(const Scalar x) const noexcept { return Min <= x && x <= Max; }
+    bool surrounds(const Scalar x) const noexcept { return Min < x && x < Max; }
 
     struct Stdc;
 };
 
-struct Interval::Stdc {
-    static constexpr Interval Empty{};
-    static constexpr Interval Universe{std::numeric_limits<double>::min(), std::numeric_limits<double>::max()};
+template <PrecisionPolicy Precision>
+struct BasicInterval<Precision>::Stdc {
+    static constexpr BasicInterval Empty{};
+    static constexpr BasicInterval Universe{std::numeric_limits<Scalar>::min(), std::numeric_limits<Scalar>::max()};
 };
+
+using Interval = BasicInterval<RenderPrecision>;
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cassert>
+#include <cstdint>
+#include <type_traits>
+#include <utility>
+
+/// Compile time list of the kinds of a tagged union (HittableObjectKind, MaterialKind) some code is instantiated for.
+template <typename Kind, Kind... kKinds>
+struct KindList {
+    /// one bit per kind of the list
+    static constexpr uint32_t kMask = ((1u << static_cast<uint32_t>(kKinds)) | ... | 0u);
+
+    static constexpr bool contains(const Kind kind) noexcept { return ((kind == kKinds) || ...); }
+};
+
+namespace detail {
+
+template <typename Kind, uint32_t kMask, uint32_t kKind, Kind... kKinds>
+consteval auto kind_list_of_mask() noexcept {
+    if constexpr (kKind == static_cast<uint32_t>(Kind::Count)) {
+        return KindList<Kind, kKinds...>{};
+    } else if constexpr ((kMask & (1u << kKind)) != 0) {
+        return kind_list_of_mask<Kind, kMask, kKind + 1, kKinds..., static_cast<Kind>(kKind)>();
+    } else {
+        return kind_list_of_mask<Kind, kMask, kKind + 1, kKinds...>();
+    }
+}
+
+} // namespace detail
+
+/// KindList of the kinds set in kMask, in enum order.
+template <typename Kind, uint32_t kMask>
+using KindListOf = decltype(detail::kind_list_of_mask<Kind, kMask, 0>());
+
+/// Calls fn(std::integral_constant<Kind, k>{}) for the kind k of the list equal to kind and returns its result. A
+/// direct call for a list of one kind, a chain of compares the compiler inlines otherwise: no function table. kind
+/// must be in the list.
+template <typename Kind, Kind kFirst, Kind... kRest, typename Fn>
+decltype(auto) visit_kind(KindList<Kind, kFirst, kRest...>, const Kind kind, Fn&& fn) {
+    if constexpr (sizeof...(kRest) == 0) {
+        assert(kind == kFirst);
+        return std::forward<Fn>(fn)(std::integral_constant<Kind, kFirst>{});
+    } else {
+        if (kind == kFirst) {
+            return std::forward<Fn>(fn)(std::integral_constant<Kind, kFirst>{});
+        }
+        return visit_kind(KindList<Kind, kRest...>{}, kind, std::forward<Fn>(fn));
+    }
+}
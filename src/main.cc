@@ -3,10 +3,12 @@
 #include <cstdint>
 #include <cstdio>
 #include <cstdlib>
+#include <filesystem>
 #include <latch>
 #include <mutex>
 #include <random>
 #include <ranges>
+#include <string>
 #include <system_error>
 #include <thread>
 #include <type_traits>
@@ -54,10 +56,16 @@
 #include "platform.window.hpp"
 #include "random.number.gen.hpp"
 #include "ray.hpp"
+#include "ray.tracer.bench.hpp"
 #include "ray.tracer.core.hpp"
 #include "ray.tracer.image.display.hpp"
 #include "ray.tracer.object.defs.hpp"
+#include "ray.tracer.render.kernels.hpp"
+#include "ray.tracer.texture.cache.hpp"
+#include "ray.tracer.texture.file.hpp"
+#include "ray.tracer.wavefront.hpp"
 #include "short_alloc.hpp"
+#include "simd.isa.hpp"
 #include "ui.backend.nuklear.hpp"
 
 #pragma GCC optimize("O0")
@@ -435,11 +443,37 @@ struct RayTracingWorker {
     void* _zmq_channel{};
     void* _zmq_poller{};
     RandomNumberGenerator _randgen{};
+    /// colors of the tile being traced, reused between tiles
+    std::vector<RGBAColor> _tile_colors{};
+    WavefrontIntegrator _wavefront{};
 
     void worker_loop();
     void process_tracing_work_package(const RayTracingWorkPackage& pkg);
+    void log_texture_cache_stats();
 };
 
+void RayTracingWorker::log_texture_cache_stats() {
+    const SceneReadGuard scene = _rtcore->rts_scene->pin(_workerid);
+    const std::shared_ptr<TextureCache>& cache = scene->Textures.cache();
+    if (!cache) {
+        return;
+    }
+
+    //
+    // every worker adds the lookups of its micro cache, the first one logs the totals
+    cache->flush_thread_stats();
+    if (_workerid != 0) {
+        return;
+    }
+
+    const TextureCacheStats stats = cache->stats();
+    LOG_INFO(g_logger,
+             "Texture cache: hit rate {:.4f} ({} micro cache hits, {} misses, {} shared hits, {} page loads), {} "
+             "evictions, {} of {} bytes resident",
+             stats.hit_rate(), stats.MicroHits, stats.MicroMisses, stats.SharedHits, stats.SharedMisses,
+             stats.Evictions, stats.ResidentBytes, stats.BudgetBytes);
+}
+
 void RayTracingWorker::worker_loop() {
     SCOPED_GUARD([this]() { WRAP_ZMQ_FUNC(zmq_poller_remove, _zmq_poller, _zmq_channel); });
     SCOPED_GUARD([this]() { WRAP_ZMQ_FUNC(zmq_close, _zmq_channel); });
@@ -482,6 +516,7 @@ void RayTracingWorker::worker_loop() {
                                    },
                                    [&quit_flag, this](const ThreadQuitMessage) mutable {
                                        LOG_INFO(g_logger, "Worker {} shutting down ...", _workerid);
+                                       log_texture_cache_stats();
                                        quit_flag = true;
                                    },
                                    [](const WorkerResponse&) {},
@@ -505,9 +540,25 @@ void RayTracingWorker::worker_loop() {
 }
 
 void RayTracingWorker::process_tracing_work_package(const RayTracingWorkPackage& rtpkg) {
+    //
+    // the whole tile is traced on the snapshot that was current when it started
+    const SceneReadGuard scene = _rtcore->rts_scene->pin(_workerid);
+
+    const uint16_t tile_width = rtpkg.pixels_end.x - rtpkg.pixels_start.x;
+    _tile_colors.resize(static_cast<size_t>(tile_width) * (rtpkg.pixels_end.y - rtpkg.pixels_start.y));
+    if (_rtcore->rts_integrator == IntegratorKind::Wavefront) {
+        _wavefront.render_tile(*_rtcore, rtpkg.pixels_start.x, rtpkg.pixels_start.y, rtpkg.pixels_end.x,
+                               rtpkg.pixels_end.y, *scene, _randgen, _tile_colors);
+    } else {
+        _rtcore->raytrace_tile(_rtcore->rts_integrator, _rtcore->rts_math_accuracy, rtpkg.pixels_start.x,
+                               rtpkg.pixels_start.y, rtpkg.pixels_end.x, rtpkg.pixels_end.y, *scene, _randgen,
+                               _tile_colors);
+    }
+
     for (uint16_t y = rtpkg.pixels_start.y; y < rtpkg.pixels_end.y; ++y) {
         for (uint16_t x = rtpkg.pixels_start.x; x < rtpkg.pixels_end.x; ++x) {
-            const RGBAColor pixel_color = _rtcore->raytrace_pixel(x, y, _randgen);
+            const RGBAColor pixel_color =
+                _tile_colors[(y - rtpkg.pixels_start.y) * tile_width + (x - rtpkg.pixels_start.x)];
             send_thread_pkg(this->_zmq_channel, RaytracedPixel{
                                                     .rtp_x = x,
                                                     .rtp_y = y,
@@ -544,7 +595,7 @@ public:
           _workqueue{std::move(rhs._workqueue)}, _worker_context{std::move(rhs._worker_context)},
           _start_timepoint{rhs._start_timepoint}, _end_timepoint{rhs._end_timepoint} {}
 
-    static tl::optional<RayTracer> create();
+    static tl::optional<RayTracer> create(const std::filesystem::path& world_config);
     void update(RayTracedImageDisplay* img_output);
     void shutdown();
     uint32_t pixels_count() const noexcept { return _imgsize.x * _imgsize.y; }
@@ -583,7 +634,7 @@ T round_up(const T value, const T multiple) noexcept {
     return ((value + multiple - 1) / multiple) * multiple;
 }
 
-tl::optional<RayTracer> RayTracer::create() {
+tl::optional<RayTracer> RayTracer::create(const std::filesystem::path& world_config) {
     int32_t z_major{};
     int32_t z_minor{};
     int32_t z_patch{};
@@ -601,15 +652,39 @@ tl::optional<RayTracer> RayTracer::create() {
         return tl::nullopt;
     }
 
-    std::shared_ptr<RayTracingCore> rtsetup = RayTracingCore::default_setup();
-    const glm::u16vec2 img_size{rtsetup->rts_img_width, rtsetup->rts_img_height};
-    const glm::uvec2 rounded_img_size{round_up<uint32_t>(img_size.x, 8), round_up<uint32_t>(img_size.y, 8)};
-
     auto cpu_count = std::thread::hardware_concurrency();
     if (cpu_count > 6) {
         cpu_count -= 2;
     }
-    LOG_INFO(g_logger, "Using {} cores", cpu_count);
+
+    std::shared_ptr<RayTracingCore> rtsetup = RayTracingCore::default_setup(cpu_count, cpu_count, world_config);
+    const glm::u16vec2 img_size{rtsetup->rts_img_width, rtsetup->rts_img_height};
+    const glm::uvec2 rounded_img_size{round_up<uint32_t>(img_size.x, 8), round_up<uint32_t>(img_size.y, 8)};
+
+    LOG_INFO(g_logger, "Using {} cores, {} integrator, {} shading math", cpu_count,
+             integrator_kind_name(rtsetup->rts_integrator), math_accuracy_name(rtsetup->rts_math_accuracy));
+
+    {
+        const SceneReadGuard scene = rtsetup->rts_scene->pin(0);
+        const AccelerationBuildStats& build_stats = scene->World.build_stats();
+        LOG_INFO(g_logger,
+                 "{} ({} builder, {} nodes, {} precision rays) over {} objects built in {:.3f} ms on {} thread(s), "
+                 "SAH cost {:.2f}",
+                 acceleration_structure_name(build_stats.Kind), bvh_builder_name(build_stats.Builder),
+                 bvh8_node_layout_name(build_stats.NodeLayout), ray_precision_name(build_stats.Precision),
+                 scene->World.size(), build_stats.Milliseconds, build_stats.Threads, build_stats.SahCost);
+
+        if (const std::shared_ptr<TextureCache>& cache = scene->Textures.cache()) {
+            LOG_INFO(g_logger, "Texture cache: {} file(s), {} bytes budget", cache->files_count(),
+                     cache->stats().BudgetBytes);
+        }
+
+        if (rtsetup->rts_integrator == IntegratorKind::Specialized) {
+            const RenderKernel& kernel = select_render_kernel(*scene);
+            LOG_INFO(g_logger, "Render kernel: object kinds {:#x}, material kinds {:#x}{}", kernel.ObjectKinds,
+                     kernel.MaterialKinds, kernel.ObjectKinds == 0 ? " (generic)" : "");
+        }
+    }
 
     const auto cpus = cpu_count;
     constexpr uint32_t BLOCK_SIZE = 8;
@@ -671,6 +746,7 @@ tl::optional<RayTracer> RayTracer::create() {
                 worker._workerid = idx;
                 worker._rtcore = rtsetup;
                 worker._work_queue = wqueue;
+                worker._wavefront = WavefrontIntegrator{rtsetup->rts_ray_sort, rtsetup->rts_math_accuracy};
 
                 {
                     SCOPED_GUARD([&workers_rdy]() { workers_rdy.count_down(); });
@@ -814,6 +890,69 @@ int main(int argc, char** argv) {
     g_logger = quill::Frontend::create_or_get_logger("global_logger", std::move(file_sink));
     g_logger->set_log_level(quill::LogLevel::Debug);
 
+    bool bench_accel{false};
+    std::string isa_name{simd_isa_name(detect_simd_isa())};
+    std::string convert_texture{};
+    std::string texture_output{};
+    std::string world_config{RayTracingCore::kDefaultWorldConfig};
+    const auto cli =
+        lyra::cli{} |
+        lyra::opt{world_config, "file"}["--world"](
+            "Scene to render or bench (default: data/config/world.config.json, demo scenes are next to it)") |
+        lyra::opt{bench_accel}["--bench-accel"](
+            "Trace the same rays through the linear scan and the BVHs, log the rays/sec and exit") |
+        lyra::opt{isa_name, "level"}["--isa"](
+            "BVH8 traversal kernels to use: baseline, sse4, avx2 or avx512 (default: the best the CPU supports)") |
+        lyra::opt{convert_texture, "image"}["--convert-texture"](
+            "Convert an image (any format stb_image reads) to a tiled mip mapped texture file (.xtex) and exit") |
+        lyra::opt{texture_output, "file"}["--texture-output"](
+            "Texture file written by --convert-texture (default: the image path with the .xtex extension)");
+
+    if (const auto arg_parse_res = cli.parse({argc, argv}); !arg_parse_res) {
+        LOG_ERROR(g_logger, "{}", arg_parse_res.message());
+        return EXIT_FAILURE;
+    }
+
+    const tl::optional<SimdIsa> requested_isa = simd_isa_from_name(isa_name);
+    if (!requested_isa) {
+        LOG_ERROR(g_logger, "Unknown ISA level {}", isa_name);
+        return EXIT_FAILURE;
+    }
+    LOG_INFO(g_logger, "BVH8 traversal kernels: {} (requested {}, CPU supports {}, built up to {})",
+             simd_isa_name(select_simd_isa(*requested_isa)), isa_name, simd_isa_name(detect_simd_isa()),
+             simd_isa_name(max_built_simd_isa()));
+
+    if (!convert_texture.empty()) {
+        std::filesystem::path output_path{texture_output};
+        if (texture_output.empty()) {
+            output_path = std::filesystem::path{convert_texture}.replace_extension(".xtex");
+        }
+
+        //
+        // the filter is a render setting, the file only holds the texels
+        const tl::expected<void, SystemError> converted =
+            TiledTexture::from_file(convert_texture, TextureFilter::Bilinear)
+                .and_then([&output_path, &convert_texture](const TiledTexture& texture) {
+                    LOG_INFO(g_logger, "Texture {}: {}x{}, {} mip levels, {} bytes", convert_texture, texture.width(),
+                             texture.height(), texture.levels().size(), texture.size_bytes());
+                    return write_texture_file(texture, output_path);
+                });
+
+        if (!converted) {
+            LOG_ERROR(g_logger, "Failed to convert texture {} to {}: {}", convert_texture, output_path.string(),
+                      converted.error().e.message());
+            return EXIT_FAILURE;
+        }
+        LOG_INFO(g_logger, "Texture written to {}", output_path.string());
+        return EXIT_SUCCESS;
+    }
+
+    if (bench_accel) {
+        bench_acceleration_structures(
+            *RayTracingCore::default_setup(std::thread::hardware_concurrency(), 1, world_config));
+        return EXIT_SUCCESS;
+    }
+
     auto window = PlatformWindow::create();
     if (!window) {
         LOG_ERROR(g_logger, "Failed to create main window!");
@@ -826,7 +965,7 @@ int main(int argc, char** argv) {
         return EXIT_FAILURE;
     }
 
-    auto raytracer = RayTracer::create();
+    auto raytracer = RayTracer::create(world_config);
     if (!raytracer) {
         LOG_ERROR(g_logger, "Failed to create raytracer ...");
         return EXIT_FAILURE;
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <type_traits>
+
+#include <glm/common.hpp>
+#include <glm/vec3.hpp>
+
+/// Spreads the low 10 bits of x so there are 2 zero bits between consecutive bits.
+inline uint32_t expand_bits_10(uint32_t x) noexcept {
+    x = (x * 0x00010001u) & 0xFF0000FFu;
+    x = (x * 0x00000101u) & 0x0F00F00Fu;
+    x = (x * 0x00000011u) & 0xC30C30C3u;
+    x = (x * 0x00000005u) & 0x49249249u;
+    return x;
+}
+
+/// Same as expand_bits_10() for the low 21 bits.
+inline uint64_t expand_bits_21(uint64_t x) noexcept {
+    x &= 0x1FFFFFull;
+    x = (x | x << 32) & 0x1F00000000FFFFull;
+    x = (x | x << 16) & 0x1F0000FF0000FFull;
+    x = (x | x << 8) & 0x100F00F00F00F00Full;
+    x = (x | x << 4) & 0x10C30C30C30C30C3ull;
+    x = (x | x << 2) & 0x1249249249249249ull;
+    return x;
+}
+
+/// Morton code of a position inside the unit cube, 10 bits per axis for uint32_t codes, 21 bits per axis for uint64_t.
+template <typename MortonCode>
+MortonCode morton_code(const glm::vec3& unit_pos) noexcept {
+    if constexpr (std::is_same_v<MortonCode, uint32_t>) {
+        const glm::vec3 q = glm::clamp(unit_pos * 1024.0f, 0.0f, 1023.0f);
+        return (expand_bits_10(static_cast<uint32_t>(q.x)) << 2) | (expand_bits_10(static_cast<uint32_t>(q.y)) << 1) |
+               expand_bits_10(static_cast<uint32_t>(q.z));
+    } else {
+        const glm::vec3 q = glm::clamp(unit_pos * 2097152.0f, 0.0f, 2097151.0f);
+        return (expand_bits_21(static_cast<uint64_t>(q.x)) << 2) | (expand_bits_21(static_cast<uint64_t>(q.y)) << 1) |
+               expand_bits_21(static_cast<uint64_t>(q.z));
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+/// Number of chunks parallel_for_chunks() splits items_count into.
+inline size_t parallel_chunks_count(const uint32_t threads_count, const size_t items_count) noexcept {
+    return std::max<size_t>(1, std::min<size_t>(threads_count, items_count));
+}
+
+/// Splits [0, items_count) into contiguous chunks and runs fn(chunk_idx, begin, end) for each chunk on its own
+/// thread, the calling thread takes the first chunk. The split only depends on the arguments, so consecutive calls
+/// with the same arguments hand the same ranges to the same chunk_idx.
+template <typename Fn>
+void parallel_for_chunks(const uint32_t threads_count, const size_t items_count, Fn&& fn) {
+    const size_t chunks = parallel_chunks_count(threads_count, items_count);
+    const size_t chunk_size = (items_count + chunks - 1) / chunks;
+
+    std::vector<std::jthread> threads{};
+    threads.reserve(chunks - 1);
+
+    for (size_t chunk = 1; chunk < chunks; ++chunk) {
+        const size_t begin = std::min(items_count, chunk * chunk_size);
+        const size_t end = std::min(items_count, begin + chunk_size);
+        threads.emplace_back([&fn, chunk, begin, end]() { fn(chunk, begin, end); });
+    }
+
+    fn(size_t{0}, size_t{0}, std::min(items_count, chunk_size));
+}
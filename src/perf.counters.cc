@@ -0,0 +1,91 @@
+#include "perf.counters.hpp"
+
+#include <cerrno>
+#include <system_error>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__)
+
+namespace {
+
+int32_t open_cache_miss_counter(const uint64_t cache_id) noexcept {
+    perf_event_attr attr{};
+    attr.type = PERF_TYPE_HW_CACHE;
+    attr.size = sizeof(attr);
+    attr.config = cache_id | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+
+    return static_cast<int32_t>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+}
+
+uint64_t read_counter(const int32_t fd) noexcept {
+    uint64_t value{};
+    if (read(fd, &value, sizeof(value)) != static_cast<ssize_t>(sizeof(value))) {
+        return 0;
+    }
+    return value;
+}
+
+} // namespace
+
+tl::expected<CacheMissCounters, SystemError> CacheMissCounters::open() {
+    const int32_t l1d_fd = open_cache_miss_counter(PERF_COUNT_HW_CACHE_L1D);
+    if (l1d_fd == -1) {
+        return tl::make_unexpected(SystemError{std::error_code{errno, std::system_category()}});
+    }
+
+    const int32_t llc_fd = open_cache_miss_counter(PERF_COUNT_HW_CACHE_LL);
+    if (llc_fd == -1) {
+        const SystemError err{std::error_code{errno, std::system_category()}};
+        close(l1d_fd);
+        return tl::make_unexpected(err);
+    }
+
+    return CacheMissCounters{l1d_fd, llc_fd};
+}
+
+CacheMissCounters::~CacheMissCounters() {
+    for (const int32_t fd : {_l1d_fd, _llc_fd}) {
+        if (fd != -1) {
+            close(fd);
+        }
+    }
+}
+
+void CacheMissCounters::start() noexcept {
+    for (const int32_t fd : {_l1d_fd, _llc_fd}) {
+        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+CacheMissCounts CacheMissCounters::stop() noexcept {
+    for (const int32_t fd : {_l1d_fd, _llc_fd}) {
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+    }
+
+    return CacheMissCounts{
+        .L1DataMisses = read_counter(_l1d_fd),
+        .LastLevelMisses = read_counter(_llc_fd),
+    };
+}
+
+#else
+
+tl::expected<CacheMissCounters, SystemError> CacheMissCounters::open() {
+    return tl::make_unexpected(SystemError{std::make_error_code(std::errc::not_supported)});
+}
+
+CacheMissCounters::~CacheMissCounters() = default;
+void CacheMissCounters::start() noexcept {}
+CacheMissCounts CacheMissCounters::stop() noexcept { return CacheMissCounts{}; }
+
+#endif
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <cstdint>
+#include <utility>
+
+#include <tl/expected.hpp>
+
+#include "error.hpp"
+
+struct CacheMissCounts {
+    uint64_t L1DataMisses{};
+    uint64_t LastLevelMisses{};
+};
+
+/// L1 data and last level cache read misses of the calling thread (user space only), read through perf_event_open.
+/// Only available on Linux, and only when kernel.perf_event_paranoid allows it.
+class CacheMissCounters {
+public:
+    static tl::expected<CacheMissCounters, SystemError> open();
+
+    ~CacheMissCounters();
+
+    CacheMissCounters(const CacheMissCounters&) = delete;
+    CacheMissCounters& operator=(const CacheMissCounters&) = delete;
+
+    CacheMissCounters(CacheMissCounters&& rhs) noexcept
+        : _l1d_fd{std::exchange(rhs._l1d_fd, -1)}, _llc_fd{std::exchange(rhs._llc_fd, -1)} {}
+
+    CacheMissCounters& operator=(CacheMissCounters&&) = delete;
+
+    /// Resets and starts counting.
+    void start() noexcept;
+    /// Stops counting, returns the misses since start().
+    CacheMissCounts stop() noexcept;
+
+private:
+    CacheMissCounters(const int32_t l1d_fd, const int32_t llc_fd) noexcept : _l1d_fd{l1d_fd}, _llc_fd{llc_fd} {}
+
+    int32_t _l1d_fd{-1};
+    int32_t _llc_fd{-1};
+};
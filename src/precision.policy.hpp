@@ -0,0 +1,52 @@
+#pragma once
+
+#include <concepts>
+#include <cstdint>
+
+/// Scalar type of the ray, interval and primitive hit math (see BasicRay, BasicInterval, BasicPrimitiveHit) and the
+/// epsilons that go with it.
+struct SinglePrecision {
+    using Scalar = float;
+    /// secondary rays ignore hits closer than this
+    static constexpr Scalar kRayTMin = 1.0e-4f;
+    /// Secondary rays start off the surface by kOriginOffset + kOriginOffsetScale * max(|p|): float keeps about 7
+    /// digits, so a fixed offset alone disappears in the rounding error of points far from the origin.
+    static constexpr Scalar kOriginOffset = 1.0e-4f;
+    static constexpr Scalar kOriginOffsetScale = 1.0e-5f;
+};
+
+struct DoublePrecision {
+    using Scalar = double;
+    static constexpr Scalar kRayTMin = 1.0e-8;
+    static constexpr Scalar kOriginOffset = 1.0e-8;
+    static constexpr Scalar kOriginOffsetScale = 1.0e-12;
+};
+
+template <typename P>
+concept PrecisionPolicy = std::floating_point<typename P::Scalar> && requires {
+    { P::kRayTMin } -> std::convertible_to<typename P::Scalar>;
+    { P::kOriginOffset } -> std::convertible_to<typename P::Scalar>;
+    { P::kOriginOffsetScale } -> std::convertible_to<typename P::Scalar>;
+};
+
+/// Precision of the renderer: rays, intervals, BVH traversal, shading.
+using RenderPrecision = SinglePrecision;
+
+/// Precision of the closest hit queries of a collection (see AccelerationParameters::ray_precision). Double converts
+/// the ray once and runs the traversal and the primitive tests in double, for scenes where float loses too much (large
+/// spheres, far away geometry).
+enum class RayPrecision : uint8_t {
+    Single,
+    Double,
+};
+
+constexpr const char* ray_precision_name(const RayPrecision precision) noexcept {
+    switch (precision) {
+    case RayPrecision::Single:
+        return "single";
+    case RayPrecision::Double:
+        return "double";
+    default:
+        return "Unknown";
+    }
+}
@@ -1,12 +1,18 @@
 #pragma once
 
+#include <cstdint>
+
 #include <glm/geometric.hpp>
 #include <glm/vec3.hpp>
 #include <random>
 
+#include "fast.math.hpp"
+
 class RandomNumberGenerator {
 public:
     RandomNumberGenerator() = default;
+    /// Same sequence for the same seed, for comparing renders.
+    explicit RandomNumberGenerator(const uint32_t seed) : _randgen{seed} {}
 
     double random_double() noexcept { return _randdist(_randgen); }
     double random_double(const double r_min, const double r_max) noexcept {
@@ -18,12 +24,12 @@ public:
     glm::vec3 random_vector(const double rmin, const double rmax) noexcept {
         return glm::vec3{random_double(rmin, rmax), random_double(rmin, rmax), random_double(rmin, rmax)};
     }
-    glm::vec3 random_unit_vector() noexcept {
+    glm::vec3 random_unit_vector(const MathAccuracy accuracy = MathAccuracy::Exact) noexcept {
         for (;;) {
             const glm::vec3 p = random_vector(-1.0, 1.0);
             const float length_squared = glm::dot(p, p);
             if (length_squared > 1e-160 && length_squared <= 1.0f) {
-                return p / std::sqrt(length_squared);
+                return accuracy == MathAccuracy::Fast ? p * fast_rsqrt(length_squared) : p / std::sqrt(length_squared);
             }
         }
     }
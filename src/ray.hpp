@@ -1,10 +1,79 @@
 #pragma once
 
+#include <algorithm>
+#include <cmath>
+
+#include <glm/geometric.hpp>
 #include <glm/vec3.hpp>
 
-struct Ray {
-    glm::vec3 Origin;
-    glm::vec3 Direction;
+#include "precision.policy.hpp"
+
+/// Footprint of a ray for the texture LOD (ray cones, Ray Tracing Gems chapter 20): the width of the cone around the
+/// ray at its origin and the spread angle, the width grows by SpreadAngle per unit of distance along the ray. The zero
+/// cone is a ray without a footprint, its hits read the finest mip level.
+struct RayCone {
+    /// Spread of the rays leaving a diffuse bounce. A single direction stands in for the whole hemisphere, so the
+    /// lookups it leads to can be blurry; large enough to move the textures of the hits of most bounces to the coarse
+    /// levels.
+    static constexpr float kDiffuseSpreadAngle = 0.1f;
+    /// the footprint of a grazing hit is clamped to 1 / kMinCosTheta times the cone width
+    static constexpr float kMinCosTheta = 0.01f;
+
+    float Width{};
+    float SpreadAngle{};
+
+    RayCone at_distance(const float distance) const noexcept {
+        return RayCone{.Width = Width + SpreadAngle * distance, .SpreadAngle = SpreadAngle};
+    }
+
+    //
+    // cones of the rays leaving a hit, this being the cone at the hit: the normal turns by width * curvature across
+    // the footprint, twice that for a mirror reflection, (1 - eta) times that for a refraction
+
+    RayCone reflected(const float curvature) const noexcept {
+        return RayCone{.Width = Width, .SpreadAngle = SpreadAngle + 2.0f * Width * std::abs(curvature)};
+    }
+
+    RayCone refracted(const float curvature, const float eta) const noexcept {
+        return RayCone{.Width = Width, .SpreadAngle = SpreadAngle + std::abs((1.0f - eta) * Width * curvature)};
+    }
+
+    RayCone diffuse() const noexcept {
+        return RayCone{.Width = Width, .SpreadAngle = std::max(SpreadAngle, kDiffuseSpreadAngle)};
+    }
+
+    /// Width of the footprint of the cone on a surface, in UV units: uv_scale UV units per unit of distance on the
+    /// surface, cos_theta between the ray and the normal.
+    float uv_footprint(const float uv_scale, const float cos_theta) const noexcept {
+        return Width * uv_scale / std::max(std::abs(cos_theta), kMinCosTheta);
+    }
+};
+
+template <PrecisionPolicy Precision>
+struct BasicRay {
+    using Scalar = typename Precision::Scalar;
+    using Vec3 = glm::vec<3, Scalar>;
+
+    Vec3 Origin;
+    Vec3 Direction;
+    /// optional, only the shading reads it, the traversal ignores it
+    RayCone Cone{};
+
+    Vec3 point_at_param(const Scalar t) const noexcept { return Origin + Direction * t; }
+};
+
+using Ray = BasicRay<RenderPrecision>;
+
+/// Origin of a ray leaving the surface point p (normal n) in direction dir: p pushed off the surface, to the side dir
+/// points to, so the ray does not hit the surface it starts from again. The offset grows with the magnitude of p since
+/// the rounding error of the hit point does (see SinglePrecision::kOriginOffsetScale).
+template <PrecisionPolicy Precision>
+typename BasicRay<Precision>::Vec3 offset_ray_origin(const typename BasicRay<Precision>::Vec3& p,
+                                                     const typename BasicRay<Precision>::Vec3& n,
+                                                     const typename BasicRay<Precision>::Vec3& dir) noexcept {
+    using Scalar = typename Precision::Scalar;
 
-    glm::vec3 point_at_param(const float t) const noexcept { return Origin + Direction * t; }
-};
\ No newline at end of file
+    const Scalar magnitude = std::max({std::abs(p.x), std::abs(p.y), std::abs(p.z)});
+    const Scalar offset = Precision::kOriginOffset + Precision::kOriginOffsetScale * magnitude;
+    return glm::dot(dir, n) < Scalar{0} ? p - n * offset : p + n * offset;
+}
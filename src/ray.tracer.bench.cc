@@ -0,0 +1,1549 @@
+#include "ray.tracer.bench.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <limits>
+#include <memory>
+#include <numbers>
+#include <span>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <glm/ext.hpp>
+
+#include "logging.hpp"
+#include "parallel.for.hpp"
+#include "perf.counters.hpp"
+#include "random.number.gen.hpp"
+#include "ray.tracer.core.hpp"
+#include "ray.tracer.environment.hpp"
+#include "ray.tracer.lights.hpp"
+#include "ray.tracer.render.kernels.hpp"
+#include "ray.tracer.texture.cache.hpp"
+#include "ray.tracer.texture.file.hpp"
+#include "ray.tracer.texture.hpp"
+#include "ray.tracer.wavefront.hpp"
+#include "simd.isa.hpp"
+
+namespace {
+
+constexpr Interval kBenchRayInterval{RenderPrecision::kRayTMin, std::numeric_limits<float>::infinity()};
+
+struct ThroughputResult {
+    size_t Hits{};
+    double Seconds{};
+
+    double mrays_per_second(const size_t rays) const noexcept {
+        return Seconds > 0.0 ? static_cast<double>(rays) / Seconds * 1.0e-6 : 0.0;
+    }
+};
+
+template <typename IntersectFn>
+ThroughputResult measure_throughput(std::span<const Ray> rays, IntersectFn&& intersect_fn) {
+    const auto start = std::chrono::high_resolution_clock::now();
+
+    size_t hits{};
+    for (const Ray& r : rays) {
+        if (intersect_fn(r)) {
+            hits += 1;
+        }
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+    return ThroughputResult{.Hits = hits, .Seconds = elapsed.count()};
+}
+
+std::vector<Ray> make_primary_rays(const RayTracingCore& rtcore, RandomNumberGenerator& randgen) {
+    std::vector<Ray> rays{};
+    rays.reserve(static_cast<size_t>(rtcore.rts_img_width) * rtcore.rts_img_height);
+
+    for (uint32_t y = 0; y < rtcore.rts_img_height; ++y) {
+        for (uint32_t x = 0; x < rtcore.rts_img_width; ++x) {
+            rays.push_back(rtcore.get_ray(x, y, randgen));
+        }
+    }
+
+    return rays;
+}
+
+std::vector<Ray> make_diffuse_bounce_rays(const HittableObject_Collection& world, std::span<const Ray> primary_rays,
+                                          RandomNumberGenerator& randgen) {
+    std::vector<Ray> rays{};
+    rays.reserve(primary_rays.size());
+
+    for (const Ray& r : primary_rays) {
+        if (const tl::optional<IntersectionRecord> int_rec = world.intersects(r, kBenchRayInterval)) {
+            const glm::vec3 dir = int_rec->Normal + randgen.random_unit_vector();
+            rays.push_back(Ray{offset_ray_origin<RenderPrecision>(int_rec->P, int_rec->Normal, dir), dir,
+                               int_rec->cone(r).diffuse()});
+        }
+    }
+
+    return rays;
+}
+
+size_t count_mismatches(const HittableObject_Collection& world, std::span<const Ray> rays) {
+    size_t mismatches{};
+    for (const Ray& r : rays) {
+        const tl::optional<IntersectionRecord> linear_hit = world.intersects_linear(r, kBenchRayInterval);
+        const tl::optional<IntersectionRecord> accel_hit = world.intersects(r, kBenchRayInterval);
+
+        if (linear_hit.has_value() != accel_hit.has_value() ||
+            (linear_hit && std::abs(linear_hit->T - accel_hit->T) > 1.0e-4)) {
+            mismatches += 1;
+        }
+    }
+    return mismatches;
+}
+
+HittableObject_Collection make_accelerated_world(const HittableObject_Collection& world,
+                                                 const AccelerationParameters& params) {
+    HittableObject_Collection accel_world{world};
+    accel_world.build_acceleration(params, std::thread::hardware_concurrency());
+
+    const AccelerationBuildStats& stats = accel_world.build_stats();
+    LOG_INFO(g_logger, "[bench] {} ({} builder) built in {:.3f} ms on {} thread(s), SAH cost {:.2f}",
+             acceleration_structure_name(stats.Kind), bvh_builder_name(stats.Builder), stats.Milliseconds,
+             stats.Threads, stats.SahCost);
+
+    return accel_world;
+}
+
+/// The scene with the two emissive spheres of data/config/emissive.world.config.json added and its acceleration
+/// structure and lights built again: the shipped scene has no lights, the light sampling benches need some.
+SceneSnapshot make_lit_scene(const SceneSnapshot& scene) {
+    const struct {
+        glm::vec3 Center;
+        float Radius;
+        glm::vec3 Emission;
+    } sphere_lights[] = {
+        {glm::vec3{0.0f, 5.0f, 2.0f}, 0.5f, glm::vec3{24.0f, 21.0f, 16.0f}},
+        {glm::vec3{-1.5f, 0.7f, 2.5f}, 0.2f, glm::vec3{20.0f, 8.0f, 2.0f}},
+    };
+
+    SceneSnapshot lit_scene{scene};
+    for (const auto& [center, radius, emission] : sphere_lights) {
+        lit_scene.World.add_object(
+            HittableObject::make_sphere(center, radius, lit_scene.Materials.add(Material::make_emissive(emission))));
+    }
+    lit_scene.World.build_acceleration(scene.World.build_params(), std::thread::hardware_concurrency());
+    lit_scene.Lights = LightCollection::build(lit_scene.World, lit_scene.Materials);
+    return lit_scene;
+}
+
+/// Moves every small sphere along a circle for a few frames, refitting (or rebuilding, when the quality monitor
+/// decides so) the acceleration structure after every frame, once for each BVH8 node layout.
+void bench_refit(const HittableObject_Collection& world, std::span<const Ray> rays) {
+    constexpr uint32_t kFramesCount = 16;
+    constexpr float kLargeRadius = 1.0f;
+
+    const uint32_t threads_count = std::thread::hardware_concurrency();
+
+    std::vector<glm::vec3> rest_centers{};
+    rest_centers.reserve(world.size());
+    for (uint32_t id = 0; id < world.size(); ++id) {
+        rest_centers.push_back(world.object(id).Sphere.Center);
+    }
+
+    for (const Bvh8NodeLayout layout : {Bvh8NodeLayout::Full, Bvh8NodeLayout::Quantized}) {
+        HittableObject_Collection animated_world =
+            make_accelerated_world(world, AccelerationParameters{.bvh8_node_layout = layout});
+
+        for (uint32_t frame = 1; frame <= kFramesCount; ++frame) {
+            const float angle = static_cast<float>(frame) * 0.25f;
+            for (uint32_t id = 0; id < animated_world.size(); ++id) {
+                const HittableObject_Sphere& sphere = animated_world.object(id).Sphere;
+                if (sphere.Radius < kLargeRadius) {
+                    const glm::vec3 offset{std::cos(angle) - 1.0f, 0.0f, std::sin(angle)};
+                    animated_world.update_sphere(id, rest_centers[id] + offset * static_cast<float>(frame) * 0.1f,
+                                                 sphere.Radius);
+                }
+            }
+
+            const AccelerationRefitStats stats = animated_world.refit_acceleration(threads_count);
+            LOG_INFO(g_logger, "[bench] {} frame {}: {} in {:.3f} ms on {} thread(s), SAH cost {:.2f} (built {:.2f})",
+                     bvh8_node_layout_name(layout), frame, stats.Rebuilt ? "rebuilt" : "refit", stats.Milliseconds,
+                     threads_count, stats.SahCost, stats.BuildSahCost);
+        }
+
+        LOG_INFO(g_logger, "[bench] animated world ({} nodes): {} mismatches over {} rays",
+                 bvh8_node_layout_name(layout), count_mismatches(animated_world, rays), rays.size());
+    }
+}
+
+size_t collection_bytes(const HittableObject_Collection& world) noexcept {
+    return world.size() * sizeof(HittableObject) + world.instances_count() * sizeof(InstanceData) +
+           world.bvh().nodes().size_bytes() + world.bvh8().size_bytes();
+}
+
+/// Places a grid of rotated and scaled copies of the small spheres, once as instances of one shared cluster (a BVH8)
+/// under a top level BVH and once flattened into a single collection, then checks both agree on the closest hits.
+void bench_instancing(const HittableObject_Collection& world, std::span<const Ray> rays) {
+    constexpr int32_t kGridHalfSize = 2;
+    constexpr float kGridSpacing = 24.0f;
+    constexpr float kLargeRadius = 1.0f;
+
+    auto cluster = std::make_shared<HittableObject_Collection>();
+    for (uint32_t id = 0; id < world.size(); ++id) {
+        if (const HittableObject& obj = world.object(id);
+            obj.ObjKind == HittableObjectKind::Sphere && obj.Sphere.Radius < kLargeRadius) {
+            cluster->add_object(obj);
+        }
+    }
+    cluster->build_acceleration(AccelerationParameters{});
+
+    HittableObject_Collection instanced_world{};
+    HittableObject_Collection flat_world{};
+    for (int32_t x = -kGridHalfSize; x <= kGridHalfSize; ++x) {
+        for (int32_t z = -kGridHalfSize; z <= kGridHalfSize; ++z) {
+            const float scale = 1.0f + 0.125f * static_cast<float>(std::abs(x + z));
+            const glm::mat4 object_to_world = glm::scale(
+                glm::rotate(glm::translate(glm::mat4{1.0f}, glm::vec3{x * kGridSpacing, 0.0f, z * kGridSpacing}),
+                            static_cast<float>(x * 5 + z), glm::vec3{0.0f, 1.0f, 0.0f}),
+                glm::vec3{scale});
+
+            instanced_world.add_instance(cluster, object_to_world);
+            for (uint32_t id = 0; id < cluster->size(); ++id) {
+                const HittableObject_Sphere& sphere = cluster->object(id).Sphere;
+                const glm::vec3 center{object_to_world * glm::vec4{sphere.Center, 1.0f}};
+                flat_world.add_object(HittableObject::make_sphere(center, sphere.Radius * scale, sphere.Material));
+            }
+        }
+    }
+
+    instanced_world.build_acceleration(AccelerationParameters{.kind = AccelerationStructureKind::Bvh2});
+    flat_world.build_acceleration(AccelerationParameters{});
+
+    LOG_INFO(g_logger, "[bench] {} instances of {} spheres: instanced {} bytes (cluster {} bytes), flattened {} bytes",
+             instanced_world.instances_count(), cluster->size(),
+             collection_bytes(instanced_world) + collection_bytes(*cluster), collection_bytes(*cluster),
+             collection_bytes(flat_world));
+
+    const ThroughputResult instanced = measure_throughput(rays, [&world = instanced_world](const Ray& r) {
+        return world.intersects(r, kBenchRayInterval).has_value();
+    });
+    const ThroughputResult flat = measure_throughput(
+        rays, [&world = flat_world](const Ray& r) { return world.intersects(r, kBenchRayInterval).has_value(); });
+
+    size_t mismatches{};
+    for (const Ray& r : rays) {
+        const tl::optional<IntersectionRecord> instanced_hit = instanced_world.intersects(r, kBenchRayInterval);
+        const tl::optional<IntersectionRecord> flat_hit = flat_world.intersects(r, kBenchRayInterval);
+
+        if (instanced_hit.has_value() != flat_hit.has_value() ||
+            (instanced_hit && std::abs(instanced_hit->T - flat_hit->T) > 1.0e-3)) {
+            mismatches += 1;
+        }
+    }
+
+    LOG_INFO(g_logger, "[bench] instanced {:.2f} Mrays/s ({} hits), flattened {:.2f} Mrays/s ({} hits), {} mismatches",
+             instanced.mrays_per_second(rays.size()), instanced.Hits, flat.mrays_per_second(rays.size()), flat.Hits,
+             mismatches);
+}
+
+/// Reader threads keep tracing small tiles of rays on pinned snapshots while a writer publishes edited versions of
+/// the scene (small spheres moved, BVH refit and lights built again), then reports how long pinning took, how many
+/// snapshots were freed and whether the lights of the last version still match their spheres.
+void bench_scene_snapshots(const SceneSnapshot& scene, std::span<const Ray> rays) {
+    constexpr uint32_t kVersionsCount = 32;
+    constexpr size_t kTileRays = 64;
+    constexpr float kLargeRadius = 1.0f;
+
+    const uint32_t readers_count = std::max(2u, std::thread::hardware_concurrency()) - 1;
+    SceneSnapshotPublisher publisher{std::make_unique<SceneSnapshot>(scene), readers_count};
+
+    struct ReaderStats {
+        size_t Tiles{};
+        size_t VersionSwitches{};
+        int64_t MaxPinNanoseconds{};
+    };
+
+    std::vector<ReaderStats> reader_stats(readers_count);
+    std::atomic<bool> stop_readers{false};
+    std::vector<std::jthread> readers{};
+    readers.reserve(readers_count);
+
+    for (uint32_t reader = 0; reader < readers_count; ++reader) {
+        readers.emplace_back([&, reader]() {
+            ReaderStats& stats = reader_stats[reader];
+            uint64_t last_version = 0;
+            size_t tile_start = (rays.size() / readers_count) * reader;
+
+            while (!stop_readers.load(std::memory_order_relaxed)) {
+                const auto pin_start = std::chrono::high_resolution_clock::now();
+                const SceneReadGuard pinned = publisher.pin(reader);
+                stats.MaxPinNanoseconds = std::max<int64_t>(
+                    stats.MaxPinNanoseconds,
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now() -
+                                                                         pin_start)
+                        .count());
+
+                if (pinned->Version != last_version) {
+                    stats.VersionSwitches += 1;
+                    last_version = pinned->Version;
+                }
+
+                for (size_t i = 0; i < kTileRays; ++i) {
+                    std::ignore = pinned->World.intersects(rays[(tile_start + i) % rays.size()], kBenchRayInterval);
+                }
+                tile_start += kTileRays;
+                stats.Tiles += 1;
+            }
+        });
+    }
+
+    const auto publish_start = std::chrono::high_resolution_clock::now();
+    for (uint32_t version = 1; version <= kVersionsCount; ++version) {
+        publisher.update([version](SceneSnapshot& next) {
+            const glm::vec3 offset{0.0f, 0.0f, 0.05f * static_cast<float>(version)};
+            for (uint32_t id = 0; id < next.World.size(); ++id) {
+                const HittableObject& obj = next.World.object(id);
+                if (obj.ObjKind == HittableObjectKind::Sphere && obj.Sphere.Radius < kLargeRadius) {
+                    next.World.update_sphere(id, obj.Sphere.Center + offset, obj.Sphere.Radius);
+                }
+            }
+            next.refit();
+        });
+    }
+    const std::chrono::duration<double, std::milli> publish_time =
+        std::chrono::high_resolution_clock::now() - publish_start;
+
+    stop_readers.store(true, std::memory_order_relaxed);
+    readers.clear();
+    publisher.reclaim();
+
+    size_t lights_count{};
+    size_t stale_lights{};
+    {
+        const SceneReadGuard latest = publisher.pin(0);
+        for (const SphereLight& light : latest->Lights.lights()) {
+            const HittableObject_Sphere& sphere = latest->World.object(light.ObjectId).Sphere;
+            lights_count += 1;
+            stale_lights += light.Center != sphere.Center || light.Radius != sphere.Radius ? 1 : 0;
+        }
+    }
+
+    ReaderStats total{};
+    for (const ReaderStats& stats : reader_stats) {
+        total.Tiles += stats.Tiles;
+        total.VersionSwitches += stats.VersionSwitches;
+        total.MaxPinNanoseconds = std::max(total.MaxPinNanoseconds, stats.MaxPinNanoseconds);
+    }
+
+    const SceneSnapshotStats snapshot_stats = publisher.stats();
+    LOG_INFO(g_logger,
+             "[bench] scene snapshots: {} versions in {:.3f} ms, {} readers traced {} tiles with {} version switches, "
+             "max pin {} ns, {} retired / {} reclaimed, {} lights ({} stale)",
+             snapshot_stats.Version, publish_time.count(), readers_count, total.Tiles, total.VersionSwitches,
+             total.MaxPinNanoseconds, snapshot_stats.Retired, snapshot_stats.Reclaimed, lights_count, stale_lights);
+}
+
+/// Builds LBVHs with 63 bit Morton codes over clusters nested in each other down to 2^-59 of the scene size, the input
+/// that drives the hierarchy to the depth cap, with and without the treelet rotations. The rotations push subtrees
+/// down, the deepest leaf must stay below kMaxTraversalDepth either way.
+void bench_lbvh_depth() {
+    constexpr uint32_t kPrimitives = 1u << 18;
+    constexpr uint32_t kNestingLevels = 60;
+
+    RandomNumberGenerator randgen{};
+    std::vector<BoundingBox> prim_bounds{};
+    prim_bounds.reserve(kPrimitives);
+    for (uint32_t i = 0; i < kPrimitives; ++i) {
+        const glm::vec3 center =
+            randgen.random_vector(0.0, 1.0) * std::ldexp(1.0f, -static_cast<int32_t>(i % kNestingLevels));
+        prim_bounds.push_back(BoundingBox{center, center});
+    }
+
+    for (const bool rotations : {false, true}) {
+        BoundingVolumeHierarchy bvh{};
+        std::vector<uint32_t> prim_order{};
+        bvh.build_linear(prim_bounds, prim_order,
+                         LbvhBuildParams{
+                             .MaxLeafSize = 1,
+                             .MortonBits = 63,
+                             .TreeletRotations = rotations,
+                             .ThreadsCount = std::thread::hardware_concurrency(),
+                         });
+
+        const uint32_t max_leaf_depth = bvh.max_leaf_depth();
+        LOG_INFO(g_logger, "[bench] LBVH over nested clusters ({} primitives), rotations {}: max leaf depth {} of {}, "
+                 "SAH cost {:.2f}",
+                 kPrimitives, rotations ? "on" : "off", max_leaf_depth, BoundingVolumeHierarchy::kMaxTraversalDepth,
+                 bvh.sah_cost());
+        if (max_leaf_depth >= BoundingVolumeHierarchy::kMaxTraversalDepth) {
+            LOG_ERROR(g_logger, "[bench] LBVH leaf depth {} overflows the traversal stacks", max_leaf_depth);
+        }
+    }
+}
+
+/// Traces random rays through a sphere field much larger than the last level cache, with the nodes in build order and
+/// in van Emde Boas order, and reports the L1/LLC read misses per ray.
+void bench_node_order() {
+    constexpr uint32_t kFieldSpheres = 1u << 20;
+    constexpr uint32_t kFieldRays = 1u << 18;
+    constexpr float kFieldHalfSize = 100.0f;
+
+    RandomNumberGenerator randgen{};
+    HittableObject_Collection field{};
+    for (uint32_t i = 0; i < kFieldSpheres; ++i) {
+        field.add_object(HittableObject::make_sphere(randgen.random_vector(-kFieldHalfSize, kFieldHalfSize),
+                                                     randgen.random_double(0.05, 0.2), MaterialHandleType{0}));
+    }
+
+    std::vector<Ray> rays{};
+    rays.reserve(kFieldRays);
+    for (uint32_t i = 0; i < kFieldRays; ++i) {
+        rays.push_back(Ray{randgen.random_vector(-kFieldHalfSize, kFieldHalfSize), randgen.random_unit_vector()});
+    }
+
+    tl::expected<CacheMissCounters, SystemError> counters = CacheMissCounters::open();
+    if (!counters) {
+        LOG_WARNING(g_logger, "[bench] cache miss counters unavailable ({}), check kernel.perf_event_paranoid",
+                    counters.error().e.message());
+    }
+
+    for (const AccelerationStructureKind kind : {AccelerationStructureKind::Bvh2, AccelerationStructureKind::Bvh8}) {
+        for (const BvhNodeOrder order : {BvhNodeOrder::Build, BvhNodeOrder::VanEmdeBoas}) {
+            const HittableObject_Collection world = make_accelerated_world(field, AccelerationParameters{
+                                                                                      .kind = kind,
+                                                                                      .builder = BvhBuilder::Lbvh,
+                                                                                      .node_order = order,
+                                                                                  });
+
+            if (counters) {
+                counters->start();
+            }
+            const ThroughputResult result = measure_throughput(
+                rays, [&world](const Ray& r) { return world.intersects(r, kBenchRayInterval).has_value(); });
+            const CacheMissCounts misses = counters ? counters->stop() : CacheMissCounts{};
+
+            LOG_INFO(g_logger,
+                     "[bench] sphere field {} ({}): {:.2f} Mrays/s, {} hits, {:.2f} L1D misses/ray, "
+                     "{:.2f} LLC misses/ray",
+                     acceleration_structure_name(kind), bvh_node_order_name(order),
+                     result.mrays_per_second(rays.size()), result.Hits,
+                     static_cast<double>(misses.L1DataMisses) / static_cast<double>(rays.size()),
+                     static_cast<double>(misses.LastLevelMisses) / static_cast<double>(rays.size()));
+        }
+    }
+}
+
+/// Shadow rays from the diffuse bounce points to a point above the scene, the direction is not normalized so the
+/// segment to the light is t in (0, 1). Compares the any hit query with a closest hit query answering the same question.
+void bench_occlusion(std::span<const HittableObject_Collection* const> worlds, std::span<const Ray> bounce_rays) {
+    const glm::vec3 kLightPosition{0.0f, 20.0f, 0.0f};
+    static constexpr Interval kShadowInterval{0.0001f, 1.0f - 0.0001f};
+
+    std::vector<Ray> shadow_rays{};
+    shadow_rays.reserve(bounce_rays.size());
+    for (const Ray& r : bounce_rays) {
+        shadow_rays.push_back(Ray{r.Origin, kLightPosition - r.Origin});
+    }
+
+    for (const HittableObject_Collection* world : worlds) {
+        const ThroughputResult closest = measure_throughput(
+            shadow_rays, [world](const Ray& r) { return world->intersects(r, kShadowInterval).has_value(); });
+        const ThroughputResult any =
+            measure_throughput(shadow_rays, [world](const Ray& r) { return world->occluded(r, kShadowInterval); });
+
+        LOG_INFO(g_logger,
+                 "[bench] {} shadow rays ({}): closest hit {:.2f} Mrays/s, any hit {:.2f} Mrays/s, speedup {:.2f}x, "
+                 "{} vs {} occluded",
+                 acceleration_structure_name(world->acceleration_kind()), shadow_rays.size(),
+                 closest.mrays_per_second(shadow_rays.size()), any.mrays_per_second(shadow_rays.size()),
+                 any.Seconds > 0.0 ? closest.Seconds / any.Seconds : 0.0, closest.Hits, any.Hits);
+    }
+}
+
+/// The 8 wide BVH kernels of every ISA level this CPU runs on the same rays, the selected level is restored after.
+void bench_simd_isa(std::span<const HittableObject_Collection* const> bvh8_worlds, const char* batch_name,
+                    std::span<const Ray> rays) {
+    const SimdIsa selected_isa = active_simd_isa();
+    const SimdIsa max_isa = std::min(detect_simd_isa(), max_built_simd_isa());
+
+    for (const HittableObject_Collection* world : bvh8_worlds) {
+        double baseline_seconds{};
+        for (uint32_t isa = 0; isa <= static_cast<uint32_t>(max_isa); ++isa) {
+            select_simd_isa(static_cast<SimdIsa>(isa));
+            const ThroughputResult result = measure_throughput(
+                rays, [world](const Ray& r) { return world->intersects(r, kBenchRayInterval).has_value(); });
+            if (isa == 0) {
+                baseline_seconds = result.Seconds;
+            }
+
+            LOG_INFO(g_logger,
+                     "[bench] {} rays ({}): BVH8 {} nodes, {} kernels {:.2f} Mrays/s, speedup {:.2f}x, {} hits, "
+                     "{} mismatches",
+                     batch_name, rays.size(), bvh8_node_layout_name(world->bvh8().layout()),
+                     simd_isa_name(static_cast<SimdIsa>(isa)), result.mrays_per_second(rays.size()),
+                     result.Seconds > 0.0 ? baseline_seconds / result.Seconds : 0.0, result.Hits,
+                     count_mismatches(*world, rays));
+        }
+    }
+
+    select_simd_isa(selected_isa);
+}
+
+/// Closest hits in float and in double precision on the same rays: throughput, hits that land on another primitive and
+/// the relative difference of the hit distances (double is the reference).
+void bench_precision(std::span<const HittableObject_Collection* const> worlds, const char* batch_name,
+                     std::span<const Ray> rays) {
+    using DoubleRay = BasicRay<DoublePrecision>;
+    using DoubleInterval = BasicInterval<DoublePrecision>;
+    const DoubleInterval double_interval{kBenchRayInterval.Min, kBenchRayInterval.Max};
+
+    std::vector<DoubleRay> double_rays{};
+    double_rays.reserve(rays.size());
+    for (const Ray& r : rays) {
+        double_rays.push_back(DoubleRay{.Origin = glm::dvec3{r.Origin}, .Direction = glm::dvec3{r.Direction}});
+    }
+
+    for (const HittableObject_Collection* world : worlds) {
+        const ThroughputResult single = measure_throughput(rays, [world](const Ray& r) {
+            return world->closest_hit<SinglePrecision>(r, kBenchRayInterval).has_value();
+        });
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        size_t double_hits{};
+        for (const DoubleRay& r : double_rays) {
+            if (world->closest_hit<DoublePrecision>(r, double_interval)) {
+                double_hits += 1;
+            }
+        }
+        const std::chrono::duration<double> double_seconds = std::chrono::high_resolution_clock::now() - start;
+
+        size_t prim_mismatches{};
+        size_t compared{};
+        double sum_rel_error{};
+        double max_rel_error{};
+        for (size_t ray = 0; ray < rays.size(); ++ray) {
+            const tl::optional<PrimitiveHit> single_hit =
+                world->closest_hit<SinglePrecision>(rays[ray], kBenchRayInterval);
+            const tl::optional<BasicPrimitiveHit<DoublePrecision>> double_hit =
+                world->closest_hit<DoublePrecision>(double_rays[ray], double_interval);
+
+            if (single_hit.has_value() != double_hit.has_value() ||
+                (single_hit && single_hit->Prim != double_hit->Prim)) {
+                prim_mismatches += 1;
+                continue;
+            }
+            if (single_hit && double_hit->T > 0.0) {
+                const double rel_error = std::abs(static_cast<double>(single_hit->T) - double_hit->T) / double_hit->T;
+                sum_rel_error += rel_error;
+                max_rel_error = std::max(max_rel_error, rel_error);
+                compared += 1;
+            }
+        }
+
+        LOG_INFO(g_logger,
+                 "[bench] {} rays ({}): {} float {:.2f} Mrays/s, double {:.2f} Mrays/s ({:.2f}x), {} vs {} hits, "
+                 "{} primitive mismatches, relative t error mean {:.3e} max {:.3e}",
+                 batch_name, rays.size(), acceleration_structure_name(world->acceleration_kind()),
+                 single.mrays_per_second(rays.size()),
+                 double_seconds.count() > 0.0 ? static_cast<double>(rays.size()) / double_seconds.count() * 1.0e-6
+                                              : 0.0,
+                 double_seconds.count() > 0.0 ? single.Seconds / double_seconds.count() : 0.0, single.Hits,
+                 double_hits, prim_mismatches, compared > 0 ? sum_rel_error / static_cast<double>(compared) : 0.0,
+                 max_rel_error);
+    }
+}
+
+/// Primary rays grouped the way RayTracingCore::raytrace_tile() groups them, traced one by one and as packets.
+void bench_ray_packets(const RayTracingCore& rtcore, std::span<const HittableObject_Collection* const> worlds) {
+    constexpr uint32_t kPacketRays = RayTracingCore::kPacketWidth * RayTracingCore::kPacketHeight;
+
+    RandomNumberGenerator randgen{};
+    std::vector<Ray> rays{};
+    std::vector<uint32_t> packet_starts{};
+    for (uint32_t packet_y = 0; packet_y < rtcore.rts_img_height; packet_y += RayTracingCore::kPacketHeight) {
+        for (uint32_t packet_x = 0; packet_x < rtcore.rts_img_width; packet_x += RayTracingCore::kPacketWidth) {
+            packet_starts.push_back(static_cast<uint32_t>(rays.size()));
+            for (uint32_t y = packet_y; y < std::min(packet_y + RayTracingCore::kPacketHeight, rtcore.rts_img_height);
+                 ++y) {
+                for (uint32_t x = packet_x; x < std::min(packet_x + RayTracingCore::kPacketWidth, rtcore.rts_img_width);
+                     ++x) {
+                    rays.push_back(rtcore.get_ray(x, y, randgen));
+                }
+            }
+        }
+    }
+    packet_starts.push_back(static_cast<uint32_t>(rays.size()));
+
+    std::vector<tl::optional<PrimitiveHit>> packet_hits(rays.size());
+    for (const HittableObject_Collection* world : worlds) {
+        const ThroughputResult single = measure_throughput(
+            rays, [world](const Ray& r) { return world->closest_hit(r, kBenchRayInterval).has_value(); });
+
+        size_t coherent_packets{};
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (size_t packet = 0; packet + 1 < packet_starts.size(); ++packet) {
+            const uint32_t first = packet_starts[packet];
+            const uint32_t count = packet_starts[packet + 1] - first;
+            assert(count <= kPacketRays);
+            if (world->closest_hit_packet(std::span{rays}.subspan(first, count), kBenchRayInterval,
+                                          std::span{packet_hits}.subspan(first, count))) {
+                coherent_packets += 1;
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+        size_t mismatches{};
+        for (size_t ray = 0; ray < rays.size(); ++ray) {
+            const tl::optional<PrimitiveHit> single_hit = world->closest_hit(rays[ray], kBenchRayInterval);
+            if (single_hit.has_value() != packet_hits[ray].has_value() ||
+                (single_hit && std::abs(single_hit->T - packet_hits[ray]->T) > 1.0e-4f)) {
+                mismatches += 1;
+            }
+        }
+
+        const ThroughputResult packets{
+            .Hits = static_cast<size_t>(std::ranges::count_if(
+                packet_hits, [](const tl::optional<PrimitiveHit>& hit) { return hit.has_value(); })),
+            .Seconds = elapsed.count(),
+        };
+        LOG_INFO(g_logger,
+                 "[bench] {} primary rays ({}): single {:.2f} Mrays/s, packets {:.2f} Mrays/s, speedup {:.2f}x, "
+                 "{}/{} coherent packets, {} mismatches",
+                 acceleration_structure_name(world->acceleration_kind()), rays.size(),
+                 single.mrays_per_second(rays.size()), packets.mrays_per_second(rays.size()),
+                 packets.Seconds > 0.0 ? single.Seconds / packets.Seconds : 0.0, coherent_packets,
+                 packet_starts.size() - 1, mismatches);
+    }
+}
+
+/// Renders the same block of tiles with every integrator on the scene as configured, then with the wavefront
+/// integrator and different secondary ray sorting settings.
+void bench_integrators(const RayTracingCore& rtcore, const SceneSnapshot& scene) {
+    constexpr uint32_t kTileSize = 8;
+    constexpr uint32_t kBlockSize = 64;
+
+    const uint32_t block_x = (rtcore.rts_img_width - std::min(rtcore.rts_img_width, kBlockSize)) / 2;
+    const uint32_t block_y = (rtcore.rts_img_height - std::min(rtcore.rts_img_height, kBlockSize)) / 2;
+    const uint32_t block_end_x = std::min(block_x + kBlockSize, rtcore.rts_img_width);
+    const uint32_t block_end_y = std::min(block_y + kBlockSize, rtcore.rts_img_height);
+    const size_t pixels = static_cast<size_t>(block_end_x - block_x) * (block_end_y - block_y);
+    const double samples = static_cast<double>(pixels) * rtcore.rts_samples_per_pixel;
+
+    RandomNumberGenerator randgen{};
+    std::vector<RGBAColor> tile_colors(kTileSize * kTileSize);
+
+    //
+    // render_tile_fn(start_x, start_y, end_x, end_y), returns the time taken and the mean pixel value
+    auto render_block = [&](auto&& render_tile_fn) {
+        double luminance{};
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t y = block_y; y < block_end_y; y += kTileSize) {
+            for (uint32_t x = block_x; x < block_end_x; x += kTileSize) {
+                const uint32_t end_x = std::min(x + kTileSize, block_end_x);
+                const uint32_t end_y = std::min(y + kTileSize, block_end_y);
+                render_tile_fn(x, y, end_x, end_y);
+
+                for (uint32_t pixel = 0; pixel < (end_x - x) * (end_y - y); ++pixel) {
+                    luminance += (tile_colors[pixel].r + tile_colors[pixel].g + tile_colors[pixel].b) / (3.0 * 255.0);
+                }
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return std::pair{elapsed.count(), luminance / static_cast<double>(std::max<size_t>(pixels, 1))};
+    };
+
+    constexpr IntegratorKind kIntegrators[] = {
+        IntegratorKind::Recursive,
+        IntegratorKind::Iterative,
+        IntegratorKind::Wavefront,
+    };
+
+    WavefrontIntegrator wavefront{RaySortParameters{}, rtcore.rts_math_accuracy};
+    for (const IntegratorKind kind : kIntegrators) {
+        const auto [seconds, mean] = render_block([&](const uint32_t x, const uint32_t y, const uint32_t end_x,
+                                                      const uint32_t end_y) {
+            if (kind == IntegratorKind::Wavefront) {
+                wavefront.render_tile(rtcore, x, y, end_x, end_y, scene, randgen, tile_colors);
+            } else {
+                rtcore.raytrace_tile(kind, rtcore.rts_math_accuracy, x, y, end_x, end_y, scene, randgen, tile_colors);
+            }
+        });
+
+        LOG_INFO(g_logger, "[bench] {} integrator: {} pixels x {} spp in {:.3f} s, {:.3f} Msamples/s, mean {:.4f}",
+                 integrator_kind_name(kind), pixels, rtcore.rts_samples_per_pixel, seconds,
+                 seconds > 0.0 ? samples / seconds * 1.0e-6 : 0.0, mean);
+    }
+
+    const WavefrontStats& stats = wavefront.stats();
+    LOG_INFO(g_logger,
+             "[bench] wavefront: {} paths, {} extended rays, {} shaded hits over {} bounce stages, {} paths ended by "
+             "Russian roulette after {} bounces",
+             stats.Paths, stats.ExtendedRays, stats.ShadedHits, stats.Bounces, stats.RouletteTerminated,
+             rtcore.rts_russian_roulette_depth);
+
+    const RaySortParameters ray_sort_settings[] = {
+        RaySortParameters{.Enabled = false},
+        RaySortParameters{.Enabled = true, .BatchSize = 256},
+        RaySortParameters{.Enabled = true, .BatchSize = 1024},
+        RaySortParameters{.Enabled = true, .BatchSize = 0},
+    };
+
+    for (const RaySortParameters& ray_sort : ray_sort_settings) {
+        WavefrontIntegrator sorting_wavefront{ray_sort, rtcore.rts_math_accuracy};
+        const auto [seconds, mean] = render_block([&](const uint32_t x, const uint32_t y, const uint32_t end_x,
+                                                      const uint32_t end_y) {
+            sorting_wavefront.render_tile(rtcore, x, y, end_x, end_y, scene, randgen, tile_colors);
+        });
+
+        const RaySortStats& sort_stats = sorting_wavefront.stats().RaySort;
+        const double secondary_rays = static_cast<double>(std::max<size_t>(sort_stats.SecondaryRays, 1));
+        LOG_INFO(g_logger,
+                 "[bench] ray sorting {} (batch {}): {:.3f} s, {} secondary rays, sort {:.3f} ms, trace {:.3f} ms, "
+                 "coherent pairs {:.2f}% in queue order, {:.2f}% in trace order",
+                 ray_sort.Enabled ? "on" : "off", ray_sort.BatchSize, seconds, sort_stats.SecondaryRays,
+                 sort_stats.SortMilliseconds, sort_stats.TraceMilliseconds,
+                 100.0 * static_cast<double>(sort_stats.CoherentPairsQueueOrder) / secondary_rays,
+                 100.0 * static_cast<double>(sort_stats.CoherentPairsTraceOrder) / secondary_rays);
+    }
+}
+
+/// Equal time comparison of the iterative integrator finding the lights only by hitting them and with light sampling
+/// (the light samples and the scattered rays combined by multiple importance sampling) on the center block of the
+/// scene: both render passes of one sample per pixel for the same time, the RMSE of the radiance is against a
+/// reference rendered with light sampling and kReferenceSamples samples per pixel.
+void bench_light_sampling(const RayTracingCore& rtcore, const SceneSnapshot& scene, const char* scene_name) {
+    constexpr uint32_t kBlockSize = 32;
+    constexpr uint32_t kReferenceSamples = 1024;
+    constexpr double kBudgetSeconds = 2.0;
+
+    const uint32_t block_x = (rtcore.rts_img_width - std::min(rtcore.rts_img_width, kBlockSize)) / 2;
+    const uint32_t block_y = (rtcore.rts_img_height - std::min(rtcore.rts_img_height, kBlockSize)) / 2;
+    const uint32_t block_end_x = std::min(block_x + kBlockSize, rtcore.rts_img_width);
+    const uint32_t block_end_y = std::min(block_y + kBlockSize, rtcore.rts_img_height);
+    const size_t pixels = static_cast<size_t>(block_end_x - block_x) * (block_end_y - block_y);
+
+    RandomNumberGenerator randgen{};
+    auto render_pass = [&](const bool light_sampling, std::vector<glm::vec3>& radiance) {
+        size_t pixel{};
+        for (uint32_t y = block_y; y < block_end_y; ++y) {
+            for (uint32_t x = block_x; x < block_end_x; ++x) {
+                const Ray r = rtcore.get_ray(x, y, randgen);
+                radiance[pixel++] += rtcore.trace_path(r, scene.World.closest_hit(r, RayTracingCore::kRayInterval),
+                                                       scene, randgen, rtcore.rts_math_accuracy, light_sampling);
+            }
+        }
+    };
+
+    std::vector<glm::vec3> reference(pixels, glm::vec3{0.0f});
+    for (uint32_t sample = 0; sample < kReferenceSamples; ++sample) {
+        render_pass(true, reference);
+    }
+    for (glm::vec3& pixel_radiance : reference) {
+        pixel_radiance /= static_cast<float>(kReferenceSamples);
+    }
+
+    for (const bool light_sampling : {false, true}) {
+        std::vector<glm::vec3> radiance(pixels, glm::vec3{0.0f});
+        uint32_t samples{};
+        const auto start = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> elapsed{};
+        do {
+            render_pass(light_sampling, radiance);
+            samples += 1;
+            elapsed = std::chrono::high_resolution_clock::now() - start;
+        } while (elapsed.count() < kBudgetSeconds);
+
+        double squared_error{};
+        double mean{};
+        for (size_t pixel = 0; pixel < pixels; ++pixel) {
+            const glm::vec3 estimate = radiance[pixel] / static_cast<float>(samples);
+            const glm::vec3 error = estimate - reference[pixel];
+            squared_error += static_cast<double>(glm::dot(error, error)) / 3.0;
+            mean += static_cast<double>(estimate.r + estimate.g + estimate.b) / 3.0;
+        }
+
+        LOG_INFO(g_logger,
+                 "[bench] light sampling {} ({}, {} lights): {} pixels x {} spp in {:.3f} s, RMSE {:.4f} against {} "
+                 "spp with light sampling, mean {:.4f}",
+                 light_sampling ? "on" : "off", scene_name, scene.Lights.size(), pixels, samples, elapsed.count(),
+                 std::sqrt(squared_error / static_cast<double>(pixels)), kReferenceSamples,
+                 mean / static_cast<double>(pixels));
+    }
+}
+
+struct MathErrorReport {
+    double MaxRelError{};
+    double MeanRelError{};
+    double ExactNanoseconds{};
+    double FastNanoseconds{};
+};
+
+/// Runs exact_fn and fast_fn over evenly spaced inputs in [lo, hi], relative errors are against exact_fn.
+template <typename ExactFn, typename FastFn>
+MathErrorReport compare_math_fn(const float lo, const float hi, ExactFn&& exact_fn, FastFn&& fast_fn) {
+    constexpr size_t kInputs = size_t{1} << 20;
+
+    std::vector<float> inputs(kInputs);
+    for (size_t i = 0; i < kInputs; ++i) {
+        inputs[i] = lo + (hi - lo) * (static_cast<float>(i) + 0.5f) / static_cast<float>(kInputs);
+    }
+
+    std::vector<float> exact(kInputs);
+    std::vector<float> fast(kInputs);
+    auto time_fn = [&inputs](auto&& fn, std::vector<float>& results) {
+        const auto start = std::chrono::high_resolution_clock::now();
+        std::ranges::transform(inputs, results.begin(), fn);
+        const std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count() / static_cast<double>(inputs.size());
+    };
+
+    MathErrorReport report{
+        .ExactNanoseconds = time_fn(exact_fn, exact),
+        .FastNanoseconds = time_fn(fast_fn, fast),
+    };
+
+    double sum_rel_error{};
+    for (size_t i = 0; i < kInputs; ++i) {
+        const double rel_error = exact[i] != 0.0f ? std::abs((static_cast<double>(fast[i]) - exact[i]) / exact[i])
+                                                  : std::abs(static_cast<double>(fast[i]));
+        sum_rel_error += rel_error;
+        report.MaxRelError = std::max(report.MaxRelError, rel_error);
+    }
+    report.MeanRelError = sum_rel_error / static_cast<double>(kInputs);
+    return report;
+}
+
+/// Error report of MathAccuracy::Fast against MathAccuracy::Exact: every approximation over the inputs the shading
+/// code gives it, then the same block rendered twice from the same random sequence. Paths diverge after the first
+/// decision (reflect or refract, unit vector rejection) the approximations flip, so the image difference has a noise
+/// component on top of the approximation error.
+void bench_math_accuracy(const RayTracingCore& rtcore, const SceneSnapshot& scene) {
+    const MathErrorReport sqrt_report = compare_math_fn(
+        0.0f, 1.0f, [](const float x) { return std::sqrt(x); }, [](const float x) { return fast_sqrt(x); });
+    const MathErrorReport rsqrt_report = compare_math_fn(
+        1.0e-6f, 1.0f, [](const float x) { return 1.0f / std::sqrt(x); }, [](const float x) { return fast_rsqrt(x); });
+    const MathErrorReport pow5_report = compare_math_fn(
+        0.0f, 1.0f, [](const float x) { return std::pow(x, 5.0f); }, [](const float x) { return fast_pow5(x); });
+
+    const struct {
+        const char* Name;
+        const MathErrorReport& Report;
+    } math_fns[] = {
+        {"sqrt [0, 1] (gamma, Fresnel)", sqrt_report},
+        {"rsqrt [1e-6, 1] (unit vectors)", rsqrt_report},
+        {"pow5 [0, 1] (Schlick)", pow5_report},
+    };
+
+    for (const auto& [name, report] : math_fns) {
+        LOG_INFO(g_logger,
+                 "[bench] fast math {}: relative error max {:.3e} mean {:.3e}, exact {:.2f} ns, fast {:.2f} ns, "
+                 "speedup {:.2f}x",
+                 name, report.MaxRelError, report.MeanRelError, report.ExactNanoseconds, report.FastNanoseconds,
+                 report.FastNanoseconds > 0.0 ? report.ExactNanoseconds / report.FastNanoseconds : 0.0);
+    }
+
+    //
+    // every 8 bit output value the gamma conversion can produce, with a few inputs per step
+    constexpr uint32_t kGammaInputs = 256 * 64;
+    uint32_t gamma_mismatches{};
+    for (uint32_t i = 0; i < kGammaInputs; ++i) {
+        const glm::vec3 linear{static_cast<float>(i) / static_cast<float>(kGammaInputs - 1)};
+        if (RGBAColor{linear, MathAccuracy::Exact}.color != RGBAColor{linear, MathAccuracy::Fast}.color) {
+            gamma_mismatches += 1;
+        }
+    }
+    LOG_INFO(g_logger, "[bench] fast math gamma: {}/{} inputs map to another 8 bit value", gamma_mismatches,
+             kGammaInputs);
+
+    constexpr uint32_t kTileSize = 8;
+    constexpr uint32_t kBlockSize = 64;
+    constexpr uint32_t kSeed = 0x5EED;
+
+    const uint32_t block_x = (rtcore.rts_img_width - std::min(rtcore.rts_img_width, kBlockSize)) / 2;
+    const uint32_t block_y = (rtcore.rts_img_height - std::min(rtcore.rts_img_height, kBlockSize)) / 2;
+    const uint32_t block_end_x = std::min(block_x + kBlockSize, rtcore.rts_img_width);
+    const uint32_t block_end_y = std::min(block_y + kBlockSize, rtcore.rts_img_height);
+
+    auto render_block = [&](const MathAccuracy accuracy, std::vector<RGBAColor>& block_colors) {
+        RandomNumberGenerator randgen{kSeed};
+        std::vector<RGBAColor> tile_colors(kTileSize * kTileSize);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t y = block_y; y < block_end_y; y += kTileSize) {
+            for (uint32_t x = block_x; x < block_end_x; x += kTileSize) {
+                const uint32_t end_x = std::min(x + kTileSize, block_end_x);
+                const uint32_t end_y = std::min(y + kTileSize, block_end_y);
+                rtcore.raytrace_tile(IntegratorKind::Iterative, accuracy, x, y, end_x, end_y, scene, randgen,
+                                     tile_colors);
+
+                for (uint32_t pixel = 0; pixel < (end_x - x) * (end_y - y); ++pixel) {
+                    block_colors.push_back(tile_colors[pixel]);
+                }
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count();
+    };
+
+    std::vector<RGBAColor> exact_colors{};
+    std::vector<RGBAColor> fast_colors{};
+    const double exact_seconds = render_block(MathAccuracy::Exact, exact_colors);
+    const double fast_seconds = render_block(MathAccuracy::Fast, fast_colors);
+
+    size_t differing_pixels{};
+    uint32_t max_channel_diff{};
+    double sum_squared_diff{};
+    for (size_t pixel = 0; pixel < exact_colors.size(); ++pixel) {
+        const RGBAColor exact = exact_colors[pixel];
+        const RGBAColor fast = fast_colors[pixel];
+        differing_pixels += exact.color != fast.color ? 1 : 0;
+
+        for (const auto [e, f] : {std::pair{exact.r, fast.r}, std::pair{exact.g, fast.g}, std::pair{exact.b, fast.b}}) {
+            const int32_t diff = static_cast<int32_t>(e) - static_cast<int32_t>(f);
+            max_channel_diff = std::max(max_channel_diff, static_cast<uint32_t>(std::abs(diff)));
+            sum_squared_diff += static_cast<double>(diff * diff);
+        }
+    }
+
+    LOG_INFO(g_logger,
+             "[bench] fast math render ({} pixels x {} spp, iterative): exact {:.3f} s, fast {:.3f} s, speedup "
+             "{:.2f}x, {} pixels differ, RMSE {:.3f} max {} (8 bit)",
+             exact_colors.size(), rtcore.rts_samples_per_pixel, exact_seconds, fast_seconds,
+             fast_seconds > 0.0 ? exact_seconds / fast_seconds : 0.0, differing_pixels,
+             std::sqrt(sum_squared_diff / static_cast<double>(std::max<size_t>(exact_colors.size() * 3, 1))),
+             max_channel_diff);
+}
+
+/// The iterative integrator against the render kernel of the scene (IntegratorKind::Specialized), same block from
+/// the same random sequence: the kernel traces the same rays in the same order, so the images have to match exactly.
+void bench_render_kernels(const RayTracingCore& rtcore, const SceneSnapshot& scene) {
+    constexpr uint32_t kTileSize = 8;
+    constexpr uint32_t kBlockSize = 64;
+    constexpr uint32_t kSeed = 0x5EED;
+
+    const uint32_t block_x = (rtcore.rts_img_width - std::min(rtcore.rts_img_width, kBlockSize)) / 2;
+    const uint32_t block_y = (rtcore.rts_img_height - std::min(rtcore.rts_img_height, kBlockSize)) / 2;
+    const uint32_t block_end_x = std::min(block_x + kBlockSize, rtcore.rts_img_width);
+    const uint32_t block_end_y = std::min(block_y + kBlockSize, rtcore.rts_img_height);
+
+    auto render_block = [&](const IntegratorKind integrator, std::vector<RGBAColor>& block_colors) {
+        RandomNumberGenerator randgen{kSeed};
+        std::vector<RGBAColor> tile_colors(kTileSize * kTileSize);
+
+        const auto start = std::chrono::high_resolution_clock::now();
+        for (uint32_t y = block_y; y < block_end_y; y += kTileSize) {
+            for (uint32_t x = block_x; x < block_end_x; x += kTileSize) {
+                const uint32_t end_x = std::min(x + kTileSize, block_end_x);
+                const uint32_t end_y = std::min(y + kTileSize, block_end_y);
+                rtcore.raytrace_tile(integrator, rtcore.rts_math_accuracy, x, y, end_x, end_y, scene, randgen,
+                                     tile_colors);
+
+                for (uint32_t pixel = 0; pixel < (end_x - x) * (end_y - y); ++pixel) {
+                    block_colors.push_back(tile_colors[pixel]);
+                }
+            }
+        }
+        const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+        return elapsed.count();
+    };
+
+    std::vector<RGBAColor> generic_colors{};
+    std::vector<RGBAColor> kernel_colors{};
+    const double generic_seconds = render_block(IntegratorKind::Iterative, generic_colors);
+    const double kernel_seconds = render_block(IntegratorKind::Specialized, kernel_colors);
+
+    size_t differing_pixels{};
+    for (size_t pixel = 0; pixel < generic_colors.size(); ++pixel) {
+        differing_pixels += generic_colors[pixel].color != kernel_colors[pixel].color ? 1 : 0;
+    }
+
+    const RenderKernel& kernel = select_render_kernel(scene);
+    LOG_INFO(g_logger,
+             "[bench] render kernel (object kinds {:#x}, material kinds {:#x}), {} pixels x {} spp: iterative {:.3f} "
+             "s, specialized {:.3f} s, speedup {:.2f}x, {} pixels differ",
+             kernel.ObjectKinds, kernel.MaterialKinds, generic_colors.size(), rtcore.rts_samples_per_pixel,
+             generic_seconds, kernel_seconds, kernel_seconds > 0.0 ? generic_seconds / kernel_seconds : 0.0,
+             differing_pixels);
+}
+
+/// Shading of the hits of rays, one hit at a time (Material::scatter(), switch on the kind per hit) against
+/// MaterialCollection::scatter_batch() over the hits sorted by (kind, material handle) in batches of
+/// WavefrontIntegrator::kShadeBatchSize. The sort is part of the batched time, as it is in the wavefront shade stage.
+void bench_material_batches(const SceneSnapshot& scene, std::span<const Ray> rays, const MathAccuracy accuracy) {
+    constexpr uint32_t kSeed = 0x5EED;
+    constexpr uint32_t kRepeats = 8;
+
+    std::vector<Ray> hit_rays{};
+    std::vector<IntersectionRecord> hit_records{};
+    for (const Ray& r : rays) {
+        if (const tl::optional<PrimitiveHit> hit = scene.World.closest_hit(r, kBenchRayInterval)) {
+            hit_rays.push_back(r);
+            hit_records.push_back(scene.World.intersection_record(r, *hit));
+        }
+    }
+
+    size_t kind_hits[static_cast<uint32_t>(MaterialKind::Count)]{};
+    for (const IntersectionRecord& int_rec : hit_records) {
+        kind_hits[static_cast<uint32_t>(scene.Materials.kind(int_rec.Material))] += 1;
+    }
+
+    //
+    // the sum of the attenuations of the scattered hits, the two paths draw their random numbers in another order so
+    // only the totals compare
+    RandomNumberGenerator per_hit_randgen{kSeed};
+    glm::dvec3 per_hit_attenuation{0.0};
+    size_t per_hit_scattered{};
+    const auto per_hit_start = std::chrono::high_resolution_clock::now();
+    for (uint32_t repeat = 0; repeat < kRepeats; ++repeat) {
+        for (size_t hit = 0; hit < hit_records.size(); ++hit) {
+            const IntersectionRecord& int_rec = hit_records[hit];
+            if (const tl::optional<ScatterRecord> scatter_rec =
+                    scene.Materials[int_rec.Material].scatter(hit_rays[hit], int_rec, per_hit_randgen, accuracy)) {
+                per_hit_attenuation += glm::dvec3{scatter_rec->Attenuation};
+                per_hit_scattered += 1;
+            }
+        }
+    }
+    const std::chrono::duration<double> per_hit_elapsed = std::chrono::high_resolution_clock::now() - per_hit_start;
+
+    RandomNumberGenerator batched_randgen{kSeed};
+    glm::dvec3 batched_attenuation{0.0};
+    size_t batched_scattered{};
+    std::vector<uint64_t> sort_keys{};
+    ScatterBatch batch{};
+    const auto batched_start = std::chrono::high_resolution_clock::now();
+    for (uint32_t repeat = 0; repeat < kRepeats; ++repeat) {
+        sort_keys.clear();
+        for (uint32_t hit = 0; hit < hit_records.size(); ++hit) {
+            const MaterialHandleType mtl = hit_records[hit].Material;
+            const uint64_t kind = static_cast<uint64_t>(scene.Materials.kind(mtl));
+            sort_keys.push_back((kind << 60) | (uint64_t{value_of(mtl)} << 32) | hit);
+        }
+        std::ranges::sort(sort_keys);
+
+        for (size_t first = 0; first < sort_keys.size();) {
+            //
+            // a batch never mixes kinds
+            const uint64_t kind = sort_keys[first] >> 60;
+            size_t last = first;
+            while (last < sort_keys.size() && last - first < WavefrontIntegrator::kShadeBatchSize &&
+                   (sort_keys[last] >> 60) == kind) {
+                last += 1;
+            }
+
+            batch.clear();
+            for (size_t key = first; key < last; ++key) {
+                const uint32_t hit = static_cast<uint32_t>(sort_keys[key]);
+                batch.push_back(hit_rays[hit], hit_records[hit]);
+            }
+            scene.Materials.scatter_batch(static_cast<MaterialKind>(kind), batch, batched_randgen, accuracy);
+
+            for (size_t hit = 0; hit < batch.size(); ++hit) {
+                if (batch.Scattered[hit]) {
+                    batched_attenuation += glm::dvec3{batch.Attenuation[hit]};
+                    batched_scattered += 1;
+                }
+            }
+            first = last;
+        }
+    }
+    const std::chrono::duration<double> batched_elapsed = std::chrono::high_resolution_clock::now() - batched_start;
+
+    const double shaded = static_cast<double>(std::max<size_t>(hit_records.size() * kRepeats, 1));
+    const double per_hit_ns = per_hit_elapsed.count() * 1.0e9 / shaded;
+    const double batched_ns = batched_elapsed.count() * 1.0e9 / shaded;
+    LOG_INFO(g_logger,
+             "[bench] material shading ({} hits x {}: {} lambertian, {} metallic, {} dielectric, {} materials): "
+             "per hit {:.2f} ns/hit, batched {:.2f} ns/hit, speedup {:.2f}x",
+             hit_records.size(), kRepeats, kind_hits[static_cast<uint32_t>(MaterialKind::Lambertian)],
+             kind_hits[static_cast<uint32_t>(MaterialKind::Metallic)],
+             kind_hits[static_cast<uint32_t>(MaterialKind::Dielectric)], scene.Materials.size(), per_hit_ns,
+             batched_ns, batched_ns > 0.0 ? per_hit_ns / batched_ns : 0.0);
+    LOG_INFO(g_logger,
+             "[bench] material shading: scattered per hit {} batched {}, mean attenuation per hit ({:.4f}, {:.4f}, "
+             "{:.4f}) batched ({:.4f}, {:.4f}, {:.4f})",
+             per_hit_scattered, batched_scattered,
+             per_hit_attenuation.x / static_cast<double>(std::max<size_t>(per_hit_scattered, 1)),
+             per_hit_attenuation.y / static_cast<double>(std::max<size_t>(per_hit_scattered, 1)),
+             per_hit_attenuation.z / static_cast<double>(std::max<size_t>(per_hit_scattered, 1)),
+             batched_attenuation.x / static_cast<double>(std::max<size_t>(batched_scattered, 1)),
+             batched_attenuation.y / static_cast<double>(std::max<size_t>(batched_scattered, 1)),
+             batched_attenuation.z / static_cast<double>(std::max<size_t>(batched_scattered, 1)));
+}
+
+/// The base level of a TiledTexture in plain row major order, same bilinear lookup as TiledTexture::sample(): the
+/// reference layout for bench_textures().
+struct RowMajorTexture {
+    std::vector<uint32_t> Texels;
+    uint32_t Width;
+    uint32_t Height;
+    std::array<float, 256> SrgbToLinear;
+
+    RowMajorTexture(std::vector<uint32_t> texels, const uint32_t width, const uint32_t height)
+        : Texels{std::move(texels)}, Width{width}, Height{height} {
+        for (uint32_t i = 0; i < SrgbToLinear.size(); ++i) {
+            const float c = static_cast<float>(i) / 255.0f;
+            SrgbToLinear[i] = c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+        }
+    }
+
+    glm::vec4 texel(const int32_t x, const int32_t y) const noexcept {
+        const uint32_t tx = static_cast<uint32_t>((x % static_cast<int32_t>(Width) + Width) % Width);
+        const uint32_t ty = static_cast<uint32_t>((y % static_cast<int32_t>(Height) + Height) % Height);
+        const uint32_t rgba8 = Texels[static_cast<size_t>(ty) * Width + tx];
+        return glm::vec4{SrgbToLinear[rgba8 & 0xFF], SrgbToLinear[(rgba8 >> 8) & 0xFF],
+                         SrgbToLinear[(rgba8 >> 16) & 0xFF], static_cast<float>(rgba8 >> 24) / 255.0f};
+    }
+
+    glm::vec3 sample(const glm::vec2 uv) const noexcept {
+        const glm::vec2 image_uv{uv.x, 1.0f - uv.y};
+        const glm::vec2 wrapped_uv = image_uv - glm::floor(image_uv);
+        const float x = wrapped_uv.x * static_cast<float>(Width) - 0.5f;
+        const float y = wrapped_uv.y * static_cast<float>(Height) - 0.5f;
+        const int32_t x0 = static_cast<int32_t>(std::floor(x));
+        const int32_t y0 = static_cast<int32_t>(std::floor(y));
+        const float fx = x - std::floor(x);
+        const float fy = y - std::floor(y);
+
+        const glm::vec4 top = glm::mix(texel(x0, y0), texel(x0 + 1, y0), fx);
+        const glm::vec4 bottom = glm::mix(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), fx);
+        return glm::vec3{glm::mix(top, bottom, fy)};
+    }
+};
+
+struct TextureUvBatch {
+    const char* Name;
+    std::span<const glm::vec2> UVs;
+    /// mip level of every lookup, empty for level 0
+    std::span<const float> Lods;
+};
+
+/// UVs of the hits of rays and the mip level of texture the ray cones select there, as if every object had it.
+void collect_hit_lookups(const SceneSnapshot& scene, const TiledTexture& texture, std::span<const Ray> rays,
+                         std::vector<glm::vec2>& uvs, std::vector<float>& lods) {
+    for (const Ray& r : rays) {
+        if (const tl::optional<PrimitiveHit> hit = scene.World.closest_hit(r, kBenchRayInterval)) {
+            const IntersectionRecord int_rec = scene.World.intersection_record(r, *hit);
+            const float cos_theta = glm::dot(r.Direction, int_rec.Normal) / glm::length(r.Direction);
+            uvs.push_back(int_rec.UV);
+            lods.push_back(texture.lod(int_rec.cone(r).uv_footprint(int_rec.UVScale, cos_theta)));
+        }
+    }
+}
+
+/// The lookups of bench_textures() on all the threads, from the resident texture and through a TextureCache over the
+/// same texture written to a texture file, with a budget of a quarter of the texture and with a budget that holds all
+/// of it. Logs the lookups/sec, the hit rates and the resident bytes of the cache.
+void bench_texture_cache(const TiledTexture& texture, std::span<const TextureUvBatch> uv_batches) {
+    const std::filesystem::path file_path = std::filesystem::temp_directory_path() / "xray.bench.xtex";
+    if (const tl::expected<void, SystemError> written = write_texture_file(texture, file_path); !written) {
+        LOG_WARNING(g_logger, "[bench] texture cache: cannot write {} ({})", file_path.string(),
+                    written.error().e.message());
+        return;
+    }
+
+    const uint32_t threads_count = std::thread::hardware_concurrency();
+    for (const size_t budget_bytes : {texture.size_bytes() / 4, texture.size_bytes()}) {
+        tl::expected<MappedTextureFile, SystemError> file = MappedTextureFile::open(file_path);
+        if (!file) {
+            LOG_WARNING(g_logger, "[bench] texture cache: cannot map {} ({})", file_path.string(),
+                        file.error().e.message());
+            break;
+        }
+
+        const auto cache = std::make_shared<TextureCache>(budget_bytes);
+        const uint32_t cache_file = cache->add_file(std::move(*file));
+        const TiledTexture cached = TiledTexture::from_cache(cache, cache_file, texture.filter());
+
+        for (const auto& [batch_name, uvs, lods] : uv_batches) {
+            auto measure_lookups = [&, uvs = uvs, lods = lods](const TiledTexture& sampled) {
+                std::vector<glm::dvec3> chunk_sums(parallel_chunks_count(threads_count, uvs.size()), glm::dvec3{0.0});
+                const auto start = std::chrono::high_resolution_clock::now();
+                parallel_for_chunks(threads_count, uvs.size(), [&](const size_t chunk, const size_t begin,
+                                                                   const size_t end) {
+                    glm::dvec3 sum{0.0};
+                    for (size_t i = begin; i < end; ++i) {
+                        sum += glm::dvec3{sampled.sample(uvs[i], lods.empty() ? 0.0f : lods[i])};
+                    }
+                    chunk_sums[chunk] = sum;
+                    cache->flush_thread_stats();
+                });
+                const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+                glm::dvec3 sum{0.0};
+                for (const glm::dvec3& chunk_sum : chunk_sums) {
+                    sum += chunk_sum;
+                }
+                return std::pair{elapsed.count(), sum};
+            };
+
+            const TextureCacheStats before = cache->stats();
+            const auto [resident_seconds, resident_sum] = measure_lookups(texture);
+            const auto [cached_seconds, cached_sum] = measure_lookups(cached);
+            const TextureCacheStats after = cache->stats();
+
+            const TextureCacheStats batch_stats{
+                .MicroHits = after.MicroHits - before.MicroHits,
+                .MicroMisses = after.MicroMisses - before.MicroMisses,
+                .SharedHits = after.SharedHits - before.SharedHits,
+                .SharedMisses = after.SharedMisses - before.SharedMisses,
+                .Evictions = after.Evictions - before.Evictions,
+                .ResidentBytes = after.ResidentBytes,
+                .BudgetBytes = after.BudgetBytes,
+            };
+            const double lookups = static_cast<double>(std::max<size_t>(uvs.size(), 1));
+            LOG_INFO(g_logger,
+                     "[bench] texture cache ({} of {} bytes budget), {} ({} UVs, {} threads): resident {:.2f} "
+                     "Mlookups/s, cached {:.2f} Mlookups/s, hit rate {:.4f} (micro caches {:.4f}), {} page loads, {} "
+                     "evictions, {} bytes resident, difference of the sums {:.6f}",
+                     batch_stats.BudgetBytes, texture.size_bytes(), batch_name, uvs.size(), threads_count,
+                     resident_seconds > 0.0 ? lookups / resident_seconds * 1.0e-6 : 0.0,
+                     cached_seconds > 0.0 ? lookups / cached_seconds * 1.0e-6 : 0.0, batch_stats.hit_rate(),
+                     static_cast<double>(batch_stats.MicroHits) /
+                         static_cast<double>(std::max<uint64_t>(batch_stats.MicroHits + batch_stats.MicroMisses, 1)),
+                     batch_stats.SharedMisses, batch_stats.Evictions, batch_stats.ResidentBytes,
+                     glm::length(cached_sum - resident_sum) / lookups);
+        }
+    }
+
+    std::error_code remove_error{};
+    std::filesystem::remove(file_path, remove_error);
+}
+
+/// Bilinear lookups in a texture much larger than the last level cache, 4x4 tiled (TiledTexture) against row major,
+/// with UVs in scanline order, the UVs of the primary and diffuse bounce hits of the scene and random UVs. Logs the
+/// lookups/sec and the L1/LLC read misses per lookup of each layout. The hits are looked up once more at the mip level
+/// of their ray cones (tiled only), then bench_texture_cache() runs all the lookups.
+void bench_textures(const SceneSnapshot& scene, std::span<const Ray> primary_rays, std::span<const Ray> bounce_rays) {
+    constexpr uint32_t kTextureSize = 4096;
+    constexpr uint32_t kLookups = 1u << 22;
+
+    std::vector<uint32_t> pixels(static_cast<size_t>(kTextureSize) * kTextureSize);
+    for (uint32_t y = 0; y < kTextureSize; ++y) {
+        for (uint32_t x = 0; x < kTextureSize; ++x) {
+            pixels[static_cast<size_t>(y) * kTextureSize + x] = ((x * 0x9E3779B1u) ^ (y * 0x85EBCA77u)) | 0xFF000000u;
+        }
+    }
+
+    const TiledTexture tiled = TiledTexture::from_pixels(pixels, kTextureSize, kTextureSize, TextureFilter::Bilinear);
+    const RowMajorTexture row_major{std::move(pixels), kTextureSize, kTextureSize};
+    LOG_INFO(g_logger, "[bench] textures: {}x{}, {} mip levels, tiled {} bytes, row major {} bytes", kTextureSize,
+             kTextureSize, tiled.levels().size(), tiled.size_bytes(), row_major.Texels.size() * sizeof(uint32_t));
+
+    std::vector<glm::vec2> scanline_uvs{};
+    scanline_uvs.reserve(kLookups);
+    for (uint32_t i = 0; i < kLookups; ++i) {
+        const uint32_t x = i % kTextureSize;
+        const uint32_t y = (i / kTextureSize) % kTextureSize;
+        scanline_uvs.push_back(glm::vec2{(static_cast<float>(x) + 0.25f) / static_cast<float>(kTextureSize),
+                                         (static_cast<float>(y) + 0.25f) / static_cast<float>(kTextureSize)});
+    }
+
+    std::vector<glm::vec2> primary_uvs{};
+    std::vector<float> primary_lods{};
+    collect_hit_lookups(scene, tiled, primary_rays, primary_uvs, primary_lods);
+    std::vector<glm::vec2> bounce_uvs{};
+    std::vector<float> bounce_lods{};
+    collect_hit_lookups(scene, tiled, bounce_rays, bounce_uvs, bounce_lods);
+
+    RandomNumberGenerator randgen{};
+    std::vector<glm::vec2> random_uvs{};
+    random_uvs.reserve(kLookups);
+    for (uint32_t i = 0; i < kLookups; ++i) {
+        random_uvs.push_back(
+            glm::vec2{static_cast<float>(randgen.random_double()), static_cast<float>(randgen.random_double())});
+    }
+
+    tl::expected<CacheMissCounters, SystemError> counters = CacheMissCounters::open();
+    if (!counters) {
+        LOG_WARNING(g_logger, "[bench] cache miss counters unavailable ({}), check kernel.perf_event_paranoid",
+                    counters.error().e.message());
+    }
+
+    const TextureUvBatch uv_batches[] = {
+        {"scanline", scanline_uvs, {}},
+        {"primary hits", primary_uvs, {}},
+        {"primary hits, ray cone LOD", primary_uvs, primary_lods},
+        {"diffuse bounce hits", bounce_uvs, {}},
+        {"diffuse bounce hits, ray cone LOD", bounce_uvs, bounce_lods},
+        {"random", random_uvs, {}},
+    };
+
+    for (const auto& [batch_name, uvs, lods] : uv_batches) {
+        const double lookups = static_cast<double>(std::max<size_t>(uvs.size(), 1));
+
+        auto measure_lookups = [&](const char* layout_name, auto&& sample_fn) {
+            glm::dvec3 sum{0.0};
+            if (counters) {
+                counters->start();
+            }
+            const auto start = std::chrono::high_resolution_clock::now();
+            for (size_t i = 0; i < uvs.size(); ++i) {
+                sum += glm::dvec3{sample_fn(uvs[i], lods.empty() ? 0.0f : lods[i])};
+            }
+            const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+            const CacheMissCounts misses = counters ? counters->stop() : CacheMissCounts{};
+
+            LOG_INFO(g_logger,
+                     "[bench] texture lookups, {} ({} UVs): {} {:.2f} Mlookups/s, {:.2f} L1D misses/lookup, {:.2f} "
+                     "LLC misses/lookup",
+                     batch_name, uvs.size(), layout_name,
+                     elapsed.count() > 0.0 ? lookups / elapsed.count() * 1.0e-6 : 0.0,
+                     static_cast<double>(misses.L1DataMisses) / lookups,
+                     static_cast<double>(misses.LastLevelMisses) / lookups);
+            return sum;
+        };
+
+        auto sample_tiled = [&tiled](const glm::vec2 uv, const float lod) { return tiled.sample(uv, lod); };
+        if (!lods.empty()) {
+            //
+            // the row major texture has no mip levels
+            measure_lookups("tiled", sample_tiled);
+            double lod_sum{};
+            size_t base_level_lookups{};
+            for (const float lod : lods) {
+                lod_sum += lod;
+                base_level_lookups += lod < 0.5f ? 1 : 0;
+            }
+            LOG_INFO(g_logger, "[bench] texture lookups, {}: mean mip level {:.2f} of {}, {:.2f}% on level 0",
+                     batch_name, lod_sum / lookups, tiled.levels().size(),
+                     100.0 * static_cast<double>(base_level_lookups) / lookups);
+            continue;
+        }
+
+        const glm::dvec3 row_major_sum = measure_lookups(
+            "row major", [&row_major](const glm::vec2 uv, const float) { return row_major.sample(uv); });
+        const glm::dvec3 tiled_sum = measure_lookups("tiled", sample_tiled);
+        LOG_INFO(g_logger, "[bench] texture lookups, {}: difference of the sums tiled vs row major {:.6f}", batch_name,
+                 glm::length(tiled_sum - row_major_sum) / lookups);
+    }
+
+    bench_texture_cache(tiled, uv_batches);
+}
+
+/// Samples fields of more and more emissive spheres from random shading points, with the light tree and with the
+/// linear pass over all the lights it stands in for. The tree time should grow with the log of the lights count, the
+/// linear one with the count. The mean of Le/pdf (no occlusion, no cosine) is the same for both, its relative
+/// deviation tells how well the tree picks the lights.
+void bench_lights() {
+    constexpr uint32_t kSamples = 1u << 16;
+    constexpr float kFieldHalfSize = 50.0f;
+
+    for (const uint32_t lights_count : {16u, 256u, 4096u}) {
+        RandomNumberGenerator randgen{lights_count};
+        MaterialCollection materials{};
+        HittableObject_Collection field{};
+        for (uint32_t i = 0; i < lights_count; ++i) {
+            const MaterialHandleType emissive = materials.add(Material::make_emissive(randgen.random_vector(0.5, 8.0)));
+            field.add_object(HittableObject::make_sphere(randgen.random_vector(-kFieldHalfSize, kFieldHalfSize),
+                                                         randgen.random_double(0.1, 1.0), emissive));
+        }
+        const LightCollection lights = LightCollection::build(field, materials);
+
+        std::vector<glm::vec3> points{};
+        points.reserve(kSamples);
+        for (uint32_t i = 0; i < kSamples; ++i) {
+            points.push_back(randgen.random_vector(-kFieldHalfSize, kFieldHalfSize));
+        }
+
+        const auto measure = [&](const char* sampler_name, auto&& sample_fn) {
+            RandomNumberGenerator sample_randgen{};
+            double sum{};
+            double sum_squares{};
+            const auto start = std::chrono::high_resolution_clock::now();
+            for (const glm::vec3& p : points) {
+                if (const tl::optional<LightSample> sample = sample_fn(p, sample_randgen)) {
+                    const double value = static_cast<double>(
+                        glm::dot(sample->Emission, glm::vec3{0.2126f, 0.7152f, 0.0722f}) / sample->Pdf);
+                    sum += value;
+                    sum_squares += value * value;
+                }
+            }
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            const double mean = sum / kSamples;
+            const double variance = std::max(0.0, sum_squares / kSamples - mean * mean);
+            LOG_INFO(g_logger, "[bench] lights ({} spheres, {} tree nodes) {}: {:.1f} ns/sample, mean {:.4f}, "
+                     "relative deviation {:.3f}",
+                     lights.size(), lights.nodes().size(), sampler_name, elapsed.count() / kSamples, mean,
+                     mean > 0.0 ? std::sqrt(variance) / mean : 0.0);
+        };
+
+        measure("tree", [&lights](const glm::vec3& p, RandomNumberGenerator& r) { return lights.sample(p, r); });
+        measure("linear",
+                [&lights](const glm::vec3& p, RandomNumberGenerator& r) { return lights.sample_linear(p, r); });
+    }
+}
+
+/// Latitude-longitude environment of width x height texels: a dim sky over a darker ground and a sun of 1 degree
+/// radius 35 degrees above the horizon that emits most of the power through a handful of texels (of the 512 x 256
+/// map), the case the rays that only find the environment by missing everything converge slowest on.
+EnvironmentMap make_sun_environment(const uint32_t width, const uint32_t height) {
+    constexpr float kSunAngularRadius = 0.01745f;
+    constexpr float kSunRadiance = 20000.0f;
+    const float sun_elevation = glm::radians(35.0f);
+    const glm::vec3 sun_dir{0.6f * std::cos(sun_elevation), std::sin(sun_elevation), -0.8f * std::cos(sun_elevation)};
+
+    std::vector<glm::vec3> pixels(static_cast<size_t>(width) * height);
+    for (uint32_t row = 0; row < height; ++row) {
+        const float theta = std::numbers::pi_v<float> * (static_cast<float>(row) + 0.5f) / static_cast<float>(height);
+        for (uint32_t column = 0; column < width; ++column) {
+            const float u = (static_cast<float>(column) + 0.5f) / static_cast<float>(width);
+            const float phi = 2.0f * std::numbers::pi_v<float> * (u - 0.5f);
+            const glm::vec3 dir{std::sin(theta) * std::sin(phi), std::cos(theta), -std::sin(theta) * std::cos(phi)};
+
+            glm::vec3 radiance = dir.y > 0.0f ? glm::vec3{0.3f, 0.45f, 0.8f} : glm::vec3{0.1f, 0.08f, 0.06f};
+            if (std::acos(std::clamp(glm::dot(dir, sun_dir), -1.0f, 1.0f)) < kSunAngularRadius) {
+                radiance = glm::vec3{kSunRadiance, 0.9f * kSunRadiance, 0.8f * kSunRadiance};
+            }
+            pixels[static_cast<size_t>(row) * width + column] = radiance;
+        }
+    }
+
+    return EnvironmentMap::from_pixels(std::move(pixels), width, height);
+}
+
+/// Builds sun environments of growing size and samples them through the alias table and uniformly over the sphere.
+/// The build should grow linearly with the texels, the sampling stay flat. Both estimate the luminance integrated over
+/// the sphere (mean of Le/pdf, no cosine), the relative deviation tells how much the alias table saves.
+void bench_environment() {
+    constexpr uint32_t kSamples = 1u << 18;
+
+    for (const auto& [width, height] : {std::pair{512u, 256u}, std::pair{2048u, 1024u}}) {
+        const auto build_start = std::chrono::high_resolution_clock::now();
+        const EnvironmentMap environment = make_sun_environment(width, height);
+        const std::chrono::duration<double, std::milli> build_elapsed =
+            std::chrono::high_resolution_clock::now() - build_start;
+
+        const auto measure = [&](const char* sampler_name, auto&& sample_fn) {
+            RandomNumberGenerator randgen{};
+            double sum{};
+            double sum_squares{};
+            const auto start = std::chrono::high_resolution_clock::now();
+            for (uint32_t i = 0; i < kSamples; ++i) {
+                const EnvironmentSample sample = sample_fn(randgen);
+                const double value =
+                    sample.Pdf > 0.0f ? static_cast<double>(luminance(sample.Radiance) / sample.Pdf) : 0.0;
+                sum += value;
+                sum_squares += value * value;
+            }
+            const std::chrono::duration<double, std::nano> elapsed = std::chrono::high_resolution_clock::now() - start;
+
+            const double mean = sum / kSamples;
+            const double variance = std::max(0.0, sum_squares / kSamples - mean * mean);
+            LOG_INFO(g_logger, "[bench] environment {}x{} (built in {:.1f} ms) {}: {:.1f} ns/sample, mean {:.4f}, "
+                     "relative deviation {:.3f}",
+                     width, height, build_elapsed.count(), sampler_name, elapsed.count() / kSamples, mean,
+                     mean > 0.0 ? std::sqrt(variance) / mean : 0.0);
+        };
+
+        measure("alias table", [&environment](RandomNumberGenerator& r) { return *environment.sample(r); });
+        measure("uniform", [&environment](RandomNumberGenerator& r) {
+            const glm::vec3 dir = r.random_unit_vector();
+            return EnvironmentSample{
+                .Direction = dir,
+                .Radiance = environment.radiance(dir),
+                .Pdf = 0.25f * std::numbers::inv_pi_v<float>,
+            };
+        });
+    }
+}
+
+} // namespace
+
+void bench_acceleration_structures(const RayTracingCore& rtcore) {
+    const SceneReadGuard scene = rtcore.rts_scene->pin(0);
+
+    const struct {
+        const char* Name;
+        HittableObject_Collection World;
+    } accelerated_worlds[] = {
+        {"BVH2", make_accelerated_world(scene->World, AccelerationParameters{.kind = AccelerationStructureKind::Bvh2})},
+        {"BVH8", make_accelerated_world(scene->World, AccelerationParameters{.kind = AccelerationStructureKind::Bvh8})},
+        {"BVH2 (LBVH)", make_accelerated_world(scene->World, AccelerationParameters{
+                                                                    .kind = AccelerationStructureKind::Bvh2,
+                                                                    .builder = BvhBuilder::Lbvh,
+                                                                })},
+        {"BVH8 (LBVH)", make_accelerated_world(scene->World, AccelerationParameters{
+                                                                    .kind = AccelerationStructureKind::Bvh8,
+                                                                    .builder = BvhBuilder::Lbvh,
+                                                                })},
+        {"BVH8 (quantized)", make_accelerated_world(scene->World, AccelerationParameters{
+                                                                         .kind = AccelerationStructureKind::Bvh8,
+                                                                         .bvh8_node_layout = Bvh8NodeLayout::Quantized,
+                                                                     })},
+    };
+
+    const HittableObject_Collection& bvh2_world = accelerated_worlds[0].World;
+    const HittableObject_Collection& bvh8_world = accelerated_worlds[1].World;
+    LOG_INFO(g_logger, "[bench] {} objects, BVH2 {} nodes ({} bytes) SAH cost {:.2f}, BVH8 {} nodes ({} bytes)",
+             scene->World.size(), bvh2_world.bvh().nodes().size(), bvh2_world.bvh().nodes().size_bytes(),
+             bvh2_world.bvh().sah_cost(), bvh8_world.bvh8().nodes_count(), bvh8_world.bvh8().size_bytes());
+
+    for (const HittableObject_Collection* world : {&bvh8_world, &accelerated_worlds[4].World}) {
+        const WideBoundingVolumeHierarchy& bvh8 = world->bvh8();
+        const size_t node_bytes = bvh8.nodes().size_bytes() + bvh8.quantized_nodes().size_bytes();
+        LOG_INFO(g_logger, "[bench] BVH8 {} nodes: {} nodes, {} node bytes + {} packet bytes, {:.2f} bytes/primitive",
+                 bvh8_node_layout_name(bvh8.layout()), bvh8.nodes_count(), node_bytes, bvh8.packets().size_bytes(),
+                 static_cast<double>(bvh8.size_bytes()) / static_cast<double>(std::max<size_t>(world->size(), 1)));
+    }
+
+    RandomNumberGenerator randgen{};
+    const std::vector<Ray> primary_rays = make_primary_rays(rtcore, randgen);
+    const std::vector<Ray> bounce_rays = make_diffuse_bounce_rays(scene->World, primary_rays, randgen);
+
+    const struct {
+        const char* Name;
+        std::span<const Ray> Rays;
+    } ray_batches[] = {
+        {"primary", primary_rays},
+        {"diffuse bounce", bounce_rays},
+    };
+
+    for (const auto& [batch_name, rays] : ray_batches) {
+        const HittableObject_Collection& world = scene->World;
+        const ThroughputResult linear = measure_throughput(
+            rays, [&world](const Ray& r) { return world.intersects_linear(r, kBenchRayInterval).has_value(); });
+
+        LOG_INFO(g_logger, "[bench] {} rays ({}): linear {:.3f} s, {:.2f} Mrays/s, {} hits", batch_name, rays.size(),
+                 linear.Seconds, linear.mrays_per_second(rays.size()), linear.Hits);
+
+        for (const auto& [accel_name, accel_world] : accelerated_worlds) {
+            const ThroughputResult accel = measure_throughput(rays, [&world = accel_world](const Ray& r) {
+                return world.intersects(r, kBenchRayInterval).has_value();
+            });
+
+            LOG_INFO(g_logger, "[bench] {} rays ({}): {} {:.3f} s, {:.2f} Mrays/s, speedup {:.2f}x, {} hits, {} mismatches",
+                     batch_name, rays.size(), accel_name, accel.Seconds, accel.mrays_per_second(rays.size()),
+                     accel.Seconds > 0.0 ? linear.Seconds / accel.Seconds : 0.0, accel.Hits,
+                     count_mismatches(accel_world, rays));
+        }
+    }
+
+    const HittableObject_Collection* query_worlds[] = {&scene->World, &bvh2_world, &bvh8_world};
+    bench_occlusion(query_worlds, bounce_rays);
+    const HittableObject_Collection* isa_worlds[] = {&bvh8_world, &accelerated_worlds[4].World};
+    for (const auto& [batch_name, rays] : ray_batches) {
+        bench_simd_isa(isa_worlds, batch_name, rays);
+        bench_precision(std::span{query_worlds}.subspan(1), batch_name, rays);
+    }
+    bench_ray_packets(rtcore, std::span{query_worlds}.subspan(1));
+    bench_integrators(rtcore, *scene);
+    const SceneSnapshot lit_scene = make_lit_scene(*scene);
+    bench_light_sampling(rtcore, lit_scene, "lit scene");
+    SceneSnapshot sun_scene{lit_scene};
+    sun_scene.Environment = std::make_shared<const EnvironmentMap>(make_sun_environment(1024, 512));
+    bench_light_sampling(rtcore, sun_scene, "sun environment");
+    bench_render_kernels(rtcore, lit_scene);
+    bench_math_accuracy(rtcore, *scene);
+    bench_material_batches(*scene, bounce_rays, rtcore.rts_math_accuracy);
+    bench_textures(*scene, primary_rays, bounce_rays);
+    bench_lights();
+    bench_environment();
+    bench_refit(scene->World, primary_rays);
+    bench_instancing(scene->World, primary_rays);
+    bench_scene_snapshots(lit_scene, primary_rays);
+    bench_node_order();
+    bench_lbvh_depth();
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+struct RayTracingCore;
+
+/// Traces the same primary and diffuse bounce rays through the linear scan, the BVH and the 8 wide BVH and logs the
+/// rays/sec of each path.
+void bench_acceleration_structures(const RayTracingCore& rtcore);
@@ -0,0 +1,322 @@
+#include "ray.tracer.bvh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <iterator>
+#include <numeric>
+
+#include "parallel.for.hpp"
+
+namespace {
+
+struct SahBin {
+    BoundingBox Bounds;
+    uint32_t Count{};
+};
+
+struct SahSplit {
+    uint32_t Axis{};
+    uint32_t Bin{};
+    float CentroidMin{};
+    float Scale{};
+    float Cost{std::numeric_limits<float>::infinity()};
+
+    uint32_t bin_of(const glm::vec3& centroid, const uint32_t bins_count) const noexcept {
+        const uint32_t bin = static_cast<uint32_t>((centroid[Axis] - CentroidMin) * Scale);
+        return std::min(bin, bins_count - 1);
+    }
+};
+
+struct BuildTask {
+    uint32_t Node;
+    uint32_t Depth;
+};
+
+} // namespace
+
+tl::optional<RayPacketFrustum> RayPacketFrustum::from_rays(std::span<const Ray> rays) noexcept {
+    if (rays.empty()) {
+        return tl::nullopt;
+    }
+
+    const glm::vec3& dir = rays[0].Direction;
+    RayPacketFrustum frustum{
+        .OriginMin = rays[0].Origin,
+        .OriginMax = rays[0].Origin,
+        .InvDirMin = glm::vec3{std::numeric_limits<float>::infinity()},
+        .InvDirMax = glm::vec3{-std::numeric_limits<float>::infinity()},
+        .NegativeMask = (dir.x < 0.0f ? 1u : 0u) | (dir.y < 0.0f ? 2u : 0u) | (dir.z < 0.0f ? 4u : 0u),
+    };
+
+    for (const Ray& r : rays) {
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            const bool negative = (frustum.NegativeMask >> axis) & 1;
+            if (r.Direction[axis] == 0.0f || (r.Direction[axis] < 0.0f) != negative) {
+                return tl::nullopt;
+            }
+        }
+
+        const glm::vec3 inv_dir = 1.0f / r.Direction;
+        frustum.OriginMin = glm::min(frustum.OriginMin, r.Origin);
+        frustum.OriginMax = glm::max(frustum.OriginMax, r.Origin);
+        frustum.InvDirMin = glm::min(frustum.InvDirMin, inv_dir);
+        frustum.InvDirMax = glm::max(frustum.InvDirMax, inv_dir);
+    }
+
+    return frustum;
+}
+
+bool RayPacketFrustum::may_hit(const BvhNode& node, const float tmin, const float tmax) const noexcept {
+    //
+    // bounds of the product of the intervals [a0, a1] and [b0, b1]
+    auto product_min = [](const float a0, const float a1, const float b0, const float b1) {
+        return std::min(std::min(a0 * b0, a0 * b1), std::min(a1 * b0, a1 * b1));
+    };
+    auto product_max = [](const float a0, const float a1, const float b0, const float b1) {
+        return std::max(std::max(a0 * b0, a0 * b1), std::max(a1 * b0, a1 * b1));
+    };
+
+    float t_enter = tmin;
+    float t_exit = tmax;
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+        const bool negative = (NegativeMask >> axis) & 1;
+        const float near_plane = negative ? node.BoundsMax[axis] : node.BoundsMin[axis];
+        const float far_plane = negative ? node.BoundsMin[axis] : node.BoundsMax[axis];
+
+        //
+        // lowest entry and highest exit distance over all the rays of the packet
+        t_enter = std::max(t_enter, product_min(near_plane - OriginMax[axis], near_plane - OriginMin[axis],
+                                                InvDirMin[axis], InvDirMax[axis]));
+        t_exit = std::min(t_exit, product_max(far_plane - OriginMax[axis], far_plane - OriginMin[axis],
+                                              InvDirMin[axis], InvDirMax[axis]));
+    }
+
+    return t_enter <= t_exit;
+}
+
+void BoundingVolumeHierarchy::build(std::span<const BoundingBox> prim_bounds, std::vector<uint32_t>& prim_order,
+                                    const BvhBuildParams& params) {
+    assert(params.BinsCount >= 2);
+
+    const uint32_t prims_count = static_cast<uint32_t>(prim_bounds.size());
+    _nodes.clear();
+    prim_order.resize(prims_count);
+    std::iota(prim_order.begin(), prim_order.end(), 0u);
+
+    if (prims_count == 0) {
+        return;
+    }
+
+    std::vector<glm::vec3> centroids{};
+    centroids.reserve(prims_count);
+    std::ranges::transform(prim_bounds, std::back_inserter(centroids),
+                           [](const BoundingBox& b) { return b.centroid(); });
+
+    _nodes.reserve(2 * prims_count - 1);
+
+    auto make_node_fn = [&](const uint32_t first, const uint32_t count) {
+        BoundingBox node_bounds;
+        for (uint32_t i = first; i < first + count; ++i) {
+            node_bounds.grow(prim_bounds[prim_order[i]]);
+        }
+
+        _nodes.push_back(BvhNode{
+            .BoundsMin = node_bounds.Min,
+            .LeftFirst = first,
+            .BoundsMax = node_bounds.Max,
+            .PrimCount = count,
+        });
+        return static_cast<uint32_t>(_nodes.size() - 1);
+    };
+
+    make_node_fn(0, prims_count);
+
+    std::vector<BuildTask> tasks{BuildTask{.Node = 0, .Depth = 0}};
+    std::vector<SahBin> bins(params.BinsCount);
+    std::vector<float> right_costs(params.BinsCount);
+
+    while (!tasks.empty()) {
+        const BuildTask task = tasks.back();
+        tasks.pop_back();
+
+        const uint32_t first = _nodes[task.Node].LeftFirst;
+        const uint32_t count = _nodes[task.Node].PrimCount;
+        if (count <= 1 || task.Depth + 1 >= kMaxTraversalDepth) {
+            continue;
+        }
+
+        BoundingBox centroid_bounds;
+        for (uint32_t i = first; i < first + count; ++i) {
+            centroid_bounds.grow(centroids[prim_order[i]]);
+        }
+
+        SahSplit best_split{};
+        for (uint32_t axis = 0; axis < 3; ++axis) {
+            const float cmin = centroid_bounds.Min[axis];
+            const float cmax = centroid_bounds.Max[axis];
+            if (!(cmax > cmin)) {
+                continue;
+            }
+
+            SahSplit split{
+                .Axis = axis,
+                .CentroidMin = cmin,
+                .Scale = static_cast<float>(params.BinsCount) / (cmax - cmin),
+            };
+
+            std::ranges::fill(bins, SahBin{});
+            for (uint32_t i = first; i < first + count; ++i) {
+                SahBin& bin = bins[split.bin_of(centroids[prim_order[i]], params.BinsCount)];
+                bin.Count += 1;
+                bin.Bounds.grow(prim_bounds[prim_order[i]]);
+            }
+
+            BoundingBox right_box;
+            uint32_t right_count{};
+            for (uint32_t b = params.BinsCount - 1; b > 0; --b) {
+                right_box.grow(bins[b].Bounds);
+                right_count += bins[b].Count;
+                right_costs[b] = static_cast<float>(right_count) * right_box.surface_area();
+            }
+
+            BoundingBox left_box;
+            uint32_t left_count{};
+            for (uint32_t b = 1; b < params.BinsCount; ++b) {
+                left_box.grow(bins[b - 1].Bounds);
+                left_count += bins[b - 1].Count;
+                if (left_count == 0 || left_count == count) {
+                    continue;
+                }
+
+                const float cost = static_cast<float>(left_count) * left_box.surface_area() + right_costs[b];
+                if (cost < best_split.Cost) {
+                    split.Bin = b;
+                    split.Cost = cost;
+                    best_split = split;
+                }
+            }
+        }
+
+        if (best_split.Cost == std::numeric_limits<float>::infinity()) {
+            //
+            // all centroids are coincident, nothing to split on
+            continue;
+        }
+
+        const float node_area = std::max(_nodes[task.Node].bounds().surface_area(), 1.0e-12f);
+        const float split_cost = params.TraversalCost + params.IntersectionCost * best_split.Cost / node_area;
+        const float leaf_cost = params.IntersectionCost * static_cast<float>(count);
+        if (count <= params.MaxLeafSize && split_cost >= leaf_cost) {
+            continue;
+        }
+
+        const auto range_start = prim_order.begin() + first;
+        const auto mid = std::partition(range_start, range_start + count, [&](const uint32_t prim) {
+            return best_split.bin_of(centroids[prim], params.BinsCount) < best_split.Bin;
+        });
+
+        const uint32_t left_count = static_cast<uint32_t>(mid - range_start);
+        assert(left_count > 0 && left_count < count);
+
+        const uint32_t left_child = make_node_fn(first, left_count);
+        const uint32_t right_child = make_node_fn(first + left_count, count - left_count);
+        assert(right_child == left_child + 1);
+
+        _nodes[task.Node].LeftFirst = left_child;
+        _nodes[task.Node].PrimCount = 0;
+
+        tasks.push_back(BuildTask{.Node = right_child, .Depth = task.Depth + 1});
+        tasks.push_back(BuildTask{.Node = left_child, .Depth = task.Depth + 1});
+    }
+
+    _nodes.shrink_to_fit();
+}
+
+float BoundingVolumeHierarchy::sah_cost(const BvhBuildParams& params) const noexcept {
+    if (_nodes.empty()) {
+        return 0.0f;
+    }
+
+    float cost{};
+    for (const BvhNode& node : _nodes) {
+        const float area = node.bounds().surface_area();
+        cost += node.is_leaf() ? params.IntersectionCost * static_cast<float>(node.PrimCount) * area
+                               : params.TraversalCost * area;
+    }
+
+    return cost / std::max(_nodes[0].bounds().surface_area(), 1.0e-12f);
+}
+
+uint32_t BoundingVolumeHierarchy::max_leaf_depth() const noexcept {
+    if (_nodes.empty()) {
+        return 0;
+    }
+
+    uint32_t max_depth{};
+    std::vector<std::pair<uint32_t, uint32_t>> stack{{0u, 0u}};
+    while (!stack.empty()) {
+        const auto [node, depth] = stack.back();
+        stack.pop_back();
+
+        if (_nodes[node].is_leaf()) {
+            max_depth = std::max(max_depth, depth);
+            continue;
+        }
+
+        stack.emplace_back(_nodes[node].LeftFirst, depth + 1);
+        stack.emplace_back(_nodes[node].LeftFirst + 1, depth + 1);
+    }
+
+    return max_depth;
+}
+
+void BoundingVolumeHierarchy::refit(std::span<const BoundingBox> prim_bounds, const uint32_t threads_count) {
+    constexpr uint32_t kNoParent = std::numeric_limits<uint32_t>::max();
+
+    if (_nodes.empty()) {
+        return;
+    }
+
+    std::vector<uint32_t> parents(_nodes.size(), kNoParent);
+    parallel_for_chunks(threads_count, _nodes.size(), [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            if (!_nodes[i].is_leaf()) {
+                parents[_nodes[i].LeftFirst] = static_cast<uint32_t>(i);
+                parents[_nodes[i].LeftFirst + 1] = static_cast<uint32_t>(i);
+            }
+        }
+    });
+
+    //
+    // every leaf walks up towards the root, the first child to arrive at a node stops there, the second one
+    // merges both children and keeps going
+    std::vector<std::atomic<uint32_t>> visits(_nodes.size());
+    parallel_for_chunks(threads_count, _nodes.size(), [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            BvhNode& leaf = _nodes[i];
+            if (!leaf.is_leaf()) {
+                continue;
+            }
+
+            BoundingBox leaf_bounds{};
+            for (uint32_t prim = leaf.LeftFirst; prim < leaf.LeftFirst + leaf.PrimCount; ++prim) {
+                leaf_bounds.grow(prim_bounds[prim]);
+            }
+            leaf.BoundsMin = leaf_bounds.Min;
+            leaf.BoundsMax = leaf_bounds.Max;
+
+            for (uint32_t node = parents[i]; node != kNoParent; node = parents[node]) {
+                if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0) {
+                    break;
+                }
+
+                BvhNode& inner = _nodes[node];
+                BoundingBox inner_bounds = _nodes[inner.LeftFirst].bounds();
+                inner_bounds.grow(_nodes[inner.LeftFirst + 1].bounds());
+                inner.BoundsMin = inner_bounds.Min;
+                inner.BoundsMax = inner_bounds.Max;
+            }
+        }
+    });
+}
@@ -0,0 +1,296 @@
+#pragma once
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <tl/optional.hpp>
+
+#include "acceleration.parameters.hpp"
+#include "bounding.box.hpp"
+#include "interval.hpp"
+#include "ray.hpp"
+
+/// Inner nodes store the index of the left child in LeftFirst, the right child sits right after it.
+/// Leaves store the first primitive in LeftFirst and a non zero PrimCount.
+struct alignas(32) BvhNode {
+    glm::vec3 BoundsMin;
+    uint32_t LeftFirst;
+    glm::vec3 BoundsMax;
+    uint32_t PrimCount;
+
+    bool is_leaf() const noexcept { return PrimCount != 0; }
+    BoundingBox bounds() const noexcept { return BoundingBox{BoundsMin, BoundsMax}; }
+};
+
+static_assert(sizeof(BvhNode) == 32, "BvhNode must stay 32 bytes (2 nodes per cache line)");
+
+/// Van Emde Boas order of a tree of node blocks given in CSR form: the children of block b are
+/// children[first_child[b]] .. children[first_child[b + 1] - 1], block 0 is the root and comes first in the order.
+/// Defined in ray.tracer.bvh.layout.cc.
+std::vector<uint32_t> van_emde_boas_order(std::span<const uint32_t> first_child, std::span<const uint32_t> children);
+
+/// Interval arithmetic bounds of a packet of rays: per axis the origins and the inverse directions of all the rays lie
+/// inside [Min, Max], so a slab test done on the intervals bounds the entry/exit distances of every ray of the packet.
+struct RayPacketFrustum {
+    glm::vec3 OriginMin;
+    glm::vec3 OriginMax;
+    glm::vec3 InvDirMin;
+    glm::vec3 InvDirMax;
+    /// bit i set when the rays travel towards -inf along axis i
+    uint32_t NegativeMask;
+
+    /// Empty when the packet is not coherent: rays going different ways along an axis (or parallel to it) would give
+    /// an inverse direction interval spanning infinity, which culls nothing.
+    static tl::optional<RayPacketFrustum> from_rays(std::span<const Ray> rays) noexcept;
+
+    /// False only when no ray of the packet can hit the box inside [tmin, tmax].
+    bool may_hit(const BvhNode& node, const float tmin, const float tmax) const noexcept;
+};
+
+struct BvhBuildParams {
+    uint32_t BinsCount{16};
+    uint32_t MaxLeafSize{4};
+    float TraversalCost{1.0f};
+    float IntersectionCost{1.0f};
+};
+
+struct LbvhBuildParams {
+    uint32_t MaxLeafSize{4};
+    uint32_t MortonBits{30};
+    bool TreeletRotations{true};
+    uint32_t ThreadsCount{1};
+};
+
+class BoundingVolumeHierarchy {
+public:
+    static constexpr uint32_t kMaxTraversalDepth = 64;
+    static constexpr uint32_t kMaxPacketRays = 16;
+
+    /// Binned SAH build over the primitive bounds. On return prim_order holds the permutation of the primitives,
+    /// leaf ranges index into it.
+    void build(std::span<const BoundingBox> prim_bounds, std::vector<uint32_t>& prim_order,
+               const BvhBuildParams& params = {});
+
+    /// Linear BVH: primitives sorted along a Morton curve of their centroids, hierarchy emitted from the sorted codes
+    /// (Karras 2012), subtrees small enough collapsed into leaves. Optionally followed by a tree rotation pass
+    /// (Kensler 2008) to win back some of the SAH quality. Defined in ray.tracer.lbvh.cc.
+    void build_linear(std::span<const BoundingBox> prim_bounds, std::vector<uint32_t>& prim_order,
+                      const LbvhBuildParams& params = {});
+
+    /// Recomputes the node bounds bottom up for primitives that moved, keeping the topology. prim_bounds must be in
+    /// leaf order (the order produced by prim_order at build time).
+    void refit(std::span<const BoundingBox> prim_bounds, const uint32_t threads_count = 1);
+
+    /// Moves the nodes to the requested memory order, the topology and the primitive order stay the same. Defined in
+    /// ray.tracer.bvh.layout.cc.
+    void apply_node_order(const BvhNodeOrder order);
+
+    void clear() noexcept { _nodes.clear(); }
+    bool empty() const noexcept { return _nodes.empty(); }
+    std::span<const BvhNode> nodes() const noexcept { return _nodes; }
+    float sah_cost(const BvhBuildParams& params = {}) const noexcept;
+    /// Depth of the deepest leaf, the root is at depth 0. Every builder keeps it below kMaxTraversalDepth, the
+    /// traversal stacks are sized for that.
+    uint32_t max_leaf_depth() const noexcept;
+
+    /// Front to back traversal. leaf_fn(first, count, BasicInterval<Precision>) tests the leaf primitives and returns
+    /// the (possibly shortened) max distance of the ray. The boxes are float, so are the slab tests whatever the
+    /// precision of the ray is, only the leaf tests run in Precision.
+    template <PrecisionPolicy Precision, typename LeafIntersectFn>
+    void traverse_closest(const BasicRay<Precision>& r, const BasicInterval<Precision> ray_t,
+                          LeafIntersectFn&& leaf_fn) const {
+        struct StackEntry {
+            uint32_t Node;
+            float TNear;
+        };
+
+        const glm::vec3 origin{r.Origin};
+        const glm::vec3 inv_dir = 1.0f / glm::vec3{r.Direction};
+        const float tmin = static_cast<float>(ray_t.Min);
+        typename Precision::Scalar closest = ray_t.Max;
+
+        const BvhNode& root = _nodes[0];
+        if (ray_box_entry(root.BoundsMin, root.BoundsMax, origin, inv_dir, tmin, static_cast<float>(closest)) ==
+            std::numeric_limits<float>::infinity()) {
+            return;
+        }
+
+        StackEntry stack[kMaxTraversalDepth];
+        uint32_t stack_top = 0;
+        stack[stack_top++] = StackEntry{0, tmin};
+
+        while (stack_top != 0) {
+            const StackEntry entry = stack[--stack_top];
+            if (entry.TNear > closest) {
+                continue;
+            }
+
+            const BvhNode* node = &_nodes[entry.Node];
+            for (;;) {
+                if (node->is_leaf()) {
+                    closest =
+                        leaf_fn(node->LeftFirst, node->PrimCount, BasicInterval<Precision>{ray_t.Min, closest});
+                    break;
+                }
+
+                const float tmax = static_cast<float>(closest);
+                const BvhNode* near_child = &_nodes[node->LeftFirst];
+                const BvhNode* far_child = &_nodes[node->LeftFirst + 1];
+                float t_near = ray_box_entry(near_child->BoundsMin, near_child->BoundsMax, origin, inv_dir, tmin, tmax);
+                float t_far = ray_box_entry(far_child->BoundsMin, far_child->BoundsMax, origin, inv_dir, tmin, tmax);
+
+                if (t_far < t_near) {
+                    std::swap(t_near, t_far);
+                    std::swap(near_child, far_child);
+                }
+
+                if (t_near == std::numeric_limits<float>::infinity()) {
+                    break;
+                }
+
+                if (t_far != std::numeric_limits<float>::infinity()) {
+                    stack[stack_top++] = StackEntry{static_cast<uint32_t>(far_child - _nodes.data()), t_far};
+                }
+                node = near_child;
+            }
+        }
+    }
+
+    /// Any hit traversal, in no particular order. leaf_fn(first, count, Interval) tests the leaf primitives and returns
+    /// true when one of them is hit, which ends the traversal.
+    template <typename LeafOccludedFn>
+    bool traverse_any(const Ray& r, const Interval ray_t, LeafOccludedFn&& leaf_fn) const {
+        const glm::vec3 inv_dir = 1.0f / r.Direction;
+        const float tmin = ray_t.Min;
+        const float tmax = ray_t.Max;
+
+        uint32_t stack[kMaxTraversalDepth + 1];
+        uint32_t stack_top = 0;
+        stack[stack_top++] = 0;
+
+        while (stack_top != 0) {
+            const BvhNode& node = _nodes[stack[--stack_top]];
+            if (ray_box_entry(node.BoundsMin, node.BoundsMax, r.Origin, inv_dir, tmin, tmax) ==
+                std::numeric_limits<float>::infinity()) {
+                continue;
+            }
+
+            if (node.is_leaf()) {
+                if (leaf_fn(node.LeftFirst, node.PrimCount, ray_t)) {
+                    return true;
+                }
+                continue;
+            }
+
+            stack[stack_top++] = node.LeftFirst + 1;
+            stack[stack_top++] = node.LeftFirst;
+        }
+
+        return false;
+    }
+
+    /// Front to back traversal of a packet of coherent rays. A node is first tested against the frustum of the whole
+    /// packet, only the rays of packets that may hit it run their own slab test. leaf_fn(first, count, ray, Interval)
+    /// tests the leaf primitives against rays[ray] and returns its (possibly shortened) max distance.
+    template <typename LeafIntersectFn>
+    void traverse_packet(std::span<const Ray> rays, const RayPacketFrustum& frustum, const Interval ray_t,
+                         LeafIntersectFn&& leaf_fn) const {
+        struct StackEntry {
+            uint32_t Node;
+            uint32_t RayMask;
+        };
+
+        assert(rays.size() <= kMaxPacketRays);
+        const float tmin = ray_t.Min;
+
+        glm::vec3 inv_dir[kMaxPacketRays];
+        float closest[kMaxPacketRays];
+        for (uint32_t ray = 0; ray < rays.size(); ++ray) {
+            inv_dir[ray] = 1.0f / rays[ray].Direction;
+            closest[ray] = ray_t.Max;
+        }
+
+        //
+        // rays of ray_mask that hit the node, t_nearest gets the smallest entry distance among them
+        auto node_rays = [&](const BvhNode& node, const uint32_t ray_mask, float& t_nearest) {
+            t_nearest = std::numeric_limits<float>::infinity();
+
+            float packet_tmax = tmin;
+            for (uint32_t lanes = ray_mask; lanes != 0; lanes &= lanes - 1) {
+                packet_tmax = std::max(packet_tmax, closest[std::countr_zero(lanes)]);
+            }
+            if (!frustum.may_hit(node, tmin, packet_tmax)) {
+                return 0u;
+            }
+
+            uint32_t hit_mask{};
+            for (uint32_t lanes = ray_mask; lanes != 0; lanes &= lanes - 1) {
+                const uint32_t ray = std::countr_zero(lanes);
+                const float t_entry = ray_box_entry(node.BoundsMin, node.BoundsMax, rays[ray].Origin, inv_dir[ray],
+                                                    tmin, closest[ray]);
+                if (t_entry != std::numeric_limits<float>::infinity()) {
+                    hit_mask |= 1u << ray;
+                    t_nearest = std::min(t_nearest, t_entry);
+                }
+            }
+            return hit_mask;
+        };
+
+        float t_root;
+        const uint32_t root_rays = node_rays(_nodes[0], (1u << rays.size()) - 1, t_root);
+        if (root_rays == 0) {
+            return;
+        }
+
+        StackEntry stack[kMaxTraversalDepth + 1];
+        uint32_t stack_top = 0;
+        stack[stack_top++] = StackEntry{0, root_rays};
+
+        while (stack_top != 0) {
+            const StackEntry entry = stack[--stack_top];
+            const BvhNode& node = _nodes[entry.Node];
+
+            if (node.is_leaf()) {
+                for (uint32_t lanes = entry.RayMask; lanes != 0; lanes &= lanes - 1) {
+                    const uint32_t ray = std::countr_zero(lanes);
+                    closest[ray] = leaf_fn(node.LeftFirst, node.PrimCount, ray, Interval{ray_t.Min, closest[ray]});
+                }
+                continue;
+            }
+
+            StackEntry near_child{node.LeftFirst, 0};
+            StackEntry far_child{node.LeftFirst + 1, 0};
+            float t_near;
+            float t_far;
+            near_child.RayMask = node_rays(_nodes[near_child.Node], entry.RayMask, t_near);
+            far_child.RayMask = node_rays(_nodes[far_child.Node], entry.RayMask, t_far);
+
+            if (t_far < t_near) {
+                std::swap(near_child, far_child);
+            }
+
+            if (far_child.RayMask != 0) {
+                stack[stack_top++] = far_child;
+            }
+            if (near_child.RayMask != 0) {
+                stack[stack_top++] = near_child;
+            }
+        }
+    }
+
+private:
+    /// Kensler rotations over the nodes less than pass_depth levels below subtree_root, itself root_depth levels below
+    /// the root of the tree. heights holds the height of the subtree of every node and is kept up to date, a rotation
+    /// that would push a leaf to kMaxTraversalDepth or deeper is skipped.
+    void rotate_subtree(const uint32_t subtree_root, const uint32_t root_depth, const uint32_t pass_depth,
+                        std::span<uint32_t> heights);
+    void rotate_treelets(const uint32_t threads_count);
+
+    std::vector<BvhNode> _nodes;
+};
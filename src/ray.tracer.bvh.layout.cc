@@ -0,0 +1,117 @@
+#include "ray.tracer.bvh.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <ranges>
+
+namespace {
+
+struct VanEmdeBoasLayout {
+    std::span<const uint32_t> FirstChild;
+    std::span<const uint32_t> Children;
+    std::vector<uint32_t> Order;
+
+    /// Lays out the first `levels` levels of the subtree of block, the blocks right below them go into frontier.
+    void emit(const uint32_t block, const uint32_t levels, std::vector<uint32_t>& frontier) {
+        if (levels <= 1) {
+            Order.push_back(block);
+            frontier.insert(frontier.end(), Children.begin() + FirstChild[block],
+                            Children.begin() + FirstChild[block + 1]);
+            return;
+        }
+
+        const uint32_t top_levels = levels / 2;
+        std::vector<uint32_t> bottom_roots{};
+        emit(block, top_levels, bottom_roots);
+
+        for (const uint32_t bottom_root : bottom_roots) {
+            emit(bottom_root, levels - top_levels, frontier);
+        }
+    }
+};
+
+} // namespace
+
+std::vector<uint32_t> van_emde_boas_order(std::span<const uint32_t> first_child, std::span<const uint32_t> children) {
+    const uint32_t blocks_count = static_cast<uint32_t>(first_child.size() - 1);
+    if (blocks_count == 0) {
+        return {};
+    }
+
+    std::vector<uint32_t> bfs_order{0};
+    bfs_order.reserve(blocks_count);
+    for (uint32_t i = 0; i < bfs_order.size(); ++i) {
+        const uint32_t block = bfs_order[i];
+        bfs_order.insert(bfs_order.end(), children.begin() + first_child[block],
+                         children.begin() + first_child[block + 1]);
+    }
+
+    std::vector<uint32_t> heights(blocks_count, 1);
+    for (const uint32_t block : std::views::reverse(bfs_order)) {
+        for (uint32_t c = first_child[block]; c < first_child[block + 1]; ++c) {
+            heights[block] = std::max(heights[block], heights[children[c]] + 1);
+        }
+    }
+
+    VanEmdeBoasLayout layout{.FirstChild = first_child, .Children = children};
+    layout.Order.reserve(blocks_count);
+
+    std::vector<uint32_t> frontier{};
+    layout.emit(0, heights[0], frontier);
+    assert(frontier.empty() && layout.Order.size() == blocks_count);
+
+    return layout.Order;
+}
+
+void BoundingVolumeHierarchy::apply_node_order(const BvhNodeOrder order) {
+    if (order == BvhNodeOrder::Build || _nodes.empty()) {
+        return;
+    }
+
+    //
+    // blocks are the root alone and then the sibling pairs, children of a block are the pairs of its inner nodes
+    std::vector<uint32_t> block_first_node{0};
+    std::vector<uint32_t> first_child{0};
+    std::vector<uint32_t> children{};
+    std::vector<uint32_t> child_block_of_node(_nodes.size());
+
+    for (uint32_t block = 0; block < block_first_node.size(); ++block) {
+        const uint32_t first = block_first_node[block];
+        const uint32_t count = block == 0 ? 1 : 2;
+
+        for (uint32_t node = first; node < first + count; ++node) {
+            if (!_nodes[node].is_leaf()) {
+                child_block_of_node[node] = static_cast<uint32_t>(block_first_node.size());
+                children.push_back(child_block_of_node[node]);
+                block_first_node.push_back(_nodes[node].LeftFirst);
+            }
+        }
+        first_child.push_back(static_cast<uint32_t>(children.size()));
+    }
+
+    const std::vector<uint32_t> block_order = van_emde_boas_order(first_child, children);
+
+    std::vector<uint32_t> new_block_first(block_first_node.size());
+    std::vector<BvhNode> ordered_nodes{};
+    ordered_nodes.reserve(_nodes.size());
+
+    for (const uint32_t block : block_order) {
+        const uint32_t count = block == 0 ? 1 : 2;
+        new_block_first[block] = static_cast<uint32_t>(ordered_nodes.size());
+        ordered_nodes.insert(ordered_nodes.end(), _nodes.begin() + block_first_node[block],
+                             _nodes.begin() + block_first_node[block] + count);
+    }
+
+    for (const uint32_t block : block_order) {
+        const uint32_t count = block == 0 ? 1 : 2;
+        for (uint32_t i = 0; i < count; ++i) {
+            BvhNode& node = ordered_nodes[new_block_first[block] + i];
+            if (!node.is_leaf()) {
+                node.LeftFirst = new_block_first[child_block_of_node[block_first_node[block] + i]];
+            }
+        }
+    }
+
+    assert(new_block_first[0] == 0);
+    _nodes = std::move(ordered_nodes);
+}
@@ -0,0 +1,463 @@
+#include "ray.tracer.bvh8.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cassert>
+#include <atomic>
+#include <cmath>
+#include <limits>
+
+#include "parallel.for.hpp"
+#include "ray.tracer.bvh8.kernels.hpp"
+#include "ray.tracer.object.defs.hpp"
+
+//
+// one table per ISA level, from the builds of ray.tracer.bvh8.kernels.cc
+namespace baseline {
+extern const Bvh8Kernels kBvh8Kernels;
+}
+
+#if defined(XRAY_ISA_DISPATCH)
+namespace sse4 {
+extern const Bvh8Kernels kBvh8Kernels;
+}
+namespace avx2 {
+extern const Bvh8Kernels kBvh8Kernels;
+}
+namespace avx512 {
+extern const Bvh8Kernels kBvh8Kernels;
+}
+#endif
+
+namespace {
+
+constexpr uint32_t kPacketWidth = Bvh8Node::kWidth;
+
+struct CollapseTask {
+    uint32_t SrcNode;
+    uint32_t DstNode;
+};
+
+/// Indexed by SimdIsa, select_simd_isa() never picks a level that was not built.
+#if defined(XRAY_ISA_DISPATCH)
+const Bvh8Kernels* const kBvh8KernelsByIsa[] = {
+    &baseline::kBvh8Kernels,
+    &sse4::kBvh8Kernels,
+    &avx2::kBvh8Kernels,
+    &avx512::kBvh8Kernels,
+};
+#else
+const Bvh8Kernels* const kBvh8KernelsByIsa[] = {&baseline::kBvh8Kernels};
+#endif
+
+float quantization_scale(const int8_t scale_exp) noexcept {
+    return std::bit_cast<float>(static_cast<uint32_t>(scale_exp + 127) << 23);
+}
+
+/// Origin, scales and quantized child bounds of a quantized node from the exact bounds of its ChildCount children.
+void quantize_child_bounds(Bvh8QuantizedNode& qnode, const BoundingBox* child_bounds) noexcept {
+    BoundingBox node_bounds{};
+    for (uint32_t i = 0; i < qnode.ChildCount; ++i) {
+        node_bounds.grow(child_bounds[i]);
+    }
+
+    qnode.Origin = node_bounds.Min;
+
+    uint8_t* qmin[3] = {qnode.QMinX, qnode.QMinY, qnode.QMinZ};
+    uint8_t* qmax[3] = {qnode.QMaxX, qnode.QMaxY, qnode.QMaxZ};
+
+    for (uint32_t axis = 0; axis < 3; ++axis) {
+        //
+        // smallest power of two that spans the node extent in 254 steps, one step of slack for the rounding of
+        // origin + q * scale
+        int32_t scale_exp{};
+        std::frexp(node_bounds.extent()[axis] / 254.0f, &scale_exp);
+        scale_exp = std::clamp(scale_exp, -126, 127);
+        qnode.ScaleExp[axis] = static_cast<int8_t>(scale_exp);
+
+        const float origin = qnode.Origin[axis];
+        const float scale = quantization_scale(qnode.ScaleExp[axis]);
+        for (uint32_t i = 0; i < qnode.ChildCount; ++i) {
+            const float cmin = child_bounds[i].Min[axis];
+            const float cmax = child_bounds[i].Max[axis];
+
+            int32_t lo = std::clamp(static_cast<int32_t>(std::floor((cmin - origin) / scale)), 0, 255);
+            while (lo > 0 && origin + static_cast<float>(lo) * scale > cmin) {
+                --lo;
+            }
+
+            int32_t hi = std::clamp(static_cast<int32_t>(std::ceil((cmax - origin) / scale)), 0, 255);
+            while (hi < 255 && origin + static_cast<float>(hi) * scale < cmax) {
+                ++hi;
+            }
+
+            qmin[axis][i] = static_cast<uint8_t>(lo);
+            qmax[axis][i] = static_cast<uint8_t>(hi);
+        }
+    }
+}
+
+} // namespace
+
+void WideBoundingVolumeHierarchy::build(const BoundingVolumeHierarchy& bvh2, std::span<const HittableObject> objects,
+                                        const Bvh8NodeLayout layout, const BvhNodeOrder order) {
+    clear();
+
+    const std::span<const BvhNode> src_nodes = bvh2.nodes();
+    if (src_nodes.empty()) {
+        return;
+    }
+
+    auto make_packets_fn = [this, objects](const uint32_t first, const uint32_t count) {
+        const uint32_t first_packet = static_cast<uint32_t>(_packets.size());
+
+        for (uint32_t packet_start = first; packet_start < first + count; packet_start += kPacketWidth) {
+            SpherePacket8 packet{};
+            packet.FirstPrim = packet_start;
+            packet.LaneCount = std::min(kPacketWidth, first + count - packet_start);
+
+            for (uint32_t lane = 0; lane < packet.LaneCount; ++lane) {
+                const HittableObject& obj = objects[packet_start + lane];
+                assert(obj.ObjKind == HittableObjectKind::Sphere);
+
+                packet.CenterX[lane] = obj.Sphere.Center.x;
+                packet.CenterY[lane] = obj.Sphere.Center.y;
+                packet.CenterZ[lane] = obj.Sphere.Center.z;
+                packet.Radius[lane] = obj.Sphere.Radius;
+            }
+
+            _packets.push_back(packet);
+        }
+
+        return first_packet;
+    };
+
+    _nodes.push_back(Bvh8Node{});
+    std::vector<CollapseTask> tasks{CollapseTask{.SrcNode = 0, .DstNode = 0}};
+
+    while (!tasks.empty()) {
+        const CollapseTask task = tasks.back();
+        tasks.pop_back();
+
+        uint32_t children[Bvh8Node::kWidth];
+        uint32_t children_count{};
+
+        if (const BvhNode& src = src_nodes[task.SrcNode]; src.is_leaf()) {
+            children[children_count++] = task.SrcNode;
+        } else {
+            children[children_count++] = src.LeftFirst;
+            children[children_count++] = src.LeftFirst + 1;
+        }
+
+        //
+        // keep opening the inner child with the largest surface area until the node is full
+        while (children_count < Bvh8Node::kWidth) {
+            uint32_t opened{children_count};
+            float opened_area{-1.0f};
+
+            for (uint32_t i = 0; i < children_count; ++i) {
+                const BvhNode& child = src_nodes[children[i]];
+                if (!child.is_leaf() && child.bounds().surface_area() > opened_area) {
+                    opened = i;
+                    opened_area = child.bounds().surface_area();
+                }
+            }
+
+            if (opened == children_count) {
+                break;
+            }
+
+            const uint32_t left = src_nodes[children[opened]].LeftFirst;
+            children[opened] = left;
+            children[children_count++] = left + 1;
+        }
+
+        Bvh8Node node{};
+        node.ChildCount = children_count;
+
+        for (uint32_t i = 0; i < children_count; ++i) {
+            const BvhNode& child = src_nodes[children[i]];
+            node.BoundsMinX[i] = child.BoundsMin.x;
+            node.BoundsMinY[i] = child.BoundsMin.y;
+            node.BoundsMinZ[i] = child.BoundsMin.z;
+            node.BoundsMaxX[i] = child.BoundsMax.x;
+            node.BoundsMaxY[i] = child.BoundsMax.y;
+            node.BoundsMaxZ[i] = child.BoundsMax.z;
+
+            if (child.is_leaf()) {
+                const uint32_t packets_count = (child.PrimCount + kPacketWidth - 1) / kPacketWidth;
+                assert(packets_count <= std::numeric_limits<uint8_t>::max());
+
+                node.Child[i] = make_packets_fn(child.LeftFirst, child.PrimCount);
+                node.PacketCount[i] = static_cast<uint8_t>(packets_count);
+            } else {
+                node.Child[i] = static_cast<uint32_t>(_nodes.size());
+                _nodes.push_back(Bvh8Node{});
+                tasks.push_back(CollapseTask{.SrcNode = children[i], .DstNode = node.Child[i]});
+            }
+        }
+
+        _nodes[task.DstNode] = node;
+    }
+
+    apply_node_order(order);
+    if (layout == Bvh8NodeLayout::Quantized) {
+        quantize_nodes();
+    }
+}
+
+void WideBoundingVolumeHierarchy::apply_node_order(const BvhNodeOrder order) {
+    if (order == BvhNodeOrder::Build || _nodes.empty()) {
+        return;
+    }
+
+    //
+    // blocks are the root alone and then the inner children of every node, which have to stay consecutive for the
+    // quantized layout
+    struct NodeBlock {
+        uint32_t First;
+        uint32_t Count;
+    };
+
+    std::vector<NodeBlock> blocks{NodeBlock{.First = 0, .Count = 1}};
+    std::vector<uint32_t> first_child{0};
+    std::vector<uint32_t> children{};
+    std::vector<uint32_t> child_block_of_node(_nodes.size());
+
+    for (uint32_t block = 0; block < blocks.size(); ++block) {
+        for (uint32_t node_idx = blocks[block].First; node_idx < blocks[block].First + blocks[block].Count;
+             ++node_idx) {
+            const Bvh8Node& node = _nodes[node_idx];
+
+            NodeBlock inner_children{.First = std::numeric_limits<uint32_t>::max(), .Count = 0};
+            for (uint32_t i = 0; i < node.ChildCount; ++i) {
+                if (node.PacketCount[i] == 0) {
+                    inner_children.First = std::min(inner_children.First, node.Child[i]);
+                    inner_children.Count += 1;
+                }
+            }
+
+            if (inner_children.Count != 0) {
+                child_block_of_node[node_idx] = static_cast<uint32_t>(blocks.size());
+                children.push_back(child_block_of_node[node_idx]);
+                blocks.push_back(inner_children);
+            }
+        }
+        first_child.push_back(static_cast<uint32_t>(children.size()));
+    }
+
+    const std::vector<uint32_t> block_order = van_emde_boas_order(first_child, children);
+
+    std::vector<uint32_t> new_block_first(blocks.size());
+    std::vector<Bvh8Node> ordered_nodes{};
+    ordered_nodes.reserve(_nodes.size());
+
+    for (const uint32_t block : block_order) {
+        new_block_first[block] = static_cast<uint32_t>(ordered_nodes.size());
+        ordered_nodes.insert(ordered_nodes.end(), _nodes.begin() + blocks[block].First,
+                             _nodes.begin() + blocks[block].First + blocks[block].Count);
+    }
+
+    for (const uint32_t block : block_order) {
+        for (uint32_t i = 0; i < blocks[block].Count; ++i) {
+            Bvh8Node& node = ordered_nodes[new_block_first[block] + i];
+            const uint32_t child_block = child_block_of_node[blocks[block].First + i];
+
+            for (uint32_t c = 0; c < node.ChildCount; ++c) {
+                if (node.PacketCount[c] == 0) {
+                    node.Child[c] = new_block_first[child_block] + (node.Child[c] - blocks[child_block].First);
+                }
+            }
+        }
+    }
+
+    assert(new_block_first[0] == 0);
+    _nodes = std::move(ordered_nodes);
+}
+
+void WideBoundingVolumeHierarchy::quantize_nodes() {
+    _quantized_nodes.clear();
+    _quantized_nodes.reserve(_nodes.size());
+
+    for (const Bvh8Node& node : _nodes) {
+        Bvh8QuantizedNode qnode{};
+        qnode.ChildCount = static_cast<uint8_t>(node.ChildCount);
+        qnode.ChildBase = std::numeric_limits<uint32_t>::max();
+        qnode.PacketBase = std::numeric_limits<uint32_t>::max();
+
+        BoundingBox child_bounds[Bvh8Node::kWidth];
+        for (uint32_t i = 0; i < node.ChildCount; ++i) {
+            child_bounds[i] = BoundingBox{glm::vec3{node.BoundsMinX[i], node.BoundsMinY[i], node.BoundsMinZ[i]},
+                                          glm::vec3{node.BoundsMaxX[i], node.BoundsMaxY[i], node.BoundsMaxZ[i]}};
+
+            qnode.PacketCount[i] = node.PacketCount[i];
+            if (node.PacketCount[i] == 0) {
+                qnode.ChildBase = std::min(qnode.ChildBase, node.Child[i]);
+            } else {
+                qnode.PacketBase = std::min(qnode.PacketBase, node.Child[i]);
+            }
+        }
+
+        quantize_child_bounds(qnode, child_bounds);
+        _quantized_nodes.push_back(qnode);
+    }
+
+    _nodes.clear();
+    _nodes.shrink_to_fit();
+}
+
+void WideBoundingVolumeHierarchy::child_indices(const uint32_t node, uint32_t* children) const noexcept {
+    if (_quantized_nodes.empty()) {
+        std::copy_n(_nodes[node].Child, _nodes[node].ChildCount, children);
+        return;
+    }
+
+    const Bvh8QuantizedNode& qnode = _quantized_nodes[node];
+    uint32_t inner = qnode.ChildBase;
+    uint32_t packet = qnode.PacketBase;
+    for (uint32_t i = 0; i < qnode.ChildCount; ++i) {
+        if (qnode.PacketCount[i] == 0) {
+            children[i] = inner++;
+        } else {
+            children[i] = packet;
+            packet += qnode.PacketCount[i];
+        }
+    }
+}
+
+void WideBoundingVolumeHierarchy::set_child_bounds(const uint32_t node, const BoundingBox* child_bounds) noexcept {
+    if (!_quantized_nodes.empty()) {
+        quantize_child_bounds(_quantized_nodes[node], child_bounds);
+        return;
+    }
+
+    Bvh8Node& wide_node = _nodes[node];
+    for (uint32_t i = 0; i < wide_node.ChildCount; ++i) {
+        wide_node.BoundsMinX[i] = child_bounds[i].Min.x;
+        wide_node.BoundsMinY[i] = child_bounds[i].Min.y;
+        wide_node.BoundsMinZ[i] = child_bounds[i].Min.z;
+        wide_node.BoundsMaxX[i] = child_bounds[i].Max.x;
+        wide_node.BoundsMaxY[i] = child_bounds[i].Max.y;
+        wide_node.BoundsMaxZ[i] = child_bounds[i].Max.z;
+    }
+}
+
+void WideBoundingVolumeHierarchy::refit(std::span<const HittableObject> objects, const uint32_t threads_count) {
+    constexpr uint32_t kNoParent = std::numeric_limits<uint32_t>::max();
+
+    const size_t nodes_count = this->nodes_count();
+    if (nodes_count == 0) {
+        return;
+    }
+
+    parallel_for_chunks(threads_count, _packets.size(), [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            SpherePacket8& packet = _packets[i];
+            for (uint32_t lane = 0; lane < packet.LaneCount; ++lane) {
+                const HittableObject& obj = objects[packet.FirstPrim + lane];
+                assert(obj.ObjKind == HittableObjectKind::Sphere);
+
+                packet.CenterX[lane] = obj.Sphere.Center.x;
+                packet.CenterY[lane] = obj.Sphere.Center.y;
+                packet.CenterZ[lane] = obj.Sphere.Center.z;
+                packet.Radius[lane] = obj.Sphere.Radius;
+            }
+        }
+    });
+
+    auto packet_count_fn = [this](const uint32_t node, const uint32_t child) -> uint32_t {
+        return _quantized_nodes.empty() ? _nodes[node].PacketCount[child] : _quantized_nodes[node].PacketCount[child];
+    };
+    auto child_count_fn = [this](const uint32_t node) -> uint32_t {
+        return _quantized_nodes.empty() ? _nodes[node].ChildCount : _quantized_nodes[node].ChildCount;
+    };
+
+    std::vector<uint32_t> parents(nodes_count, kNoParent);
+    std::vector<uint32_t> inner_children(nodes_count, 0);
+    parallel_for_chunks(threads_count, nodes_count, [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t node = begin; node < end; ++node) {
+            uint32_t children[Bvh8Node::kWidth];
+            child_indices(static_cast<uint32_t>(node), children);
+            for (uint32_t i = 0; i < child_count_fn(static_cast<uint32_t>(node)); ++i) {
+                if (packet_count_fn(static_cast<uint32_t>(node), i) == 0) {
+                    parents[children[i]] = static_cast<uint32_t>(node);
+                    inner_children[node] += 1;
+                }
+            }
+        }
+    });
+
+    //
+    // every node with leaf children only walks up towards the root, the last inner child to arrive at a node
+    // refits it and keeps going. The exact bounds of the refit nodes are kept aside, the quantized nodes only have
+    // the rounded ones.
+    std::vector<BoundingBox> node_bounds(nodes_count);
+    std::vector<std::atomic<uint32_t>> arrivals(nodes_count);
+    parallel_for_chunks(threads_count, nodes_count, [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t first = begin; first < end; ++first) {
+            if (inner_children[first] != 0) {
+                continue;
+            }
+
+            for (uint32_t node = static_cast<uint32_t>(first);;) {
+                uint32_t children[Bvh8Node::kWidth];
+                child_indices(node, children);
+
+                BoundingBox child_bounds[Bvh8Node::kWidth];
+                BoundingBox bounds{};
+                for (uint32_t i = 0; i < child_count_fn(node); ++i) {
+                    if (const uint32_t packets_count = packet_count_fn(node, i); packets_count != 0) {
+                        for (uint32_t p = children[i]; p < children[i] + packets_count; ++p) {
+                            const SpherePacket8& packet = _packets[p];
+                            for (uint32_t lane = 0; lane < packet.LaneCount; ++lane) {
+                                const glm::vec3 center{packet.CenterX[lane], packet.CenterY[lane],
+                                                       packet.CenterZ[lane]};
+                                child_bounds[i].grow(BoundingBox{center - glm::vec3{packet.Radius[lane]},
+                                                                 center + glm::vec3{packet.Radius[lane]}});
+                            }
+                        }
+                    } else {
+                        child_bounds[i] = node_bounds[children[i]];
+                    }
+                    bounds.grow(child_bounds[i]);
+                }
+
+                set_child_bounds(node, child_bounds);
+                node_bounds[node] = bounds;
+
+                const uint32_t parent = parents[node];
+                if (parent == kNoParent ||
+                    arrivals[parent].fetch_add(1, std::memory_order_acq_rel) + 1 != inner_children[parent]) {
+                    break;
+                }
+                node = parent;
+            }
+        }
+    });
+}
+
+tl::optional<Bvh8Hit> WideBoundingVolumeHierarchy::intersects(const Ray& r, const Interval ray_t) const noexcept {
+    const Bvh8Kernels& kernels = bvh8_kernels();
+    const float tmin = ray_t.Min;
+    const float tmax = ray_t.Max;
+
+    Bvh8Hit hit;
+    const bool was_hit = !_quantized_nodes.empty()
+                             ? kernels.ClosestHitQuantized(_quantized_nodes.data(), _packets.data(), r, tmin, tmax, hit)
+                             : kernels.ClosestHit(_nodes.data(), _packets.data(), r, tmin, tmax, hit);
+    return was_hit ? tl::optional<Bvh8Hit>{hit} : tl::nullopt;
+}
+
+bool WideBoundingVolumeHierarchy::occluded(const Ray& r, const Interval ray_t) const noexcept {
+    const Bvh8Kernels& kernels = bvh8_kernels();
+    const float tmin = ray_t.Min;
+    const float tmax = ray_t.Max;
+
+    Bvh8Hit hit;
+    if (!_quantized_nodes.empty()) {
+        return kernels.AnyHitQuantized(_quantized_nodes.data(), _packets.data(), r, tmin, tmax, hit);
+    }
+    return kernels.AnyHit(_nodes.data(), _packets.data(), r, tmin, tmax, hit);
+}
+
+const Bvh8Kernels& bvh8_kernels() noexcept { return *kBvh8KernelsByIsa[static_cast<uint32_t>(active_simd_isa())]; }
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <tl/optional.hpp>
+
+#include "acceleration.parameters.hpp"
+#include "interval.hpp"
+#include "ray.hpp"
+#include "ray.tracer.bvh.hpp"
+
+struct HittableObject;
+
+/// 8 children per node, bounds stored as SoA so one slab test covers all of them.
+struct alignas(64) Bvh8Node {
+    static constexpr uint32_t kWidth = 8;
+
+    float BoundsMinX[kWidth];
+    float BoundsMinY[kWidth];
+    float BoundsMinZ[kWidth];
+    float BoundsMaxX[kWidth];
+    float BoundsMaxY[kWidth];
+    float BoundsMaxZ[kWidth];
+    /// Node index for inner children, index of the first sphere packet for leaf children.
+    uint32_t Child[kWidth];
+    /// Number of sphere packets of a leaf child, 0 for inner children.
+    uint8_t PacketCount[kWidth];
+    uint32_t ChildCount;
+};
+
+/// Bvh8Node with the child bounds quantized to 8 bits inside the node box (power of two scale per axis), rounded
+/// outwards so the decoded boxes always contain the exact ones. Inner children are consecutive nodes starting at
+/// ChildBase, the packets of the leaf children are consecutive starting at PacketBase.
+struct alignas(16) Bvh8QuantizedNode {
+    glm::vec3 Origin;
+    int8_t ScaleExp[3];
+    uint8_t ChildCount;
+    uint32_t ChildBase;
+    uint32_t PacketBase;
+    /// Number of sphere packets of a leaf child, 0 for inner children.
+    uint8_t PacketCount[Bvh8Node::kWidth];
+    uint8_t QMinX[Bvh8Node::kWidth];
+    uint8_t QMinY[Bvh8Node::kWidth];
+    uint8_t QMinZ[Bvh8Node::kWidth];
+    uint8_t QMaxX[Bvh8Node::kWidth];
+    uint8_t QMaxY[Bvh8Node::kWidth];
+    uint8_t QMaxZ[Bvh8Node::kWidth];
+};
+
+static_assert(sizeof(Bvh8QuantizedNode) == 80, "Bvh8QuantizedNode must stay 80 bytes (5 x 16)");
+
+/// Up to 8 spheres of a leaf, SoA so the ray/sphere quadratic runs on all of them at once.
+struct alignas(32) SpherePacket8 {
+    float CenterX[Bvh8Node::kWidth];
+    float CenterY[Bvh8Node::kWidth];
+    float CenterZ[Bvh8Node::kWidth];
+    float Radius[Bvh8Node::kWidth];
+    uint32_t FirstPrim;
+    uint32_t LaneCount;
+};
+
+struct Bvh8Hit {
+    float T;
+    uint32_t Prim;
+};
+
+class WideBoundingVolumeHierarchy {
+public:
+    static constexpr uint32_t kMaxStackSize = (Bvh8Node::kWidth - 1) * BoundingVolumeHierarchy::kMaxTraversalDepth + 1;
+
+    /// Collapses the binary hierarchy into 8 wide nodes. Objects must be in the leaf order of bvh2. With the quantized
+    /// layout only the quantized nodes are kept.
+    void build(const BoundingVolumeHierarchy& bvh2, std::span<const HittableObject> objects,
+               const Bvh8NodeLayout layout = Bvh8NodeLayout::Full, const BvhNodeOrder order = BvhNodeOrder::Build);
+
+    /// Copies the moved spheres into the packets and recomputes the child bounds of every node bottom up, in parallel,
+    /// keeping the topology, the node order and the layout (quantized nodes are quantized again from the refit child
+    /// bounds). Objects must still be in the order the tree was built for.
+    void refit(std::span<const HittableObject> objects, const uint32_t threads_count = 1);
+
+    void clear() noexcept {
+        _nodes.clear();
+        _quantized_nodes.clear();
+        _packets.clear();
+    }
+
+    bool empty() const noexcept { return _nodes.empty() && _quantized_nodes.empty(); }
+    Bvh8NodeLayout layout() const noexcept {
+        return _quantized_nodes.empty() ? Bvh8NodeLayout::Full : Bvh8NodeLayout::Quantized;
+    }
+    std::span<const Bvh8Node> nodes() const noexcept { return _nodes; }
+    std::span<const Bvh8QuantizedNode> quantized_nodes() const noexcept { return _quantized_nodes; }
+    std::span<const SpherePacket8> packets() const noexcept { return _packets; }
+    size_t nodes_count() const noexcept { return _nodes.size() + _quantized_nodes.size(); }
+    /// nodes and sphere packets
+    size_t size_bytes() const noexcept {
+        return std::span{_nodes}.size_bytes() + std::span{_quantized_nodes}.size_bytes() +
+               std::span{_packets}.size_bytes();
+    }
+
+    /// Closest hit, returns the distance and the index of the object that was hit.
+    tl::optional<Bvh8Hit> intersects(const Ray& r, const Interval ray_t) const noexcept;
+    /// Any hit inside ray_t, stops at the first one.
+    bool occluded(const Ray& r, const Interval ray_t) const noexcept;
+
+private:
+    void apply_node_order(const BvhNodeOrder order);
+    void quantize_nodes();
+    /// Indices of the children of a node (nodes for the inner children, first packet for the leaf children), written
+    /// to children.
+    void child_indices(const uint32_t node, uint32_t* children) const noexcept;
+    /// Sets the child bounds of a node from the exact ones, requantized for the quantized layout.
+    void set_child_bounds(const uint32_t node, const BoundingBox* child_bounds) noexcept;
+
+    std::vector<Bvh8Node> _nodes;
+    std::vector<Bvh8QuantizedNode> _quantized_nodes;
+    std::vector<SpherePacket8> _packets;
+};
@@ -0,0 +1,286 @@
+#include "ray.tracer.bvh8.kernels.hpp"
+
+#include <bit>
+#include <cstdint>
+#include <limits>
+
+#include "simd.float8.hpp"
+
+//
+// Built once per SimdIsa level, XRAY_KERNEL_ISA names the level and its namespace. Everything here lives in that
+// namespace or has internal linkage: an inline function shared with the rest of the program (glm, std::span, ...)
+// could end up out of line and the linker is free to keep the AVX-512 copy for the whole executable.
+#if !defined(XRAY_KERNEL_ISA)
+#error "XRAY_KERNEL_ISA must name the ISA level this file is built for"
+#endif
+
+namespace XRAY_KERNEL_ISA {
+
+namespace {
+
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+constexpr SimdIsa kSimdIsa = SimdIsa::Avx512;
+#elif defined(__AVX2__)
+constexpr SimdIsa kSimdIsa = SimdIsa::Avx2;
+#elif defined(__SSE4_2__)
+constexpr SimdIsa kSimdIsa = SimdIsa::Sse4;
+#else
+constexpr SimdIsa kSimdIsa = SimdIsa::Baseline;
+#endif
+
+constexpr uint32_t kPacketWidth = Bvh8Node::kWidth;
+
+struct TraversalEntry {
+    uint32_t Child;
+    uint32_t PacketCount;
+    float TNear;
+};
+
+/// The ray broadcast to all the lanes.
+struct RayLanes {
+    Float8 OriginX;
+    Float8 OriginY;
+    Float8 OriginZ;
+    Float8 DirX;
+    Float8 DirY;
+    Float8 DirZ;
+    Float8 InvDirX;
+    Float8 InvDirY;
+    Float8 InvDirZ;
+    Float8 DirLenSq;
+    Float8 InvDirLenSq;
+    Float8 TMin;
+};
+
+float quantization_scale(const int8_t scale_exp) noexcept {
+    return std::bit_cast<float>(static_cast<uint32_t>(scale_exp + 127) << 23);
+}
+
+/// Slab test against all the children, stores the entry distances and returns the mask of the children that were hit.
+uint32_t child_entry_distances(const Bvh8Node& node, const RayLanes& ray, const float closest,
+                               float* entry_dist) noexcept {
+    const Float8 tx0 = (f8_load(node.BoundsMinX) - ray.OriginX) * ray.InvDirX;
+    const Float8 tx1 = (f8_load(node.BoundsMaxX) - ray.OriginX) * ray.InvDirX;
+    const Float8 ty0 = (f8_load(node.BoundsMinY) - ray.OriginY) * ray.InvDirY;
+    const Float8 ty1 = (f8_load(node.BoundsMaxY) - ray.OriginY) * ray.InvDirY;
+    const Float8 tz0 = (f8_load(node.BoundsMinZ) - ray.OriginZ) * ray.InvDirZ;
+    const Float8 tz1 = (f8_load(node.BoundsMaxZ) - ray.OriginZ) * ray.InvDirZ;
+
+    const Float8 tenter = f8_max(f8_max(f8_min(tx0, tx1), f8_min(ty0, ty1)), f8_max(f8_min(tz0, tz1), ray.TMin));
+    const Float8 texit =
+        f8_min(f8_min(f8_max(tx0, tx1), f8_max(ty0, ty1)), f8_min(f8_max(tz0, tz1), f8_broadcast(closest)));
+
+    f8_store(entry_dist, tenter);
+    return m8_bits(tenter <= texit) & lanes_mask(node.ChildCount);
+}
+
+uint32_t child_entry_distances(const Bvh8QuantizedNode& node, const RayLanes& ray, const float closest,
+                               float* entry_dist) noexcept {
+    //
+    // decode the boxes first (q * scale is exact) instead of folding the scale into the inverse direction, so axis
+    // parallel rays (inv_dir = inf) behave exactly like with the full precision boxes
+    const Float8 scale_x = f8_broadcast(quantization_scale(node.ScaleExp[0]));
+    const Float8 scale_y = f8_broadcast(quantization_scale(node.ScaleExp[1]));
+    const Float8 scale_z = f8_broadcast(quantization_scale(node.ScaleExp[2]));
+    const Float8 origin_x = f8_broadcast(node.Origin.x);
+    const Float8 origin_y = f8_broadcast(node.Origin.y);
+    const Float8 origin_z = f8_broadcast(node.Origin.z);
+
+    const Float8 tx0 = (f8_from_u8(node.QMinX) * scale_x + origin_x - ray.OriginX) * ray.InvDirX;
+    const Float8 tx1 = (f8_from_u8(node.QMaxX) * scale_x + origin_x - ray.OriginX) * ray.InvDirX;
+    const Float8 ty0 = (f8_from_u8(node.QMinY) * scale_y + origin_y - ray.OriginY) * ray.InvDirY;
+    const Float8 ty1 = (f8_from_u8(node.QMaxY) * scale_y + origin_y - ray.OriginY) * ray.InvDirY;
+    const Float8 tz0 = (f8_from_u8(node.QMinZ) * scale_z + origin_z - ray.OriginZ) * ray.InvDirZ;
+    const Float8 tz1 = (f8_from_u8(node.QMaxZ) * scale_z + origin_z - ray.OriginZ) * ray.InvDirZ;
+
+    const Float8 tenter = f8_max(f8_max(f8_min(tx0, tx1), f8_min(ty0, ty1)), f8_max(f8_min(tz0, tz1), ray.TMin));
+    const Float8 texit =
+        f8_min(f8_min(f8_max(tx0, tx1), f8_max(ty0, ty1)), f8_min(f8_max(tz0, tz1), f8_broadcast(closest)));
+
+    f8_store(entry_dist, tenter);
+    return m8_bits(tenter <= texit) & lanes_mask(node.ChildCount);
+}
+
+const uint32_t* child_indices(const Bvh8Node& node, uint32_t*) noexcept { return node.Child; }
+
+const uint32_t* child_indices(const Bvh8QuantizedNode& node, uint32_t* scratch) noexcept {
+    uint32_t inner = node.ChildBase;
+    uint32_t packet = node.PacketBase;
+    for (uint32_t i = 0; i < node.ChildCount; ++i) {
+        if (node.PacketCount[i] == 0) {
+            scratch[i] = inner++;
+        } else {
+            scratch[i] = packet;
+            packet += node.PacketCount[i];
+        }
+    }
+    return scratch;
+}
+
+/// Closest hit, or with kAnyHit the first hit found.
+template <bool kAnyHit, typename Node>
+bool intersect_wide_bvh(const Node* nodes, const SpherePacket8* packets, const Ray& r, const float tmin,
+                        const float tmax, Bvh8Hit& hit) noexcept {
+    constexpr float kInfinity = std::numeric_limits<float>::infinity();
+
+    float closest = tmax;
+    bool any_hit{false};
+
+    //
+    // component wise, no glm here (see the top of the file)
+    const float dir_x = r.Direction.x;
+    const float dir_y = r.Direction.y;
+    const float dir_z = r.Direction.z;
+    const float dir_len_sq = dir_x * dir_x + dir_y * dir_y + dir_z * dir_z;
+    const RayLanes ray{
+        .OriginX = f8_broadcast(r.Origin.x),
+        .OriginY = f8_broadcast(r.Origin.y),
+        .OriginZ = f8_broadcast(r.Origin.z),
+        .DirX = f8_broadcast(dir_x),
+        .DirY = f8_broadcast(dir_y),
+        .DirZ = f8_broadcast(dir_z),
+        .InvDirX = f8_broadcast(1.0f / dir_x),
+        .InvDirY = f8_broadcast(1.0f / dir_y),
+        .InvDirZ = f8_broadcast(1.0f / dir_z),
+        .DirLenSq = f8_broadcast(dir_len_sq),
+        .InvDirLenSq = f8_broadcast(1.0f / dir_len_sq),
+        .TMin = f8_broadcast(tmin),
+    };
+    const Float8 zero8 = f8_broadcast(0.0f);
+    const Float8 infinity8 = f8_broadcast(kInfinity);
+
+    TraversalEntry stack[WideBoundingVolumeHierarchy::kMaxStackSize];
+    uint32_t stack_top{};
+    stack[stack_top++] = TraversalEntry{.Child = 0, .PacketCount = 0, .TNear = tmin};
+
+    while (stack_top != 0) {
+        const TraversalEntry entry = stack[--stack_top];
+        if (entry.TNear > closest) {
+            continue;
+        }
+
+        if (entry.PacketCount != 0) {
+            for (uint32_t packet_idx = entry.Child; packet_idx < entry.Child + entry.PacketCount; ++packet_idx) {
+                const SpherePacket8& packet = packets[packet_idx];
+
+                const Float8 oc_x = f8_load(packet.CenterX) - ray.OriginX;
+                const Float8 oc_y = f8_load(packet.CenterY) - ray.OriginY;
+                const Float8 oc_z = f8_load(packet.CenterZ) - ray.OriginZ;
+                const Float8 radius = f8_load(packet.Radius);
+
+                //
+                // same robust form as sphere_roots() in ray.tracer.object.defs.cc: discriminant from the distance of
+                // the center to the ray line, roots q / a and c / q
+                const Float8 h = ray.DirX * oc_x + ray.DirY * oc_y + ray.DirZ * oc_z;
+                const Float8 h_over_a = h * ray.InvDirLenSq;
+                const Float8 l_x = ray.DirX * h_over_a - oc_x;
+                const Float8 l_y = ray.DirY * h_over_a - oc_y;
+                const Float8 l_z = ray.DirZ * h_over_a - oc_z;
+                const Float8 radius_sq = radius * radius;
+                const Float8 delta = ray.DirLenSq * (radius_sq - (l_x * l_x + l_y * l_y + l_z * l_z));
+                const Float8 c = oc_x * oc_x + oc_y * oc_y + oc_z * oc_z - radius_sq;
+                const Float8 sqrtd = f8_sqrt(f8_max(delta, zero8));
+                const Float8 q = f8_select(h < zero8, h - sqrtd, h + sqrtd);
+                const Float8 root_q = q * ray.InvDirLenSq;
+                const Float8 root_c = c / q;
+
+                const Float8 tmax8 = f8_broadcast(closest);
+                const Float8 root_near = f8_min(root_q, root_c);
+                const Float8 root_far = f8_max(root_q, root_c);
+                const Float8 root =
+                    f8_select((ray.TMin < root_near) & (root_near < tmax8), root_near,
+                              f8_select((ray.TMin < root_far) & (root_far < tmax8), root_far, infinity8));
+
+                uint32_t lanes = m8_bits(zero8 <= delta) & m8_bits(root < infinity8) & lanes_mask(packet.LaneCount);
+                if (lanes == 0) {
+                    continue;
+                }
+
+                float roots[kPacketWidth];
+                f8_store(roots, root);
+                if constexpr (kAnyHit) {
+                    hit = Bvh8Hit{.T = roots[lowest_lane(lanes)], .Prim = packet.FirstPrim + lowest_lane(lanes)};
+                    return true;
+                }
+
+                for (; lanes != 0; lanes &= lanes - 1) {
+                    const uint32_t lane = lowest_lane(lanes);
+                    if (roots[lane] < closest) {
+                        closest = roots[lane];
+                        hit = Bvh8Hit{.T = closest, .Prim = packet.FirstPrim + lane};
+                        any_hit = true;
+                    }
+                }
+            }
+            continue;
+        }
+
+        const Node& node = nodes[entry.Child];
+        float entry_dist[Bvh8Node::kWidth];
+        uint32_t hit_children = child_entry_distances(node, ray, closest, entry_dist);
+        if (hit_children == 0) {
+            continue;
+        }
+
+        uint32_t children_scratch[Bvh8Node::kWidth];
+        const uint32_t* children = child_indices(node, children_scratch);
+
+        //
+        // sort the hit children farthest first, so the nearest one ends up on top of the stack
+        TraversalEntry sorted[Bvh8Node::kWidth];
+        uint32_t sorted_count{};
+        for (; hit_children != 0; hit_children &= hit_children - 1) {
+            const uint32_t lane = lowest_lane(hit_children);
+            const TraversalEntry child_entry{
+                .Child = children[lane],
+                .PacketCount = node.PacketCount[lane],
+                .TNear = entry_dist[lane],
+            };
+
+            uint32_t pos = sorted_count++;
+            for (; pos > 0 && sorted[pos - 1].TNear < child_entry.TNear; --pos) {
+                sorted[pos] = sorted[pos - 1];
+            }
+            sorted[pos] = child_entry;
+        }
+
+        for (uint32_t i = 0; i < sorted_count; ++i) {
+            stack[stack_top++] = sorted[i];
+        }
+    }
+
+    return any_hit;
+}
+
+bool closest_hit(const Bvh8Node* nodes, const SpherePacket8* packets, const Ray& r, const float tmin,
+                 const float tmax, Bvh8Hit& hit) noexcept {
+    return intersect_wide_bvh<false>(nodes, packets, r, tmin, tmax, hit);
+}
+
+bool closest_hit_quantized(const Bvh8QuantizedNode* nodes, const SpherePacket8* packets, const Ray& r,
+                           const float tmin, const float tmax, Bvh8Hit& hit) noexcept {
+    return intersect_wide_bvh<false>(nodes, packets, r, tmin, tmax, hit);
+}
+
+bool any_hit(const Bvh8Node* nodes, const SpherePacket8* packets, const Ray& r, const float tmin, const float tmax,
+             Bvh8Hit& hit) noexcept {
+    return intersect_wide_bvh<true>(nodes, packets, r, tmin, tmax, hit);
+}
+
+bool any_hit_quantized(const Bvh8QuantizedNode* nodes, const SpherePacket8* packets, const Ray& r, const float tmin,
+                       const float tmax, Bvh8Hit& hit) noexcept {
+    return intersect_wide_bvh<true>(nodes, packets, r, tmin, tmax, hit);
+}
+
+} // namespace
+
+extern const Bvh8Kernels kBvh8Kernels;
+const Bvh8Kernels kBvh8Kernels{
+    .Isa = kSimdIsa,
+    .ClosestHit = closest_hit,
+    .ClosestHitQuantized = closest_hit_quantized,
+    .AnyHit = any_hit,
+    .AnyHitQuantized = any_hit_quantized,
+};
+
+} // namespace XRAY_KERNEL_ISA
@@ -0,0 +1,24 @@
+#pragma once
+
+#include "ray.hpp"
+#include "ray.tracer.bvh8.hpp"
+#include "simd.isa.hpp"
+
+/// Traversal of the 8 wide BVH (8 wide box tests, 8 wide ray/sphere tests), built once per SimdIsa level from
+/// ray.tracer.bvh8.kernels.cc. The kernels return true and fill hit when something was hit inside (tmin, tmax); the
+/// any hit ones stop at the first hit.
+struct Bvh8Kernels {
+    using Bvh8Kernel = bool (*)(const Bvh8Node* nodes, const SpherePacket8* packets, const Ray& r, const float tmin,
+                                const float tmax, Bvh8Hit& hit) noexcept;
+    using Bvh8QuantizedKernel = bool (*)(const Bvh8QuantizedNode* nodes, const SpherePacket8* packets, const Ray& r,
+                                         const float tmin, const float tmax, Bvh8Hit& hit) noexcept;
+
+    SimdIsa Isa;
+    Bvh8Kernel ClosestHit;
+    Bvh8QuantizedKernel ClosestHitQuantized;
+    Bvh8Kernel AnyHit;
+    Bvh8QuantizedKernel AnyHitQuantized;
+};
+
+/// Kernels of the level chosen with select_simd_isa().
+const Bvh8Kernels& bvh8_kernels() noexcept;
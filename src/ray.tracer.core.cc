@@ -1,10 +1,17 @@
 #include "ray.tracer.core.hpp"
 
+#include <algorithm>
+#include <cassert>
+#include <filesystem>
 #include <glm/common.hpp>
 #include <glm/ext.hpp>
 #include <numbers>
+#include <optional>
+#include <string>
 #include <strong_type/strong_type.hpp>
 #include <tuple>
+#include <unordered_map>
+#include <vector>
 
 #include <iosfwd>
 #include <iostream>
@@ -13,9 +20,14 @@
 #include <rfl.hpp>
 #include <rfl/json.hpp>
 
+#include "acceleration.parameters.hpp"
 #include "camera.parameters.hpp"
 #include "random.number.gen.hpp"
 #include "ray.tracer.material.handle.hpp"
+#include "ray.tracer.render.kernels.hpp"
+#include "ray.tracer.texture.cache.hpp"
+#include "ray.tracer.texture.file.hpp"
+#include "ray.tracer.texture.hpp"
 
 std::tuple<CameraParameters, HittableObject_Collection, MaterialCollection> make_world_basic() {
     const float R = std::cos(std::numbers::pi_v<float> * 0.25f);
@@ -51,6 +63,8 @@ struct SphereDef {
 
 struct AlbedoMatDef {
     std::array<float, 3> albedo;
+    /// image file multiplying the albedo, optional
+    std::optional<std::string> texture;
 };
 
 struct DielectricMatDef {
@@ -60,9 +74,36 @@ struct DielectricMatDef {
 struct MetallicMatDef {
     std::array<float, 3> albedo;
     float fuzzines;
+    std::optional<std::string> texture;
 };
 
-using MaterialDef = rfl::TaggedUnion<"material_def", AlbedoMatDef, DielectricMatDef, MetallicMatDef>;
+struct EmissiveMatDef {
+    std::array<float, 3> emission;
+};
+
+using MaterialDef = rfl::TaggedUnion<"material_def", AlbedoMatDef, DielectricMatDef, MetallicMatDef, EmissiveMatDef>;
+
+/// Spheres shared by all the instances that place them.
+struct ClusterDef {
+    std::vector<std::pair<SphereDef, MaterialDef>> objects;
+};
+
+struct InstanceDef {
+    uint32_t cluster;
+    std::array<float, 3> translation;
+    /// degrees, around the y axis
+    float rotation_y;
+    float scale;
+};
+
+/// Latitude-longitude image the rays that miss everything see instead of the sky gradient, see EnvironmentMap.
+struct EnvironmentDef {
+    std::string path;
+    /// scales the radiance of the image
+    float intensity;
+    /// degrees, around the y axis
+    float rotation_y;
+};
 
 struct WorldDefinition {
     CameraParameters camera{
@@ -77,6 +118,7 @@ struct WorldDefinition {
         .lookat = {0.0f, 0.0f, -1.0f},
         .world_up = {0.0f, 1.0f, 0.0f},
     };
+    AccelerationParameters acceleration{};
     int32_t a_min{-11};
     int32_t a_max{11};
     int32_t b_min{-11};
@@ -92,35 +134,112 @@ struct WorldDefinition {
         {SphereDef{{-4.0f, -1.0f, 0.0f}, 1.0f}, AlbedoMatDef{0.4f, 0.2f, 0.1f}},
         {SphereDef{{4.0f, -1.0f, 0.0f}, 1.0f}, AlbedoMatDef{0.7f, 0.6f, 0.5f}},
     };
+    std::vector<ClusterDef> clusters{};
+    std::vector<InstanceDef> instances{};
+    std::optional<EnvironmentDef> environment{};
 };
 
 glm::vec3 to_vec3(const std::array<float, 3>& a) noexcept { return glm::vec3{a[0], a[1], a[2]}; }
 
-std::tuple<CameraParameters, HittableObject_Collection, MaterialCollection> make_world_spheres() {
+/// Loads the texture files the materials name into the TextureCollection of the scene, every file once. Texture files
+/// (.xtex, see --convert-texture) are mapped and read through the texture cache of the collection, created with the
+/// first one, the other images are decoded and resident.
+class MaterialTextureLoader {
+public:
+    MaterialTextureLoader(TextureCollection& textures, const TextureFilter filter, const size_t cache_bytes) noexcept
+        : _textures{textures}, _filter{filter}, _cache_bytes{cache_bytes} {}
+
+    const TiledTexture* load(const std::optional<std::string>& path) {
+        if (!path) {
+            return nullptr;
+        }
+
+        if (const auto loaded = _loaded.find(*path); loaded != _loaded.end()) {
+            return loaded->second;
+        }
+
+        const TiledTexture* texture = _textures.add(std::make_shared<const TiledTexture>(load_texture(*path)));
+        _loaded.emplace(*path, texture);
+        return texture;
+    }
+
+private:
+    TiledTexture load_texture(const std::filesystem::path& path) {
+        if (path.extension() != ".xtex") {
+            return TiledTexture::from_file(path, _filter).value();
+        }
+
+        if (!_textures.cache()) {
+            _textures.set_cache(std::make_shared<TextureCache>(_cache_bytes));
+        }
+        const uint32_t file = _textures.cache()->add_file(MappedTextureFile::open(path).value());
+        return TiledTexture::from_cache(_textures.cache(), file, _filter);
+    }
+
+    TextureCollection& _textures;
+    TextureFilter _filter;
+    size_t _cache_bytes;
+    std::unordered_map<std::string, const TiledTexture*> _loaded;
+};
+
+Material make_material(const MaterialDef& mtl_def, MaterialTextureLoader& texture_loader) {
+    return rfl::visit(
+        [&texture_loader](const auto& mtl_def) {
+            using mat_def_type = std::decay_t<decltype(mtl_def)>;
+            if constexpr (std::is_same_v<mat_def_type, AlbedoMatDef>) {
+                return Material::make_lambertian(to_vec3(mtl_def.albedo), texture_loader.load(mtl_def.texture));
+            } else if constexpr (std::is_same_v<mat_def_type, DielectricMatDef>) {
+                return Material::make_dielectric(mtl_def.refindex);
+            } else if constexpr (std::is_same_v<mat_def_type, MetallicMatDef>) {
+                return Material::make_metallic(to_vec3(mtl_def.albedo), mtl_def.fuzzines,
+                                               texture_loader.load(mtl_def.texture));
+            } else if constexpr (std::is_same_v<mat_def_type, EmissiveMatDef>) {
+                return Material::make_emissive(to_vec3(mtl_def.emission));
+            } else {
+                static_assert(rfl::always_false_v<mat_def_type>, "Not all cases were covered.");
+            }
+        },
+        mtl_def);
+}
+
+std::tuple<CameraParameters, AccelerationParameters, HittableObject_Collection, MaterialCollection, TextureCollection,
+           std::shared_ptr<const EnvironmentMap>>
+make_world_spheres(const std::filesystem::path& world_config) {
     MaterialCollection material_coll;
+    TextureCollection texture_coll;
     HittableObject_Collection world;
-    const WorldDefinition world_def = rfl::json::load<WorldDefinition>("data/config/world.config.json").value();
+    //
+    // settings missing from the file keep their defaults, configs written before a setting existed still load
+    const WorldDefinition world_def =
+        rfl::json::load<WorldDefinition, rfl::DefaultIfMissing>(world_config.string()).value();
+    MaterialTextureLoader texture_loader{texture_coll, world_def.camera.texture_filter,
+                                         size_t{world_def.camera.texture_cache_megabytes} << 20};
 
     for (const auto& [sphere_def, mtl_def] : world_def.objects) {
-        const Material mtl = rfl::visit(
-            [](const auto& mtl_def) {
-                using mat_def_type = std::decay_t<decltype(mtl_def)>;
-                if constexpr (std::is_same_v<mat_def_type, AlbedoMatDef>) {
-                    return Material::make_lambertian(to_vec3(mtl_def.albedo));
-                } else if constexpr (std::is_same_v<mat_def_type, DielectricMatDef>) {
-                    return Material::make_dielectric(mtl_def.refindex);
-                } else if constexpr (std::is_same_v<mat_def_type, MetallicMatDef>) {
-                    return Material::make_metallic(to_vec3(mtl_def.albedo), mtl_def.fuzzines);
-                } else {
-                    static_assert(rfl::always_false_v<mat_def_type>, "Not all cases were covered.");
-                }
-            },
-            mtl_def);
-
-        const MaterialHandleType mtl_handle = material_coll.add(mtl);
+        const MaterialHandleType mtl_handle = material_coll.add(make_material(mtl_def, texture_loader));
         world.add_object(HittableObject::make_sphere(to_vec3(sphere_def.center), sphere_def.radius, mtl_handle));
     }
 
+    std::vector<std::shared_ptr<const HittableObject_Collection>> clusters{};
+    for (const ClusterDef& cluster_def : world_def.clusters) {
+        auto cluster = std::make_shared<HittableObject_Collection>();
+        for (const auto& [sphere_def, mtl_def] : cluster_def.objects) {
+            const MaterialHandleType mtl_handle = material_coll.add(make_material(mtl_def, texture_loader));
+            cluster->add_object(HittableObject::make_sphere(to_vec3(sphere_def.center), sphere_def.radius, mtl_handle));
+        }
+
+        cluster->build_acceleration(world_def.acceleration);
+        clusters.push_back(std::move(cluster));
+    }
+
+    for (const InstanceDef& instance_def : world_def.instances) {
+        const glm::mat4 object_to_world =
+            glm::scale(glm::rotate(glm::translate(glm::mat4{1.0f}, to_vec3(instance_def.translation)),
+                                   glm::radians(instance_def.rotation_y), glm::vec3{0.0f, 1.0f, 0.0f}),
+                       glm::vec3{instance_def.scale});
+        world.add_instance(clusters.at(instance_def.cluster), object_to_world);
+    }
+
     RandomNumberGenerator rand_gen{};
     for (int32_t a = world_def.a_min; a < world_def.a_max; ++a) {
         for (int32_t b = world_def.b_min; b < world_def.b_max; ++b) {
@@ -145,7 +264,13 @@ std::tuple<CameraParameters, HittableObject_Collection, MaterialCollection> make
         }
     }
 
-    return std::tuple{world_def.camera, world, material_coll};
+    auto environment = std::make_shared<const EnvironmentMap>(
+        world_def.environment ? EnvironmentMap::from_file(world_def.environment->path, world_def.environment->intensity,
+                                                          world_def.environment->rotation_y)
+                                    .value()
+                              : EnvironmentMap{});
+
+    return std::tuple{world_def.camera, world_def.acceleration, world, material_coll, texture_coll, environment};
 }
 
 struct CameraFrame {
@@ -168,8 +293,11 @@ CameraFrame make_camera_frame(const glm::vec3& lookfrom, const glm::vec3& lookat
     };
 }
 
-std::shared_ptr<RayTracingCore> RayTracingCore::default_setup() {
-    auto [cam_params, world, mtl_coll] = make_world_spheres();
+std::shared_ptr<RayTracingCore> RayTracingCore::default_setup(const uint32_t build_threads,
+                                                             const uint32_t scene_readers,
+                                                             const std::filesystem::path& world_config) {
+    auto [cam_params, accel_params, world, mtl_coll, texture_coll, environment] = make_world_spheres(world_config);
+    world.build_acceleration(accel_params, build_threads);
 
     const uint32_t image_height =
         static_cast<uint32_t>(static_cast<float>(cam_params.image_width) / cam_params.aspect_ratio);
@@ -195,6 +323,15 @@ std::shared_ptr<RayTracingCore> RayTracingCore::default_setup() {
     const float defocus_radius = cam_params.focus_distance * std::tan(glm::radians(cam_params.defocus_angle * 0.5f));
     // make_world_basic();
 
+    LightCollection lights = LightCollection::build(world, mtl_coll);
+    auto scene = std::make_unique<SceneSnapshot>(SceneSnapshot{
+        .World = std::move(world),
+        .Materials = std::move(mtl_coll),
+        .Textures = std::move(texture_coll),
+        .Lights = std::move(lights),
+        .Environment = std::move(environment),
+    });
+
     return std::make_shared<RayTracingCore>(RayTracingCore{
         .rts_img_width = cam_params.image_width,
         .rts_img_height = image_height,
@@ -210,8 +347,17 @@ std::shared_ptr<RayTracingCore> RayTracingCore::default_setup() {
         .rts_cam_center = cam_frame.Center,
         .rts_defocus_disk_u = cam_frame.U * defocus_radius,
         .rts_defocus_disk_v = cam_frame.V * defocus_radius,
-        .rts_world = std::move(world),
-        .rts_materials = std::move(mtl_coll),
+        .rts_pixel_spread_angle = std::atan(viewport_height / (cam_params.focus_distance * image_height)),
+        .rts_integrator = cam_params.integrator,
+        .rts_russian_roulette_depth = cam_params.russian_roulette_depth,
+        .rts_ray_sort =
+            RaySortParameters{
+                .Enabled = cam_params.sort_secondary_rays,
+                .BatchSize = cam_params.ray_sort_batch_size,
+            },
+        .rts_math_accuracy = cam_params.math_accuracy,
+        .rts_light_sampling = cam_params.light_sampling,
+        .rts_scene = std::make_unique<SceneSnapshotPublisher>(std::move(scene), scene_readers),
     });
 }
 
@@ -230,36 +376,133 @@ Ray RayTracingCore::get_ray(const uint32_t x, const uint32_t y, RandomNumberGene
     return Ray{
         .Origin = ray_origin,
         .Direction = pixel_sample - ray_origin,
+        .Cone = RayCone{.Width = 0.0f, .SpreadAngle = rts_pixel_spread_angle},
     };
 }
 
 glm::vec3 RayTracingCore::compute_color(const Ray& r, const uint16_t depth, const HittableObject_Collection& world,
-                                        const MaterialCollection& materials, RandomNumberGenerator& randgen) noexcept {
+                                        const MaterialCollection& materials, const EnvironmentMap& environment,
+                                        RandomNumberGenerator& randgen, const MathAccuracy accuracy) noexcept {
     if (depth == 0) {
         return glm::vec3{0.0f};
     }
 
-    if (const tl::optional<IntersectionRecord> int_rec =
-            world.intersects(r, Interval{0.0001, std::numeric_limits<double>::infinity()})) {
+    return shade_closest_hit(r, world.closest_hit(r, kRayInterval), depth, world, materials, environment, randgen,
+                             accuracy);
+}
+
+glm::vec3 RayTracingCore::shade_closest_hit(const Ray& r, const tl::optional<PrimitiveHit>& hit, const uint16_t depth,
+                                            const HittableObject_Collection& world, const MaterialCollection& materials,
+                                            const EnvironmentMap& environment, RandomNumberGenerator& randgen,
+                                            const MathAccuracy accuracy) noexcept {
+    if (depth == 0) {
+        return glm::vec3{0.0f};
+    }
+
+    if (hit) {
+        const IntersectionRecord int_rec = world.intersection_record(r, *hit);
+        const Material& material = materials[int_rec.Material];
+        if (const tl::optional<ScatterRecord> scatter_rec = material.scatter(r, int_rec, randgen, accuracy)) {
+            return material.emitted() +
+                   scatter_rec->Attenuation *
+                       compute_color(scatter_rec->ScatteredRay, depth - 1, world, materials, environment, randgen,
+                                     accuracy);
+        }
+
+        return material.emitted();
+    }
+
+    return environment.radiance(glm::normalize(r.Direction));
+}
+
+bool RayTracingCore::survives_russian_roulette(glm::vec3& throughput, RandomNumberGenerator& randgen) noexcept {
+    const float survival = std::min(1.0f, std::max(throughput.r, std::max(throughput.g, throughput.b)));
+    if (randgen.random_double() >= survival) {
+        return false;
+    }
+
+    throughput /= survival;
+    return true;
+}
 
-        const Material& material = materials[int_rec->Material];
-        if (const tl::optional<ScatterRecord> scatter_rec = material.scatter(r, *int_rec, randgen)) {
-            return scatter_rec->Attenuation *
-                   compute_color(scatter_rec->ScatteredRay, depth - 1, world, materials, randgen);
+glm::vec3 RayTracingCore::hit_emission(const SceneSnapshot& scene, const PrimitiveHit& hit,
+                                       const IntersectionRecord& int_rec, const glm::vec3& scatter_p,
+                                       const float scatter_pdf) noexcept {
+    const glm::vec3 emission = scene.Materials.emission(int_rec.Material);
+    if (scatter_pdf == 0.0f || emission == glm::vec3{0.0f}) {
+        return emission;
+    }
+
+    const uint32_t light = scene.Lights.light_of_object(scene.World.hit_object_id(hit));
+    if (light == LightCollection::kNoLight) {
+        return emission;
+    }
+    return emission * power_heuristic(scatter_pdf, scene.Lights.pdf(scatter_p, light));
+}
+
+glm::vec3 RayTracingCore::miss_radiance(const SceneSnapshot& scene, const Ray& r, const float scatter_pdf) noexcept {
+    const EnvironmentMap& environment = *scene.Environment;
+    const glm::vec3 dir = glm::normalize(r.Direction);
+    const glm::vec3 radiance = environment.radiance(dir);
+    if (scatter_pdf == 0.0f || !environment.importance_sampled()) {
+        return radiance;
+    }
+    return radiance * power_heuristic(scatter_pdf, environment.pdf(dir));
+}
+
+glm::vec3 RayTracingCore::sample_direct_light(const SceneSnapshot& scene, const Ray& r,
+                                              const IntersectionRecord& int_rec, const Material& material,
+                                              RandomNumberGenerator& randgen) noexcept {
+    glm::vec3 radiance{0.0f};
+
+    if (const tl::optional<LightSample> light = scene.Lights.sample(int_rec.P, randgen)) {
+        const glm::vec3 to_light = light->P - int_rec.P;
+        const glm::vec3 light_dir = glm::normalize(to_light);
+        const glm::vec3 bsdf_cos = material.eval(r, int_rec, light_dir);
+        const Ray shadow_ray{offset_ray_origin<RenderPrecision>(int_rec.P, int_rec.Normal, to_light), to_light};
+        if (bsdf_cos != glm::vec3{0.0f} &&
+            !scene.World.occluded(shadow_ray, Interval{RenderPrecision::kRayTMin, 1.0f - kShadowRayEpsilon})) {
+            radiance += bsdf_cos * light->Emission *
+                        (power_heuristic(light->Pdf, material.pdf(r, int_rec, light_dir)) / light->Pdf);
         }
+    }
 
-        return glm::vec3{0};
+    //
+    // the environment is one more light, with a sample of its own: the shadow ray goes all the way out
+    if (const tl::optional<EnvironmentSample> env = scene.Environment->sample(randgen)) {
+        const glm::vec3 bsdf_cos = material.eval(r, int_rec, env->Direction);
+        const Ray shadow_ray{offset_ray_origin<RenderPrecision>(int_rec.P, int_rec.Normal, env->Direction),
+                             env->Direction};
+        if (bsdf_cos != glm::vec3{0.0f} && !scene.World.occluded(shadow_ray, kRayInterval)) {
+            radiance += bsdf_cos * env->Radiance *
+                        (power_heuristic(env->Pdf, material.pdf(r, int_rec, env->Direction)) / env->Pdf);
+        }
     }
 
-    const glm::vec3 unit_dir = glm::normalize(r.Direction);
-    const float t = 0.5f * (unit_dir.y + 1.0f);
-    return (1.0f - t) * glm::vec3{1.0f} + t * glm::vec3{0.5f, 0.7f, 1.0f};
+    return radiance;
 }
 
-RGBAColor RayTracingCore::raytrace_pixel(const uint32_t x, const uint32_t y, RandomNumberGenerator& rand_gen) const {
+RGBAColor RayTracingCore::raytrace_pixel(const uint32_t x, const uint32_t y, const SceneSnapshot& scene,
+                                         RandomNumberGenerator& rand_gen) const {
     glm::vec3 pixel_color{0.0f};
     for (uint32_t sample = 0; sample < rts_samples_per_pixel; ++sample) {
-        pixel_color += compute_color(get_ray(x, y, rand_gen), rts_maxdepth, rts_world, rts_materials, rand_gen);
+        pixel_color += compute_color(get_ray(x, y, rand_gen), rts_maxdepth, scene.World, scene.Materials,
+                                     *scene.Environment, rand_gen, rts_math_accuracy);
+    }
+    return RGBAColor{pixel_color * rts_pixels_sample_scale, rts_math_accuracy};
+}
+
+void RayTracingCore::raytrace_tile(const IntegratorKind integrator, const MathAccuracy accuracy, const uint32_t start_x,
+                                   const uint32_t start_y, const uint32_t end_x, const uint32_t end_y,
+                                   const SceneSnapshot& scene, RandomNumberGenerator& rand_gen,
+                                   std::span<RGBAColor> tile_colors) const {
+    assert(integrator != IntegratorKind::Wavefront);
+
+    if (integrator == IntegratorKind::Specialized) {
+        (this->*select_render_kernel(scene).RenderTile)(IntegratorKind::Iterative, accuracy, start_x, start_y, end_x,
+                                                         end_y, scene, rand_gen, tile_colors);
+        return;
     }
-    return RGBAColor{pixel_color * rts_pixels_sample_scale};
+
+    trace_tile(integrator, accuracy, start_x, start_y, end_x, end_y, scene, rand_gen, tile_colors);
 }
@@ -1,17 +1,27 @@
 #pragma once
 
+#include <algorithm>
+#include <cassert>
+#include <concepts>
 #include <cstdint>
+#include <filesystem>
 #include <limits>
 #include <memory>
+#include <span>
+#include <vector>
 
 #include <glm/geometric.hpp>
 #include <glm/vec3.hpp>
+#include <tl/optional.hpp>
 
+#include "camera.parameters.hpp"
 #include "color.hpp"
 #include "interval.hpp"
 #include "ray.hpp"
 #include "ray.tracer.material.defs.hpp"
 #include "ray.tracer.object.defs.hpp"
+#include "ray.tracer.scene.snapshot.hpp"
+#include "ray.tracer.wavefront.hpp"
 
 class RandomNumberGenerator;
 
@@ -30,13 +40,214 @@ struct RayTracingCore {
     glm::vec3 rts_cam_center;
     glm::vec3 rts_defocus_disk_u;
     glm::vec3 rts_defocus_disk_v;
-    HittableObject_Collection rts_world;
-    MaterialCollection rts_materials;
+    /// angle a pixel covers seen from the camera, spread of the cones of the primary rays (see RayCone)
+    float rts_pixel_spread_angle;
+    IntegratorKind rts_integrator;
+    uint16_t rts_russian_roulette_depth;
+    RaySortParameters rts_ray_sort;
+    MathAccuracy rts_math_accuracy;
+    /// next event estimation in the iterative, specialized and wavefront integrators, combined with the scattered rays
+    /// that hit the lights (and the environment image) by multiple importance sampling, see sample_direct_light(),
+    /// hit_emission() and miss_radiance()
+    bool rts_light_sampling;
+    /// world and materials, workers pin the current snapshot per tile (reader slot = worker id)
+    std::unique_ptr<SceneSnapshotPublisher> rts_scene;
 
-    static std::shared_ptr<RayTracingCore> default_setup();
+    /// scene default_setup() loads unless given another one, the other files in data/config are demo scenes
+    static constexpr const char* kDefaultWorldConfig = "data/config/world.config.json";
+
+    static std::shared_ptr<RayTracingCore>
+    default_setup(const uint32_t build_threads = 1, const uint32_t scene_readers = 1,
+                  const std::filesystem::path& world_config = kDefaultWorldConfig);
+
+    static constexpr Interval kRayInterval{RenderPrecision::kRayTMin, std::numeric_limits<float>::infinity()};
+    /// shadow rays end at the light, at t = 1, and stop that much short of it so they do not hit the light itself
+    static constexpr float kShadowRayEpsilon = 1.0e-3f;
+    /// primary ray packets cover kPacketWidth x kPacketHeight pixels of a tile
+    static constexpr uint32_t kPacketWidth = 8;
+    static constexpr uint32_t kPacketHeight = 2;
 
     static glm::vec3 compute_color(const Ray& r, const uint16_t depth, const HittableObject_Collection& world,
-                                   const MaterialCollection& materials, RandomNumberGenerator& randgen) noexcept;
+                                   const MaterialCollection& materials, const EnvironmentMap& environment,
+                                   RandomNumberGenerator& randgen, const MathAccuracy accuracy) noexcept;
+    /// Russian roulette: the path survives with probability max(throughput) (capped at 1), survivors get their
+    /// throughput divided by it so the estimate stays unbiased.
+    static bool survives_russian_roulette(glm::vec3& throughput, RandomNumberGenerator& randgen) noexcept;
+    /// Multiple importance sampling weight of a sample drawn with pdf that the strategy of other_pdf could have drawn
+    /// as well (power heuristic, exponent 2).
+    static float power_heuristic(const float pdf, const float other_pdf) noexcept {
+        const float pdf2 = pdf * pdf;
+        const float other_pdf2 = other_pdf * other_pdf;
+        return pdf2 + other_pdf2 > 0.0f ? pdf2 / (pdf2 + other_pdf2) : 0.0f;
+    }
+    /// Emission of the material of a hit, found by a ray scattered from scatter_p with the PDF scatter_pdf (see
+    /// ScatterRecord::Pdf). When the lights were sampled at scatter_p too (scatter_pdf is not 0 then) and the object
+    /// hit is one of them, the emission gets the MIS weight of the scattered ray against the light samples.
+    static glm::vec3 hit_emission(const SceneSnapshot& scene, const PrimitiveHit& hit,
+                                  const IntersectionRecord& int_rec, const glm::vec3& scatter_p,
+                                  const float scatter_pdf) noexcept;
+    /// Radiance of the environment seen by a ray that missed everything, scattered with the PDF scatter_pdf. When the
+    /// environment was sampled at the scatter too (scatter_pdf is not 0 then, see sample_direct_light()), the radiance
+    /// gets the MIS weight of the scattered ray against the environment samples.
+    static glm::vec3 miss_radiance(const SceneSnapshot& scene, const Ray& r, const float scatter_pdf) noexcept;
+    /// Next event estimation at a hit on a material with a PDF (see MaterialCollection::has_pdf()): radiance of a
+    /// point on a light picked for the hit (see LightCollection::sample()) times Material::eval() over the PDF of the
+    /// point, with the MIS weight of the light sample against the scattered rays. Zero when the shadow ray is blocked.
+    /// An importance sampled environment adds a sample of its own (see EnvironmentMap::sample()), weighted the same.
+    static glm::vec3 sample_direct_light(const SceneSnapshot& scene, const Ray& r, const IntersectionRecord& int_rec,
+                                         const Material& material, RandomNumberGenerator& randgen) noexcept;
+    /// Iterative version of compute_color(), starting from the already known closest hit of r. Terminates paths with
+    /// Russian roulette once rts_russian_roulette_depth bounces are done. With light_sampling every hit on a material
+    /// with a PDF adds a light sample (sample_direct_light()), compute_color() only finds the lights by hitting them.
+    /// The render kernels instantiate it for the object and material kinds of a scene (HittableObjectKindList,
+    /// MaterialKindList): the closest hits and the scattering are dispatched over those kinds at compile time. All the
+    /// kinds is the generic path, it goes through HittableObject_Collection::closest_hit() and so runs the double
+    /// precision collections too.
+    template <typename ObjectKinds = AllHittableObjectKinds, typename MaterialKinds = AllMaterialKinds>
+    glm::vec3 trace_path(Ray r, tl::optional<PrimitiveHit> hit, const SceneSnapshot& scene,
+                         RandomNumberGenerator& randgen, const MathAccuracy accuracy,
+                         const bool light_sampling) const noexcept;
+    /// Color of a ray whose closest hit is already known (or that missed everything).
+    static glm::vec3 shade_closest_hit(const Ray& r, const tl::optional<PrimitiveHit>& hit, const uint16_t depth,
+                                       const HittableObject_Collection& world, const MaterialCollection& materials,
+                                       const EnvironmentMap& environment, RandomNumberGenerator& randgen,
+                                       const MathAccuracy accuracy) noexcept;
+    /// Primary ray through a random point of pixel (x, y), with the cone of the pixel.
     Ray get_ray(const uint32_t x, const uint32_t y, RandomNumberGenerator& randgen) const;
-    RGBAColor raytrace_pixel(const uint32_t x, const uint32_t y, RandomNumberGenerator& rand_gen) const;
+    RGBAColor raytrace_pixel(const uint32_t x, const uint32_t y, const SceneSnapshot& scene,
+                             RandomNumberGenerator& rand_gen) const;
+    /// Traces the pixels [start_x, end_x) x [start_y, end_y), colors are written row major to tile_colors. The primary
+    /// rays of a sample are traced as packets (see HittableObject_Collection::closest_hit_packet()), the bounces one by
+    /// one with the recursive or the iterative integrator, the specialized one hands the tile to the render kernel of
+    /// the scene. Shading and the gamma conversion use the given accuracy.
+    void raytrace_tile(const IntegratorKind integrator, const MathAccuracy accuracy, const uint32_t start_x,
+                       const uint32_t start_y, const uint32_t end_x, const uint32_t end_y, const SceneSnapshot& scene,
+                       RandomNumberGenerator& rand_gen, std::span<RGBAColor> tile_colors) const;
+    /// The tile loop of raytrace_tile() for the recursive or the iterative integrator, compiled for object and material
+    /// kinds like trace_path(). All the kinds is the generic path (HittableObject_Collection::closest_hit_packet()),
+    /// the render kernels instantiate the others with the iterative integrator. Every instantiation traces the same
+    /// packets and draws the random numbers in the same order.
+    template <typename ObjectKinds = AllHittableObjectKinds, typename MaterialKinds = AllMaterialKinds>
+    void trace_tile(const IntegratorKind integrator, const MathAccuracy accuracy, const uint32_t start_x,
+                    const uint32_t start_y, const uint32_t end_x, const uint32_t end_y, const SceneSnapshot& scene,
+                    RandomNumberGenerator& rand_gen, std::span<RGBAColor> tile_colors) const;
 };
+
+template <typename ObjectKinds, typename MaterialKinds>
+glm::vec3 RayTracingCore::trace_path(Ray r, tl::optional<PrimitiveHit> hit, const SceneSnapshot& scene,
+                                     RandomNumberGenerator& randgen, const MathAccuracy accuracy,
+                                     const bool light_sampling) const noexcept {
+    glm::vec3 radiance{0.0f};
+    glm::vec3 throughput{1.0f};
+    //
+    // last scatter of the path, see hit_emission()
+    glm::vec3 scatter_p{0.0f};
+    float scatter_pdf{};
+
+    for (uint32_t depth = 0; depth < rts_maxdepth; ++depth) {
+        if (depth >= rts_russian_roulette_depth && !survives_russian_roulette(throughput, randgen)) {
+            return radiance;
+        }
+
+        if (depth != 0) {
+            if constexpr (std::same_as<ObjectKinds, AllHittableObjectKinds>) {
+                hit = scene.World.closest_hit(r, kRayInterval);
+            } else {
+                hit = scene.World.closest_hit_kinds<ObjectKinds>(r, kRayInterval);
+            }
+        }
+
+        if (!hit) {
+            return radiance + throughput * miss_radiance(scene, r, scatter_pdf);
+        }
+
+        const IntersectionRecord int_rec = scene.World.intersection_record(r, *hit);
+        if constexpr (MaterialKinds::contains(MaterialKind::Emissive)) {
+            radiance += throughput * hit_emission(scene, *hit, int_rec, scatter_p, scatter_pdf);
+        }
+
+        //
+        // the light sample does not depend on the scatter, a path the material absorbs still gets it. Only the
+        // Lambertian and the Metallic materials have a PDF.
+        bool samples_lights{false};
+        if constexpr (MaterialKinds::contains(MaterialKind::Lambertian) ||
+                      MaterialKinds::contains(MaterialKind::Metallic)) {
+            samples_lights = light_sampling && scene.Materials.has_pdf(int_rec.Material);
+            if (samples_lights) {
+                radiance +=
+                    throughput * sample_direct_light(scene, r, int_rec, scene.Materials[int_rec.Material], randgen);
+            }
+        }
+
+        const tl::optional<ScatterRecord> scatter_rec =
+            scene.Materials.scatter_kinds<MaterialKinds>(r, int_rec, randgen, accuracy);
+        if (!scatter_rec) {
+            return radiance;
+        }
+
+        throughput *= scatter_rec->Attenuation;
+        r = scatter_rec->ScatteredRay;
+        scatter_p = int_rec.P;
+        scatter_pdf = samples_lights ? scatter_rec->Pdf : 0.0f;
+    }
+
+    //
+    // out of bounces, like compute_color() at depth 0
+    return radiance;
+}
+
+template <typename ObjectKinds, typename MaterialKinds>
+void RayTracingCore::trace_tile(const IntegratorKind integrator, const MathAccuracy accuracy, const uint32_t start_x,
+                                const uint32_t start_y, const uint32_t end_x, const uint32_t end_y,
+                                const SceneSnapshot& scene, RandomNumberGenerator& rand_gen,
+                                std::span<RGBAColor> tile_colors) const {
+    assert(integrator == IntegratorKind::Recursive || integrator == IntegratorKind::Iterative);
+    static_assert(kPacketWidth * kPacketHeight <= BoundingVolumeHierarchy::kMaxPacketRays);
+
+    const uint32_t tile_width = end_x - start_x;
+    assert(tile_colors.size() >= static_cast<size_t>(tile_width) * (end_y - start_y));
+
+    std::vector<glm::vec3> tile_radiance(static_cast<size_t>(tile_width) * (end_y - start_y), glm::vec3{0.0f});
+
+    Ray packet_rays[kPacketWidth * kPacketHeight];
+    tl::optional<PrimitiveHit> packet_hits[kPacketWidth * kPacketHeight];
+    uint32_t packet_pixels[kPacketWidth * kPacketHeight];
+
+    for (uint32_t sample = 0; sample < rts_samples_per_pixel; ++sample) {
+        for (uint32_t packet_y = start_y; packet_y < end_y; packet_y += kPacketHeight) {
+            for (uint32_t packet_x = start_x; packet_x < end_x; packet_x += kPacketWidth) {
+                uint32_t rays_count{};
+                for (uint32_t y = packet_y; y < std::min(packet_y + kPacketHeight, end_y); ++y) {
+                    for (uint32_t x = packet_x; x < std::min(packet_x + kPacketWidth, end_x); ++x) {
+                        packet_rays[rays_count] = get_ray(x, y, rand_gen);
+                        packet_pixels[rays_count] = (y - start_y) * tile_width + (x - start_x);
+                        rays_count += 1;
+                    }
+                }
+
+                if constexpr (std::same_as<ObjectKinds, AllHittableObjectKinds>) {
+                    scene.World.closest_hit_packet(std::span{packet_rays, rays_count}, kRayInterval,
+                                                   std::span{packet_hits, rays_count});
+                } else {
+                    scene.World.closest_hit_packet_kinds<ObjectKinds>(std::span{packet_rays, rays_count}, kRayInterval,
+                                                                      std::span{packet_hits, rays_count});
+                }
+
+                //
+                // hits go back to their own pixel, from there on every sample continues on its own
+                for (uint32_t ray = 0; ray < rays_count; ++ray) {
+                    tile_radiance[packet_pixels[ray]] +=
+                        integrator == IntegratorKind::Iterative
+                            ? trace_path<ObjectKinds, MaterialKinds>(packet_rays[ray], packet_hits[ray], scene,
+                                                                     rand_gen, accuracy, rts_light_sampling)
+                            : shade_closest_hit(packet_rays[ray], packet_hits[ray], rts_maxdepth, scene.World,
+                                                scene.Materials, *scene.Environment, rand_gen, accuracy);
+                }
+            }
+        }
+    }
+
+    for (size_t pixel = 0; pixel < tile_radiance.size(); ++pixel) {
+        tile_colors[pixel] = RGBAColor{tile_radiance[pixel] * rts_pixels_sample_scale, accuracy};
+    }
+}
@@ -0,0 +1,180 @@
+#include "ray.tracer.environment.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <memory>
+#include <numbers>
+#include <string>
+#include <system_error>
+
+#include <glm/geometric.hpp>
+
+#include <stb_image.h>
+
+#include "color.hpp"
+#include "random.number.gen.hpp"
+
+namespace {
+
+/// largest float below 1, keeps the random numbers scaled up to an index inside the table
+constexpr float kOneMinusEpsilon = 0x1.fffffep-1f;
+
+} // namespace
+
+tl::expected<EnvironmentMap, SystemError> EnvironmentMap::from_file(const std::filesystem::path& path,
+                                                                    const float intensity, const float rotation_y) {
+    const std::string s_path = path.string();
+    int32_t width{};
+    int32_t height{};
+    int32_t channels{};
+
+    std::unique_ptr<float, decltype(&stbi_image_free)> pixels{
+        stbi_loadf(s_path.c_str(), &width, &height, &channels, STBI_rgb), &stbi_image_free};
+    if (!pixels) {
+        return tl::make_unexpected(SystemError{std::make_error_code(std::errc::io_error)});
+    }
+
+    std::vector<glm::vec3> radiance(static_cast<size_t>(width) * static_cast<size_t>(height));
+    for (size_t texel = 0; texel < radiance.size(); ++texel) {
+        const float* rgb = pixels.get() + texel * 3;
+        radiance[texel] = glm::vec3{rgb[0], rgb[1], rgb[2]};
+    }
+
+    return from_pixels(std::move(radiance), static_cast<uint32_t>(width), static_cast<uint32_t>(height), intensity,
+                       rotation_y);
+}
+
+EnvironmentMap EnvironmentMap::from_pixels(std::vector<glm::vec3> pixels, const uint32_t width, const uint32_t height,
+                                           const float intensity, const float rotation_y) {
+    assert(pixels.size() == static_cast<size_t>(width) * height && width != 0 && height != 0);
+
+    EnvironmentMap env{};
+    env._radiance = std::move(pixels);
+    env._width = width;
+    env._height = height;
+    env._rotation = rotation_y / 360.0f;
+    for (glm::vec3& texel : env._radiance) {
+        texel = glm::max(texel * intensity, glm::vec3{0.0f});
+    }
+
+    //
+    // a row spans [row, row + 1) / height of pi in theta, its texels 2 pi / width each in phi
+    env._row_solid_angle.resize(height);
+    for (uint32_t row = 0; row < height; ++row) {
+        const float cos_top = std::cos(std::numbers::pi_v<float> * static_cast<float>(row) / height);
+        const float cos_bottom = std::cos(std::numbers::pi_v<float> * static_cast<float>(row + 1) / height);
+        env._row_solid_angle[row] = 2.0f * std::numbers::pi_v<float> / width * (cos_top - cos_bottom);
+    }
+
+    const size_t texels_count = env._radiance.size();
+    env._texel_pmf.resize(texels_count);
+    double total_power{};
+    for (size_t texel = 0; texel < texels_count; ++texel) {
+        env._texel_pmf[texel] = luminance(env._radiance[texel]) * env._row_solid_angle[texel / width];
+        total_power += env._texel_pmf[texel];
+    }
+    if (!(total_power > 0.0)) {
+        //
+        // black image, nothing to sample
+        env._texel_pmf.clear();
+        return env;
+    }
+
+    //
+    // Vose's alias table: the slots under the mean take their missing share from the ones over it
+    env._alias_threshold.resize(texels_count);
+    env._alias.resize(texels_count);
+    std::vector<double> scaled(texels_count);
+    std::vector<uint32_t> small{};
+    std::vector<uint32_t> large{};
+    for (uint32_t texel = 0; texel < texels_count; ++texel) {
+        env._texel_pmf[texel] = static_cast<float>(env._texel_pmf[texel] / total_power);
+        scaled[texel] = static_cast<double>(env._texel_pmf[texel]) * static_cast<double>(texels_count);
+        (scaled[texel] < 1.0 ? small : large).push_back(texel);
+    }
+
+    while (!small.empty() && !large.empty()) {
+        const uint32_t under = small.back();
+        small.pop_back();
+        const uint32_t over = large.back();
+
+        env._alias_threshold[under] = static_cast<float>(scaled[under]);
+        env._alias[under] = over;
+        scaled[over] -= 1.0 - scaled[under];
+        if (scaled[over] < 1.0) {
+            large.pop_back();
+            small.push_back(over);
+        }
+    }
+
+    //
+    // what is left is 1 up to rounding
+    for (const uint32_t texel : large) {
+        env._alias_threshold[texel] = 1.0f;
+        env._alias[texel] = texel;
+    }
+    for (const uint32_t texel : small) {
+        env._alias_threshold[texel] = 1.0f;
+        env._alias[texel] = texel;
+    }
+
+    return env;
+}
+
+uint32_t EnvironmentMap::texel_of(const glm::vec3& dir) const noexcept {
+    const float u = 0.5f + std::atan2(dir.x, -dir.z) * (0.5f * std::numbers::inv_pi_v<float>) + _rotation;
+    const float v = std::acos(std::clamp(dir.y, -1.0f, 1.0f)) * std::numbers::inv_pi_v<float>;
+    const uint32_t column =
+        std::min(static_cast<uint32_t>((u - std::floor(u)) * static_cast<float>(_width)), _width - 1);
+    const uint32_t row = std::min(static_cast<uint32_t>(v * static_cast<float>(_height)), _height - 1);
+    return row * _width + column;
+}
+
+glm::vec3 EnvironmentMap::radiance(const glm::vec3& dir) const noexcept {
+    if (_radiance.empty()) {
+        const float t = 0.5f * (dir.y + 1.0f);
+        return (1.0f - t) * glm::vec3{1.0f} + t * glm::vec3{0.5f, 0.7f, 1.0f};
+    }
+
+    return _radiance[texel_of(dir)];
+}
+
+tl::optional<EnvironmentSample> EnvironmentMap::sample(RandomNumberGenerator& randgen) const noexcept {
+    if (!importance_sampled()) {
+        return tl::nullopt;
+    }
+
+    //
+    // one random number picks the slot and decides between the texel of the slot and its alias
+    const float scaled = std::min(static_cast<float>(randgen.random_double()), kOneMinusEpsilon) *
+                         static_cast<float>(_alias.size());
+    const uint32_t slot = std::min(static_cast<uint32_t>(scaled), static_cast<uint32_t>(_alias.size() - 1));
+    const uint32_t texel = scaled - static_cast<float>(slot) < _alias_threshold[slot] ? slot : _alias[slot];
+
+    //
+    // uniform in the solid angle of the texel: phi uniform over the column, cos theta uniform over the row
+    const uint32_t row = texel / _width;
+    const uint32_t column = texel % _width;
+    const float u = (static_cast<float>(column) + static_cast<float>(randgen.random_double())) / _width - _rotation;
+    const float phi = 2.0f * std::numbers::pi_v<float> * (u - 0.5f);
+    const float cos_top = std::cos(std::numbers::pi_v<float> * static_cast<float>(row) / _height);
+    const float cos_bottom = std::cos(std::numbers::pi_v<float> * static_cast<float>(row + 1) / _height);
+    const float cos_theta = cos_top + (cos_bottom - cos_top) * static_cast<float>(randgen.random_double());
+    const float sin_theta = std::sqrt(std::max(0.0f, 1.0f - cos_theta * cos_theta));
+
+    return EnvironmentSample{
+        .Direction = glm::vec3{sin_theta * std::sin(phi), cos_theta, -sin_theta * std::cos(phi)},
+        .Radiance = _radiance[texel],
+        .Pdf = _texel_pmf[texel] / _row_solid_angle[row],
+    };
+}
+
+float EnvironmentMap::pdf(const glm::vec3& dir) const noexcept {
+    if (!importance_sampled()) {
+        return 0.0f;
+    }
+
+    const uint32_t texel = texel_of(dir);
+    return _texel_pmf[texel] / _row_solid_angle[texel / _width];
+}
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <tl/expected.hpp>
+#include <tl/optional.hpp>
+
+#include "error.hpp"
+
+class RandomNumberGenerator;
+
+/// Direction toward the environment picked for a shading point.
+struct EnvironmentSample {
+    /// unit length
+    glm::vec3 Direction;
+    glm::vec3 Radiance;
+    /// per unit of solid angle
+    float Pdf;
+};
+
+/// What the rays that miss everything see: the sky gradient when default constructed, or a latitude-longitude HDR
+/// image (+y up, the center column looks down -z) with the radiance of every texel constant over the directions it
+/// covers.
+///
+/// An image is a light too. Its texels get picked in proportion to their power (luminance times the solid angle they
+/// cover) through an alias table built once, then a direction uniformly in the solid angle of the texel: a sun a few
+/// texels wide gets found by the light samples instead of by the few scattered rays that happen to hit it.
+class EnvironmentMap {
+public:
+    EnvironmentMap() = default;
+
+    /// Any image stb_image reads, .hdr for radiance beyond 1. intensity scales the radiance, rotation_y (degrees)
+    /// turns the image around +y.
+    static tl::expected<EnvironmentMap, SystemError> from_file(const std::filesystem::path& path,
+                                                               const float intensity = 1.0f,
+                                                               const float rotation_y = 0.0f);
+    /// Linear radiance of width x height texels, row major from the top (+y) row.
+    static EnvironmentMap from_pixels(std::vector<glm::vec3> pixels, const uint32_t width, const uint32_t height,
+                                      const float intensity = 1.0f, const float rotation_y = 0.0f);
+
+    uint32_t width() const noexcept { return _width; }
+    uint32_t height() const noexcept { return _height; }
+    /// An image with some power: sample() and pdf() work, the sky gradient is only found by the rays that miss.
+    bool importance_sampled() const noexcept { return !_alias.empty(); }
+
+    /// Radiance coming from the unit direction dir.
+    glm::vec3 radiance(const glm::vec3& dir) const noexcept;
+    /// Direction picked in proportion to the power of the texels. Nothing when not importance_sampled().
+    tl::optional<EnvironmentSample> sample(RandomNumberGenerator& randgen) const noexcept;
+    /// Per unit of solid angle, the PDF of sample() picking the unit direction dir.
+    float pdf(const glm::vec3& dir) const noexcept;
+
+private:
+    /// Texel of the image dir falls in.
+    uint32_t texel_of(const glm::vec3& dir) const noexcept;
+
+    /// intensity applied
+    std::vector<glm::vec3> _radiance;
+    uint32_t _width{};
+    uint32_t _height{};
+    /// rotation_y as a fraction of a turn
+    float _rotation{};
+    /// solid angle of a texel of every row
+    std::vector<float> _row_solid_angle;
+    /// probability of sample() picking every texel
+    std::vector<float> _texel_pmf;
+    /// alias table over the texels (Vose): a uniformly picked slot keeps its texel with its threshold probability
+    /// and gives its alias otherwise
+    std::vector<float> _alias_threshold;
+    std::vector<uint32_t> _alias;
+};
@@ -0,0 +1,400 @@
+#include "ray.tracer.bvh.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cassert>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+
+#include "morton.code.hpp"
+#include "parallel.for.hpp"
+
+namespace {
+
+constexpr uint32_t kLeafRef = 0x80000000u;
+
+/// Internal node of the radix tree, Left/Right have kLeafRef set when they refer to a leaf (a sorted primitive).
+struct RadixTreeNode {
+    uint32_t Left;
+    uint32_t Right;
+    uint32_t First;
+    uint32_t Last;
+};
+
+/// LSD radix sort of (key, value) pairs, 8 bits per pass. Every pass builds per chunk histograms in parallel,
+/// prefix sums them digit major / chunk minor (which keeps the sort stable) and scatters in parallel.
+template <typename Key>
+void parallel_radix_sort(std::vector<Key>& keys, std::vector<uint32_t>& values, const uint32_t key_bits,
+                         const uint32_t threads_count) {
+    constexpr uint32_t kDigitBits = 8;
+    constexpr uint32_t kBuckets = 1u << kDigitBits;
+
+    const size_t items_count = keys.size();
+    const size_t chunks = parallel_chunks_count(threads_count, items_count);
+
+    std::vector<Key> keys_tmp(items_count);
+    std::vector<uint32_t> values_tmp(items_count);
+    std::vector<uint32_t> histograms(chunks * kBuckets);
+
+    for (uint32_t shift = 0; shift < key_bits; shift += kDigitBits) {
+        std::ranges::fill(histograms, 0u);
+
+        parallel_for_chunks(threads_count, items_count, [&](const size_t chunk, const size_t begin, const size_t end) {
+            uint32_t* histogram = &histograms[chunk * kBuckets];
+            for (size_t i = begin; i < end; ++i) {
+                histogram[(keys[i] >> shift) & (kBuckets - 1)] += 1;
+            }
+        });
+
+        uint32_t offset{};
+        for (uint32_t digit = 0; digit < kBuckets; ++digit) {
+            for (size_t chunk = 0; chunk < chunks; ++chunk) {
+                const uint32_t count = histograms[chunk * kBuckets + digit];
+                histograms[chunk * kBuckets + digit] = offset;
+                offset += count;
+            }
+        }
+
+        parallel_for_chunks(threads_count, items_count, [&](const size_t chunk, const size_t begin, const size_t end) {
+            uint32_t* dst_offsets = &histograms[chunk * kBuckets];
+            for (size_t i = begin; i < end; ++i) {
+                const uint32_t dst = dst_offsets[(keys[i] >> shift) & (kBuckets - 1)]++;
+                keys_tmp[dst] = keys[i];
+                values_tmp[dst] = values[i];
+            }
+        });
+
+        keys.swap(keys_tmp);
+        values.swap(values_tmp);
+    }
+}
+
+/// Karras 2012, every internal node is emitted independently from the sorted codes.
+template <typename Key>
+void emit_radix_tree(std::span<const Key> codes, std::vector<RadixTreeNode>& internal_nodes,
+                     std::vector<uint32_t>& internal_parents, std::vector<uint32_t>& leaf_parents,
+                     const uint32_t threads_count) {
+    const int64_t items_count = static_cast<int64_t>(codes.size());
+
+    //
+    // length of the common prefix of codes i and j, duplicate codes are told apart by their index
+    auto delta_fn = [codes, items_count](const int64_t i, const int64_t j) -> int32_t {
+        if (j < 0 || j >= items_count) {
+            return -1;
+        }
+        if (codes[i] == codes[j]) {
+            return static_cast<int32_t>(sizeof(Key) * 8) +
+                   std::countl_zero(static_cast<uint32_t>(i) ^ static_cast<uint32_t>(j));
+        }
+        return std::countl_zero(static_cast<Key>(codes[i] ^ codes[j]));
+    };
+
+    parallel_for_chunks(threads_count, internal_nodes.size(), [&](const size_t, const size_t begin, const size_t end) {
+        for (int64_t i = static_cast<int64_t>(begin); i < static_cast<int64_t>(end); ++i) {
+            const int64_t d = delta_fn(i, i + 1) - delta_fn(i, i - 1) >= 0 ? 1 : -1;
+            const int32_t delta_min = delta_fn(i, i - d);
+
+            int64_t l_max = 2;
+            while (delta_fn(i, i + l_max * d) > delta_min) {
+                l_max *= 2;
+            }
+
+            int64_t l = 0;
+            for (int64_t t = l_max / 2; t >= 1; t /= 2) {
+                if (delta_fn(i, i + (l + t) * d) > delta_min) {
+                    l += t;
+                }
+            }
+
+            const int64_t j = i + l * d;
+            const int32_t delta_node = delta_fn(i, j);
+
+            int64_t s = 0;
+            for (int64_t div = 2, t = 0;; div *= 2) {
+                t = (l + div - 1) / div;
+                if (delta_fn(i, i + (s + t) * d) > delta_node) {
+                    s += t;
+                }
+                if (t <= 1) {
+                    break;
+                }
+            }
+
+            const int64_t gamma = i + s * d + std::min<int64_t>(d, 0);
+            const uint32_t first = static_cast<uint32_t>(std::min(i, j));
+            const uint32_t last = static_cast<uint32_t>(std::max(i, j));
+            const uint32_t left = static_cast<uint32_t>(gamma);
+            const uint32_t right = static_cast<uint32_t>(gamma + 1);
+
+            internal_nodes[i] = RadixTreeNode{
+                .Left = first == left ? (left | kLeafRef) : left,
+                .Right = last == right ? (right | kLeafRef) : right,
+                .First = first,
+                .Last = last,
+            };
+
+            (first == left ? leaf_parents[left] : internal_parents[left]) = static_cast<uint32_t>(i);
+            (last == right ? leaf_parents[right] : internal_parents[right]) = static_cast<uint32_t>(i);
+        }
+    });
+}
+
+template <typename Key>
+void sort_primitives(std::span<const glm::vec3> centroids, const BoundingBox& centroid_bounds,
+                     std::vector<uint32_t>& prim_order, std::vector<RadixTreeNode>& internal_nodes,
+                     std::vector<uint32_t>& internal_parents, std::vector<uint32_t>& leaf_parents,
+                     const uint32_t key_bits, const uint32_t threads_count) {
+    const glm::vec3 extent = centroid_bounds.extent();
+    const glm::vec3 inv_extent{extent.x > 0.0f ? 1.0f / extent.x : 0.0f, extent.y > 0.0f ? 1.0f / extent.y : 0.0f,
+                               extent.z > 0.0f ? 1.0f / extent.z : 0.0f};
+
+    std::vector<Key> codes(centroids.size());
+    parallel_for_chunks(threads_count, centroids.size(), [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            codes[i] = morton_code<Key>((centroids[i] - centroid_bounds.Min) * inv_extent);
+        }
+    });
+
+    parallel_radix_sort(codes, prim_order, key_bits, threads_count);
+    emit_radix_tree<Key>(codes, internal_nodes, internal_parents, leaf_parents, threads_count);
+}
+
+} // namespace
+
+void BoundingVolumeHierarchy::build_linear(std::span<const BoundingBox> prim_bounds, std::vector<uint32_t>& prim_order,
+                                           const LbvhBuildParams& params) {
+    const uint32_t prims_count = static_cast<uint32_t>(prim_bounds.size());
+    const uint32_t threads_count = std::max(params.ThreadsCount, 1u);
+
+    _nodes.clear();
+    prim_order.resize(prims_count);
+    std::iota(prim_order.begin(), prim_order.end(), 0u);
+
+    if (prims_count == 0) {
+        return;
+    }
+
+    if (prims_count == 1) {
+        _nodes.push_back(BvhNode{prim_bounds[0].Min, 0, prim_bounds[0].Max, 1});
+        return;
+    }
+
+    std::vector<glm::vec3> centroids(prims_count);
+    std::vector<BoundingBox> chunk_bounds(parallel_chunks_count(threads_count, prims_count));
+    parallel_for_chunks(threads_count, prims_count, [&](const size_t chunk, const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            centroids[i] = prim_bounds[i].centroid();
+            chunk_bounds[chunk].grow(centroids[i]);
+        }
+    });
+
+    BoundingBox centroid_bounds;
+    for (const BoundingBox& b : chunk_bounds) {
+        centroid_bounds.grow(b);
+    }
+
+    std::vector<RadixTreeNode> internal_nodes(prims_count - 1);
+    std::vector<uint32_t> internal_parents(prims_count - 1);
+    std::vector<uint32_t> leaf_parents(prims_count);
+
+    if (params.MortonBits > 30) {
+        sort_primitives<uint64_t>(centroids, centroid_bounds, prim_order, internal_nodes, internal_parents,
+                                  leaf_parents, 63, threads_count);
+    } else {
+        sort_primitives<uint32_t>(centroids, centroid_bounds, prim_order, internal_nodes, internal_parents,
+                                  leaf_parents, 30, threads_count);
+    }
+
+    //
+    // bounds bottom up, the second thread to reach a node merges its children and keeps going
+    std::vector<BoundingBox> internal_bounds(prims_count - 1);
+    std::vector<std::atomic<uint32_t>> visits(prims_count - 1);
+
+    auto child_bounds_fn = [&](const uint32_t ref) -> const BoundingBox& {
+        return (ref & kLeafRef) ? prim_bounds[prim_order[ref & ~kLeafRef]] : internal_bounds[ref];
+    };
+
+    parallel_for_chunks(threads_count, prims_count, [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t leaf = begin; leaf < end; ++leaf) {
+            for (uint32_t node = leaf_parents[leaf];; node = internal_parents[node]) {
+                if (visits[node].fetch_add(1, std::memory_order_acq_rel) == 0) {
+                    break;
+                }
+
+                BoundingBox b = child_bounds_fn(internal_nodes[node].Left);
+                b.grow(child_bounds_fn(internal_nodes[node].Right));
+                internal_bounds[node] = b;
+
+                if (node == 0) {
+                    break;
+                }
+            }
+        }
+    });
+
+    //
+    // depth first into the pair layout, collapsing small subtrees into leaves (their primitives are contiguous)
+    struct EmitTask {
+        uint32_t Ref;
+        uint32_t Slot;
+        uint32_t Depth;
+    };
+
+    _nodes.resize(1);
+    _nodes.reserve(2 * prims_count - 1);
+    std::vector<EmitTask> tasks{EmitTask{.Ref = 0, .Slot = 0, .Depth = 0}};
+
+    while (!tasks.empty()) {
+        const EmitTask task = tasks.back();
+        tasks.pop_back();
+
+        if (task.Ref & kLeafRef) {
+            const uint32_t leaf = task.Ref & ~kLeafRef;
+            const BoundingBox& b = prim_bounds[prim_order[leaf]];
+            _nodes[task.Slot] = BvhNode{b.Min, leaf, b.Max, 1};
+            continue;
+        }
+
+        const RadixTreeNode& radix_node = internal_nodes[task.Ref];
+        const BoundingBox& b = internal_bounds[task.Ref];
+        const uint32_t count = radix_node.Last - radix_node.First + 1;
+
+        if (count <= params.MaxLeafSize || task.Depth + 1 >= kMaxTraversalDepth) {
+            _nodes[task.Slot] = BvhNode{b.Min, radix_node.First, b.Max, count};
+            continue;
+        }
+
+        const uint32_t left_slot = static_cast<uint32_t>(_nodes.size());
+        _nodes.resize(_nodes.size() + 2);
+        _nodes[task.Slot] = BvhNode{b.Min, left_slot, b.Max, 0};
+
+        tasks.push_back(EmitTask{.Ref = radix_node.Right, .Slot = left_slot + 1, .Depth = task.Depth + 1});
+        tasks.push_back(EmitTask{.Ref = radix_node.Left, .Slot = left_slot, .Depth = task.Depth + 1});
+    }
+
+    _nodes.shrink_to_fit();
+
+    if (params.TreeletRotations) {
+        rotate_treelets(threads_count);
+    }
+}
+
+void BoundingVolumeHierarchy::rotate_subtree(const uint32_t subtree_root, const uint32_t root_depth,
+                                             const uint32_t pass_depth, std::span<uint32_t> heights) {
+    struct Visit {
+        uint32_t Node;
+        uint32_t Depth;
+    };
+
+    std::vector<Visit> pre_order{};
+    std::vector<Visit> stack{Visit{.Node = subtree_root, .Depth = 0}};
+    while (!stack.empty()) {
+        const Visit v = stack.back();
+        stack.pop_back();
+
+        if (_nodes[v.Node].is_leaf() || v.Depth >= pass_depth) {
+            continue;
+        }
+
+        pre_order.push_back(v);
+        stack.push_back(Visit{.Node = _nodes[v.Node].LeftFirst, .Depth = v.Depth + 1});
+        stack.push_back(Visit{.Node = _nodes[v.Node].LeftFirst + 1, .Depth = v.Depth + 1});
+    }
+
+    //
+    // children before parents, every node tries to swap one child with one of its grandchildren
+    // (under the other child), keeps the swap that shrinks the other child the most. The child goes one level
+    // down with its whole subtree, its deepest leaf must stay above kMaxTraversalDepth.
+    for (auto itr = pre_order.rbegin(); itr != pre_order.rend(); ++itr) {
+        const uint32_t first_child = _nodes[itr->Node].LeftFirst;
+        const uint32_t depth = root_depth + itr->Depth;
+
+        float best_gain{};
+        uint32_t best_child{};
+        uint32_t best_grandchild{};
+        uint32_t best_other{};
+
+        for (uint32_t side = 0; side < 2; ++side) {
+            const uint32_t child = first_child + side;
+            const uint32_t other = first_child + (1 - side);
+            if (_nodes[other].is_leaf() || depth + 2 + heights[child] >= kMaxTraversalDepth) {
+                continue;
+            }
+
+            const float other_area = _nodes[other].bounds().surface_area();
+            for (uint32_t grand_side = 0; grand_side < 2; ++grand_side) {
+                const uint32_t grandchild = _nodes[other].LeftFirst + grand_side;
+                const uint32_t kept_grandchild = _nodes[other].LeftFirst + (1 - grand_side);
+
+                BoundingBox rotated_other = _nodes[child].bounds();
+                rotated_other.grow(_nodes[kept_grandchild].bounds());
+
+                if (const float gain = other_area - rotated_other.surface_area(); gain > best_gain) {
+                    best_gain = gain;
+                    best_child = child;
+                    best_grandchild = grandchild;
+                    best_other = other;
+                }
+            }
+        }
+
+        if (best_gain > 0.0f) {
+            std::swap(_nodes[best_child], _nodes[best_grandchild]);
+            std::swap(heights[best_child], heights[best_grandchild]);
+
+            BvhNode& other = _nodes[best_other];
+            BoundingBox other_bounds = _nodes[other.LeftFirst].bounds();
+            other_bounds.grow(_nodes[other.LeftFirst + 1].bounds());
+            other.BoundsMin = other_bounds.Min;
+            other.BoundsMax = other_bounds.Max;
+            heights[best_other] = 1 + std::max(heights[other.LeftFirst], heights[other.LeftFirst + 1]);
+        }
+
+        heights[itr->Node] = 1 + std::max(heights[first_child], heights[first_child + 1]);
+    }
+}
+
+void BoundingVolumeHierarchy::rotate_treelets(const uint32_t threads_count) {
+    //
+    // subtrees below the split depth are independent, rotate them in parallel, then the top of the tree
+    const uint32_t split_depth = std::bit_width(threads_count) + 2;
+
+    //
+    // the emit pass puts the children after their parent
+    std::vector<uint32_t> heights(_nodes.size(), 0);
+    for (size_t node = _nodes.size(); node-- > 0;) {
+        if (!_nodes[node].is_leaf()) {
+            heights[node] = 1 + std::max(heights[_nodes[node].LeftFirst], heights[_nodes[node].LeftFirst + 1]);
+        }
+    }
+
+    std::vector<uint32_t> subtree_roots{};
+    std::vector<std::pair<uint32_t, uint32_t>> stack{{0u, 0u}};
+    while (!stack.empty()) {
+        const auto [node, depth] = stack.back();
+        stack.pop_back();
+
+        if (_nodes[node].is_leaf()) {
+            continue;
+        }
+
+        if (depth == split_depth) {
+            subtree_roots.push_back(node);
+            continue;
+        }
+
+        stack.emplace_back(_nodes[node].LeftFirst, depth + 1);
+        stack.emplace_back(_nodes[node].LeftFirst + 1, depth + 1);
+    }
+
+    parallel_for_chunks(threads_count, subtree_roots.size(), [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            rotate_subtree(subtree_roots[i], split_depth, std::numeric_limits<uint32_t>::max(), heights);
+        }
+    });
+
+    rotate_subtree(0, 0, split_depth, heights);
+    assert(max_leaf_depth() < kMaxTraversalDepth);
+}
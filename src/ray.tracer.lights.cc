@@ -0,0 +1,239 @@
+#include "ray.tracer.lights.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <numbers>
+#include <numeric>
+
+#include <glm/geometric.hpp>
+
+#include "color.hpp"
+#include "random.number.gen.hpp"
+#include "ray.tracer.material.defs.hpp"
+#include "ray.tracer.object.defs.hpp"
+
+namespace {
+
+/// largest float below 1, the random numbers rescaled on the way down the tree stay in [0, 1)
+constexpr float kOneMinusEpsilon = 0x1.fffffep-1f;
+
+BoundingBox sphere_bounds(const SphereLight& light) noexcept {
+    const glm::vec3 r{light.Radius};
+    return BoundingBox{light.Center - r, light.Center + r};
+}
+
+/// How much lights of the given power inside bounds are worth to p. A point close to the center of the bounds would
+/// get an unbounded weight, so the distance is at least half of the half diagonal: a larger floor flattens the
+/// weights of the big nodes near the root and the tree picks the far lights almost as often as the near ones.
+float importance(const BoundingBox& bounds, const float power, const glm::vec3& p) noexcept {
+    const glm::vec3 to_center = bounds.centroid() - p;
+    const glm::vec3 half_extent = bounds.extent() * 0.5f;
+    return power / std::max(glm::dot(to_center, to_center), 0.25f * glm::dot(half_extent, half_extent));
+}
+
+/// 1 - cos of the half angle of the cone the sphere covers seen from a point at squared distance distance2 from its
+/// center, without the cancellation of the small (far away) cones.
+float cone_one_minus_cos(const SphereLight& light, const float distance2) noexcept {
+    const float sin_max2 = light.Radius * light.Radius / distance2;
+    const float cos_max = std::sqrt(std::max(0.0f, 1.0f - sin_max2));
+    return sin_max2 / (1.0f + cos_max);
+}
+
+} // namespace
+
+LightCollection LightCollection::build(const HittableObject_Collection& world, const MaterialCollection& materials) {
+    LightCollection lights{};
+    lights._light_of_object.assign(world.size(), kNoLight);
+
+    for (uint32_t object_id = 0; object_id < world.size(); ++object_id) {
+        const HittableObject& obj = world.object(object_id);
+        if (obj.ObjKind != HittableObjectKind::Sphere ||
+            materials.kind(obj.Sphere.Material) != MaterialKind::Emissive) {
+            continue;
+        }
+
+        const glm::vec3 emission = materials.emission(obj.Sphere.Material);
+        const float area = 4.0f * std::numbers::pi_v<float> * obj.Sphere.Radius * obj.Sphere.Radius;
+        const float power = luminance(emission) * area * std::numbers::pi_v<float>;
+        if (!(power > 0.0f)) {
+            continue;
+        }
+
+        lights._light_of_object[object_id] = static_cast<uint32_t>(lights._lights.size());
+        lights._lights.push_back(SphereLight{
+            .Center = obj.Sphere.Center,
+            .Radius = obj.Sphere.Radius,
+            .Emission = emission,
+            .Power = power,
+            .ObjectId = object_id,
+        });
+    }
+
+    if (!lights._lights.empty()) {
+        std::vector<uint32_t> order(lights._lights.size());
+        std::iota(order.begin(), order.end(), 0u);
+        lights._nodes.reserve(2 * order.size() - 1);
+        lights._leaf_of_light.resize(order.size());
+        lights.build_node(order, kNoLight);
+    }
+
+    return lights;
+}
+
+uint32_t LightCollection::build_node(std::span<uint32_t> lights, const uint32_t parent) {
+    const uint32_t node = static_cast<uint32_t>(_nodes.size());
+    _nodes.push_back(Node{.Bounds = {}, .Power = 0.0f, .RightChild = 0, .Light = kNoLight, .Parent = parent});
+
+    if (lights.size() == 1) {
+        const SphereLight& light = _lights[lights.front()];
+        _nodes[node].Bounds = sphere_bounds(light);
+        _nodes[node].Power = light.Power;
+        _nodes[node].Light = lights.front();
+        _leaf_of_light[lights.front()] = node;
+        return node;
+    }
+
+    //
+    // median split of the centers along the axis they spread the most on
+    BoundingBox center_bounds{};
+    for (const uint32_t light : lights) {
+        center_bounds.grow(_lights[light].Center);
+    }
+    const uint32_t axis = center_bounds.largest_axis();
+    const size_t half = lights.size() / 2;
+    std::ranges::nth_element(lights, lights.begin() + static_cast<ptrdiff_t>(half),
+                             [this, axis](const uint32_t a, const uint32_t b) {
+                                 return _lights[a].Center[axis] < _lights[b].Center[axis];
+                             });
+
+    const uint32_t left = build_node(lights.first(half), node);
+    const uint32_t right = build_node(lights.subspan(half), node);
+    assert(left == node + 1);
+
+    BoundingBox bounds = _nodes[left].Bounds;
+    bounds.grow(_nodes[right].Bounds);
+    _nodes[node].Bounds = bounds;
+    _nodes[node].Power = _nodes[left].Power + _nodes[right].Power;
+    _nodes[node].RightChild = right;
+    return node;
+}
+
+tl::optional<LightSample> LightCollection::sample(const glm::vec3& p, RandomNumberGenerator& randgen) const noexcept {
+    if (_nodes.empty()) {
+        return tl::nullopt;
+    }
+
+    //
+    // one random number picks the whole path down the tree, rescaled to [0, 1) after every choice
+    float u = static_cast<float>(randgen.random_double());
+    float pick_pmf = 1.0f;
+    uint32_t node = 0;
+    while (_nodes[node].Light == kNoLight) {
+        const float left_probability = this->left_probability(node, p);
+        if (u < left_probability) {
+            u /= left_probability;
+            pick_pmf *= left_probability;
+            node = node + 1;
+        } else {
+            u = (u - left_probability) / (1.0f - left_probability);
+            pick_pmf *= 1.0f - left_probability;
+            node = _nodes[node].RightChild;
+        }
+        u = std::min(u, kOneMinusEpsilon);
+    }
+
+    return sample_light(_nodes[node].Light, pick_pmf, p, randgen);
+}
+
+float LightCollection::pdf(const glm::vec3& p, const uint32_t light) const noexcept {
+    assert(light < _lights.size());
+    const SphereLight& sphere = _lights[light];
+    const glm::vec3 to_center = sphere.Center - p;
+    const float distance2 = glm::dot(to_center, to_center);
+    if (distance2 <= sphere.Radius * sphere.Radius) {
+        return 0.0f;
+    }
+
+    //
+    // the choices sample() makes on the way down to the leaf, from the bottom up
+    float pick_pmf = 1.0f;
+    for (uint32_t node = _leaf_of_light[light]; _nodes[node].Parent != kNoLight; node = _nodes[node].Parent) {
+        const uint32_t parent = _nodes[node].Parent;
+        const float left_probability = this->left_probability(parent, p);
+        pick_pmf *= _nodes[parent].RightChild == node ? 1.0f - left_probability : left_probability;
+    }
+
+    return pick_pmf / (2.0f * std::numbers::pi_v<float> * cone_one_minus_cos(sphere, distance2));
+}
+
+float LightCollection::left_probability(const uint32_t node, const glm::vec3& p) const noexcept {
+    const Node& left = _nodes[node + 1];
+    const Node& right = _nodes[_nodes[node].RightChild];
+    const float left_importance = importance(left.Bounds, left.Power, p);
+    const float right_importance = importance(right.Bounds, right.Power, p);
+    const float total = left_importance + right_importance;
+    return total > 0.0f ? left_importance / total : 0.5f;
+}
+
+tl::optional<LightSample> LightCollection::sample_linear(const glm::vec3& p,
+                                                         RandomNumberGenerator& randgen) const noexcept {
+    float total{};
+    for (const SphereLight& light : _lights) {
+        total += importance(sphere_bounds(light), light.Power, p);
+    }
+    if (!(total > 0.0f)) {
+        return tl::nullopt;
+    }
+
+    const float u = static_cast<float>(randgen.random_double()) * total;
+    float running{};
+    for (uint32_t light = 0; light < _lights.size(); ++light) {
+        const float light_importance = importance(sphere_bounds(_lights[light]), _lights[light].Power, p);
+        running += light_importance;
+        if (u < running || light + 1 == _lights.size()) {
+            return sample_light(light, light_importance / total, p, randgen);
+        }
+    }
+
+    return tl::nullopt;
+}
+
+tl::optional<LightSample> LightCollection::sample_light(const uint32_t light, const float pick_pmf, const glm::vec3& p,
+                                                        RandomNumberGenerator& randgen) const noexcept {
+    const SphereLight& sphere = _lights[light];
+    const glm::vec3 to_center = sphere.Center - p;
+    const float distance2 = glm::dot(to_center, to_center);
+    const float radius2 = sphere.Radius * sphere.Radius;
+    if (distance2 <= radius2 || !(pick_pmf > 0.0f)) {
+        return tl::nullopt;
+    }
+
+    //
+    // uniform in the cone the sphere covers
+    const float distance = std::sqrt(distance2);
+    const float one_minus_cos_max = cone_one_minus_cos(sphere, distance2);
+
+    const float one_minus_cos = static_cast<float>(randgen.random_double()) * one_minus_cos_max;
+    const float cos_theta = 1.0f - one_minus_cos;
+    const float sin_theta2 = std::max(0.0f, one_minus_cos * (2.0f - one_minus_cos));
+    const float sin_theta = std::sqrt(sin_theta2);
+    const float phi = 2.0f * std::numbers::pi_v<float> * static_cast<float>(randgen.random_double());
+
+    const glm::vec3 w = to_center / distance;
+    const glm::vec3 helper = std::abs(w.x) > 0.9f ? glm::vec3{0.0f, 1.0f, 0.0f} : glm::vec3{1.0f, 0.0f, 0.0f};
+    const glm::vec3 u = glm::normalize(glm::cross(helper, w));
+    const glm::vec3 v = glm::cross(w, u);
+    const glm::vec3 dir = (sin_theta * std::cos(phi)) * u + (sin_theta * std::sin(phi)) * v + cos_theta * w;
+
+    //
+    // near intersection of dir with the sphere
+    const float t = distance * cos_theta - std::sqrt(std::max(0.0f, radius2 - distance2 * sin_theta2));
+
+    return LightSample{
+        .P = p + t * dir,
+        .Emission = sphere.Emission,
+        .Pdf = pick_pmf / (2.0f * std::numbers::pi_v<float> * one_minus_cos_max),
+        .Light = light,
+    };
+}
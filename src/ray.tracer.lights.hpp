@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <tl/optional.hpp>
+
+#include "bounding.box.hpp"
+
+class HittableObject_Collection;
+class MaterialCollection;
+class RandomNumberGenerator;
+
+/// Emissive sphere of the world.
+struct SphereLight {
+    glm::vec3 Center;
+    float Radius;
+    glm::vec3 Emission;
+    /// emitted power (luminance of the emission times area times pi), what the light tree picks the lights by
+    float Power;
+    /// of the sphere in the world
+    uint32_t ObjectId;
+};
+
+/// Point on a light picked for a shading point.
+struct LightSample {
+    glm::vec3 P;
+    glm::vec3 Emission;
+    /// per unit of solid angle seen from the shading point, the probability of picking the light included
+    float Pdf;
+    uint32_t Light;
+};
+
+/// The emissive spheres of the world and a light tree over them (a BVH of the lights, every node keeps the power of
+/// the lights below it) to pick one for a shading point in time logarithmic in the number of lights. Built from the
+/// world like the acceleration structure. The lights are copies of the spheres: whoever edits the world builds them
+/// again, for a scene snapshot that is SceneSnapshot::refit().
+class LightCollection {
+public:
+    static constexpr uint32_t kNoLight = ~0u;
+
+    struct Node {
+        BoundingBox Bounds;
+        float Power;
+        /// second child of an interior node, the first one is the next node
+        uint32_t RightChild;
+        /// light of a leaf, kNoLight for an interior node
+        uint32_t Light;
+        /// kNoLight for the root
+        uint32_t Parent;
+    };
+
+    /// The top level emissive spheres of world. The ones inside instances are not lights, only the paths that hit them
+    /// see their emission.
+    static LightCollection build(const HittableObject_Collection& world, const MaterialCollection& materials);
+
+    bool empty() const noexcept { return _lights.empty(); }
+    size_t size() const noexcept { return _lights.size(); }
+    std::span<const SphereLight> lights() const noexcept { return _lights; }
+    std::span<const Node> nodes() const noexcept { return _nodes; }
+
+    /// Light of an object id of the world, kNoLight for the objects that are not lights.
+    uint32_t light_of_object(const uint32_t object_id) const noexcept {
+        return object_id < _light_of_object.size() ? _light_of_object[object_id] : kNoLight;
+    }
+
+    /// Picks a light for the shading point p, walking down the tree with every child picked in proportion to its
+    /// importance (power over squared distance to p), then a point of the light uniformly in the cone of directions
+    /// it covers seen from p. Nothing when there are no lights or p is inside the light picked.
+    tl::optional<LightSample> sample(const glm::vec3& p, RandomNumberGenerator& randgen) const noexcept;
+    /// Same as sample() with the importance of every light computed, linear in the number of lights: the reference
+    /// for the tree.
+    tl::optional<LightSample> sample_linear(const glm::vec3& p, RandomNumberGenerator& randgen) const noexcept;
+    /// Per unit of solid angle seen from p, the PDF of sample() picking a point of the light that lies in the
+    /// direction of it: what a direction found by other means (a scattered ray hitting the light) weighs against the
+    /// light samples. Walks up the tree from the leaf of the light.
+    float pdf(const glm::vec3& p, const uint32_t light) const noexcept;
+
+private:
+    /// Builds the subtree of lights (indices into _lights), returns its root.
+    uint32_t build_node(std::span<uint32_t> lights, const uint32_t parent);
+    /// Probability of sample() going down to the first child of the interior node, seen from p.
+    float left_probability(const uint32_t node, const glm::vec3& p) const noexcept;
+    tl::optional<LightSample> sample_light(const uint32_t light, const float pick_pmf, const glm::vec3& p,
+                                           RandomNumberGenerator& randgen) const noexcept;
+
+    std::vector<SphereLight> _lights;
+    std::vector<Node> _nodes;
+    /// indexed by the light
+    std::vector<uint32_t> _leaf_of_light;
+    /// indexed by the object id
+    std::vector<uint32_t> _light_of_object;
+};
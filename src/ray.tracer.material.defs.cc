@@ -1,105 +1,219 @@
 #include "ray.tracer.material.defs.hpp"
 
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
 #include <glm/vec3.hpp>
 
 #include "random.number.gen.hpp"
 #include "ray.tracer.math.hpp"
 #include "ray.tracer.object.defs.hpp"
-
-typedef tl::optional<ScatterRecord> (*ScatterFuncType)(const void*, const Ray& ray_in,
-                                                       const IntersectionRecord& int_rec,
-                                                       RandomNumberGenerator& randgen) noexcept;
+#include "ray.tracer.texture.hpp"
 
 template <typename T>
 concept ScatteringMaterial = requires(const T& mtl, RandomNumberGenerator& randgen) {
     {
-        mtl.scatter(std::declval<Ray>(), std::declval<IntersectionRecord>(), randgen)
+        mtl.scatter(std::declval<Ray>(), std::declval<IntersectionRecord>(), randgen, MathAccuracy::Exact)
     } noexcept -> std::same_as<tl::optional<ScatterRecord>>;
+    {
+        mtl.eval(std::declval<Ray>(), std::declval<IntersectionRecord>(), glm::vec3{})
+    } noexcept -> std::same_as<glm::vec3>;
+    {
+        mtl.pdf(std::declval<Ray>(), std::declval<IntersectionRecord>(), glm::vec3{})
+    } noexcept -> std::same_as<float>;
 };
 
-template <typename S>
-    requires ScatteringMaterial<S>
-tl::optional<ScatterRecord> scatter_dispatch_func(const void* obj, const Ray& ray_in, const IntersectionRecord& int_rec,
-                                                  RandomNumberGenerator& randgen) noexcept {
-    return static_cast<const S*>(obj)->scatter(ray_in, int_rec, randgen);
+namespace {
+
+/// Albedo at the hit, the texture is read at the mip level of the footprint of the cone of the ray there.
+glm::vec3 albedo_at(const glm::vec3& albedo, const TiledTexture* albedo_texture, const glm::vec2 uv,
+                    const float uv_scale, const RayCone& hit_cone, const glm::vec3& ray_dir,
+                    const glm::vec3& normal) noexcept {
+    if (!albedo_texture) {
+        return albedo;
+    }
+
+    const float cos_theta = glm::dot(ray_dir, normal) / glm::length(ray_dir);
+    return albedo * albedo_texture->sample(uv, albedo_texture->lod(hit_cone.uv_footprint(uv_scale, cos_theta)));
 }
 
-constexpr ScatterFuncType kFuncDispatchTable[static_cast<uint32_t>(MaterialKind::Count)] = {
-    &scatter_dispatch_func<Material_Lambertian>,
-};
+/// Cone of a metallic reflection: a mirror reflection widened by the fuzz, a fuzziness of 1 spreads about as much as
+/// a diffuse bounce.
+RayCone fuzzy_reflected_cone(const RayCone& hit_cone, const float curvature, const float fuzziness) noexcept {
+    const RayCone reflected = hit_cone.reflected(curvature);
+    return RayCone{
+        .Width = reflected.Width,
+        .SpreadAngle = reflected.SpreadAngle + fuzziness * RayCone::kDiffuseSpreadAngle,
+    };
+}
+
+/// PDF of the cosine distributed directions around the normal the Lambertian materials scatter to.
+float cosine_pdf(const glm::vec3& normal, const glm::vec3& dir) noexcept {
+    return std::max(0.0f, glm::dot(normal, dir)) * std::numbers::inv_pi_v<float>;
+}
+
+/// PDF of the directions of a metallic scatter: toward reflected (unit) plus a uniform point of the sphere of radius
+/// fuzziness, all the directions of the cone that sphere covers. The line t * dir crosses the sphere at t = b -+ root,
+/// both crossings add the density of the points of the sphere (1 / its area) times t^2 over the cosine with its
+/// normal (root / fuzziness). A fuzziness of 1 gives a cosine lobe around reflected, 0 a mirror (no PDF).
+float fuzzy_reflection_pdf(const glm::vec3& reflected, const float fuzziness, const glm::vec3& dir) noexcept {
+    const float b = glm::dot(dir, reflected);
+    const float discriminant = b * b - (1.0f - fuzziness * fuzziness);
+    if (!(fuzziness > 0.0f) || !(discriminant > 0.0f) || b <= 0.0f) {
+        return 0.0f;
+    }
+
+    const float root = std::sqrt(discriminant);
+    const float t_near = std::max(0.0f, b - root);
+    const float t_far = b + root;
+    return (t_near * t_near + t_far * t_far) / (4.0f * std::numbers::pi_v<float> * fuzziness * root);
+}
+
+} // namespace
 
 tl::optional<ScatterRecord> Material_Lambertian::scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
-                                                         RandomNumberGenerator& randgen) const noexcept {
-    glm::vec3 scatter_dir = int_rec.Normal + randgen.random_unit_vector();
+                                                         RandomNumberGenerator& randgen,
+                                                         const MathAccuracy accuracy) const noexcept {
+    glm::vec3 scatter_dir = int_rec.Normal + randgen.random_unit_vector(accuracy);
     if (near_zero(scatter_dir)) {
         scatter_dir = int_rec.Normal;
     }
 
+    const RayCone hit_cone = int_rec.cone(ray_in);
     return ScatterRecord{
-        .Attenuation = Albedo,
-        .ScatteredRay = Ray{int_rec.P, scatter_dir},
+        .Attenuation =
+            albedo_at(Albedo, AlbedoTexture, int_rec.UV, int_rec.UVScale, hit_cone, ray_in.Direction, int_rec.Normal),
+        .ScatteredRay = Ray{offset_ray_origin<RenderPrecision>(int_rec.P, int_rec.Normal, scatter_dir), scatter_dir,
+                            hit_cone.diffuse()},
+        .Pdf = cosine_pdf(int_rec.Normal, glm::normalize(scatter_dir)),
     };
 }
 
+glm::vec3 Material_Lambertian::eval(const Ray& ray_in, const IntersectionRecord& int_rec,
+                                    const glm::vec3& dir) const noexcept {
+    const float pdf = cosine_pdf(int_rec.Normal, dir);
+    if (pdf == 0.0f) {
+        return glm::vec3{0.0f};
+    }
+    return pdf * albedo_at(Albedo, AlbedoTexture, int_rec.UV, int_rec.UVScale, int_rec.cone(ray_in),
+                           ray_in.Direction, int_rec.Normal);
+}
+
+float Material_Lambertian::pdf(const Ray&, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept {
+    return cosine_pdf(int_rec.Normal, dir);
+}
+
 tl::optional<ScatterRecord> Material_Metallic::scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
-                                                       RandomNumberGenerator& randgen) const noexcept {
-    glm::vec3 reflected = glm::reflect(ray_in.Direction, int_rec.Normal);
-    reflected = glm::normalize(reflected) + Fuzziness * randgen.random_unit_vector();
+                                                       RandomNumberGenerator& randgen,
+                                                       const MathAccuracy accuracy) const noexcept {
+    const glm::vec3 mirror_dir = math_normalize(glm::reflect(ray_in.Direction, int_rec.Normal), accuracy);
+    const glm::vec3 reflected = mirror_dir + Fuzziness * randgen.random_unit_vector(accuracy);
     if (glm::dot(reflected, int_rec.Normal) > 0.0f) {
+        const RayCone hit_cone = int_rec.cone(ray_in);
         return ScatterRecord{
-            .Attenuation = Albedo,
-            .ScatteredRay = Ray{int_rec.P, reflected},
+            .Attenuation = albedo_at(Albedo, AlbedoTexture, int_rec.UV, int_rec.UVScale, hit_cone, ray_in.Direction,
+                                     int_rec.Normal),
+            .ScatteredRay = Ray{offset_ray_origin<RenderPrecision>(int_rec.P, int_rec.Normal, reflected), reflected,
+                                fuzzy_reflected_cone(hit_cone, int_rec.Curvature, Fuzziness)},
+            .Pdf = fuzzy_reflection_pdf(mirror_dir, Fuzziness, glm::normalize(reflected)),
         };
     }
     return tl::nullopt;
 }
 
+glm::vec3 Material_Metallic::eval(const Ray& ray_in, const IntersectionRecord& int_rec,
+                                  const glm::vec3& dir) const noexcept {
+    //
+    // the directions below the surface are absorbed
+    const float pdf = glm::dot(dir, int_rec.Normal) > 0.0f ? this->pdf(ray_in, int_rec, dir) : 0.0f;
+    if (pdf == 0.0f) {
+        return glm::vec3{0.0f};
+    }
+    return pdf * albedo_at(Albedo, AlbedoTexture, int_rec.UV, int_rec.UVScale, int_rec.cone(ray_in),
+                           ray_in.Direction, int_rec.Normal);
+}
+
+float Material_Metallic::pdf(const Ray& ray_in, const IntersectionRecord& int_rec,
+                             const glm::vec3& dir) const noexcept {
+    return fuzzy_reflection_pdf(glm::normalize(glm::reflect(ray_in.Direction, int_rec.Normal)), Fuzziness, dir);
+}
+
 tl::optional<ScatterRecord> Material_Dielectric::scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
-                                                         RandomNumberGenerator& randgen) const noexcept {
+                                                         RandomNumberGenerator& randgen,
+                                                         const MathAccuracy accuracy) const noexcept {
     const float eta = int_rec.FrontFace ? (1.0f / RefractionIndex) : RefractionIndex;
-    const glm::vec3 unit_dir = glm::normalize(ray_in.Direction);
+    const glm::vec3 unit_dir = math_normalize(ray_in.Direction, accuracy);
     const float cos_theta = std::fmin(glm::dot(-unit_dir, int_rec.Normal), 1.0f);
-    const float sin_theta = std::sqrtf(1.0f - cos_theta * cos_theta);
+    const float sin_theta = math_sqrt(1.0f - cos_theta * cos_theta, accuracy);
 
-    auto schlick_reflectance_fn = [](const float cosine, const float refaction_index) noexcept {
+    auto schlick_reflectance_fn = [accuracy](const float cosine, const float refaction_index) noexcept {
         const float r0 = (1.0f - refaction_index) / (1.0f + refaction_index);
         const float r1 = r0 * r0;
 
-        return r1 + (1.0f - r1) * std::powf((1.0f - cosine), 5.0f);
+        return r1 + (1.0f - r1) * math_pow5(1.0f - cosine, accuracy);
     };
 
+    const RayCone hit_cone = int_rec.cone(ray_in);
     glm::vec3 scatter_dir;
+    RayCone scatter_cone;
     if (const bool cannot_refract = (eta * sin_theta) > 1.0f;
         cannot_refract || schlick_reflectance_fn(cos_theta, eta) > randgen.random_double()) {
         scatter_dir = glm::reflect(unit_dir, int_rec.Normal);
+        scatter_cone = hit_cone.reflected(int_rec.Curvature);
     } else {
-        scatter_dir = glm::refract(unit_dir, int_rec.Normal, eta);
+        scatter_dir = math_refract(unit_dir, int_rec.Normal, eta, accuracy);
+        scatter_cone = hit_cone.refracted(int_rec.Curvature, eta);
     }
 
     return ScatterRecord{
         .Attenuation = glm::vec3{1.0f},
         .ScatteredRay =
             Ray{
-                .Origin = int_rec.P,
+                .Origin = offset_ray_origin<RenderPrecision>(int_rec.P, int_rec.Normal, scatter_dir),
                 .Direction = scatter_dir,
+                .Cone = scatter_cone,
             },
+        .Pdf = 0.0f,
     };
 }
 
+glm::vec3 Material_Dielectric::eval(const Ray&, const IntersectionRecord&, const glm::vec3&) const noexcept {
+    return glm::vec3{0.0f};
+}
+
+float Material_Dielectric::pdf(const Ray&, const IntersectionRecord&, const glm::vec3&) const noexcept { return 0.0f; }
+
+tl::optional<ScatterRecord> Material_Emissive::scatter(const Ray&, const IntersectionRecord&, RandomNumberGenerator&,
+                                                       const MathAccuracy) const noexcept {
+    return tl::nullopt;
+}
+
+glm::vec3 Material_Emissive::eval(const Ray&, const IntersectionRecord&, const glm::vec3&) const noexcept {
+    return glm::vec3{0.0f};
+}
+
+float Material_Emissive::pdf(const Ray&, const IntersectionRecord&, const glm::vec3&) const noexcept { return 0.0f; }
+
 tl::optional<ScatterRecord> Material::scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
-                                              RandomNumberGenerator& randgen) const noexcept {
+                                              RandomNumberGenerator& randgen,
+                                              const MathAccuracy accuracy) const noexcept {
 
     switch (this->MatKind) {
     case MaterialKind::Lambertian:
-        return this->Lambertian.scatter(ray_in, int_rec, randgen);
+        return this->Lambertian.scatter(ray_in, int_rec, randgen, accuracy);
         break;
 
     case MaterialKind::Metallic:
-        return this->Metallic.scatter(ray_in, int_rec, randgen);
+        return this->Metallic.scatter(ray_in, int_rec, randgen, accuracy);
         break;
 
     case MaterialKind::Dielectric:
-        return this->Dielectric.scatter(ray_in, int_rec, randgen);
+        return this->Dielectric.scatter(ray_in, int_rec, randgen, accuracy);
+        break;
+
+    case MaterialKind::Emissive:
+        return this->Emissive.scatter(ray_in, int_rec, randgen, accuracy);
         break;
 
     default:
@@ -107,3 +221,265 @@ tl::optional<ScatterRecord> Material::scatter(const Ray& ray_in, const Intersect
         return tl::nullopt;
     }
 }
+
+glm::vec3 Material::eval(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept {
+    switch (this->MatKind) {
+    case MaterialKind::Lambertian:
+        return this->Lambertian.eval(ray_in, int_rec, dir);
+
+    case MaterialKind::Metallic:
+        return this->Metallic.eval(ray_in, int_rec, dir);
+
+    case MaterialKind::Dielectric:
+        return this->Dielectric.eval(ray_in, int_rec, dir);
+
+    case MaterialKind::Emissive:
+        return this->Emissive.eval(ray_in, int_rec, dir);
+
+    default:
+        assert(false);
+        return glm::vec3{0.0f};
+    }
+}
+
+float Material::pdf(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept {
+    switch (this->MatKind) {
+    case MaterialKind::Lambertian:
+        return this->Lambertian.pdf(ray_in, int_rec, dir);
+
+    case MaterialKind::Metallic:
+        return this->Metallic.pdf(ray_in, int_rec, dir);
+
+    case MaterialKind::Dielectric:
+        return this->Dielectric.pdf(ray_in, int_rec, dir);
+
+    case MaterialKind::Emissive:
+        return this->Emissive.pdf(ray_in, int_rec, dir);
+
+    default:
+        assert(false);
+        return 0.0f;
+    }
+}
+
+void ScatterBatch::push_back(const Ray& ray_in, const IntersectionRecord& int_rec) {
+    Material.push_back(int_rec.Material);
+    P.push_back(int_rec.P);
+    Normal.push_back(int_rec.Normal);
+    Direction.push_back(ray_in.Direction);
+    UV.push_back(int_rec.UV);
+    UVScale.push_back(int_rec.UVScale);
+    Curvature.push_back(int_rec.Curvature);
+    Cone.push_back(int_rec.cone(ray_in));
+    FrontFace.push_back(int_rec.FrontFace ? 1 : 0);
+}
+
+MaterialHandleType MaterialCollection::add(const Material& mtl) {
+    const MaterialHandleType mtl_handle{static_cast<uint32_t>(_kinds.size())};
+    _kinds.push_back(mtl.MatKind);
+    _kinds_mask |= 1u << static_cast<uint32_t>(mtl.MatKind);
+    _albedo.push_back(mtl.MatKind == MaterialKind::Lambertian ? mtl.Lambertian.Albedo
+                      : mtl.MatKind == MaterialKind::Metallic ? mtl.Metallic.Albedo
+                                                              : glm::vec3{0.0f});
+    _albedo_texture.push_back(mtl.MatKind == MaterialKind::Lambertian ? mtl.Lambertian.AlbedoTexture
+                              : mtl.MatKind == MaterialKind::Metallic ? mtl.Metallic.AlbedoTexture
+                                                                      : nullptr);
+    _fuzziness.push_back(mtl.MatKind == MaterialKind::Metallic ? mtl.Metallic.Fuzziness : 0.0f);
+    _refraction_index.push_back(mtl.MatKind == MaterialKind::Dielectric ? mtl.Dielectric.RefractionIndex : 0.0f);
+    _emission.push_back(mtl.emitted());
+    return mtl_handle;
+}
+
+Material MaterialCollection::operator[](const MaterialHandleType mtl) const noexcept {
+    const uint32_t idx = value_of(mtl);
+    assert(idx < _kinds.size());
+
+    switch (_kinds[idx]) {
+    case MaterialKind::Metallic:
+        return Material::make_metallic(_albedo[idx], _fuzziness[idx], _albedo_texture[idx]);
+
+    case MaterialKind::Dielectric:
+        return Material::make_dielectric(_refraction_index[idx]);
+
+    case MaterialKind::Emissive:
+        return Material::make_emissive(_emission[idx]);
+
+    default:
+        return Material::make_lambertian(_albedo[idx], _albedo_texture[idx]);
+    }
+}
+
+template <typename MaterialKinds>
+tl::optional<ScatterRecord> MaterialCollection::scatter_kinds(const Ray& ray_in, const IntersectionRecord& int_rec,
+                                                              RandomNumberGenerator& randgen,
+                                                              const MathAccuracy accuracy) const noexcept {
+    assert((_kinds_mask & ~MaterialKinds::kMask) == 0);
+    return visit_kind(MaterialKinds{}, kind(int_rec.Material), [&](const auto mtl_kind) {
+        const auto material = of_kind<mtl_kind.value>(int_rec.Material);
+        static_assert(ScatteringMaterial<decltype(material)>);
+        return material.scatter(ray_in, int_rec, randgen, accuracy);
+    });
+}
+
+void MaterialCollection::scatter_batch(const MaterialKind kind, ScatterBatch& batch, RandomNumberGenerator& randgen,
+                                       const MathAccuracy accuracy) const {
+    const size_t count = batch.size();
+    batch.Attenuation.resize(count);
+    batch.ScatteredRay.resize(count);
+    batch.Pdf.resize(count);
+    batch.Scattered.resize(count);
+    batch.Random.resize(count);
+
+    //
+    // the generator is sequential (and the unit vectors are rejection sampled), so the random numbers are drawn up
+    // front and the kernels only do arithmetic
+    switch (kind) {
+    case MaterialKind::Lambertian:
+        for (glm::vec3& random : batch.Random) {
+            random = randgen.random_unit_vector(accuracy);
+        }
+        scatter_lambertian(batch);
+        apply_albedo_textures(batch);
+        break;
+
+    case MaterialKind::Metallic:
+        for (glm::vec3& random : batch.Random) {
+            random = randgen.random_unit_vector(accuracy);
+        }
+        scatter_metallic(batch, accuracy);
+        apply_albedo_textures(batch);
+        break;
+
+    case MaterialKind::Dielectric:
+        for (glm::vec3& random : batch.Random) {
+            random.x = static_cast<float>(randgen.random_double());
+        }
+        scatter_dielectric(batch, accuracy);
+        break;
+
+    case MaterialKind::Emissive:
+        //
+        // absorbs every path, the emission is added by the integrator when the hit is found
+        std::ranges::fill(batch.Scattered, uint8_t{0});
+        break;
+
+    default:
+        assert(false);
+        break;
+    }
+}
+
+void MaterialCollection::scatter_lambertian(ScatterBatch& batch) const noexcept {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const glm::vec3 normal = batch.Normal[i];
+        const glm::vec3 random_dir = normal + batch.Random[i];
+        const glm::vec3 scatter_dir = near_zero(random_dir) ? normal : random_dir;
+
+        batch.Attenuation[i] = _albedo[value_of(batch.Material[i])];
+        batch.ScatteredRay[i] = Ray{offset_ray_origin<RenderPrecision>(batch.P[i], normal, scatter_dir), scatter_dir,
+                                    batch.Cone[i].diffuse()};
+        batch.Pdf[i] = cosine_pdf(normal, glm::normalize(scatter_dir));
+        batch.Scattered[i] = 1;
+    }
+}
+
+void MaterialCollection::scatter_metallic(ScatterBatch& batch, const MathAccuracy accuracy) const noexcept {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const uint32_t mtl = value_of(batch.Material[i]);
+        const glm::vec3 normal = batch.Normal[i];
+        const glm::vec3 mirror_dir = math_normalize(glm::reflect(batch.Direction[i], normal), accuracy);
+        const glm::vec3 reflected = mirror_dir + _fuzziness[mtl] * batch.Random[i];
+
+        batch.Attenuation[i] = _albedo[mtl];
+        batch.ScatteredRay[i] = Ray{offset_ray_origin<RenderPrecision>(batch.P[i], normal, reflected), reflected,
+                                    fuzzy_reflected_cone(batch.Cone[i], batch.Curvature[i], _fuzziness[mtl])};
+        batch.Pdf[i] = fuzzy_reflection_pdf(mirror_dir, _fuzziness[mtl], glm::normalize(reflected));
+        batch.Scattered[i] = glm::dot(reflected, normal) > 0.0f ? 1 : 0;
+    }
+}
+
+void MaterialCollection::scatter_dielectric(ScatterBatch& batch, const MathAccuracy accuracy) const noexcept {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        const float refraction_index = _refraction_index[value_of(batch.Material[i])];
+        const float eta = batch.FrontFace[i] ? (1.0f / refraction_index) : refraction_index;
+        const glm::vec3 normal = batch.Normal[i];
+        const glm::vec3 unit_dir = math_normalize(batch.Direction[i], accuracy);
+        const float cos_theta = std::fmin(glm::dot(-unit_dir, normal), 1.0f);
+        const float sin_theta = math_sqrt(1.0f - cos_theta * cos_theta, accuracy);
+
+        //
+        // Schlick's approximation, same as Material_Dielectric::scatter()
+        const float r0 = (1.0f - eta) / (1.0f + eta);
+        const float r1 = r0 * r0;
+        const float reflectance = r1 + (1.0f - r1) * math_pow5(1.0f - cos_theta, accuracy);
+
+        const bool reflects = (eta * sin_theta) > 1.0f || reflectance > batch.Random[i].x;
+        const glm::vec3 scatter_dir =
+            reflects ? glm::reflect(unit_dir, normal) : math_refract(unit_dir, normal, eta, accuracy);
+        const RayCone scatter_cone =
+            reflects ? batch.Cone[i].reflected(batch.Curvature[i]) : batch.Cone[i].refracted(batch.Curvature[i], eta);
+
+        batch.Attenuation[i] = glm::vec3{1.0f};
+        batch.ScatteredRay[i] =
+            Ray{offset_ray_origin<RenderPrecision>(batch.P[i], normal, scatter_dir), scatter_dir, scatter_cone};
+        batch.Pdf[i] = 0.0f;
+        batch.Scattered[i] = 1;
+    }
+}
+
+void MaterialCollection::apply_albedo_textures(ScatterBatch& batch) const noexcept {
+    for (size_t i = 0; i < batch.size(); ++i) {
+        if (const TiledTexture* albedo_texture = _albedo_texture[value_of(batch.Material[i])]) {
+            batch.Attenuation[i] = albedo_at(batch.Attenuation[i], albedo_texture, batch.UV[i], batch.UVScale[i],
+                                             batch.Cone[i], batch.Direction[i], batch.Normal[i]);
+        }
+    }
+}
+
+//
+// every non empty MaterialKindList
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<1>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<2>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<3>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<4>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<5>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<6>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<7>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<8>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<9>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<10>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<11>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<12>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<13>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<14>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
+template tl::optional<ScatterRecord> MaterialCollection::scatter_kinds<MaterialKindList<15>>(
+    const Ray& ray_in, const IntersectionRecord& int_rec, RandomNumberGenerator& randgen,
+    const MathAccuracy accuracy) const noexcept;
@@ -2,48 +2,83 @@
 
 #include <cassert>
 #include <cstdint>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <tl/optional.hpp>
 #include <vector>
 
+#include "fast.math.hpp"
+#include "kind.list.hpp"
 #include "ray.hpp"
 #include "ray.tracer.material.handle.hpp"
 
 struct IntersectionRecord;
 class RandomNumberGenerator;
+class TiledTexture;
 
 struct ScatterRecord {
+    /// BSDF times the cosine over Pdf (see Material::eval()), or the weight of a specular scatter
     glm::vec3 Attenuation;
     Ray ScatteredRay;
+    /// per unit of solid angle, the PDF of the direction of ScatteredRay (see Material::pdf()), 0 for the specular
+    /// scatters (mirror, dielectric) no other sampling strategy can find
+    float Pdf;
 };
 
 enum class MaterialKind : uint32_t {
     Lambertian,
     Metallic,
     Dielectric,
+    /// light source, absorbs everything that hits it
+    Emissive,
     Count,
 };
 
+/// KindList of the material kinds in kMask (see MaterialCollection::kinds_mask()).
+template <uint32_t kMask>
+using MaterialKindList = KindListOf<MaterialKind, kMask>;
+using AllMaterialKinds = MaterialKindList<(1u << static_cast<uint32_t>(MaterialKind::Count)) - 1>;
+
 struct Material_Lambertian {
     glm::vec3 Albedo;
+    /// multiplies Albedo at the UV of the hit, optional (owned by the TextureCollection of the scene)
+    const TiledTexture* AlbedoTexture;
 
     tl::optional<ScatterRecord> scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
-                                        RandomNumberGenerator& randgen) const noexcept;
+                                        RandomNumberGenerator& randgen, const MathAccuracy accuracy) const noexcept;
+    glm::vec3 eval(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
+    float pdf(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
 };
 
 struct Material_Metallic {
     glm::vec3 Albedo;
+    /// see Material_Lambertian::AlbedoTexture
+    const TiledTexture* AlbedoTexture;
     float Fuzziness;
 
     tl::optional<ScatterRecord> scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
-                                        RandomNumberGenerator& randgen) const noexcept;
+                                        RandomNumberGenerator& randgen, const MathAccuracy accuracy) const noexcept;
+    glm::vec3 eval(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
+    float pdf(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
 };
 
 struct Material_Dielectric {
     float RefractionIndex;
 
     tl::optional<ScatterRecord> scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
-                                        RandomNumberGenerator& randgen) const noexcept;
+                                        RandomNumberGenerator& randgen, const MathAccuracy accuracy) const noexcept;
+    glm::vec3 eval(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
+    float pdf(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
+};
+
+struct Material_Emissive {
+    /// radiance leaving the surface, the same in every direction
+    glm::vec3 Emission;
+
+    tl::optional<ScatterRecord> scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
+                                        RandomNumberGenerator& randgen, const MathAccuracy accuracy) const noexcept;
+    glm::vec3 eval(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
+    float pdf(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
 };
 
 struct Material {
@@ -52,24 +87,28 @@ struct Material {
         Material_Lambertian Lambertian;
         Material_Metallic Metallic;
         Material_Dielectric Dielectric;
+        Material_Emissive Emissive;
     };
 
-    static Material make_lambertian(glm::vec3 albedo) noexcept {
+    static Material make_lambertian(glm::vec3 albedo, const TiledTexture* albedo_texture = nullptr) noexcept {
         return Material{
             .MatKind = MaterialKind::Lambertian,
             .Lambertian =
                 Material_Lambertian{
                     .Albedo = albedo,
+                    .AlbedoTexture = albedo_texture,
                 },
         };
     }
 
-    static Material make_metallic(glm::vec3 albedo, const float fuzziness) noexcept {
+    static Material make_metallic(glm::vec3 albedo, const float fuzziness,
+                                  const TiledTexture* albedo_texture = nullptr) noexcept {
         return Material{
             .MatKind = MaterialKind::Metallic,
             .Metallic =
                 Material_Metallic{
                     .Albedo = albedo,
+                    .AlbedoTexture = albedo_texture,
                     .Fuzziness = std::min(1.0f, fuzziness),
                 },
         };
@@ -85,26 +124,146 @@ struct Material {
         };
     }
 
+    static Material make_emissive(const glm::vec3& emission) noexcept {
+        return Material{
+            .MatKind = MaterialKind::Emissive,
+            .Emissive =
+                Material_Emissive{
+                    .Emission = emission,
+                },
+        };
+    }
+
     tl::optional<ScatterRecord> scatter(const Ray& ray_in, const IntersectionRecord& int_rec,
-                                        RandomNumberGenerator& randgen) const noexcept;
+                                        RandomNumberGenerator& randgen, const MathAccuracy accuracy) const noexcept;
+    /// BSDF times the cosine with the normal of the hit for the light leaving along the unit direction dir toward the
+    /// origin of ray_in: what a light sample in direction dir is weighted with. 0 for the specular kinds.
+    glm::vec3 eval(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
+    /// Per unit of solid angle, the PDF of scatter() sampling the unit direction dir. 0 for the specular kinds, the
+    /// Attenuation of a ScatterRecord of the others is eval() / pdf() of its direction.
+    float pdf(const Ray& ray_in, const IntersectionRecord& int_rec, const glm::vec3& dir) const noexcept;
+    /// Radiance the surface emits, 0 for all the kinds but Emissive.
+    glm::vec3 emitted() const noexcept {
+        return MatKind == MaterialKind::Emissive ? Emissive.Emission : glm::vec3{0.0f};
+    }
+};
+
+/// Hits of one material kind handed to MaterialCollection::scatter_batch(), one array per field: index i of all the
+/// arrays is the same hit. The caller fills the inputs with push_back(), the kernels write the outputs. Meant to be
+/// reused from batch to batch.
+struct ScatterBatch {
+    std::vector<MaterialHandleType> Material;
+    std::vector<glm::vec3> P;
+    std::vector<glm::vec3> Normal;
+    std::vector<glm::vec3> Direction;
+    std::vector<glm::vec2> UV;
+    std::vector<float> UVScale;
+    std::vector<float> Curvature;
+    /// cone of the incoming ray at the hit, see IntersectionRecord::cone()
+    std::vector<RayCone> Cone;
+    std::vector<uint8_t> FrontFace;
+
+    std::vector<glm::vec3> Attenuation;
+    std::vector<Ray> ScatteredRay;
+    /// see ScatterRecord::Pdf
+    std::vector<float> Pdf;
+    /// 0 when the hit absorbed the path, Attenuation and ScatteredRay are garbage then
+    std::vector<uint8_t> Scattered;
+    /// random unit vectors (Lambertian, Metallic), [0, 1) numbers in x (Dielectric), drawn before the kernel runs
+    std::vector<glm::vec3> Random;
+
+    size_t size() const noexcept { return Material.size(); }
+
+    void clear() noexcept {
+        Material.clear();
+        P.clear();
+        Normal.clear();
+        Direction.clear();
+        UV.clear();
+        UVScale.clear();
+        Curvature.clear();
+        Cone.clear();
+        FrontFace.clear();
+    }
+
+    void push_back(const Ray& ray_in, const IntersectionRecord& int_rec);
 };
 
+/// Materials stored one array per parameter, indexed by the handle. Parameters a kind does not have are 0 (albedo of
+/// a dielectric, emission of everything but the emissive materials and so on).
 class MaterialCollection {
 public:
     MaterialCollection() = default;
 
-    MaterialHandleType add(const Material& mtl) {
-        const MaterialHandleType mtl_handle{static_cast<uint32_t>(_materials.size())};
-        _materials.push_back(mtl);
-        return mtl_handle;
+    MaterialHandleType add(const Material& mtl);
+
+    /// The material rebuilt from the arrays, for the integrators that scatter one hit at a time.
+    Material operator[](const MaterialHandleType mtl) const noexcept;
+
+    MaterialKind kind(const MaterialHandleType mtl) const noexcept {
+        const uint32_t idx = value_of(mtl);
+        assert(idx < _kinds.size());
+        return _kinds[idx];
+    }
+
+    size_t size() const noexcept { return _kinds.size(); }
+    /// see Material::emitted()
+    glm::vec3 emission(const MaterialHandleType mtl) const noexcept { return _emission[value_of(mtl)]; }
+    /// Material::pdf() is not 0 everywhere: the diffuse and the fuzzy metallic materials, where the integrators
+    /// sample the lights.
+    bool has_pdf(const MaterialHandleType mtl) const noexcept {
+        const uint32_t idx = value_of(mtl);
+        return _kinds[idx] == MaterialKind::Lambertian ||
+               (_kinds[idx] == MaterialKind::Metallic && _fuzziness[idx] > 0.0f);
     }
+    /// one bit per MaterialKind the collection holds
+    uint32_t kinds_mask() const noexcept { return _kinds_mask; }
 
-    const Material& operator[](const MaterialHandleType mtl) const {
+    /// The parameters of a material of kind kKind, as the Material_ struct of that kind.
+    template <MaterialKind kKind>
+    auto of_kind(const MaterialHandleType mtl) const noexcept {
         const uint32_t idx = value_of(mtl);
-        assert(idx < _materials.size());
-        return _materials[idx];
+        assert(idx < _kinds.size() && _kinds[idx] == kKind);
+
+        if constexpr (kKind == MaterialKind::Lambertian) {
+            return Material_Lambertian{.Albedo = _albedo[idx], .AlbedoTexture = _albedo_texture[idx]};
+        } else if constexpr (kKind == MaterialKind::Metallic) {
+            return Material_Metallic{
+                .Albedo = _albedo[idx], .AlbedoTexture = _albedo_texture[idx], .Fuzziness = _fuzziness[idx]};
+        } else if constexpr (kKind == MaterialKind::Dielectric) {
+            return Material_Dielectric{.RefractionIndex = _refraction_index[idx]};
+        } else {
+            static_assert(kKind == MaterialKind::Emissive);
+            return Material_Emissive{.Emission = _emission[idx]};
+        }
     }
 
+    /// Material::scatter() of the hit material for a collection that only holds the kinds of MaterialKinds (a
+    /// MaterialKindList): no switch for a single kind, compares over the listed kinds otherwise, the scatter functions
+    /// inlined. Instantiated for every MaterialKindList.
+    template <typename MaterialKinds>
+    tl::optional<ScatterRecord> scatter_kinds(const Ray& ray_in, const IntersectionRecord& int_rec,
+                                              RandomNumberGenerator& randgen,
+                                              const MathAccuracy accuracy) const noexcept;
+
+    /// Scatters every hit of batch, all of them on materials of the given kind: one kernel per kind, no dispatch per
+    /// hit. The Lambertian and Metallic kernels are branch free loops over the batch arrays the compiler vectorizes,
+    /// hits sorted by material handle read the same parameters back to back. The texture lookups of textured materials
+    /// run in a second pass over the batch, at the mip level of the footprint of the ray cone.
+    void scatter_batch(const MaterialKind kind, ScatterBatch& batch, RandomNumberGenerator& randgen,
+                       const MathAccuracy accuracy) const;
+
 private:
-    std::vector<Material> _materials;
+    void scatter_lambertian(ScatterBatch& batch) const noexcept;
+    void scatter_metallic(ScatterBatch& batch, const MathAccuracy accuracy) const noexcept;
+    void scatter_dielectric(ScatterBatch& batch, const MathAccuracy accuracy) const noexcept;
+    void apply_albedo_textures(ScatterBatch& batch) const noexcept;
+
+    std::vector<MaterialKind> _kinds;
+    std::vector<glm::vec3> _albedo;
+    std::vector<const TiledTexture*> _albedo_texture;
+    std::vector<float> _fuzziness;
+    std::vector<float> _refraction_index;
+    std::vector<glm::vec3> _emission;
+    uint32_t _kinds_mask{};
 };
@@ -2,80 +2,707 @@
 
 #include <algorithm>
 #include <cassert>
+#include <chrono>
+#include <cmath>
+#include <concepts>
+#include <iterator>
+#include <numbers>
 #include <ranges>
+#include <span>
 
 #include <glm/glm.hpp>
 
+#include "parallel.for.hpp"
 #include "ray.hpp"
 
 IntersectionRecord::IntersectionRecord(const glm::vec3& p, const glm::vec3& outward_normal, const float t, const Ray& r,
                                        MaterialHandleType mtl) noexcept {
     this->P = p;
+    this->UV = glm::vec2{0.0f};
+    this->UVScale = 0.0f;
+    this->Curvature = 0.0f;
     this->T = t;
     this->Material = mtl;
     this->FrontFace = glm::dot(r.Direction, outward_normal) < 0.0f;
     this->Normal = this->FrontFace ? outward_normal : -outward_normal;
 }
 
-typedef tl::optional<IntersectionRecord> (*IntersectFuncType)(const void*, const Ray&, const Interval);
+template <PrecisionPolicy Precision>
+using IntersectFuncType = tl::optional<BasicPrimitiveHit<Precision>> (*)(const void*, const BasicRay<Precision>&,
+                                                                         const BasicInterval<Precision>);
 
-template <typename T>
+template <typename T, typename Precision>
 concept SupportsRayIntersection = requires(T a) {
-    { a.intersects(Ray{}, Interval{}) } -> std::same_as<tl::optional<IntersectionRecord>>;
+    {
+        a.template closest_hit<Precision>(BasicRay<Precision>{}, BasicInterval<Precision>{})
+    } -> std::same_as<tl::optional<BasicPrimitiveHit<Precision>>>;
+};
+
+template <typename T, PrecisionPolicy Precision>
+    requires SupportsRayIntersection<T, Precision>
+tl::optional<BasicPrimitiveHit<Precision>> intersect_dispatch_func(const void* obj, const BasicRay<Precision>& r,
+                                                                   const BasicInterval<Precision> ray_t) {
+    return static_cast<const T*>(obj)->template closest_hit<Precision>(r, ray_t);
+}
+
+template <PrecisionPolicy Precision>
+constexpr IntersectFuncType<Precision> kFuncTable[static_cast<uint32_t>(HittableObjectKind::Count)] = {
+    &intersect_dispatch_func<HittableObject_Sphere, Precision>,
+    &intersect_dispatch_func<HittableObject_Instance, Precision>,
+};
+
+template <PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>>
+HittableObject::closest_hit(const BasicRay<Precision>& r, const BasicInterval<Precision> ray_t) const noexcept {
+    return kFuncTable<Precision>[static_cast<uint32_t>(this->ObjKind)](&this->Sphere, r, ray_t);
+}
+
+template <HittableObjectKind kKind>
+const auto& object_of_kind(const HittableObject& obj) noexcept {
+    if constexpr (kKind == HittableObjectKind::Sphere) {
+        return obj.Sphere;
+    } else {
+        static_assert(kKind == HittableObjectKind::Instance);
+        return obj.Instance;
+    }
+}
+
+/// Closest hit of one object of a collection: through kFuncTable for ObjectKinds = void, dispatched over the kinds of
+/// the HittableObjectKindList otherwise.
+template <typename ObjectKinds, PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>> object_closest_hit(const HittableObject& obj, const BasicRay<Precision>& r,
+                                                              const BasicInterval<Precision> ray_t) noexcept {
+    if constexpr (std::is_void_v<ObjectKinds>) {
+        return obj.closest_hit(r, ray_t);
+    } else {
+        return visit_kind(ObjectKinds{}, obj.ObjKind, [&](const auto kind) {
+            return object_of_kind<kind.value>(obj).template closest_hit<Precision>(r, ray_t);
+        });
+    }
+}
+
+template <PrecisionPolicy Precision>
+IntersectionRecord HittableObject::intersection_record(const Ray& r,
+                                                       const BasicPrimitiveHit<Precision>& hit) const noexcept {
+    switch (this->ObjKind) {
+    case HittableObjectKind::Instance:
+        return this->Instance.intersection_record(r, hit);
+
+    default:
+        assert(this->ObjKind == HittableObjectKind::Sphere);
+        return this->Sphere.intersection_record<Precision>(r, hit.T);
+    }
+}
+
+typedef bool (*OccludedFuncType)(const void*, const Ray&, const Interval);
+
+template <typename T>
+concept SupportsRayOcclusion = requires(T a) {
+    { a.occluded(Ray{}, Interval{}) } -> std::same_as<bool>;
 };
 
 template <typename T>
-    requires SupportsRayIntersection<T>
-tl::optional<IntersectionRecord> intersect_dispatch_func(const void* obj, const Ray& r, const Interval ray_t) {
-    return static_cast<const T*>(obj)->intersects(r, ray_t);
+    requires SupportsRayOcclusion<T>
+bool occluded_dispatch_func(const void* obj, const Ray& r, const Interval ray_t) {
+    return static_cast<const T*>(obj)->occluded(r, ray_t);
 }
 
-constexpr IntersectFuncType kFuncTable[static_cast<uint32_t>(HittableObjectKind::Count)] = {
-    &intersect_dispatch_func<HittableObject_Sphere>,
+constexpr OccludedFuncType kOccludedFuncTable[static_cast<uint32_t>(HittableObjectKind::Count)] = {
+    &occluded_dispatch_func<HittableObject_Sphere>,
+    &occluded_dispatch_func<HittableObject_Instance>,
 };
 
-tl::optional<IntersectionRecord> HittableObject::intersects(const Ray& r, const Interval ray_t) const {
-    return kFuncTable[static_cast<uint32_t>(this->ObjKind)](&this->Sphere, r, ray_t);
+bool HittableObject::occluded(const Ray& r, const Interval ray_t) const noexcept {
+    return kOccludedFuncTable[static_cast<uint32_t>(this->ObjKind)](&this->Sphere, r, ray_t);
 }
 
-tl::optional<IntersectionRecord> HittableObject_Sphere::intersects(const Ray& r, const Interval ray_t) const {
+/// Roots of the ray/sphere quadratic, near one first, false when the ray misses. Robust form from Ray Tracing Gems
+/// (chapter 7): the discriminant comes from the distance of the center to the ray line instead of h^2 - a*c and the
+/// second root from c/q, so neither cancels out for spheres that are large or far away compared to their distance to
+/// the ray origin (the radius 1000 ground sphere).
+template <typename Scalar>
+bool sphere_roots(const glm::vec<3, Scalar>& origin, const glm::vec<3, Scalar>& dir, const glm::vec<3, Scalar>& center,
+                  const Scalar radius, Scalar& t_near, Scalar& t_far) noexcept {
+    const glm::vec<3, Scalar> oc = center - origin;
+    const Scalar a = glm::dot(dir, dir);
+    const Scalar h = glm::dot(dir, oc);
+    const Scalar c = glm::dot(oc, oc) - radius * radius;
+
+    const glm::vec<3, Scalar> l = dir * (h / a) - oc;
+    const Scalar delta = a * (radius * radius - glm::dot(l, l));
+    if (delta < Scalar{0}) {
+        return false;
+    }
+
+    const Scalar q = h + std::copysign(std::sqrt(delta), h);
+    const Scalar t0 = q / a;
+    const Scalar t1 = c / q;
+    t_near = std::min(t0, t1);
+    t_far = std::max(t0, t1);
+    return true;
+}
 
-    const glm::vec oc = Center - r.Origin;
-    const float a = glm::dot(r.Direction, r.Direction);
-    const float h = glm::dot(r.Direction, oc);
-    const float c = glm::dot(oc, oc) - Radius * Radius;
+template <PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>>
+HittableObject_Sphere::closest_hit(const BasicRay<Precision>& r, const BasicInterval<Precision> ray_t) const noexcept {
+    using Scalar = typename Precision::Scalar;
 
-    const float delta = h * h - a * c;
-    if (delta < 0.0f) {
+    Scalar t_near;
+    Scalar t_far;
+    if (!sphere_roots(r.Origin, r.Direction, glm::vec<3, Scalar>{Center}, Scalar{Radius}, t_near, t_far)) {
         return tl::nullopt;
     }
 
-    const float sqrtd = std::sqrt(delta);
-    float root = (h - sqrtd) / a;
+    Scalar root = t_near;
     if (!ray_t.surrounds(root)) {
-        root = (h + sqrtd) / a;
+        root = t_far;
         if (!ray_t.surrounds(root)) {
             return tl::nullopt;
         }
     }
 
-    const glm::vec3 p = r.point_at_param(root);
-    const glm::vec3 outward_normal = (p - Center) / Radius;
+    return BasicPrimitiveHit<Precision>{.T = root, .Prim = 0, .InstancePrim = 0};
+}
+
+bool HittableObject_Sphere::occluded(const Ray& r, const Interval ray_t) const noexcept {
+    float t_near;
+    float t_far;
+    if (!sphere_roots(r.Origin, r.Direction, Center, Radius, t_near, t_far)) {
+        return false;
+    }
 
-    return IntersectionRecord{p, outward_normal, root, r, Material};
+    return ray_t.surrounds(t_near) || ray_t.surrounds(t_far);
 }
 
-tl::optional<IntersectionRecord> HittableObject_Collection::intersects(const Ray& r, const Interval ray_t) const {
-    double closest_object = ray_t.Max;
-    tl::optional<IntersectionRecord> intersection;
+template <PrecisionPolicy Precision>
+IntersectionRecord HittableObject_Sphere::intersection_record(const Ray& r,
+                                                              const typename Precision::Scalar t) const noexcept {
+    using Scalar = typename Precision::Scalar;
+
+    const glm::vec<3, Scalar> p = glm::vec<3, Scalar>{r.Origin} + glm::vec<3, Scalar>{r.Direction} * t;
+    const glm::vec3 outward_normal{(p - glm::vec<3, Scalar>{Center}) / Scalar{Radius}};
+
+    //
+    // u is the angle around the y axis from -x, v goes from the bottom pole (0) to the top one (1)
+    IntersectionRecord int_rec{glm::vec3{p}, outward_normal, static_cast<float>(t), r, Material};
+    const float phi = std::atan2(-outward_normal.z, outward_normal.x) + std::numbers::pi_v<float>;
+    const float theta = std::acos(glm::clamp(-outward_normal.y, -1.0f, 1.0f));
+    int_rec.UV = glm::vec2{phi * 0.5f * std::numbers::inv_pi_v<float>, theta * std::numbers::inv_pi_v<float>};
+    //
+    // the unit UV square covers the whole surface, 4 pi r^2
+    int_rec.UVScale = 0.5f * std::numbers::inv_sqrtpi_v<float> / Radius;
+    int_rec.Curvature = 1.0f / Radius;
+    return int_rec;
+}
+
+BoundingBox HittableObject_Sphere::bounds() const noexcept {
+    const glm::vec3 r{Radius};
+    return BoundingBox{Center - r, Center + r};
+}
+
+template <PrecisionPolicy Precision>
+BasicRay<Precision> HittableObject_Instance::object_ray(const BasicRay<Precision>& r) const noexcept {
+    using Scalar = typename Precision::Scalar;
+
+    const glm::mat<4, 3, Scalar> world_to_object{Data->WorldToObject};
+    return BasicRay<Precision>{
+        .Origin = world_to_object * glm::vec<4, Scalar>{r.Origin, Scalar{1}},
+        .Direction = world_to_object * glm::vec<4, Scalar>{r.Direction, Scalar{0}},
+    };
+}
+
+template <PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>>
+HittableObject_Instance::closest_hit(const BasicRay<Precision>& r,
+                                     const BasicInterval<Precision> ray_t) const noexcept {
+    return Data->Geometry->closest_hit<Precision>(object_ray(r), ray_t)
+        .map([](const BasicPrimitiveHit<Precision> hit) {
+            return BasicPrimitiveHit<Precision>{.T = hit.T, .Prim = 0, .InstancePrim = hit.Prim};
+        });
+}
+
+template <PrecisionPolicy Precision>
+IntersectionRecord
+HittableObject_Instance::intersection_record(const Ray& r, const BasicPrimitiveHit<Precision>& hit) const noexcept {
+    using Scalar = typename Precision::Scalar;
 
+    const Ray local_ray = object_ray(r);
+    IntersectionRecord int_rec = Data->Geometry->intersection_record(
+        local_ray, BasicPrimitiveHit<Precision>{.T = hit.T, .Prim = hit.InstancePrim, .InstancePrim = 0});
+
+    //
+    // dot(M * d, M^-T * n) == dot(d, n), so the normal keeps facing the ray and FrontFace stays valid
+    int_rec.P = glm::vec3{glm::vec<3, Scalar>{r.Origin} + glm::vec<3, Scalar>{r.Direction} * hit.T};
+    int_rec.Normal = glm::normalize(Data->NormalToWorld * int_rec.Normal);
+
+    //
+    // object space units per world unit along the ray, taken as the scale of the instance around the hit
+    const float object_per_world = glm::length(local_ray.Direction) / glm::length(r.Direction);
+    int_rec.UVScale *= object_per_world;
+    int_rec.Curvature *= object_per_world;
+    return int_rec;
+}
+
+bool HittableObject_Instance::occluded(const Ray& r, const Interval ray_t) const noexcept {
+    return Data->Geometry->occluded(object_ray(r), ray_t);
+}
+
+BoundingBox HittableObject_Instance::bounds() const noexcept { return Data->Bounds; }
+
+BoundingBox HittableObject::bounds() const noexcept {
+    switch (this->ObjKind) {
+    case HittableObjectKind::Sphere:
+        return this->Sphere.bounds();
+
+    case HittableObjectKind::Instance:
+        return this->Instance.bounds();
+
+    default:
+        assert(false);
+        return BoundingBox{};
+    }
+}
+
+uint32_t HittableObject_Collection::add_instance(std::shared_ptr<const HittableObject_Collection> geometry,
+                                                const glm::mat4& object_to_world) {
+    assert(geometry->instances_count() == 0);
+    const BoundingBox geometry_bounds = geometry->bounds();
+
+    BoundingBox world_bounds{};
+    for (uint32_t corner = 0; corner < 8; ++corner) {
+        const glm::vec3 p{
+            (corner & 1) ? geometry_bounds.Max.x : geometry_bounds.Min.x,
+            (corner & 2) ? geometry_bounds.Max.y : geometry_bounds.Min.y,
+            (corner & 4) ? geometry_bounds.Max.z : geometry_bounds.Min.z,
+        };
+        world_bounds.grow(glm::vec3{object_to_world * glm::vec4{p, 1.0f}});
+    }
+
+    const glm::mat4 world_to_object = glm::inverse(object_to_world);
+    _instances.push_back(std::make_shared<const InstanceData>(InstanceData{
+        .Geometry = std::move(geometry),
+        .WorldToObject = glm::mat4x3{world_to_object},
+        .NormalToWorld = glm::transpose(glm::mat3{world_to_object}),
+        .Bounds = world_bounds,
+    }));
+
+    return add_object(HittableObject::make_instance(_instances.back().get()));
+}
+
+BoundingBox HittableObject_Collection::bounds() const noexcept {
+    if (!_bvh.empty()) {
+        return _bvh.nodes()[0].bounds();
+    }
+
+    BoundingBox coll_bounds{};
     for (const HittableObject& obj : _objects) {
-        if (const tl::optional<IntersectionRecord> obj_intersect =
-                obj.intersects(r, Interval{ray_t.Min, closest_object})) {
-            intersection = obj_intersect;
-            closest_object = obj_intersect->T;
+        coll_bounds.grow(obj.bounds());
+    }
+    return coll_bounds;
+}
+
+bool HittableObject_Collection::spheres_only() const noexcept {
+    return std::ranges::all_of(_objects,
+                               [](const HittableObject& obj) { return obj.ObjKind == HittableObjectKind::Sphere; });
+}
+
+void HittableObject_Collection::build_bvh(const AccelerationParameters& params, const uint32_t max_leaf_size,
+                                          const uint32_t build_threads) {
+    std::vector<BoundingBox> prim_bounds{};
+    prim_bounds.reserve(_objects.size());
+    std::ranges::transform(_objects, std::back_inserter(prim_bounds),
+                           [](const HittableObject& obj) { return obj.bounds(); });
+
+    std::vector<uint32_t> prim_order{};
+    if (params.builder == BvhBuilder::Lbvh) {
+        _bvh.build_linear(prim_bounds, prim_order,
+                          LbvhBuildParams{
+                              .MaxLeafSize = max_leaf_size,
+                              .MortonBits = params.lbvh_morton_bits,
+                              .TreeletRotations = params.lbvh_treelet_rotations,
+                              .ThreadsCount = build_threads,
+                          });
+    } else {
+        _bvh.build(prim_bounds, prim_order,
+                   BvhBuildParams{
+                       .BinsCount = params.bvh_bins,
+                       .MaxLeafSize = max_leaf_size,
+                   });
+    }
+    _bvh.apply_node_order(params.node_order);
+
+    std::vector<HittableObject> ordered_objects{};
+    ordered_objects.reserve(_objects.size());
+    std::ranges::transform(prim_order, std::back_inserter(ordered_objects),
+                           [this](const uint32_t idx) { return _objects[idx]; });
+    _objects = std::move(ordered_objects);
+
+    std::vector<uint32_t> ordered_ids{};
+    ordered_ids.reserve(_object_ids.size());
+    std::ranges::transform(prim_order, std::back_inserter(ordered_ids),
+                           [this](const uint32_t idx) { return _object_ids[idx]; });
+    _object_ids = std::move(ordered_ids);
+
+    for (uint32_t slot = 0; slot < _object_ids.size(); ++slot) {
+        _object_slots[_object_ids[slot]] = slot;
+    }
+}
+
+void HittableObject_Collection::build_acceleration(const AccelerationParameters& params,
+                                                   const uint32_t build_threads) {
+    drop_acceleration();
+
+    _build_params = params;
+    const auto build_start = std::chrono::steady_clock::now();
+
+    switch (params.kind) {
+    case AccelerationStructureKind::Linear:
+        break;
+
+    case AccelerationStructureKind::Bvh2:
+        build_bvh(params, params.bvh_max_leaf_size, build_threads);
+        break;
+
+    case AccelerationStructureKind::Bvh8:
+        if (!spheres_only()) {
+            build_bvh(params, params.bvh_max_leaf_size, build_threads);
+            break;
+        }
+
+        //
+        // a leaf becomes one sphere packet, so let the leaves fill all the lanes
+        build_bvh(params, std::max(params.bvh_max_leaf_size, Bvh8Node::kWidth), build_threads);
+        _bvh8.build(_bvh, _objects, _build_params.bvh8_node_layout, _build_params.node_order);
+        break;
+
+    default:
+        assert(false);
+        break;
+    }
+
+    _build_stats = AccelerationBuildStats{
+        .Kind = acceleration_kind(),
+        .Builder = params.builder,
+        .NodeLayout = _bvh8.empty() ? Bvh8NodeLayout::Full : _bvh8.layout(),
+        .Precision = params.ray_precision,
+        .Threads = params.builder == BvhBuilder::Lbvh ? std::max(build_threads, 1u) : 1u,
+        .Milliseconds =
+            std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - build_start).count(),
+        .SahCost = _bvh.empty() ? 0.0f : _bvh.sah_cost(),
+    };
+}
+
+void HittableObject_Collection::update_sphere(const uint32_t object_id, const glm::vec3& center,
+                                             const float radius) noexcept {
+    HittableObject& obj = _objects[_object_slots[object_id]];
+    assert(obj.ObjKind == HittableObjectKind::Sphere);
+
+    obj.Sphere.Center = center;
+    obj.Sphere.Radius = radius;
+}
+
+AccelerationRefitStats HittableObject_Collection::refit_acceleration(const uint32_t threads_count) {
+    const AccelerationStructureKind kind = acceleration_kind();
+    if (kind == AccelerationStructureKind::Linear) {
+        return AccelerationRefitStats{};
+    }
+
+    const auto refit_start = std::chrono::steady_clock::now();
+
+    std::vector<BoundingBox> prim_bounds(_objects.size());
+    parallel_for_chunks(threads_count, _objects.size(), [&](const size_t, const size_t begin, const size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            prim_bounds[i] = _objects[i].bounds();
+        }
+    });
+
+    _bvh.refit(prim_bounds, threads_count);
+
+    AccelerationRefitStats stats{
+        .Rebuilt = false,
+        .SahCost = _bvh.sah_cost(),
+        .BuildSahCost = _build_stats.SahCost,
+    };
+
+    if (stats.SahCost > _build_stats.SahCost * _build_params.refit_rebuild_sah_ratio) {
+        build_acceleration(_build_params, threads_count);
+        stats.Rebuilt = true;
+        stats.SahCost = _build_stats.SahCost;
+    } else if (kind == AccelerationStructureKind::Bvh8) {
+        //
+        // the wide nodes and sphere packets are copies, refit them in place, only a rebuild collapses the binary
+        // tree again
+        _bvh8.refit(_objects, threads_count);
+    }
+
+    stats.Milliseconds =
+        std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - refit_start).count();
+    return stats;
+}
+
+AccelerationStructureKind HittableObject_Collection::acceleration_kind() const noexcept {
+    if (!_bvh8.empty()) {
+        return AccelerationStructureKind::Bvh8;
+    }
+    return _bvh.empty() ? AccelerationStructureKind::Linear : AccelerationStructureKind::Bvh2;
+}
+
+tl::optional<PrimitiveHit> HittableObject_Collection::closest_hit(const Ray& r,
+                                                                 const Interval ray_t) const noexcept {
+    if (_build_params.ray_precision == RayPrecision::Double) {
+        const BasicRay<DoublePrecision> double_ray{
+            .Origin = glm::dvec3{r.Origin},
+            .Direction = glm::dvec3{r.Direction},
+        };
+        return closest_hit(double_ray, BasicInterval<DoublePrecision>{ray_t.Min, ray_t.Max})
+            .map([](const BasicPrimitiveHit<DoublePrecision> hit) {
+                return PrimitiveHit{.T = static_cast<float>(hit.T), .Prim = hit.Prim, .InstancePrim = hit.InstancePrim};
+            });
+    }
+
+    return closest_hit<RenderPrecision>(r, ray_t);
+}
+
+template <PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>>
+HittableObject_Collection::closest_hit(const BasicRay<Precision>& r,
+                                       const BasicInterval<Precision> ray_t) const noexcept {
+    return closest_hit_of<void>(r, ray_t);
+}
+
+template <PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>>
+HittableObject_Collection::closest_hit_linear(const BasicRay<Precision>& r,
+                                              const BasicInterval<Precision> ray_t) const noexcept {
+    return closest_hit_scan<void>(r, ray_t);
+}
+
+template <typename ObjectKinds>
+tl::optional<PrimitiveHit> HittableObject_Collection::closest_hit_kinds(const Ray& r,
+                                                                        const Interval ray_t) const noexcept {
+    assert(_build_params.ray_precision == RayPrecision::Single);
+    assert((_kinds_mask & ~ObjectKinds::kMask) == 0);
+    return closest_hit_of<ObjectKinds>(r, ray_t);
+}
+
+template <typename ObjectKinds, PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>>
+HittableObject_Collection::closest_hit_of(const BasicRay<Precision>& r,
+                                          const BasicInterval<Precision> ray_t) const noexcept {
+    switch (acceleration_kind()) {
+    case AccelerationStructureKind::Bvh8:
+        //
+        // the BVH8 kernels are float only, the BVH2 is kept next to it with the same object order
+        if constexpr (std::same_as<Precision, RenderPrecision>) {
+            return _bvh8.intersects(r, ray_t).map(
+                [](const Bvh8Hit hit) { return PrimitiveHit{.T = hit.T, .Prim = hit.Prim, .InstancePrim = 0}; });
+        }
+        [[fallthrough]];
+
+    case AccelerationStructureKind::Bvh2:
+        return closest_hit_bvh<ObjectKinds>(r, ray_t);
+
+    default:
+        return closest_hit_scan<ObjectKinds>(r, ray_t);
+    }
+}
+
+template <typename ObjectKinds, PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>>
+HittableObject_Collection::closest_hit_bvh(const BasicRay<Precision>& r,
+                                           const BasicInterval<Precision> ray_t) const noexcept {
+    using Scalar = typename Precision::Scalar;
+
+    tl::optional<BasicPrimitiveHit<Precision>> closest;
+    auto leaf_fn = [&](const uint32_t first, const uint32_t count, const BasicInterval<Precision> leaf_t) {
+        Scalar closest_object = leaf_t.Max;
+        for (uint32_t prim = first; prim < first + count; ++prim) {
+            if (const tl::optional<BasicPrimitiveHit<Precision>> obj_hit = object_closest_hit<ObjectKinds>(
+                    _objects[prim], r, BasicInterval<Precision>{leaf_t.Min, closest_object})) {
+                closest =
+                    BasicPrimitiveHit<Precision>{.T = obj_hit->T, .Prim = prim, .InstancePrim = obj_hit->InstancePrim};
+                closest_object = obj_hit->T;
+            }
+        }
+        return closest_object;
+    };
+
+    _bvh.traverse_closest(r, ray_t, leaf_fn);
+
+    return closest;
+}
+
+template <typename ObjectKinds, PrecisionPolicy Precision>
+tl::optional<BasicPrimitiveHit<Precision>>
+HittableObject_Collection::closest_hit_scan(const BasicRay<Precision>& r,
+                                            const BasicInterval<Precision> ray_t) const noexcept {
+    typename Precision::Scalar closest_object = ray_t.Max;
+    tl::optional<BasicPrimitiveHit<Precision>> closest;
+
+    for (uint32_t prim = 0; prim < _objects.size(); ++prim) {
+        if (const tl::optional<BasicPrimitiveHit<Precision>> obj_hit = object_closest_hit<ObjectKinds>(
+                _objects[prim], r, BasicInterval<Precision>{ray_t.Min, closest_object})) {
+            closest =
+                BasicPrimitiveHit<Precision>{.T = obj_hit->T, .Prim = prim, .InstancePrim = obj_hit->InstancePrim};
+            closest_object = obj_hit->T;
+        }
+    }
+
+    return closest;
+}
+
+bool HittableObject_Collection::closest_hit_packet(std::span<const Ray> rays, const Interval ray_t,
+                                                   std::span<tl::optional<PrimitiveHit>> hits) const noexcept {
+    return closest_hit_packet_of<void>(rays, ray_t, hits);
+}
+
+template <typename ObjectKinds>
+bool HittableObject_Collection::closest_hit_packet_kinds(std::span<const Ray> rays, const Interval ray_t,
+                                                         std::span<tl::optional<PrimitiveHit>> hits) const noexcept {
+    assert(_build_params.ray_precision == RayPrecision::Single);
+    assert((_kinds_mask & ~ObjectKinds::kMask) == 0);
+    return closest_hit_packet_of<ObjectKinds>(rays, ray_t, hits);
+}
+
+template <typename ObjectKinds>
+bool HittableObject_Collection::closest_hit_packet_of(std::span<const Ray> rays, const Interval ray_t,
+                                                      std::span<tl::optional<PrimitiveHit>> hits) const noexcept {
+    assert(hits.size() >= rays.size());
+
+    //
+    // the BVH2 is kept next to the BVH8 and both use the same object order, the packet traversal is float only
+    tl::optional<RayPacketFrustum> frustum{};
+    if (_build_params.ray_precision == RayPrecision::Single && !_bvh.empty() &&
+        rays.size() <= BoundingVolumeHierarchy::kMaxPacketRays) {
+        frustum = RayPacketFrustum::from_rays(rays);
+    }
+
+    if (!frustum) {
+        for (uint32_t ray = 0; ray < rays.size(); ++ray) {
+            if constexpr (std::is_void_v<ObjectKinds>) {
+                hits[ray] = closest_hit(rays[ray], ray_t);
+            } else {
+                hits[ray] = closest_hit_of<ObjectKinds>(rays[ray], ray_t);
+            }
+        }
+        return false;
+    }
+
+    std::fill_n(hits.begin(), rays.size(), tl::nullopt);
+    auto leaf_fn = [&](const uint32_t first, const uint32_t count, const uint32_t ray, const Interval leaf_t) {
+        float closest_object = leaf_t.Max;
+        for (uint32_t prim = first; prim < first + count; ++prim) {
+            if (const tl::optional<PrimitiveHit> obj_hit =
+                    object_closest_hit<ObjectKinds>(_objects[prim], rays[ray], Interval{leaf_t.Min, closest_object})) {
+                hits[ray] = PrimitiveHit{.T = obj_hit->T, .Prim = prim, .InstancePrim = obj_hit->InstancePrim};
+                closest_object = obj_hit->T;
+            }
+        }
+        return closest_object;
+    };
+
+    _bvh.traverse_packet(rays, *frustum, ray_t, leaf_fn);
+
+    return true;
+}
+
+IntersectionRecord HittableObject_Collection::intersection_record(const Ray& r,
+                                                                  const PrimitiveHit& hit) const noexcept {
+    if (_build_params.ray_precision == RayPrecision::Double) {
+        //
+        // the traversal found the root in double and rounded it, the primitive test finds it again within a few float
+        // ulps of the rounded distance
+        const double t = hit.T;
+        const double slack = std::abs(t) * 0x1p-20 + DoublePrecision::kRayTMin;
+        const BasicRay<DoublePrecision> double_ray{
+            .Origin = glm::dvec3{r.Origin},
+            .Direction = glm::dvec3{r.Direction},
+        };
+        if (const tl::optional<BasicPrimitiveHit<DoublePrecision>> double_hit = _objects[hit.Prim].closest_hit(
+                double_ray, BasicInterval<DoublePrecision>{t - slack, t + slack})) {
+            return intersection_record(
+                r, BasicPrimitiveHit<DoublePrecision>{
+                       .T = double_hit->T, .Prim = hit.Prim, .InstancePrim = double_hit->InstancePrim});
         }
     }
 
-    return intersection;
+    return _objects[hit.Prim].intersection_record(r, hit);
+}
+
+template <PrecisionPolicy Precision>
+IntersectionRecord
+HittableObject_Collection::intersection_record(const Ray& r, const BasicPrimitiveHit<Precision>& hit) const noexcept {
+    return _objects[hit.Prim].intersection_record(r, hit);
+}
+
+tl::optional<IntersectionRecord> HittableObject_Collection::intersects(const Ray& r, const Interval ray_t) const {
+    return closest_hit(r, ray_t).map([&](const PrimitiveHit& hit) { return intersection_record(r, hit); });
+}
+
+tl::optional<IntersectionRecord> HittableObject_Collection::intersects_linear(const Ray& r,
+                                                                              const Interval ray_t) const {
+    return closest_hit_linear(r, ray_t).map([&](const PrimitiveHit& hit) { return intersection_record(r, hit); });
+}
+
+bool HittableObject_Collection::occluded(const Ray& r, const Interval ray_t) const noexcept {
+    switch (acceleration_kind()) {
+    case AccelerationStructureKind::Bvh8:
+        return _bvh8.occluded(r, ray_t);
+
+    case AccelerationStructureKind::Bvh2:
+        return _bvh.traverse_any(r, ray_t, [&](const uint32_t first, const uint32_t count, const Interval leaf_t) {
+            return std::ranges::any_of(std::span{_objects}.subspan(first, count),
+                                       [&](const HittableObject& obj) { return obj.occluded(r, leaf_t); });
+        });
+
+    default:
+        return occluded_linear(r, ray_t);
+    }
+}
+
+bool HittableObject_Collection::occluded_linear(const Ray& r, const Interval ray_t) const noexcept {
+    return std::ranges::any_of(_objects, [&](const HittableObject& obj) { return obj.occluded(r, ray_t); });
 }
+
+template tl::optional<BasicPrimitiveHit<SinglePrecision>>
+HittableObject::closest_hit(const BasicRay<SinglePrecision>& r,
+                            const BasicInterval<SinglePrecision> ray_t) const noexcept;
+template tl::optional<BasicPrimitiveHit<DoublePrecision>>
+HittableObject::closest_hit(const BasicRay<DoublePrecision>& r,
+                            const BasicInterval<DoublePrecision> ray_t) const noexcept;
+template tl::optional<BasicPrimitiveHit<SinglePrecision>>
+HittableObject_Collection::closest_hit(const BasicRay<SinglePrecision>& r,
+                                       const BasicInterval<SinglePrecision> ray_t) const noexcept;
+template tl::optional<BasicPrimitiveHit<DoublePrecision>>
+HittableObject_Collection::closest_hit(const BasicRay<DoublePrecision>& r,
+                                       const BasicInterval<DoublePrecision> ray_t) const noexcept;
+template tl::optional<BasicPrimitiveHit<SinglePrecision>>
+HittableObject_Collection::closest_hit_linear(const BasicRay<SinglePrecision>& r,
+                                              const BasicInterval<SinglePrecision> ray_t) const noexcept;
+template tl::optional<BasicPrimitiveHit<DoublePrecision>>
+HittableObject_Collection::closest_hit_linear(const BasicRay<DoublePrecision>& r,
+                                              const BasicInterval<DoublePrecision> ray_t) const noexcept;
+template IntersectionRecord
+HittableObject_Collection::intersection_record(const Ray& r,
+                                               const BasicPrimitiveHit<SinglePrecision>& hit) const noexcept;
+template IntersectionRecord
+HittableObject_Collection::intersection_record(const Ray& r,
+                                               const BasicPrimitiveHit<DoublePrecision>& hit) const noexcept;
+
+//
+// every non empty HittableObjectKindList
+template tl::optional<PrimitiveHit>
+HittableObject_Collection::closest_hit_kinds<HittableObjectKindList<1>>(const Ray& r,
+                                                                       const Interval ray_t) const noexcept;
+template bool HittableObject_Collection::closest_hit_packet_kinds<HittableObjectKindList<1>>(
+    std::span<const Ray> rays, const Interval ray_t, std::span<tl::optional<PrimitiveHit>> hits) const noexcept;
+template tl::optional<PrimitiveHit>
+HittableObject_Collection::closest_hit_kinds<HittableObjectKindList<2>>(const Ray& r,
+                                                                       const Interval ray_t) const noexcept;
+template bool HittableObject_Collection::closest_hit_packet_kinds<HittableObjectKindList<2>>(
+    std::span<const Ray> rays, const Interval ray_t, std::span<tl::optional<PrimitiveHit>> hits) const noexcept;
+template tl::optional<PrimitiveHit>
+HittableObject_Collection::closest_hit_kinds<HittableObjectKindList<3>>(const Ray& r,
+                                                                       const Interval ray_t) const noexcept;
+template bool HittableObject_Collection::closest_hit_packet_kinds<HittableObjectKindList<3>>(
+    std::span<const Ray> rays, const Interval ray_t, std::span<tl::optional<PrimitiveHit>> hits) const noexcept;
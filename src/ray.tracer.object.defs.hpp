@@ -1,44 +1,112 @@
 #pragma once
 
 #include <cstdint>
+#include <memory>
+#include <span>
 #include <vector>
 
+#include <glm/mat3x3.hpp>
+#include <glm/mat4x3.hpp>
+#include <glm/mat4x4.hpp>
+#include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 #include <tl/optional.hpp>
 
+#include "acceleration.parameters.hpp"
+#include "bounding.box.hpp"
 #include "interval.hpp"
+#include "kind.list.hpp"
+#include "precision.policy.hpp"
+#include "ray.hpp"
+#include "ray.tracer.bvh.hpp"
+#include "ray.tracer.bvh8.hpp"
 #include "ray.tracer.material.handle.hpp"
 
-struct Ray;
+struct InstanceData;
 
 struct IntersectionRecord {
     glm::vec3 P;
     glm::vec3 Normal;
+    /// surface parameterization, [0, 1]^2, for the texture lookups
+    glm::vec2 UV;
+    /// UV units per unit of distance on the surface around P, and the curvature there (1 / radius), for the ray cones
+    float UVScale;
+    float Curvature;
+    float T;
     MaterialHandleType Material;
     bool FrontFace;
-    double T;
 
+    IntersectionRecord() noexcept = default;
     IntersectionRecord(const glm::vec3& p, const glm::vec3& outward_normal, const float t, const Ray& r,
                        MaterialHandleType mtl) noexcept;
+
+    /// Cone of r (the ray that hit) at P.
+    RayCone cone(const Ray& r) const noexcept { return r.Cone.at_distance(T * glm::length(r.Direction)); }
+};
+
+/// What the closest hit traversal keeps track of: the distance and the primitive, nothing else. The IntersectionRecord
+/// is built from it once, for the final hit (see HittableObject_Collection::intersection_record()).
+template <PrecisionPolicy Precision>
+struct BasicPrimitiveHit {
+    typename Precision::Scalar T;
+    /// index of the object in the collection, filled in by the collection
+    uint32_t Prim;
+    /// index of the object inside the instance geometry, for instance hits
+    uint32_t InstancePrim;
 };
 
+using PrimitiveHit = BasicPrimitiveHit<RenderPrecision>;
+
 enum class HittableObjectKind : uint32_t {
     Sphere,
+    Instance,
     Count,
 };
 
+/// KindList of the object kinds in kMask (see HittableObject_Collection::kinds_mask()).
+template <uint32_t kMask>
+using HittableObjectKindList = KindListOf<HittableObjectKind, kMask>;
+using AllHittableObjectKinds = HittableObjectKindList<(1u << static_cast<uint32_t>(HittableObjectKind::Count)) - 1>;
+
 struct HittableObject_Sphere {
     glm::vec3 Center;
     float Radius;
     MaterialHandleType Material;
 
-    tl::optional<IntersectionRecord> intersects(const Ray& r, const Interval ray_t) const;
+    template <PrecisionPolicy Precision>
+    tl::optional<BasicPrimitiveHit<Precision>> closest_hit(const BasicRay<Precision>& r,
+                                                           const BasicInterval<Precision> ray_t) const noexcept;
+    bool occluded(const Ray& r, const Interval ray_t) const noexcept;
+    /// The hit point and normal are computed in the precision of t and converted once.
+    template <PrecisionPolicy Precision>
+    IntersectionRecord intersection_record(const Ray& r, const typename Precision::Scalar t) const noexcept;
+    BoundingBox bounds() const noexcept;
+};
+
+/// Shared geometry placed in the world through an affine transform, the data lives in the collection that owns the
+/// instance (see HittableObject_Collection::add_instance()).
+struct HittableObject_Instance {
+    const InstanceData* Data;
+
+    template <PrecisionPolicy Precision>
+    tl::optional<BasicPrimitiveHit<Precision>> closest_hit(const BasicRay<Precision>& r,
+                                                           const BasicInterval<Precision> ray_t) const noexcept;
+    bool occluded(const Ray& r, const Interval ray_t) const noexcept;
+    template <PrecisionPolicy Precision>
+    IntersectionRecord intersection_record(const Ray& r, const BasicPrimitiveHit<Precision>& hit) const noexcept;
+    BoundingBox bounds() const noexcept;
+
+private:
+    /// The direction is not renormalized, so the ray parameter (and ray_t) is the same in both spaces.
+    template <PrecisionPolicy Precision>
+    BasicRay<Precision> object_ray(const BasicRay<Precision>& r) const noexcept;
 };
 
 struct HittableObject {
     HittableObjectKind ObjKind;
     union {
         HittableObject_Sphere Sphere;
+        HittableObject_Instance Instance;
     };
 
     static HittableObject make_sphere(const glm::vec3& center, const float radius, MaterialHandleType mtl) noexcept {
@@ -53,15 +121,164 @@ struct HittableObject {
         };
     }
 
-    tl::optional<IntersectionRecord> intersects(const Ray& r, const Interval ray_t) const;
+    static HittableObject make_instance(const InstanceData* data) noexcept {
+        return HittableObject{
+            .ObjKind = HittableObjectKind::Instance,
+            .Instance =
+                HittableObject_Instance{
+                    .Data = data,
+                },
+        };
+    }
+
+    template <PrecisionPolicy Precision>
+    tl::optional<BasicPrimitiveHit<Precision>> closest_hit(const BasicRay<Precision>& r,
+                                                           const BasicInterval<Precision> ray_t) const noexcept;
+    template <PrecisionPolicy Precision>
+    IntersectionRecord intersection_record(const Ray& r, const BasicPrimitiveHit<Precision>& hit) const noexcept;
+    /// True if anything is hit inside ray_t. Stops at the first hit and never builds the hit point or normal, for
+    /// visibility queries (shadow rays) that only need a yes/no answer.
+    bool occluded(const Ray& r, const Interval ray_t) const noexcept;
+    BoundingBox bounds() const noexcept;
 };
 
 class HittableObject_Collection {
 public:
-    void add_object(const HittableObject& obj) { _objects.push_back(obj); }
-    void clear() { _objects.clear(); }
+    /// Returns the id of the object, stays valid when building the acceleration structure reorders the objects.
+    uint32_t add_object(const HittableObject& obj) {
+        const uint32_t object_id = static_cast<uint32_t>(_objects.size());
+        _objects.push_back(obj);
+        _kinds_mask |= 1u << static_cast<uint32_t>(obj.ObjKind);
+        _object_ids.push_back(object_id);
+        _object_slots.push_back(object_id);
+        drop_acceleration();
+        return object_id;
+    }
+
+    /// Places the (already built) geometry in the world, returns the object id of the instance. The geometry is shared
+    /// by all the instances of it, so memory scales with the unique geometry and not with the placed copies. Instances
+    /// are one level deep, the geometry can not hold instances itself.
+    uint32_t add_instance(std::shared_ptr<const HittableObject_Collection> geometry, const glm::mat4& object_to_world);
+
+    void clear() {
+        _objects.clear();
+        _object_ids.clear();
+        _object_slots.clear();
+        _instances.clear();
+        _kinds_mask = 0;
+        drop_acceleration();
+    }
+
+    /// Moves/resizes a sphere in place. The acceleration structure is stale until refit_acceleration() is called, the
+    /// lights of a scene until SceneSnapshot::refit() is.
+    void update_sphere(const uint32_t object_id, const glm::vec3& center, const float radius) noexcept;
+
+    /// Refits the acceleration structure to the updated objects (bounds only, same topology), or rebuilds it from
+    /// scratch with the last build parameters once the refit tree got too slow (see refit_rebuild_sah_ratio).
+    AccelerationRefitStats refit_acceleration(const uint32_t threads_count = 1);
+
+    /// Builds the requested acceleration structure and reorders the objects to match its leaf order. Adding objects
+    /// afterwards drops it and falls back to the linear scan until the next build. build_threads is only used by the
+    /// LBVH builder. The BVH8 sphere packets only hold spheres, collections with instances get a BVH2 instead.
+    void build_acceleration(const AccelerationParameters& params, const uint32_t build_threads = 1);
+
+    size_t size() const noexcept { return _objects.size(); }
+    size_t instances_count() const noexcept { return _instances.size(); }
+    /// one bit per HittableObjectKind the collection holds
+    uint32_t kinds_mask() const noexcept { return _kinds_mask; }
+    RayPrecision ray_precision() const noexcept { return _build_params.ray_precision; }
+    BoundingBox bounds() const noexcept;
+    const HittableObject& object(const uint32_t object_id) const noexcept { return _objects[_object_slots[object_id]]; }
+    /// object id of the (top level) object of a hit
+    uint32_t hit_object_id(const PrimitiveHit& hit) const noexcept { return _object_ids[hit.Prim]; }
+    AccelerationStructureKind acceleration_kind() const noexcept;
+    const BoundingVolumeHierarchy& bvh() const noexcept { return _bvh; }
+    const WideBoundingVolumeHierarchy& bvh8() const noexcept { return _bvh8; }
+    const AccelerationBuildStats& build_stats() const noexcept { return _build_stats; }
+    const AccelerationParameters& build_params() const noexcept { return _build_params; }
+
+    /// Closest hit, the traversal only tracks the distance and the primitive (see PrimitiveHit). Runs in the precision
+    /// the acceleration structure was built for (see AccelerationParameters::ray_precision), double precision converts
+    /// the ray and the hit distance back and forth.
+    tl::optional<PrimitiveHit> closest_hit(const Ray& r, const Interval ray_t) const noexcept;
+    /// Closest hit in the given precision, whatever the build parameters ask for. In double precision the box tests
+    /// stay float and the BVH8 is skipped for the BVH2 kept next to it, only the primitive tests run in double.
+    template <PrecisionPolicy Precision>
+    tl::optional<BasicPrimitiveHit<Precision>> closest_hit(const BasicRay<Precision>& r,
+                                                           const BasicInterval<Precision> ray_t) const noexcept;
+    template <PrecisionPolicy Precision>
+    tl::optional<BasicPrimitiveHit<Precision>> closest_hit_linear(const BasicRay<Precision>& r,
+                                                                  const BasicInterval<Precision> ray_t) const noexcept;
+    /// Closest hits of up to BoundingVolumeHierarchy::kMaxPacketRays rays, traversed together through the BVH when
+    /// they are coherent (see RayPacketFrustum) and one by one otherwise (always for double precision collections).
+    /// Returns true when the packet path was taken.
+    bool closest_hit_packet(std::span<const Ray> rays, const Interval ray_t,
+                            std::span<tl::optional<PrimitiveHit>> hits) const noexcept;
+    /// closest_hit() and closest_hit_packet() for a single precision collection that only holds the kinds of
+    /// ObjectKinds (a HittableObjectKindList): the object tests in the leaves are dispatched over those kinds at
+    /// compile time and inlined, instead of going through the function table. Instantiated for every
+    /// HittableObjectKindList.
+    template <typename ObjectKinds>
+    tl::optional<PrimitiveHit> closest_hit_kinds(const Ray& r, const Interval ray_t) const noexcept;
+    template <typename ObjectKinds>
+    bool closest_hit_packet_kinds(std::span<const Ray> rays, const Interval ray_t,
+                                  std::span<tl::optional<PrimitiveHit>> hits) const noexcept;
+    /// Builds the hit point, normal and material of a hit returned by closest_hit(). For a double precision collection
+    /// the hit primitive is intersected again in double, so the hit point is computed from the double distance and
+    /// converted once, instead of being rebuilt from the float one.
+    IntersectionRecord intersection_record(const Ray& r, const PrimitiveHit& hit) const noexcept;
+    /// Record of a hit found in the given precision, the hit point is computed in that precision and converted once.
+    template <PrecisionPolicy Precision>
+    IntersectionRecord intersection_record(const Ray& r, const BasicPrimitiveHit<Precision>& hit) const noexcept;
+
     tl::optional<IntersectionRecord> intersects(const Ray& r, const Interval ray_t) const;
+    tl::optional<IntersectionRecord> intersects_linear(const Ray& r, const Interval ray_t) const;
+    /// Any hit query, see HittableObject::occluded().
+    bool occluded(const Ray& r, const Interval ray_t) const noexcept;
+    bool occluded_linear(const Ray& r, const Interval ray_t) const noexcept;
 
 private:
+    void drop_acceleration() noexcept {
+        _bvh.clear();
+        _bvh8.clear();
+    }
+
+    bool spheres_only() const noexcept;
+    void build_bvh(const AccelerationParameters& params, const uint32_t max_leaf_size, const uint32_t build_threads);
+    //
+    // ObjectKinds is void for the function table dispatch (any kind), a HittableObjectKindList otherwise
+    template <typename ObjectKinds, PrecisionPolicy Precision>
+    tl::optional<BasicPrimitiveHit<Precision>> closest_hit_of(const BasicRay<Precision>& r,
+                                                              const BasicInterval<Precision> ray_t) const noexcept;
+    template <typename ObjectKinds, PrecisionPolicy Precision>
+    tl::optional<BasicPrimitiveHit<Precision>> closest_hit_bvh(const BasicRay<Precision>& r,
+                                                               const BasicInterval<Precision> ray_t) const noexcept;
+    template <typename ObjectKinds, PrecisionPolicy Precision>
+    tl::optional<BasicPrimitiveHit<Precision>> closest_hit_scan(const BasicRay<Precision>& r,
+                                                                const BasicInterval<Precision> ray_t) const noexcept;
+    template <typename ObjectKinds>
+    bool closest_hit_packet_of(std::span<const Ray> rays, const Interval ray_t,
+                               std::span<tl::optional<PrimitiveHit>> hits) const noexcept;
+
     std::vector<HittableObject> _objects;
+    /// object id of _objects[i]
+    std::vector<uint32_t> _object_ids;
+    /// index into _objects of an object id
+    std::vector<uint32_t> _object_slots;
+    /// shared so copies of the collection keep the instance data alive, the objects point into it
+    std::vector<std::shared_ptr<const InstanceData>> _instances;
+    uint32_t _kinds_mask{};
+    BoundingVolumeHierarchy _bvh;
+    WideBoundingVolumeHierarchy _bvh8;
+    AccelerationParameters _build_params;
+    AccelerationBuildStats _build_stats;
+};
+
+/// Bottom level geometry of an instance and the transforms to get rays into and normals out of its object space.
+struct InstanceData {
+    std::shared_ptr<const HittableObject_Collection> Geometry;
+    glm::mat4x3 WorldToObject;
+    /// inverse transpose of the linear part of the object to world transform
+    glm::mat3 NormalToWorld;
+    BoundingBox Bounds;
 };
@@ -0,0 +1,57 @@
+#include "ray.tracer.render.kernels.hpp"
+
+#include <array>
+#include <utility>
+
+#include "ray.tracer.core.hpp"
+#include "ray.tracer.scene.snapshot.hpp"
+
+namespace {
+
+constexpr uint32_t kObjectKindsMasks = 1u << static_cast<uint32_t>(HittableObjectKind::Count);
+constexpr uint32_t kMaterialKindsMasks = 1u << static_cast<uint32_t>(MaterialKind::Count);
+
+//
+// kRenderKernels[object kinds mask][material kinds mask], an empty set gets the kernel of all the kinds
+
+template <uint32_t kObjectKinds, uint32_t kMaterialKinds>
+constexpr RenderKernel make_render_kernel() noexcept {
+    constexpr uint32_t kObjects = kObjectKinds != 0 ? kObjectKinds : AllHittableObjectKinds::kMask;
+    constexpr uint32_t kMaterials = kMaterialKinds != 0 ? kMaterialKinds : AllMaterialKinds::kMask;
+    return RenderKernel{
+        .RenderTile = &RayTracingCore::trace_tile<HittableObjectKindList<kObjects>, MaterialKindList<kMaterials>>,
+        .ObjectKinds = kObjects,
+        .MaterialKinds = kMaterials,
+    };
+}
+
+template <uint32_t kObjectKinds, uint32_t... kMaterialKinds>
+constexpr std::array<RenderKernel, kMaterialKindsMasks>
+make_render_kernels_row(std::integer_sequence<uint32_t, kMaterialKinds...>) noexcept {
+    return {make_render_kernel<kObjectKinds, kMaterialKinds>()...};
+}
+
+template <uint32_t... kObjectKinds>
+constexpr std::array<std::array<RenderKernel, kMaterialKindsMasks>, kObjectKindsMasks>
+make_render_kernels(std::integer_sequence<uint32_t, kObjectKinds...>) noexcept {
+    return {make_render_kernels_row<kObjectKinds>(std::make_integer_sequence<uint32_t, kMaterialKindsMasks>{})...};
+}
+
+constexpr std::array<std::array<RenderKernel, kMaterialKindsMasks>, kObjectKindsMasks> kRenderKernels =
+    make_render_kernels(std::make_integer_sequence<uint32_t, kObjectKindsMasks>{});
+
+constexpr RenderKernel kGenericRenderKernel{
+    .RenderTile = &RayTracingCore::trace_tile<>,
+    .ObjectKinds = 0,
+    .MaterialKinds = 0,
+};
+
+} // namespace
+
+const RenderKernel& select_render_kernel(const SceneSnapshot& scene) noexcept {
+    if (scene.World.ray_precision() != RayPrecision::Single) {
+        return kGenericRenderKernel;
+    }
+
+    return kRenderKernels[scene.World.kinds_mask()][scene.Materials.kinds_mask()];
+}
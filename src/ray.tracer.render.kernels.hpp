@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+
+#include "camera.parameters.hpp"
+#include "color.hpp"
+#include "fast.math.hpp"
+#include "ray.tracer.core.hpp"
+
+/// RayTracingCore::trace_tile() instantiated for a set of kinds, the kernels run it with the iterative integrator.
+using RenderTileFn = void (RayTracingCore::*)(const IntegratorKind integrator, const MathAccuracy accuracy,
+                                              const uint32_t start_x, const uint32_t start_y, const uint32_t end_x,
+                                              const uint32_t end_y, const SceneSnapshot& scene,
+                                              RandomNumberGenerator& randgen, std::span<RGBAColor> tile_colors) const;
+
+/// The iterative integrator compiled for a set of object and material kinds (HittableObjectKindList,
+/// MaterialKindList): the object tests and the scatter functions are dispatched over those kinds at compile time and
+/// inlined, a scene of spheres with Lambertian, metallic and dielectric materials runs without a call through a
+/// function table per object or per hit. One instantiation per pair of non empty kind sets.
+struct RenderKernel {
+    RenderTileFn RenderTile;
+    /// kinds masks the kernel was compiled for (HittableObjectKindList::kMask, MaterialKindList::kMask), 0 for the
+    /// generic kernel
+    uint32_t ObjectKinds;
+    uint32_t MaterialKinds;
+};
+
+/// Kernel of the object and material kinds the scene holds, picked when a snapshot is loaded. Double precision
+/// collections get the generic kernel (RayTracingCore::trace_tile<>()), the specialized ones are single precision.
+const RenderKernel& select_render_kernel(const SceneSnapshot& scene) noexcept;
@@ -0,0 +1,88 @@
+#include "ray.tracer.scene.snapshot.hpp"
+
+#include <algorithm>
+
+AccelerationRefitStats SceneSnapshot::refit(const uint32_t threads_count) {
+    const AccelerationRefitStats stats = World.refit_acceleration(threads_count);
+    Lights = LightCollection::build(World, Materials);
+    return stats;
+}
+
+SceneReadGuard::~SceneReadGuard() {
+    if (_slot_epoch) {
+        //
+        // release: every read of the snapshot happens before a writer that sees the slot quiescent frees it
+        _slot_epoch->store(SceneSnapshotPublisher::kQuiescent, std::memory_order_release);
+    }
+}
+
+SceneSnapshotPublisher::SceneSnapshotPublisher(std::unique_ptr<SceneSnapshot> initial, const uint32_t readers_count)
+    : _current{initial.release()}, _slots{std::make_unique<ReaderSlot[]>(readers_count)},
+      _readers_count{readers_count} {}
+
+SceneSnapshotPublisher::~SceneSnapshotPublisher() { delete _current.load(std::memory_order_acquire); }
+
+SceneReadGuard SceneSnapshotPublisher::pin(const uint32_t reader) noexcept {
+    assert(reader < _readers_count);
+    std::atomic<uint64_t>& slot_epoch = _slots[reader].Epoch;
+    assert(slot_epoch.load(std::memory_order_relaxed) == kQuiescent);
+
+    //
+    // announce the epoch before loading the snapshot (both seq_cst): a writer that retires a snapshot in epoch e
+    // either sees this slot pinned at <= e, or this reader loads the snapshot that replaced it
+    slot_epoch.store(_epoch.load(std::memory_order_seq_cst), std::memory_order_seq_cst);
+    return SceneReadGuard{&slot_epoch, _current.load(std::memory_order_seq_cst)};
+}
+
+uint64_t SceneSnapshotPublisher::publish(std::unique_ptr<SceneSnapshot> snapshot) {
+    std::lock_guard writer_lock{_writer_mtx};
+    return publish_locked(std::move(snapshot));
+}
+
+uint64_t SceneSnapshotPublisher::publish_locked(std::unique_ptr<SceneSnapshot> snapshot) {
+    snapshot->Version = _current.load(std::memory_order_relaxed)->Version + 1;
+    const uint64_t version = snapshot->Version;
+
+    const SceneSnapshot* previous = _current.exchange(snapshot.release(), std::memory_order_seq_cst);
+    const uint64_t retire_epoch = _epoch.fetch_add(1, std::memory_order_seq_cst);
+    _retired.push_back(RetiredSnapshot{
+        .Epoch = retire_epoch,
+        .Snapshot = std::unique_ptr<const SceneSnapshot>{previous},
+    });
+
+    reclaim_locked();
+    return version;
+}
+
+size_t SceneSnapshotPublisher::reclaim() {
+    std::lock_guard writer_lock{_writer_mtx};
+    return reclaim_locked();
+}
+
+size_t SceneSnapshotPublisher::reclaim_locked() {
+    if (_retired.empty()) {
+        return 0;
+    }
+
+    uint64_t oldest_pinned = kQuiescent;
+    for (uint32_t reader = 0; reader < _readers_count; ++reader) {
+        oldest_pinned = std::min(oldest_pinned, _slots[reader].Epoch.load(std::memory_order_seq_cst));
+    }
+
+    //
+    // a reader pinned at epoch p may hold any snapshot retired in an epoch >= p
+    const size_t freed = std::erase_if(
+        _retired, [oldest_pinned](const RetiredSnapshot& retired) { return retired.Epoch < oldest_pinned; });
+    _reclaimed += freed;
+    return freed;
+}
+
+SceneSnapshotStats SceneSnapshotPublisher::stats() const {
+    std::lock_guard writer_lock{_writer_mtx};
+    return SceneSnapshotStats{
+        .Version = _current.load(std::memory_order_acquire)->Version,
+        .Epoch = _epoch.load(std::memory_order_acquire),
+        .Retired = _retired.size(),
+        .Reclaimed = _reclaimed,
+    };
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "ray.tracer.environment.hpp"
+#include "ray.tracer.lights.hpp"
+#include "ray.tracer.material.defs.hpp"
+#include "ray.tracer.object.defs.hpp"
+#include "ray.tracer.texture.hpp"
+
+/// One published version of the scene. Never modified once published, edits go into a copy (see
+/// SceneSnapshotPublisher::update()).
+struct SceneSnapshot {
+    uint64_t Version{};
+    HittableObject_Collection World;
+    MaterialCollection Materials;
+    /// what the textured materials point to
+    TextureCollection Textures;
+    /// the emissive spheres of World, see LightCollection::build()
+    LightCollection Lights;
+    /// what the rays that miss everything see, shared by the snapshots copied from this one
+    std::shared_ptr<const EnvironmentMap> Environment{std::make_shared<const EnvironmentMap>()};
+
+    /// After spheres of World were moved or resized (HittableObject_Collection::update_sphere()): refits the
+    /// acceleration structure and builds Lights again, they hold their own copy of the emissive spheres. What an edit
+    /// of the scene (SceneSnapshotPublisher::update()) calls instead of World.refit_acceleration().
+    AccelerationRefitStats refit(const uint32_t threads_count = 1);
+};
+
+struct SceneSnapshotStats {
+    uint64_t Version{};
+    uint64_t Epoch{};
+    size_t Retired{};
+    size_t Reclaimed{};
+};
+
+/// Keeps a reader slot pinned to the snapshot it was created with, unpins it when destroyed.
+class SceneReadGuard {
+public:
+    SceneReadGuard(std::atomic<uint64_t>* slot_epoch, const SceneSnapshot* snapshot) noexcept
+        : _slot_epoch{slot_epoch}, _snapshot{snapshot} {}
+
+    ~SceneReadGuard();
+
+    SceneReadGuard(const SceneReadGuard&) = delete;
+    SceneReadGuard& operator=(const SceneReadGuard&) = delete;
+
+    SceneReadGuard(SceneReadGuard&& rhs) noexcept
+        : _slot_epoch{std::exchange(rhs._slot_epoch, nullptr)}, _snapshot{std::exchange(rhs._snapshot, nullptr)} {}
+
+    SceneReadGuard& operator=(SceneReadGuard&&) = delete;
+
+    const SceneSnapshot& operator*() const noexcept { return *_snapshot; }
+    const SceneSnapshot* operator->() const noexcept { return _snapshot; }
+
+private:
+    std::atomic<uint64_t>* _slot_epoch;
+    const SceneSnapshot* _snapshot;
+};
+
+/// RCU style publication of scene snapshots. Readers (the ray tracing workers) pin their slot to the current epoch and
+/// load the current snapshot, which costs a couple of atomic loads/stores and never waits on a writer. Writers copy the
+/// current snapshot, edit the copy and swap it in; the old one is retired with the epoch it was replaced in and freed
+/// once no reader is pinned to that epoch or an older one.
+class SceneSnapshotPublisher {
+public:
+    static constexpr uint64_t kQuiescent = std::numeric_limits<uint64_t>::max();
+
+    SceneSnapshotPublisher(std::unique_ptr<SceneSnapshot> initial, const uint32_t readers_count);
+    ~SceneSnapshotPublisher();
+
+    SceneSnapshotPublisher(const SceneSnapshotPublisher&) = delete;
+    SceneSnapshotPublisher& operator=(const SceneSnapshotPublisher&) = delete;
+
+    /// Pins the reader slot and returns the current snapshot, which stays alive until the guard is destroyed. Every
+    /// reader thread owns one slot, a slot must not be pinned twice.
+    SceneReadGuard pin(const uint32_t reader) noexcept;
+
+    /// Copies the current snapshot, lets edit_fn(SceneSnapshot&) change the copy and publishes it. Returns the version
+    /// of the published snapshot. Writers are serialized among themselves, readers are never blocked.
+    template <typename EditFn>
+    uint64_t update(EditFn&& edit_fn) {
+        std::lock_guard writer_lock{_writer_mtx};
+        auto next = std::make_unique<SceneSnapshot>(*_current.load(std::memory_order_acquire));
+        edit_fn(*next);
+        return publish_locked(std::move(next));
+    }
+
+    uint64_t publish(std::unique_ptr<SceneSnapshot> snapshot);
+
+    /// Frees the retired snapshots no reader can still see, returns how many were freed. Also done by every publish.
+    size_t reclaim();
+
+    uint32_t readers_count() const noexcept { return _readers_count; }
+    SceneSnapshotStats stats() const;
+
+private:
+    struct alignas(64) ReaderSlot {
+        std::atomic<uint64_t> Epoch{kQuiescent};
+    };
+
+    struct RetiredSnapshot {
+        uint64_t Epoch;
+        std::unique_ptr<const SceneSnapshot> Snapshot;
+    };
+
+    uint64_t publish_locked(std::unique_ptr<SceneSnapshot> snapshot);
+    size_t reclaim_locked();
+
+    std::atomic<const SceneSnapshot*> _current;
+    std::atomic<uint64_t> _epoch{0};
+    std::unique_ptr<ReaderSlot[]> _slots;
+    uint32_t _readers_count;
+    mutable std::mutex _writer_mtx;
+    std::vector<RetiredSnapshot> _retired;
+    size_t _reclaimed{};
+};
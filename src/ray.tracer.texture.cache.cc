@@ -0,0 +1,177 @@
+#include "ray.tracer.texture.cache.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <span>
+#include <utility>
+
+namespace {
+
+std::atomic<uint64_t> g_texture_cache_ids{1};
+
+} // namespace
+
+struct TextureCache::MicroCache {
+    struct Entry {
+        uint64_t Key{~uint64_t{0}};
+        SlotRef Slot{kNoSlot, kNoTag};
+    };
+
+    uint64_t CacheId{};
+    Entry Entries[kMicroCacheEntries];
+    /// since the last flush to the shared stats
+    uint64_t Hits{};
+    uint64_t Misses{};
+};
+
+TextureCache::TextureCache(const size_t budget_bytes)
+    : _id{g_texture_cache_ids.fetch_add(1, std::memory_order_relaxed)},
+      _slots_count{std::max(kMinPages, static_cast<uint32_t>(budget_bytes / kPageBytes))},
+      _slot_texels{std::make_unique<uint32_t[]>(size_t{_slots_count} * kPageTexels)},
+      _slot_tags{std::make_unique<std::atomic<uint64_t>[]>(_slots_count)}, _slot_keys(_slots_count),
+      _lru_prev(_slots_count, kNoSlot), _lru_next(_slots_count, kNoSlot) {
+    _slot_of_key.reserve(_slots_count);
+    _stats.BudgetBytes = size_t{_slots_count} * kPageBytes;
+}
+
+TextureCache::~TextureCache() = default;
+
+uint32_t TextureCache::add_file(MappedTextureFile file) {
+    std::lock_guard lock{_mtx};
+    _files.push_back(std::make_unique<const MappedTextureFile>(std::move(file)));
+    return static_cast<uint32_t>(_files.size() - 1);
+}
+
+TextureCache::MicroCache& TextureCache::thread_micro_cache() noexcept {
+    thread_local MicroCache micro_cache{};
+    return micro_cache;
+}
+
+uint32_t TextureCache::texel(const uint32_t file, const uint32_t page, const uint32_t page_texel) noexcept {
+    assert(file < _files.size() && page < _files[file]->pages_count() && page_texel < kPageTexels);
+    const uint64_t key = (uint64_t{file} << 32) | page;
+
+    MicroCache& micro_cache = thread_micro_cache();
+    if (micro_cache.CacheId != _id) {
+        micro_cache = MicroCache{};
+        micro_cache.CacheId = _id;
+    }
+
+    MicroCache::Entry& entry = micro_cache.Entries[(page + file * 0x9E3779B1u) & (kMicroCacheEntries - 1)];
+    if (entry.Key == key) {
+        if (const tl::optional<uint32_t> value = read_slot(entry.Slot, page_texel)) {
+            micro_cache.Hits += 1;
+            return *value;
+        }
+    }
+
+    //
+    // loops only if the page is evicted again between the load and the read
+    micro_cache.Misses += 1;
+    for (;;) {
+        entry = MicroCache::Entry{.Key = key, .Slot = acquire_page(key, micro_cache)};
+        if (const tl::optional<uint32_t> value = read_slot(entry.Slot, page_texel)) {
+            return *value;
+        }
+    }
+}
+
+tl::optional<uint32_t> TextureCache::read_slot(const SlotRef slot, const uint32_t page_texel) const noexcept {
+    const std::atomic<uint64_t>& slot_tag = _slot_tags[slot.Slot];
+    if (slot_tag.load(std::memory_order_acquire) != slot.Tag) {
+        return tl::nullopt;
+    }
+
+    const uint32_t value =
+        std::atomic_ref<uint32_t>{_slot_texels[size_t{slot.Slot} * kPageTexels + page_texel]}.load(
+            std::memory_order_relaxed);
+
+    //
+    // a load that started after the read cleared the tag first
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot_tag.load(std::memory_order_relaxed) != slot.Tag) {
+        return tl::nullopt;
+    }
+    return value;
+}
+
+TextureCache::SlotRef TextureCache::acquire_page(const uint64_t key, MicroCache& micro_cache) {
+    std::lock_guard lock{_mtx};
+    _stats.MicroHits += std::exchange(micro_cache.Hits, 0);
+    _stats.MicroMisses += std::exchange(micro_cache.Misses, 0);
+
+    if (const auto resident = _slot_of_key.find(key); resident != _slot_of_key.end()) {
+        const uint32_t slot = resident->second;
+        lru_unlink(slot);
+        lru_push_front(slot);
+        _stats.SharedHits += 1;
+        return SlotRef{slot, _slot_tags[slot].load(std::memory_order_relaxed)};
+    }
+
+    _stats.SharedMisses += 1;
+    uint32_t slot;
+    if (_slots_used < _slots_count) {
+        slot = _slots_used++;
+    } else {
+        slot = _lru_tail;
+        lru_unlink(slot);
+        _slot_of_key.erase(_slot_keys[slot]);
+        _stats.Evictions += 1;
+    }
+
+    //
+    // the micro caches still pointing to the slot fail the tag check from here on
+    _slot_tags[slot].store(kNoTag, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    const MappedTextureFile& file = *_files[key >> 32];
+    const uint32_t page = static_cast<uint32_t>(key);
+    uint32_t* slot_texels = &_slot_texels[size_t{slot} * kPageTexels];
+    for (const TextureTile& tile : file.page_tiles(page)) {
+        for (const uint32_t texel : tile.Texels) {
+            std::atomic_ref<uint32_t>{*slot_texels++}.store(texel, std::memory_order_relaxed);
+        }
+    }
+    file.release_page(page);
+
+    const uint64_t tag = _next_tag++;
+    _slot_tags[slot].store(tag, std::memory_order_release);
+    _slot_keys[slot] = key;
+    _slot_of_key.emplace(key, slot);
+    lru_push_front(slot);
+    return SlotRef{slot, tag};
+}
+
+void TextureCache::lru_unlink(const uint32_t slot) noexcept {
+    const uint32_t prev = _lru_prev[slot];
+    const uint32_t next = _lru_next[slot];
+    (prev != kNoSlot ? _lru_next[prev] : _lru_head) = next;
+    (next != kNoSlot ? _lru_prev[next] : _lru_tail) = prev;
+    _lru_prev[slot] = kNoSlot;
+    _lru_next[slot] = kNoSlot;
+}
+
+void TextureCache::lru_push_front(const uint32_t slot) noexcept {
+    _lru_prev[slot] = kNoSlot;
+    _lru_next[slot] = _lru_head;
+    (_lru_head != kNoSlot ? _lru_prev[_lru_head] : _lru_tail) = slot;
+    _lru_head = slot;
+}
+
+void TextureCache::flush_thread_stats() {
+    MicroCache& micro_cache = thread_micro_cache();
+    if (micro_cache.CacheId != _id) {
+        return;
+    }
+
+    std::lock_guard lock{_mtx};
+    _stats.MicroHits += std::exchange(micro_cache.Hits, 0);
+    _stats.MicroMisses += std::exchange(micro_cache.Misses, 0);
+}
+
+TextureCacheStats TextureCache::stats() const {
+    std::lock_guard lock{_mtx};
+    TextureCacheStats stats = _stats;
+    stats.ResidentBytes = size_t{_slots_used} * kPageBytes;
+    return stats;
+}
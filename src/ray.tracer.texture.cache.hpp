@@ -0,0 +1,110 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <tl/optional.hpp>
+
+#include "ray.tracer.texture.file.hpp"
+#include "ray.tracer.texture.hpp"
+
+struct TextureCacheStats {
+    /// lookups answered by the per thread micro caches, and the ones passed on to the shared cache
+    uint64_t MicroHits{};
+    uint64_t MicroMisses{};
+    /// pages found in the shared cache, and pages loaded from the files
+    uint64_t SharedHits{};
+    uint64_t SharedMisses{};
+    uint64_t Evictions{};
+    size_t ResidentBytes{};
+    size_t BudgetBytes{};
+
+    /// lookups that did not load a page
+    double hit_rate() const noexcept {
+        const uint64_t lookups = MicroHits + MicroMisses;
+        return lookups != 0 ? 1.0 - static_cast<double>(SharedMisses) / static_cast<double>(lookups) : 0.0;
+    }
+};
+
+/// Pages of texture files (see MappedTextureFile) held in a fixed budget of memory, the least recently used page is
+/// evicted to make room for a new one. Shared by all the rendering threads.
+///
+/// Every thread has a small direct mapped micro cache of the pages it used last in front of the shared one, a lookup
+/// that hits it reads the texel without a lock or a shared write: the slot of the page carries a tag, changed on every
+/// load, that the lookup checks before and after reading the texel (a seqlock), a page evicted in the meantime sends
+/// the lookup to the shared cache. Only loads and the LRU updates of the micro cache misses take the lock.
+class TextureCache {
+public:
+    static constexpr uint32_t kPageTexels =
+        TiledTexture::kPageTiles * TiledTexture::kPageTiles * TextureTile::kTileSize * TextureTile::kTileSize;
+    static constexpr size_t kPageBytes = kPageTexels * sizeof(uint32_t);
+    /// per thread, a power of two
+    static constexpr uint32_t kMicroCacheEntries = 64;
+    /// a budget smaller than that gets that many pages anyway, so that the pages the threads are reading are not
+    /// all evicted by each other
+    static constexpr uint32_t kMinPages = 64;
+
+    explicit TextureCache(const size_t budget_bytes);
+    ~TextureCache();
+
+    TextureCache(const TextureCache&) = delete;
+    TextureCache& operator=(const TextureCache&) = delete;
+
+    /// Adds a file, returns its index for TiledTexture::from_cache(). Files are added before rendering starts.
+    uint32_t add_file(MappedTextureFile file);
+    const MappedTextureFile& file(const uint32_t file) const noexcept { return *_files[file]; }
+    size_t files_count() const noexcept { return _files.size(); }
+
+    /// Texel of a page of a file (see TiledTexture::locate()), loads the page when it is not resident.
+    uint32_t texel(const uint32_t file, const uint32_t page, const uint32_t page_texel) noexcept;
+
+    /// Adds the micro cache counters of the calling thread to the shared stats, they are added on every micro cache
+    /// miss otherwise.
+    void flush_thread_stats();
+    TextureCacheStats stats() const;
+
+private:
+    static constexpr uint64_t kNoTag = 0;
+    static constexpr uint32_t kNoSlot = ~0u;
+
+    /// slot and tag of a resident page
+    struct SlotRef {
+        uint32_t Slot;
+        uint64_t Tag;
+    };
+
+    struct MicroCache;
+
+    /// One per thread, emptied when the thread moves on to another cache.
+    static MicroCache& thread_micro_cache() noexcept;
+    /// The texel if the slot still holds the page loaded with tag.
+    tl::optional<uint32_t> read_slot(const SlotRef slot, const uint32_t page_texel) const noexcept;
+    /// Finds or loads the page, under the lock.
+    SlotRef acquire_page(const uint64_t key, MicroCache& micro_cache);
+    void lru_unlink(const uint32_t slot) noexcept;
+    void lru_push_front(const uint32_t slot) noexcept;
+
+    const uint64_t _id;
+    const uint32_t _slots_count;
+    std::unique_ptr<uint32_t[]> _slot_texels;
+    /// kNoTag while the slot is empty or being loaded
+    std::unique_ptr<std::atomic<uint64_t>[]> _slot_tags;
+
+    mutable std::mutex _mtx;
+    std::vector<std::unique_ptr<const MappedTextureFile>> _files;
+    /// (file << 32) | page of every slot in use, and the other way around
+    std::vector<uint64_t> _slot_keys;
+    std::unordered_map<uint64_t, uint32_t> _slot_of_key;
+    std::vector<uint32_t> _lru_prev;
+    std::vector<uint32_t> _lru_next;
+    uint32_t _lru_head{kNoSlot};
+    uint32_t _lru_tail{kNoSlot};
+    uint32_t _slots_used{};
+    uint64_t _next_tag{kNoTag + 1};
+    TextureCacheStats _stats{};
+};
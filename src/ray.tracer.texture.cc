@@ -0,0 +1,266 @@
+#include "ray.tracer.texture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cassert>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <system_error>
+
+#include <glm/common.hpp>
+#include <glm/vec4.hpp>
+
+#include <stb_image.h>
+
+#include "ray.tracer.texture.cache.hpp"
+
+namespace {
+
+float srgb_to_linear(const float c) noexcept {
+    return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+}
+
+uint32_t linear_to_srgb8(const float c) noexcept {
+    const float srgb = c <= 0.0031308f ? c * 12.92f : 1.055f * std::pow(c, 1.0f / 2.4f) - 0.055f;
+    return static_cast<uint32_t>(std::clamp(srgb, 0.0f, 1.0f) * 255.0f + 0.5f);
+}
+
+const std::array<float, 256> kSrgbToLinear = [] {
+    std::array<float, 256> table{};
+    for (uint32_t i = 0; i < table.size(); ++i) {
+        table[i] = srgb_to_linear(static_cast<float>(i) / 255.0f);
+    }
+    return table;
+}();
+
+glm::vec4 decode_texel(const uint32_t rgba8) noexcept {
+    return glm::vec4{kSrgbToLinear[rgba8 & 0xFF], kSrgbToLinear[(rgba8 >> 8) & 0xFF],
+                     kSrgbToLinear[(rgba8 >> 16) & 0xFF], static_cast<float>(rgba8 >> 24) / 255.0f};
+}
+
+uint32_t encode_texel(const glm::vec4& linear) noexcept {
+    const uint32_t alpha = static_cast<uint32_t>(std::clamp(linear.a, 0.0f, 1.0f) * 255.0f + 0.5f);
+    return linear_to_srgb8(linear.r) | (linear_to_srgb8(linear.g) << 8) | (linear_to_srgb8(linear.b) << 16) |
+           (alpha << 24);
+}
+
+/// x modulo size, for negative x too
+int32_t wrap(const int32_t x, const uint32_t size) noexcept {
+    const int32_t r = x % static_cast<int32_t>(size);
+    return r < 0 ? r + static_cast<int32_t>(size) : r;
+}
+
+} // namespace
+
+tl::expected<TiledTexture, SystemError> TiledTexture::from_file(const std::filesystem::path& path,
+                                                                const TextureFilter filter) {
+    const std::string s_path = path.string();
+    int32_t width{};
+    int32_t height{};
+    int32_t channels{};
+
+    std::unique_ptr<stbi_uc, decltype(&stbi_image_free)> pixels{
+        stbi_load(s_path.c_str(), &width, &height, &channels, STBI_rgb_alpha), &stbi_image_free};
+    if (!pixels) {
+        return tl::make_unexpected(SystemError{std::make_error_code(std::errc::io_error)});
+    }
+
+    //
+    // stbi_load() returns R, G, B, A bytes, the same layout as the RGBA8 texels on little endian targets
+    static_assert(std::endian::native == std::endian::little);
+    std::vector<uint32_t> texels(static_cast<size_t>(width) * static_cast<size_t>(height));
+    std::memcpy(texels.data(), pixels.get(), texels.size() * sizeof(uint32_t));
+
+    return from_pixels(texels, static_cast<uint32_t>(width), static_cast<uint32_t>(height), filter);
+}
+
+TiledTexture TiledTexture::from_pixels(std::span<const uint32_t> pixels, const uint32_t width, const uint32_t height,
+                                       const TextureFilter filter) {
+    assert(width > 0 && height > 0 && pixels.size() >= static_cast<size_t>(width) * height);
+    constexpr uint32_t kTileSize = TextureTile::kTileSize;
+    constexpr uint32_t kTileSizeLog2 = TextureTile::kTileSizeLog2;
+
+    TiledTexture texture{};
+    texture._filter = filter;
+
+    uint32_t pages_count{};
+    uint32_t tiles_count{};
+    for (uint32_t level_width = width, level_height = height;;) {
+        const uint32_t tiles_x = (level_width + kTileSize - 1) >> kTileSizeLog2;
+        const uint32_t tiles_y = (level_height + kTileSize - 1) >> kTileSizeLog2;
+        const uint32_t pages_x = (tiles_x + kPageTiles - 1) >> kPageTilesLog2;
+        const uint32_t pages_y = (tiles_y + kPageTiles - 1) >> kPageTilesLog2;
+
+        //
+        // the pages on the right and bottom borders are padded to the full page size
+        const MipLevel level{
+            .Width = level_width,
+            .Height = level_height,
+            .PagesX = pages_x,
+            .PageTilesX = std::min(tiles_x, kPageTiles),
+            .PageTilesY = std::min(tiles_y, kPageTiles),
+            .FirstPage = pages_count,
+            .FirstTile = tiles_count,
+        };
+        texture._levels.push_back(level);
+        pages_count += pages_x * pages_y;
+        tiles_count += pages_x * pages_y * level.page_tiles();
+
+        if (level_width == 1 && level_height == 1) {
+            break;
+        }
+        level_width = std::max(1u, level_width / 2);
+        level_height = std::max(1u, level_height / 2);
+    }
+    texture._tiles.resize(tiles_count);
+
+    auto store_texel = [&texture](const MipLevel& level, const uint32_t x, const uint32_t y, const uint32_t rgba8) {
+        const TexelLocation texel = locate(level, x, y);
+        TextureTile& tile = texture._tiles[level.FirstTile + (texel.Page - level.FirstPage) * level.page_tiles() +
+                                           (texel.PageTexel >> (2 * kTileSizeLog2))];
+        tile.Texels[texel.PageTexel & (kTileSize * kTileSize - 1)] = rgba8;
+    };
+
+    const MipLevel& base = texture._levels.front();
+    for (uint32_t y = 0; y < height; ++y) {
+        for (uint32_t x = 0; x < width; ++x) {
+            store_texel(base, x, y, pixels[static_cast<size_t>(y) * width + x]);
+        }
+    }
+
+    //
+    // 2x2 box filter in linear space, the odd row/column of odd sized levels is folded into the last texel
+    for (size_t level_idx = 1; level_idx < texture._levels.size(); ++level_idx) {
+        const MipLevel& src = texture._levels[level_idx - 1];
+        const MipLevel& dst = texture._levels[level_idx];
+
+        for (uint32_t y = 0; y < dst.Height; ++y) {
+            for (uint32_t x = 0; x < dst.Width; ++x) {
+                const uint32_t x0 = std::min(2 * x, src.Width - 1);
+                const uint32_t y0 = std::min(2 * y, src.Height - 1);
+                const uint32_t x1 = std::min(2 * x + 1, src.Width - 1);
+                const uint32_t y1 = std::min(2 * y + 1, src.Height - 1);
+
+                const glm::vec4 sum = decode_texel(texture.texel_rgba8(src, x0, y0)) +
+                                      decode_texel(texture.texel_rgba8(src, x1, y0)) +
+                                      decode_texel(texture.texel_rgba8(src, x0, y1)) +
+                                      decode_texel(texture.texel_rgba8(src, x1, y1));
+                store_texel(dst, x, y, encode_texel(sum * 0.25f));
+            }
+        }
+    }
+
+    return texture;
+}
+
+TiledTexture TiledTexture::from_cache(std::shared_ptr<TextureCache> cache, const uint32_t file,
+                                      const TextureFilter filter) {
+    TiledTexture texture{};
+    const std::span<const MipLevel> levels = cache->file(file).levels();
+    texture._levels.assign(levels.begin(), levels.end());
+    texture._cache = std::move(cache);
+    texture._cache_file = file;
+    texture._filter = filter;
+    return texture;
+}
+
+TiledTexture::TexelLocation TiledTexture::locate(const MipLevel& level, const uint32_t x, const uint32_t y) noexcept {
+    constexpr uint32_t kTileSize = TextureTile::kTileSize;
+    constexpr uint32_t kTileSizeLog2 = TextureTile::kTileSizeLog2;
+
+    assert(x < level.Width && y < level.Height);
+    const uint32_t tile_x = x >> kTileSizeLog2;
+    const uint32_t tile_y = y >> kTileSizeLog2;
+    const uint32_t page_tile = (tile_y & (kPageTiles - 1)) * level.PageTilesX + (tile_x & (kPageTiles - 1));
+    return TexelLocation{
+        .Page = level.FirstPage + (tile_y >> kPageTilesLog2) * level.PagesX + (tile_x >> kPageTilesLog2),
+        .PageTexel = (page_tile << (2 * kTileSizeLog2)) | ((y & (kTileSize - 1)) << kTileSizeLog2) |
+                     (x & (kTileSize - 1)),
+    };
+}
+
+uint32_t TiledTexture::texel_rgba8(const MipLevel& level, const uint32_t x, const uint32_t y) const noexcept {
+    constexpr uint32_t kTileSize = TextureTile::kTileSize;
+    constexpr uint32_t kTileSizeLog2 = TextureTile::kTileSizeLog2;
+
+    const TexelLocation texel = locate(level, x, y);
+    if (_cache) {
+        return _cache->texel(_cache_file, texel.Page, texel.PageTexel);
+    }
+
+    const TextureTile& tile = _tiles[level.FirstTile + (texel.Page - level.FirstPage) * level.page_tiles() +
+                                     (texel.PageTexel >> (2 * kTileSizeLog2))];
+    return tile.Texels[texel.PageTexel & (kTileSize * kTileSize - 1)];
+}
+
+glm::vec3 TiledTexture::texel(const uint32_t level, const int32_t x, const int32_t y) const noexcept {
+    assert(level < _levels.size());
+    const MipLevel& mip = _levels[level];
+    return glm::vec3{decode_texel(
+        texel_rgba8(mip, static_cast<uint32_t>(wrap(x, mip.Width)), static_cast<uint32_t>(wrap(y, mip.Height))))};
+}
+
+glm::vec3 TiledTexture::bilinear(const uint32_t level, const glm::vec2 uv) const noexcept {
+    const MipLevel& mip = _levels[level];
+
+    //
+    // texel centers are at half integers
+    const float x = uv.x * static_cast<float>(mip.Width) - 0.5f;
+    const float y = uv.y * static_cast<float>(mip.Height) - 0.5f;
+    const float x_floor = std::floor(x);
+    const float y_floor = std::floor(y);
+    const float fx = x - x_floor;
+    const float fy = y - y_floor;
+
+    //
+    // uv is in [0, 1), so the footprint only wraps at the borders: x0 >= -1 and x1 <= Width
+    const uint32_t x0 = x_floor < 0.0f ? mip.Width - 1 : std::min(static_cast<uint32_t>(x_floor), mip.Width - 1);
+    const uint32_t y0 = y_floor < 0.0f ? mip.Height - 1 : std::min(static_cast<uint32_t>(y_floor), mip.Height - 1);
+    const uint32_t x1 = x0 + 1 == mip.Width ? 0 : x0 + 1;
+    const uint32_t y1 = y0 + 1 == mip.Height ? 0 : y0 + 1;
+
+    const glm::vec4 top = glm::mix(decode_texel(texel_rgba8(mip, x0, y0)), decode_texel(texel_rgba8(mip, x1, y0)), fx);
+    const glm::vec4 bottom =
+        glm::mix(decode_texel(texel_rgba8(mip, x0, y1)), decode_texel(texel_rgba8(mip, x1, y1)), fx);
+    return glm::vec3{glm::mix(top, bottom, fy)};
+}
+
+float TiledTexture::lod(const float uv_footprint) const noexcept {
+    const float texels = static_cast<float>(width()) * static_cast<float>(height());
+    return std::max(0.0f, std::log2(uv_footprint * std::sqrt(texels)));
+}
+
+glm::vec3 TiledTexture::sample(const glm::vec2 uv, const float lod) const noexcept {
+    const float max_level = static_cast<float>(_levels.size() - 1);
+    const float level = std::clamp(lod, 0.0f, max_level);
+    //
+    // v goes up, the rows of the image go down
+    const glm::vec2 image_uv{uv.x, 1.0f - uv.y};
+    const glm::vec2 wrapped_uv = image_uv - glm::floor(image_uv);
+
+    switch (_filter) {
+    case TextureFilter::Nearest: {
+        const MipLevel& mip = _levels[static_cast<uint32_t>(level + 0.5f)];
+        const uint32_t x = std::min(static_cast<uint32_t>(wrapped_uv.x * static_cast<float>(mip.Width)), mip.Width - 1);
+        const uint32_t y =
+            std::min(static_cast<uint32_t>(wrapped_uv.y * static_cast<float>(mip.Height)), mip.Height - 1);
+        return glm::vec3{decode_texel(texel_rgba8(mip, x, y))};
+    }
+
+    case TextureFilter::Trilinear: {
+        const float level_floor = std::floor(level);
+        const uint32_t level0 = static_cast<uint32_t>(level_floor);
+        const float blend = level - level_floor;
+        if (blend == 0.0f) {
+            return bilinear(level0, wrapped_uv);
+        }
+        return glm::mix(bilinear(level0, wrapped_uv), bilinear(level0 + 1, wrapped_uv), blend);
+    }
+
+    default:
+        return bilinear(static_cast<uint32_t>(level + 0.5f), wrapped_uv);
+    }
+}
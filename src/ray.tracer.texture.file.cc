@@ -0,0 +1,177 @@
+#include "ray.tracer.texture.file.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <system_error>
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr uint64_t round_up(const uint64_t value, const uint64_t alignment) noexcept {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+} // namespace
+
+tl::expected<void, SystemError> write_texture_file(const TiledTexture& texture, const std::filesystem::path& path) {
+    const std::span<const TiledTexture::MipLevel> levels = texture.levels();
+    const std::span<const TextureTile> tiles = texture.tiles();
+    if (tiles.empty()) {
+        return tl::make_unexpected(SystemError{std::make_error_code(std::errc::invalid_argument)});
+    }
+
+    const TiledTexture::MipLevel& last_level = levels.back();
+    const TextureFileHeader header{
+        .Magic = TextureFileHeader::kMagic,
+        .Version = TextureFileHeader::kVersion,
+        .Width = texture.width(),
+        .Height = texture.height(),
+        .LevelsCount = static_cast<uint32_t>(levels.size()),
+        .PagesCount = last_level.FirstPage + 1,
+        .TilesCount = static_cast<uint32_t>(tiles.size()),
+        .TileSizeLog2 = TextureTile::kTileSizeLog2,
+        .PageTilesLog2 = TiledTexture::kPageTilesLog2,
+        .Reserved = 0,
+        .DataOffset =
+            round_up(sizeof(TextureFileHeader) + levels.size_bytes(), TextureFileHeader::kDataAlignment),
+    };
+
+    std::ofstream file{path, std::ios::binary | std::ios::trunc};
+    if (!file) {
+        return tl::make_unexpected(SystemError{std::make_error_code(std::errc::io_error)});
+    }
+
+    const std::vector<char> padding(header.DataOffset - sizeof(TextureFileHeader) - levels.size_bytes(), 0);
+    file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(levels.data()), static_cast<std::streamsize>(levels.size_bytes()));
+    file.write(padding.data(), static_cast<std::streamsize>(padding.size()));
+    file.write(reinterpret_cast<const char*>(tiles.data()), static_cast<std::streamsize>(tiles.size_bytes()));
+
+    if (!file.flush()) {
+        return tl::make_unexpected(SystemError{std::make_error_code(std::errc::io_error)});
+    }
+    return {};
+}
+
+std::span<const TextureTile> MappedTextureFile::page_tiles(const uint32_t page) const noexcept {
+    const PageRange range = _pages[page];
+    return std::span{tiles() + range.FirstTile, range.TilesCount};
+}
+
+const TextureTile* MappedTextureFile::tiles() const noexcept {
+    return reinterpret_cast<const TextureTile*>(static_cast<const std::byte*>(_mapping) + _header.DataOffset);
+}
+
+#if defined(__unix__) || defined(__APPLE__)
+
+tl::expected<MappedTextureFile, SystemError> MappedTextureFile::open(const std::filesystem::path& path) {
+    const int32_t fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+        return tl::make_unexpected(SystemError{std::error_code{errno, std::system_category()}});
+    }
+
+    struct stat file_stat {};
+    if (fstat(fd, &file_stat) != 0) {
+        const SystemError err{std::error_code{errno, std::system_category()}};
+        close(fd);
+        return tl::make_unexpected(err);
+    }
+
+    const size_t file_bytes = static_cast<size_t>(file_stat.st_size);
+    if (file_bytes < sizeof(TextureFileHeader)) {
+        close(fd);
+        return tl::make_unexpected(SystemError{std::make_error_code(std::errc::illegal_byte_sequence)});
+    }
+
+    void* mapping = mmap(nullptr, file_bytes, PROT_READ, MAP_PRIVATE, fd, 0);
+    const int32_t mmap_errno = errno;
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return tl::make_unexpected(SystemError{std::error_code{mmap_errno, std::system_category()}});
+    }
+
+    //
+    // the lookups land anywhere in the file, no read ahead
+    madvise(mapping, file_bytes, MADV_RANDOM);
+
+    TextureFileHeader header{};
+    std::memcpy(&header, mapping, sizeof(header));
+
+    const size_t levels_end = sizeof(TextureFileHeader) + size_t{header.LevelsCount} * sizeof(TiledTexture::MipLevel);
+    if (header.Magic != TextureFileHeader::kMagic || header.Version != TextureFileHeader::kVersion ||
+        header.TileSizeLog2 != TextureTile::kTileSizeLog2 || header.PageTilesLog2 != TiledTexture::kPageTilesLog2 ||
+        header.LevelsCount == 0 || levels_end > header.DataOffset ||
+        header.DataOffset % TextureFileHeader::kDataAlignment != 0 ||
+        header.DataOffset + uint64_t{header.TilesCount} * sizeof(TextureTile) > file_bytes) {
+        munmap(mapping, file_bytes);
+        return tl::make_unexpected(SystemError{std::make_error_code(std::errc::illegal_byte_sequence)});
+    }
+
+    std::vector<TiledTexture::MipLevel> levels(header.LevelsCount);
+    std::memcpy(levels.data(), static_cast<const std::byte*>(mapping) + sizeof(TextureFileHeader),
+                levels.size() * sizeof(TiledTexture::MipLevel));
+
+    //
+    // page ranges of every level, a page past the tiles of the file means a broken level table
+    std::vector<PageRange> pages(header.PagesCount);
+    for (size_t level_idx = 0; level_idx < levels.size(); ++level_idx) {
+        const TiledTexture::MipLevel& level = levels[level_idx];
+        const uint32_t next_first_page =
+            level_idx + 1 < levels.size() ? levels[level_idx + 1].FirstPage : header.PagesCount;
+        if (level.page_tiles() == 0 || level.FirstPage >= next_first_page) {
+            munmap(mapping, file_bytes);
+            return tl::make_unexpected(SystemError{std::make_error_code(std::errc::illegal_byte_sequence)});
+        }
+
+        for (uint32_t page = level.FirstPage; page < next_first_page; ++page) {
+            const PageRange range{
+                .FirstTile = level.FirstTile + (page - level.FirstPage) * level.page_tiles(),
+                .TilesCount = level.page_tiles(),
+            };
+            if (page >= pages.size() || uint64_t{range.FirstTile} + range.TilesCount > header.TilesCount) {
+                munmap(mapping, file_bytes);
+                return tl::make_unexpected(SystemError{std::make_error_code(std::errc::illegal_byte_sequence)});
+            }
+            pages[page] = range;
+        }
+    }
+
+    return MappedTextureFile{mapping, file_bytes, header, std::move(levels), std::move(pages)};
+}
+
+MappedTextureFile::~MappedTextureFile() {
+    if (_mapping) {
+        munmap(_mapping, _mapping_bytes);
+    }
+}
+
+void MappedTextureFile::release_page(const uint32_t page) const noexcept {
+    //
+    // only the memory pages entirely inside the range, the ones shared with the neighbour pages stay mapped
+    static const uintptr_t kMemoryPageBytes = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+    const std::span<const TextureTile> tiles = page_tiles(page);
+    const uintptr_t first = round_up(reinterpret_cast<uintptr_t>(tiles.data()), kMemoryPageBytes);
+    const uintptr_t last = (reinterpret_cast<uintptr_t>(tiles.data() + tiles.size()) / kMemoryPageBytes) *
+                           kMemoryPageBytes;
+    if (first < last) {
+        madvise(reinterpret_cast<void*>(first), last - first, MADV_DONTNEED);
+    }
+}
+
+#else
+
+tl::expected<MappedTextureFile, SystemError> MappedTextureFile::open(const std::filesystem::path&) {
+    return tl::make_unexpected(SystemError{std::make_error_code(std::errc::not_supported)});
+}
+
+MappedTextureFile::~MappedTextureFile() = default;
+void MappedTextureFile::release_page(const uint32_t) const noexcept {}
+
+#endif
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <span>
+#include <utility>
+#include <vector>
+
+#include <tl/expected.hpp>
+
+#include "error.hpp"
+#include "ray.tracer.texture.hpp"
+
+/// Texture file (.xtex), little endian: this header, the TiledTexture::MipLevel of every level and, from DataOffset
+/// (a multiple of kDataAlignment), the tiles of all the levels in TiledTexture::tiles() order. Every page of the
+/// texture is one contiguous range of the file.
+struct TextureFileHeader {
+    /// "XTEX"
+    static constexpr uint32_t kMagic = 0x58455458;
+    static constexpr uint32_t kVersion = 1;
+    static constexpr uint64_t kDataAlignment = 4096;
+
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t LevelsCount;
+    uint32_t PagesCount;
+    uint32_t TilesCount;
+    uint32_t TileSizeLog2;
+    uint32_t PageTilesLog2;
+    uint32_t Reserved;
+    uint64_t DataOffset;
+};
+
+/// Writes a resident texture as a texture file, the offline conversion step (see --convert-texture).
+tl::expected<void, SystemError> write_texture_file(const TiledTexture& texture, const std::filesystem::path& path);
+
+/// Read only mapping of a texture file. Only the header and the level table are read when the file is opened, the
+/// tiles are paged in by the kernel when the TextureCache copies them. Only available on POSIX systems.
+class MappedTextureFile {
+public:
+    static tl::expected<MappedTextureFile, SystemError> open(const std::filesystem::path& path);
+
+    ~MappedTextureFile();
+
+    MappedTextureFile(const MappedTextureFile&) = delete;
+    MappedTextureFile& operator=(const MappedTextureFile&) = delete;
+
+    MappedTextureFile(MappedTextureFile&& rhs) noexcept
+        : _mapping{std::exchange(rhs._mapping, nullptr)}, _mapping_bytes{std::exchange(rhs._mapping_bytes, 0)},
+          _header{rhs._header}, _levels{std::move(rhs._levels)}, _pages{std::move(rhs._pages)} {}
+
+    MappedTextureFile& operator=(MappedTextureFile&&) = delete;
+
+    uint32_t width() const noexcept { return _header.Width; }
+    uint32_t height() const noexcept { return _header.Height; }
+    std::span<const TiledTexture::MipLevel> levels() const noexcept { return _levels; }
+    uint32_t pages_count() const noexcept { return _header.PagesCount; }
+    size_t size_bytes() const noexcept { return _mapping_bytes; }
+
+    /// Tiles of a page (pages are numbered across the levels, see TiledTexture::MipLevel::FirstPage).
+    std::span<const TextureTile> page_tiles(const uint32_t page) const noexcept;
+    /// Drops the mapped memory pages of a page from the process once the cache has copied it, the resident set stays
+    /// at the cache budget. The next page_tiles() of that page reads it from the file (or the page cache) again.
+    void release_page(const uint32_t page) const noexcept;
+
+private:
+    /// tiles of a page, in the tiles of the file
+    struct PageRange {
+        uint32_t FirstTile;
+        uint32_t TilesCount;
+    };
+
+    MappedTextureFile(void* mapping, const size_t mapping_bytes, const TextureFileHeader& header,
+                      std::vector<TiledTexture::MipLevel> levels, std::vector<PageRange> pages) noexcept
+        : _mapping{mapping}, _mapping_bytes{mapping_bytes}, _header{header}, _levels{std::move(levels)},
+          _pages{std::move(pages)} {}
+
+    const TextureTile* tiles() const noexcept;
+
+    void* _mapping{};
+    size_t _mapping_bytes{};
+    TextureFileHeader _header{};
+    std::vector<TiledTexture::MipLevel> _levels;
+    std::vector<PageRange> _pages;
+};
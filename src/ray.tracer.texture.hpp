@@ -0,0 +1,149 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <vector>
+
+#include <glm/vec2.hpp>
+#include <glm/vec3.hpp>
+#include <tl/expected.hpp>
+
+#include "error.hpp"
+
+class TextureCache;
+
+enum class TextureFilter : uint8_t {
+    Nearest,
+    Bilinear,
+    /// bilinear in the two levels around the LOD, blended
+    Trilinear,
+};
+
+constexpr const char* texture_filter_name(const TextureFilter filter) noexcept {
+    switch (filter) {
+    case TextureFilter::Nearest:
+        return "nearest";
+    case TextureFilter::Bilinear:
+        return "bilinear";
+    case TextureFilter::Trilinear:
+        return "trilinear";
+    default:
+        return "Unknown";
+    }
+}
+
+/// kTileSize x kTileSize texels, row major: 4x4 RGBA8 texels are one cache line, so the 2x2 footprint of a bilinear
+/// lookup touches one line most of the time and never more than four, wherever the hit lands.
+struct alignas(64) TextureTile {
+    static constexpr uint32_t kTileSizeLog2 = 2;
+    static constexpr uint32_t kTileSize = 1u << kTileSizeLog2;
+
+    /// RGBA8, sRGB encoded, R in the low byte
+    uint32_t Texels[kTileSize * kTileSize];
+};
+
+/// Albedo texture for the CPU ray tracer: a mip pyramid (box filtered down to 1x1) of tiled levels, addressed with
+/// wrapping UVs (v = 0 is the bottom row of the image). Lookups return linear RGB.
+///
+/// The tiles of a level are grouped in pages of kPageTiles x kPageTiles tiles (64x64 texels, 16 KB), a page is
+/// contiguous and is the unit the TextureCache loads. The tiles are either resident (from_file(), from_pixels()) or
+/// paged in from a texture file through a TextureCache (from_cache()).
+class TiledTexture {
+public:
+    static constexpr uint32_t kPageTilesLog2 = 4;
+    static constexpr uint32_t kPageTiles = 1u << kPageTilesLog2;
+
+    struct MipLevel {
+        uint32_t Width;
+        uint32_t Height;
+        /// pages per row
+        uint32_t PagesX;
+        /// tiles per row and per column of a page, less than kPageTiles for the levels smaller than a page
+        uint32_t PageTilesX;
+        uint32_t PageTilesY;
+        /// index of the first page of the level, pages are numbered across the levels
+        uint32_t FirstPage;
+        /// index of the first tile of the level
+        uint32_t FirstTile;
+
+        uint32_t page_tiles() const noexcept { return PageTilesX * PageTilesY; }
+    };
+
+    /// Decodes the file with stb_image (any format it reads, 8 bits per channel) and builds the pyramid.
+    static tl::expected<TiledTexture, SystemError> from_file(const std::filesystem::path& path,
+                                                             const TextureFilter filter);
+    /// Tiles width x height RGBA8 sRGB texels (row major) and builds the pyramid.
+    static TiledTexture from_pixels(std::span<const uint32_t> pixels, const uint32_t width, const uint32_t height,
+                                    const TextureFilter filter);
+    /// Texture file added to cache (TextureCache::add_file()), the texels are read through the cache.
+    static TiledTexture from_cache(std::shared_ptr<TextureCache> cache, const uint32_t file,
+                                   const TextureFilter filter);
+
+    /// Filtered color at uv, lod is the mip level (fractional for trilinear filtering, clamped to the pyramid).
+    glm::vec3 sample(const glm::vec2 uv, const float lod = 0.0f) const noexcept;
+    /// Mip level for a lookup whose footprint is uv_footprint UV units wide (see RayCone::uv_footprint()): log2 of the
+    /// texels of level 0 it covers, 0 for a footprint narrower than a texel.
+    float lod(const float uv_footprint) const noexcept;
+    /// Unfiltered texel of a level, x and y wrap.
+    glm::vec3 texel(const uint32_t level, const int32_t x, const int32_t y) const noexcept;
+
+    uint32_t width() const noexcept { return _levels.front().Width; }
+    uint32_t height() const noexcept { return _levels.front().Height; }
+    std::span<const MipLevel> levels() const noexcept { return _levels; }
+    TextureFilter filter() const noexcept { return _filter; }
+    /// tiles of all the levels, empty for a texture read through a cache
+    std::span<const TextureTile> tiles() const noexcept { return _tiles; }
+    /// bytes of the resident tiles, the pages of a cached texture are accounted for by the cache
+    size_t size_bytes() const noexcept { return _tiles.size() * sizeof(TextureTile); }
+
+private:
+    /// Where a texel lives: the page (numbered across the levels) and the index of the texel in the page.
+    struct TexelLocation {
+        uint32_t Page;
+        uint32_t PageTexel;
+    };
+
+    TiledTexture() = default;
+
+    /// x, y inside the level
+    static TexelLocation locate(const MipLevel& level, const uint32_t x, const uint32_t y) noexcept;
+    /// x, y inside the level
+    uint32_t texel_rgba8(const MipLevel& level, const uint32_t x, const uint32_t y) const noexcept;
+    glm::vec3 bilinear(const uint32_t level, const glm::vec2 uv) const noexcept;
+
+    std::vector<MipLevel> _levels;
+    std::vector<TextureTile> _tiles;
+    std::shared_ptr<TextureCache> _cache;
+    uint32_t _cache_file{};
+    TextureFilter _filter{TextureFilter::Bilinear};
+};
+
+/// Textures of a scene. Materials point to them (see Material_Lambertian::AlbedoTexture), the textures are shared
+/// with every copy of the collection so the pointers stay valid in all the snapshots that hold one. So is the cache
+/// the file backed textures are read through.
+class TextureCollection {
+public:
+    const TiledTexture* add(std::shared_ptr<const TiledTexture> texture) {
+        _textures.push_back(std::move(texture));
+        return _textures.back().get();
+    }
+
+    size_t size() const noexcept { return _textures.size(); }
+
+    const std::shared_ptr<TextureCache>& cache() const noexcept { return _cache; }
+    void set_cache(std::shared_ptr<TextureCache> cache) noexcept { _cache = std::move(cache); }
+
+    size_t size_bytes() const noexcept {
+        size_t bytes{};
+        for (const std::shared_ptr<const TiledTexture>& texture : _textures) {
+            bytes += texture->size_bytes();
+        }
+        return bytes;
+    }
+
+private:
+    std::vector<std::shared_ptr<const TiledTexture>> _textures;
+    std::shared_ptr<TextureCache> _cache;
+};
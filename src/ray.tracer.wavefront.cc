@@ -0,0 +1,266 @@
+#include "ray.tracer.wavefront.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <numeric>
+
+#include "bounding.box.hpp"
+#include "morton.code.hpp"
+#include "ray.tracer.core.hpp"
+#include "ray.tracer.scene.snapshot.hpp"
+
+namespace {
+
+uint32_t direction_octant(const glm::vec3& dir) noexcept {
+    return (dir.x < 0.0f ? 1u : 0u) | (dir.y < 0.0f ? 2u : 0u) | (dir.z < 0.0f ? 4u : 0u);
+}
+
+} // namespace
+
+void WavefrontIntegrator::render_tile(const RayTracingCore& rtcore, const uint32_t start_x, const uint32_t start_y,
+                                      const uint32_t end_x, const uint32_t end_y, const SceneSnapshot& scene,
+                                      RandomNumberGenerator& randgen, std::span<RGBAColor> tile_colors) {
+    assert(tile_colors.size() >= static_cast<size_t>(end_x - start_x) * (end_y - start_y));
+
+    generate(rtcore, start_x, start_y, end_x, end_y, randgen);
+
+    //
+    // a path alive after rts_maxdepth extensions contributes nothing, like compute_color() at depth 0
+    for (uint32_t bounce = 0; bounce < rtcore.rts_maxdepth && _paths.size() != 0; ++bounce) {
+        extend(scene.World, bounce == 0);
+        shade(scene, rtcore.rts_light_sampling, randgen);
+        if (bounce + 1 >= rtcore.rts_russian_roulette_depth && bounce + 1 < rtcore.rts_maxdepth) {
+            roulette(randgen);
+        }
+        compact();
+        _stats.Bounces += 1;
+    }
+
+    for (size_t pixel = 0; pixel < _radiance.size(); ++pixel) {
+        tile_colors[pixel] = RGBAColor{_radiance[pixel] * rtcore.rts_pixels_sample_scale, _accuracy};
+    }
+}
+
+void WavefrontIntegrator::generate(const RayTracingCore& rtcore, const uint32_t start_x, const uint32_t start_y,
+                                   const uint32_t end_x, const uint32_t end_y, RandomNumberGenerator& randgen) {
+    const uint32_t tile_width = end_x - start_x;
+    const size_t pixels_count = static_cast<size_t>(tile_width) * (end_y - start_y);
+
+    _radiance.assign(pixels_count, glm::vec3{0.0f});
+    _paths.resize(pixels_count * rtcore.rts_samples_per_pixel);
+    _packet_starts.clear();
+
+    //
+    // same packet order as RayTracingCore::raytrace_tile(), so the primary rays can be extended as packets
+    uint32_t path{};
+    for (uint32_t sample = 0; sample < rtcore.rts_samples_per_pixel; ++sample) {
+        for (uint32_t packet_y = start_y; packet_y < end_y; packet_y += RayTracingCore::kPacketHeight) {
+            for (uint32_t packet_x = start_x; packet_x < end_x; packet_x += RayTracingCore::kPacketWidth) {
+                _packet_starts.push_back(path);
+
+                for (uint32_t y = packet_y; y < std::min(packet_y + RayTracingCore::kPacketHeight, end_y); ++y) {
+                    for (uint32_t x = packet_x; x < std::min(packet_x + RayTracingCore::kPacketWidth, end_x); ++x) {
+                        _paths.Rays[path] = rtcore.get_ray(x, y, randgen);
+                        _paths.Throughput[path] = glm::vec3{1.0f};
+                        _paths.Pixel[path] = (y - start_y) * tile_width + (x - start_x);
+                        _paths.Alive[path] = 1;
+                        _paths.ScatterPdf[path] = 0.0f;
+                        path += 1;
+                    }
+                }
+            }
+        }
+    }
+    _packet_starts.push_back(path);
+
+    _stats.Paths += _paths.size();
+}
+
+void WavefrontIntegrator::extend(const HittableObject_Collection& world, const bool primary) {
+    if (primary) {
+        for (size_t packet = 0; packet + 1 < _packet_starts.size(); ++packet) {
+            const uint32_t first = _packet_starts[packet];
+            const uint32_t count = _packet_starts[packet + 1] - first;
+            world.closest_hit_packet(std::span{_paths.Rays}.subspan(first, count), RayTracingCore::kRayInterval,
+                                     std::span{_paths.Hit}.subspan(first, count));
+        }
+        _stats.ExtendedRays += _paths.size();
+        return;
+    }
+
+    const auto sort_start = std::chrono::steady_clock::now();
+    _trace_order.resize(_paths.size());
+    if (_ray_sort.Enabled) {
+        sort_secondary_rays();
+    } else {
+        std::iota(_trace_order.begin(), _trace_order.end(), 0u);
+    }
+
+    const auto trace_start = std::chrono::steady_clock::now();
+    for (const uint32_t path : _trace_order) {
+        _paths.Hit[path] = world.closest_hit(_paths.Rays[path], RayTracingCore::kRayInterval);
+    }
+    const auto trace_end = std::chrono::steady_clock::now();
+
+    RaySortStats& sort_stats = _stats.RaySort;
+    sort_stats.SecondaryRays += _paths.size();
+    sort_stats.SortMilliseconds += std::chrono::duration<double, std::milli>(trace_start - sort_start).count();
+    sort_stats.TraceMilliseconds += std::chrono::duration<double, std::milli>(trace_end - trace_start).count();
+    sort_stats.CoherentPairsTraceOrder += coherent_pairs(_trace_order);
+    if (_ray_sort.Enabled) {
+        std::iota(_trace_order.begin(), _trace_order.end(), 0u);
+    }
+    sort_stats.CoherentPairsQueueOrder += coherent_pairs(_trace_order);
+
+    _stats.ExtendedRays += _paths.size();
+}
+
+void WavefrontIntegrator::sort_secondary_rays() {
+    //
+    // Morton codes relative to the origins of this queue, not the scene: the ground sphere alone would leave a handful
+    // of cells for everything else
+    BoundingBox origin_bounds{};
+    for (const Ray& r : _paths.Rays) {
+        origin_bounds.grow(r.Origin);
+    }
+    const glm::vec3 inv_extent = 1.0f / glm::max(origin_bounds.extent(), glm::vec3{1.0e-6f});
+
+    //
+    // 3 bits octant over 27 bits Morton code (9 bits per axis), the path index in the low half
+    _sort_keys.resize(_paths.size());
+    for (uint32_t path = 0; path < _paths.size(); ++path) {
+        const Ray& r = _paths.Rays[path];
+        const uint64_t morton = morton_code<uint32_t>((r.Origin - origin_bounds.Min) * inv_extent) >> 3;
+        const uint64_t key = (uint64_t{direction_octant(r.Direction)} << 27) | morton;
+        _sort_keys[path] = (key << 32) | path;
+    }
+
+    const size_t batch_size = _ray_sort.BatchSize == 0 ? _sort_keys.size() : _ray_sort.BatchSize;
+    for (size_t first = 0; first < _sort_keys.size(); first += batch_size) {
+        std::sort(_sort_keys.begin() + first, _sort_keys.begin() + std::min(first + batch_size, _sort_keys.size()));
+    }
+
+    std::ranges::transform(_sort_keys, _trace_order.begin(),
+                           [](const uint64_t sort_key) { return static_cast<uint32_t>(sort_key); });
+}
+
+size_t WavefrontIntegrator::coherent_pairs(std::span<const uint32_t> order) const noexcept {
+    size_t pairs{};
+    for (size_t i = 1; i < order.size(); ++i) {
+        const uint32_t prev_path = order[i - 1];
+        const uint32_t path = order[i];
+        const tl::optional<PrimitiveHit>& prev_hit = _paths.Hit[prev_path];
+        const tl::optional<PrimitiveHit>& hit = _paths.Hit[path];
+        if (prev_hit && hit && prev_hit->Prim == hit->Prim && prev_hit->InstancePrim == hit->InstancePrim &&
+            direction_octant(_paths.Rays[prev_path].Direction) == direction_octant(_paths.Rays[path].Direction)) {
+            pairs += 1;
+        }
+    }
+    return pairs;
+}
+
+void WavefrontIntegrator::shade(const SceneSnapshot& scene, const bool light_sampling,
+                                RandomNumberGenerator& randgen) {
+    for (std::vector<uint64_t>& queue : _material_queues) {
+        queue.clear();
+    }
+
+    //
+    // misses are done, hits get their record built once, add their emission and go to the queue of their material
+    // kind, keyed on (material handle << 32 | path)
+    for (uint32_t path = 0; path < _paths.size(); ++path) {
+        if (!_paths.Hit[path]) {
+            const glm::vec3 miss = RayTracingCore::miss_radiance(scene, _paths.Rays[path], _paths.ScatterPdf[path]);
+            _radiance[_paths.Pixel[path]] += _paths.Throughput[path] * miss;
+            _paths.Alive[path] = 0;
+            continue;
+        }
+
+        _paths.HitRecord[path] = scene.World.intersection_record(_paths.Rays[path], *_paths.Hit[path]);
+        _radiance[_paths.Pixel[path]] +=
+            _paths.Throughput[path] * RayTracingCore::hit_emission(scene, *_paths.Hit[path], _paths.HitRecord[path],
+                                                                   _paths.ScatterP[path], _paths.ScatterPdf[path]);
+        const MaterialHandleType mtl = _paths.HitRecord[path].Material;
+        _material_queues[static_cast<uint32_t>(scene.Materials.kind(mtl))].push_back(
+            (uint64_t{value_of(mtl)} << 32) | path);
+    }
+
+    //
+    // one kernel per kind over batches of kShadeBatchSize hits, the hits of a material next to each other
+    for (uint32_t kind = 0; kind < static_cast<uint32_t>(MaterialKind::Count); ++kind) {
+        std::vector<uint64_t>& queue = _material_queues[kind];
+        std::ranges::sort(queue);
+        _stats.ShadedHits += queue.size();
+
+        for (size_t first = 0; first < queue.size(); first += kShadeBatchSize) {
+            const std::span<const uint64_t> batch_keys =
+                std::span{queue}.subspan(first, std::min(kShadeBatchSize, queue.size() - first));
+
+            _scatter_batch.clear();
+            for (const uint64_t key : batch_keys) {
+                const uint32_t path = static_cast<uint32_t>(key);
+                _scatter_batch.push_back(_paths.Rays[path], _paths.HitRecord[path]);
+            }
+
+            scene.Materials.scatter_batch(static_cast<MaterialKind>(kind), _scatter_batch, randgen, _accuracy);
+
+            //
+            // the light samples of the hits on materials with a PDF, one shadow ray each, absorbed paths included
+            for (size_t hit = 0; hit < batch_keys.size(); ++hit) {
+                const uint32_t path = static_cast<uint32_t>(batch_keys[hit]);
+                const IntersectionRecord& int_rec = _paths.HitRecord[path];
+                const bool samples_lights = light_sampling && scene.Materials.has_pdf(int_rec.Material);
+                if (samples_lights) {
+                    _radiance[_paths.Pixel[path]] +=
+                        _paths.Throughput[path] * RayTracingCore::sample_direct_light(scene, _paths.Rays[path], int_rec,
+                                                                                      scene.Materials[int_rec.Material],
+                                                                                      randgen);
+                }
+
+                if (!_scatter_batch.Scattered[hit]) {
+                    _paths.Alive[path] = 0;
+                    continue;
+                }
+
+                _paths.Throughput[path] *= _scatter_batch.Attenuation[hit];
+                _paths.Rays[path] = _scatter_batch.ScatteredRay[hit];
+                _paths.Alive[path] = 1;
+                _paths.ScatterP[path] = int_rec.P;
+                _paths.ScatterPdf[path] = samples_lights ? _scatter_batch.Pdf[hit] : 0.0f;
+            }
+        }
+    }
+}
+
+void WavefrontIntegrator::roulette(RandomNumberGenerator& randgen) {
+    for (size_t path = 0; path < _paths.size(); ++path) {
+        if (_paths.Alive[path] && !RayTracingCore::survives_russian_roulette(_paths.Throughput[path], randgen)) {
+            _paths.Alive[path] = 0;
+            _stats.RouletteTerminated += 1;
+        }
+    }
+}
+
+void WavefrontIntegrator::compact() {
+    size_t alive_count{};
+    for (size_t path = 0; path < _paths.size(); ++path) {
+        if (!_paths.Alive[path]) {
+            continue;
+        }
+
+        if (path != alive_count) {
+            _paths.Rays[alive_count] = _paths.Rays[path];
+            _paths.Throughput[alive_count] = _paths.Throughput[path];
+            _paths.Pixel[alive_count] = _paths.Pixel[path];
+            _paths.Alive[alive_count] = 1;
+            _paths.ScatterP[alive_count] = _paths.ScatterP[path];
+            _paths.ScatterPdf[alive_count] = _paths.ScatterPdf[path];
+        }
+        alive_count += 1;
+    }
+
+    //
+    // hits and records are rewritten by the next extend/shade
+    _paths.resize(alive_count);
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <tl/optional.hpp>
+
+#include "color.hpp"
+#include "ray.hpp"
+#include "ray.tracer.material.defs.hpp"
+#include "ray.tracer.object.defs.hpp"
+
+class RandomNumberGenerator;
+struct RayTracingCore;
+struct SceneSnapshot;
+
+/// Optional binning of the secondary rays before they are traced: the rays of every batch of BatchSize paths are
+/// traced in (direction octant, Morton code of the origin) order, so consecutive rays tend to visit the same nodes.
+/// Primary rays are coherent already and are never sorted.
+struct RaySortParameters {
+    bool Enabled{false};
+    /// 0 sorts the whole queue at once
+    uint32_t BatchSize{4096};
+};
+
+struct RaySortStats {
+    size_t SecondaryRays{};
+    double SortMilliseconds{};
+    /// secondary extend stages, sorting excluded
+    double TraceMilliseconds{};
+    /// rays that hit the same object as the ray before them and went the same way (octant), once counted in queue
+    /// order and once in the order they were traced
+    size_t CoherentPairsQueueOrder{};
+    size_t CoherentPairsTraceOrder{};
+};
+
+struct WavefrontStats {
+    size_t Paths{};
+    size_t ExtendedRays{};
+    size_t ShadedHits{};
+    /// paths ended by Russian roulette
+    size_t RouletteTerminated{};
+    uint32_t Bounces{};
+    RaySortStats RaySort{};
+};
+
+/// State of every path in flight, one array per field: index i of all the arrays is the same path.
+struct WavefrontPathQueue {
+    std::vector<Ray> Rays;
+    std::vector<glm::vec3> Throughput;
+    /// pixel of the tile the path contributes to
+    std::vector<uint32_t> Pixel;
+    std::vector<tl::optional<PrimitiveHit>> Hit;
+    std::vector<IntersectionRecord> HitRecord;
+    std::vector<uint8_t> Alive;
+    /// point and PDF of the last scatter of the path, see RayTracingCore::hit_emission()
+    std::vector<glm::vec3> ScatterP;
+    std::vector<float> ScatterPdf;
+
+    size_t size() const noexcept { return Rays.size(); }
+
+    void resize(const size_t count) {
+        Rays.resize(count);
+        Throughput.resize(count);
+        Pixel.resize(count);
+        Hit.resize(count);
+        HitRecord.resize(count);
+        Alive.resize(count);
+        ScatterP.resize(count);
+        ScatterPdf.resize(count);
+    }
+};
+
+/// Path tracer that keeps all the samples of a tile in flight and runs the bounces as a sequence of batch stages
+/// over the whole queue: generate the primary rays, extend (closest hit of every path), shade (hits sorted by material
+/// kind and handle, scattered in batches by the kernel of the kind, misses accumulate the environment, hits their
+/// emission, hits on materials with a PDF a light sample), Russian roulette and compact (drop the finished paths).
+/// Same estimator as RayTracingCore::trace_path(), one instance per worker thread, the queues are reused between tiles.
+class WavefrontIntegrator {
+public:
+    /// hits per MaterialCollection::scatter_batch() call
+    static constexpr size_t kShadeBatchSize = 256;
+
+    explicit WavefrontIntegrator(const RaySortParameters& ray_sort = {},
+                                 const MathAccuracy accuracy = MathAccuracy::Exact) noexcept
+        : _ray_sort{ray_sort}, _accuracy{accuracy} {}
+
+    /// Traces the pixels [start_x, end_x) x [start_y, end_y), colors are written row major to tile_colors.
+    void render_tile(const RayTracingCore& rtcore, const uint32_t start_x, const uint32_t start_y, const uint32_t end_x,
+                     const uint32_t end_y, const SceneSnapshot& scene, RandomNumberGenerator& randgen,
+                     std::span<RGBAColor> tile_colors);
+
+    /// Totals over all the tiles rendered so far.
+    const WavefrontStats& stats() const noexcept { return _stats; }
+
+private:
+    void generate(const RayTracingCore& rtcore, const uint32_t start_x, const uint32_t start_y, const uint32_t end_x,
+                  const uint32_t end_y, RandomNumberGenerator& randgen);
+    void extend(const HittableObject_Collection& world, const bool primary);
+    void sort_secondary_rays();
+    /// Adjacent paths of order that went the same way and hit the same object.
+    size_t coherent_pairs(std::span<const uint32_t> order) const noexcept;
+    void shade(const SceneSnapshot& scene, const bool light_sampling, RandomNumberGenerator& randgen);
+    void roulette(RandomNumberGenerator& randgen);
+    void compact();
+
+    RaySortParameters _ray_sort;
+    /// of the shade kernels and the gamma conversion
+    MathAccuracy _accuracy;
+    WavefrontPathQueue _paths;
+    /// first path of every primary ray packet, the last entry is the paths count
+    std::vector<uint32_t> _packet_starts;
+    /// (sort key << 32 | path) of the secondary rays and the paths in the order they are traced
+    std::vector<uint64_t> _sort_keys;
+    std::vector<uint32_t> _trace_order;
+    /// (material handle << 32 | path) of the paths that hit a material of each kind
+    std::vector<uint64_t> _material_queues[static_cast<uint32_t>(MaterialKind::Count)];
+    ScatterBatch _scatter_batch;
+    std::vector<glm::vec3> _radiance;
+    WavefrontStats _stats;
+};
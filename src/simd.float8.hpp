@@ -0,0 +1,219 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <cstdint>
+
+#if defined(__AVX2__) || defined(__SSE4_1__)
+#include <immintrin.h>
+#endif
+
+#if !defined(XRAY_KERNEL_ISA)
+#define XRAY_KERNEL_ISA baseline
+#endif
+
+/// 8 lane float vector. Maps to one AVX register when the translation unit is built with AVX2 (masks in opmask
+/// registers with AVX-512VL), to a pair of SSE registers with SSE4.1, otherwise to plain loops the compiler is free to
+/// vectorize with whatever the baseline ISA offers. Lives in the namespace of the ISA level the translation unit is
+/// built for (see ray.tracer.bvh8.kernels.cc), so the builds for different levels never share a definition.
+namespace XRAY_KERNEL_ISA {
+
+#if defined(__AVX2__)
+
+struct Float8 {
+    __m256 v;
+};
+
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+struct Mask8 {
+    __mmask8 m;
+};
+#else
+struct Mask8 {
+    __m256 m;
+};
+#endif
+
+inline Float8 f8_broadcast(const float f) noexcept { return Float8{_mm256_set1_ps(f)}; }
+inline Float8 f8_load(const float* p) noexcept { return Float8{_mm256_load_ps(p)}; }
+inline void f8_store(float* p, const Float8 a) noexcept { _mm256_storeu_ps(p, a.v); }
+/// Widens 8 bytes to 8 floats.
+inline Float8 f8_from_u8(const uint8_t* p) noexcept {
+    return Float8{_mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(p))))};
+}
+
+inline Float8 operator+(const Float8 a, const Float8 b) noexcept { return Float8{_mm256_add_ps(a.v, b.v)}; }
+inline Float8 operator-(const Float8 a, const Float8 b) noexcept { return Float8{_mm256_sub_ps(a.v, b.v)}; }
+inline Float8 operator*(const Float8 a, const Float8 b) noexcept { return Float8{_mm256_mul_ps(a.v, b.v)}; }
+inline Float8 operator/(const Float8 a, const Float8 b) noexcept { return Float8{_mm256_div_ps(a.v, b.v)}; }
+
+inline Float8 f8_min(const Float8 a, const Float8 b) noexcept { return Float8{_mm256_min_ps(a.v, b.v)}; }
+inline Float8 f8_max(const Float8 a, const Float8 b) noexcept { return Float8{_mm256_max_ps(a.v, b.v)}; }
+inline Float8 f8_sqrt(const Float8 a) noexcept { return Float8{_mm256_sqrt_ps(a.v)}; }
+
+#if defined(__AVX512F__) && defined(__AVX512VL__)
+
+inline Mask8 operator<(const Float8 a, const Float8 b) noexcept {
+    return Mask8{_mm256_cmp_ps_mask(a.v, b.v, _CMP_LT_OQ)};
+}
+inline Mask8 operator<=(const Float8 a, const Float8 b) noexcept {
+    return Mask8{_mm256_cmp_ps_mask(a.v, b.v, _CMP_LE_OQ)};
+}
+inline Mask8 operator&(const Mask8 a, const Mask8 b) noexcept { return Mask8{static_cast<__mmask8>(a.m & b.m)}; }
+
+/// Bit i set when lane i is set.
+inline uint32_t m8_bits(const Mask8 a) noexcept { return a.m; }
+
+/// a where the mask is set, b elsewhere.
+inline Float8 f8_select(const Mask8 mask, const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm256_mask_blend_ps(mask.m, b.v, a.v)};
+}
+
+#else
+
+inline Mask8 operator<(const Float8 a, const Float8 b) noexcept { return Mask8{_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+inline Mask8 operator<=(const Float8 a, const Float8 b) noexcept { return Mask8{_mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ)}; }
+inline Mask8 operator&(const Mask8 a, const Mask8 b) noexcept { return Mask8{_mm256_and_ps(a.m, b.m)}; }
+
+/// Bit i set when lane i is set.
+inline uint32_t m8_bits(const Mask8 a) noexcept { return static_cast<uint32_t>(_mm256_movemask_ps(a.m)); }
+
+/// a where the mask is set, b elsewhere.
+inline Float8 f8_select(const Mask8 mask, const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm256_blendv_ps(b.v, a.v, mask.m)};
+}
+
+#endif
+
+#elif defined(__SSE4_1__)
+
+struct Float8 {
+    __m128 lo;
+    __m128 hi;
+};
+
+struct Mask8 {
+    __m128 lo;
+    __m128 hi;
+};
+
+inline Float8 f8_broadcast(const float f) noexcept { return Float8{_mm_set1_ps(f), _mm_set1_ps(f)}; }
+inline Float8 f8_load(const float* p) noexcept { return Float8{_mm_load_ps(p), _mm_load_ps(p + 4)}; }
+inline void f8_store(float* p, const Float8 a) noexcept {
+    _mm_storeu_ps(p, a.lo);
+    _mm_storeu_ps(p + 4, a.hi);
+}
+inline Float8 f8_from_u8(const uint8_t* p) noexcept {
+    const __m128i bytes = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(p));
+    return Float8{
+        _mm_cvtepi32_ps(_mm_cvtepu8_epi32(bytes)),
+        _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_srli_si128(bytes, 4))),
+    };
+}
+
+inline Float8 operator+(const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm_add_ps(a.lo, b.lo), _mm_add_ps(a.hi, b.hi)};
+}
+inline Float8 operator-(const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm_sub_ps(a.lo, b.lo), _mm_sub_ps(a.hi, b.hi)};
+}
+inline Float8 operator*(const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm_mul_ps(a.lo, b.lo), _mm_mul_ps(a.hi, b.hi)};
+}
+inline Float8 operator/(const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm_div_ps(a.lo, b.lo), _mm_div_ps(a.hi, b.hi)};
+}
+
+inline Float8 f8_min(const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm_min_ps(a.lo, b.lo), _mm_min_ps(a.hi, b.hi)};
+}
+inline Float8 f8_max(const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm_max_ps(a.lo, b.lo), _mm_max_ps(a.hi, b.hi)};
+}
+inline Float8 f8_sqrt(const Float8 a) noexcept { return Float8{_mm_sqrt_ps(a.lo), _mm_sqrt_ps(a.hi)}; }
+
+inline Mask8 operator<(const Float8 a, const Float8 b) noexcept {
+    return Mask8{_mm_cmplt_ps(a.lo, b.lo), _mm_cmplt_ps(a.hi, b.hi)};
+}
+inline Mask8 operator<=(const Float8 a, const Float8 b) noexcept {
+    return Mask8{_mm_cmple_ps(a.lo, b.lo), _mm_cmple_ps(a.hi, b.hi)};
+}
+inline Mask8 operator&(const Mask8 a, const Mask8 b) noexcept {
+    return Mask8{_mm_and_ps(a.lo, b.lo), _mm_and_ps(a.hi, b.hi)};
+}
+
+inline uint32_t m8_bits(const Mask8 a) noexcept {
+    return static_cast<uint32_t>(_mm_movemask_ps(a.lo) | (_mm_movemask_ps(a.hi) << 4));
+}
+
+inline Float8 f8_select(const Mask8 mask, const Float8 a, const Float8 b) noexcept {
+    return Float8{_mm_blendv_ps(b.lo, a.lo, mask.lo), _mm_blendv_ps(b.hi, a.hi, mask.hi)};
+}
+
+#else
+
+struct Float8 {
+    float v[8];
+};
+
+struct Mask8 {
+    bool m[8];
+};
+
+#define FLOAT8_LANEWISE(expr)                                                                                         \
+    Float8 r;                                                                                                          \
+    for (uint32_t i = 0; i < 8; ++i) {                                                                                 \
+        r.v[i] = expr;                                                                                                 \
+    }                                                                                                                  \
+    return r
+
+#define MASK8_LANEWISE(expr)                                                                                           \
+    Mask8 r;                                                                                                           \
+    for (uint32_t i = 0; i < 8; ++i) {                                                                                 \
+        r.m[i] = expr;                                                                                                 \
+    }                                                                                                                  \
+    return r
+
+inline Float8 f8_broadcast(const float f) noexcept { FLOAT8_LANEWISE(f); }
+inline Float8 f8_load(const float* p) noexcept { FLOAT8_LANEWISE(p[i]); }
+inline void f8_store(float* p, const Float8 a) noexcept { std::copy(a.v, a.v + 8, p); }
+inline Float8 f8_from_u8(const uint8_t* p) noexcept { FLOAT8_LANEWISE(static_cast<float>(p[i])); }
+
+inline Float8 operator+(const Float8 a, const Float8 b) noexcept { FLOAT8_LANEWISE(a.v[i] + b.v[i]); }
+inline Float8 operator-(const Float8 a, const Float8 b) noexcept { FLOAT8_LANEWISE(a.v[i] - b.v[i]); }
+inline Float8 operator*(const Float8 a, const Float8 b) noexcept { FLOAT8_LANEWISE(a.v[i] * b.v[i]); }
+inline Float8 operator/(const Float8 a, const Float8 b) noexcept { FLOAT8_LANEWISE(a.v[i] / b.v[i]); }
+
+inline Float8 f8_min(const Float8 a, const Float8 b) noexcept { FLOAT8_LANEWISE(a.v[i] < b.v[i] ? a.v[i] : b.v[i]); }
+inline Float8 f8_max(const Float8 a, const Float8 b) noexcept { FLOAT8_LANEWISE(a.v[i] > b.v[i] ? a.v[i] : b.v[i]); }
+inline Float8 f8_sqrt(const Float8 a) noexcept { FLOAT8_LANEWISE(std::sqrt(a.v[i])); }
+
+inline Mask8 operator<(const Float8 a, const Float8 b) noexcept { MASK8_LANEWISE(a.v[i] < b.v[i]); }
+inline Mask8 operator<=(const Float8 a, const Float8 b) noexcept { MASK8_LANEWISE(a.v[i] <= b.v[i]); }
+inline Mask8 operator&(const Mask8 a, const Mask8 b) noexcept { MASK8_LANEWISE(a.m[i] && b.m[i]); }
+
+inline uint32_t m8_bits(const Mask8 a) noexcept {
+    uint32_t bits{};
+    for (uint32_t i = 0; i < 8; ++i) {
+        bits |= a.m[i] ? (1u << i) : 0u;
+    }
+    return bits;
+}
+
+inline Float8 f8_select(const Mask8 mask, const Float8 a, const Float8 b) noexcept {
+    FLOAT8_LANEWISE(mask.m[i] ? a.v[i] : b.v[i]);
+}
+
+#undef FLOAT8_LANEWISE
+#undef MASK8_LANEWISE
+
+#endif
+
+/// Mask with the first count lanes set.
+inline uint32_t lanes_mask(const uint32_t count) noexcept { return (1u << count) - 1u; }
+
+/// Index of the lowest set bit, bits must not be 0.
+inline uint32_t lowest_lane(const uint32_t bits) noexcept { return static_cast<uint32_t>(std::countr_zero(bits)); }
+
+} // namespace XRAY_KERNEL_ISA
@@ -0,0 +1,103 @@
+#include "simd.isa.hpp"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+#include <intrin.h>
+#endif
+
+namespace {
+
+std::atomic<SimdIsa> g_active_simd_isa{SimdIsa::Baseline};
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_AMD64))
+
+bool cpuid_bit(const int32_t leaf, const int32_t subleaf, const uint32_t reg, const uint32_t bit) noexcept {
+    int32_t regs[4];
+    __cpuidex(regs, leaf, subleaf);
+    return (static_cast<uint32_t>(regs[reg]) >> bit) & 1u;
+}
+
+SimdIsa detect_cpu_isa() noexcept {
+    constexpr uint32_t kEbx = 1;
+    constexpr uint32_t kEcx = 2;
+
+    if (!cpuid_bit(1, 0, kEcx, 20) || !cpuid_bit(1, 0, kEcx, 23)) {
+        return SimdIsa::Baseline;
+    }
+
+    //
+    // the OS has to save the YMM (and for AVX-512 the opmask/ZMM) state, otherwise the instructions fault
+    if (!cpuid_bit(1, 0, kEcx, 27)) {
+        return SimdIsa::Sse4;
+    }
+    const uint64_t xcr0 = _xgetbv(0);
+    const bool avx2 = (xcr0 & 0x6) == 0x6 && cpuid_bit(1, 0, kEcx, 12) && cpuid_bit(7, 0, kEbx, 5) &&
+                      cpuid_bit(7, 0, kEbx, 8);
+    if (!avx2) {
+        return SimdIsa::Sse4;
+    }
+
+    const bool avx512 = (xcr0 & 0xe6) == 0xe6 && cpuid_bit(7, 0, kEbx, 16) && cpuid_bit(7, 0, kEbx, 17) &&
+                        cpuid_bit(7, 0, kEbx, 30) && cpuid_bit(7, 0, kEbx, 31);
+    return avx512 ? SimdIsa::Avx512 : SimdIsa::Avx2;
+}
+
+#elif (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+
+SimdIsa detect_cpu_isa() noexcept {
+    //
+    // libgcc checks the OS support of the AVX state too
+    __builtin_cpu_init();
+
+    if (!__builtin_cpu_supports("sse4.2") || !__builtin_cpu_supports("popcnt")) {
+        return SimdIsa::Baseline;
+    }
+    if (!__builtin_cpu_supports("avx2") || !__builtin_cpu_supports("fma") || !__builtin_cpu_supports("bmi2")) {
+        return SimdIsa::Sse4;
+    }
+    if (!__builtin_cpu_supports("avx512f") || !__builtin_cpu_supports("avx512vl") ||
+        !__builtin_cpu_supports("avx512dq") || !__builtin_cpu_supports("avx512bw")) {
+        return SimdIsa::Avx2;
+    }
+    return SimdIsa::Avx512;
+}
+
+#else
+
+SimdIsa detect_cpu_isa() noexcept { return SimdIsa::Baseline; }
+
+#endif
+
+} // namespace
+
+tl::optional<SimdIsa> simd_isa_from_name(const std::string_view name) noexcept {
+    for (uint32_t isa = 0; isa < static_cast<uint32_t>(SimdIsa::Count); ++isa) {
+        if (name == simd_isa_name(static_cast<SimdIsa>(isa))) {
+            return static_cast<SimdIsa>(isa);
+        }
+    }
+    return tl::nullopt;
+}
+
+SimdIsa detect_simd_isa() noexcept {
+    static const SimdIsa detected = detect_cpu_isa();
+    return detected;
+}
+
+SimdIsa max_built_simd_isa() noexcept {
+#if defined(XRAY_ISA_DISPATCH)
+    return SimdIsa::Avx512;
+#else
+    return SimdIsa::Baseline;
+#endif
+}
+
+SimdIsa select_simd_isa(const SimdIsa requested) noexcept {
+    const SimdIsa selected = std::min({requested, detect_simd_isa(), max_built_simd_isa()});
+    g_active_simd_isa.store(selected, std::memory_order_relaxed);
+    return selected;
+}
+
+SimdIsa active_simd_isa() noexcept { return g_active_simd_isa.load(std::memory_order_relaxed); }
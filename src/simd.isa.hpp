@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <string_view>
+
+#include <tl/optional.hpp>
+
+/// Instruction set levels the BVH8 traversal kernels (ray.tracer.bvh8.kernels.cc) are built for (the x86-64
+/// microarchitecture levels v1 to v4). Only those kernels are dispatched: everything else, the BVH2 traversal and the
+/// material scatter/shading batches included, is built once for Baseline. The kernels of the higher levels are only
+/// called when the CPU supports them.
+enum class SimdIsa : uint8_t {
+    /// x86-64 (SSE2), or whatever the target architecture is when it is not x86-64
+    Baseline,
+    /// SSE4.2, POPCNT
+    Sse4,
+    /// AVX2, FMA, BMI2
+    Avx2,
+    /// AVX-512 F/VL/DQ/BW
+    Avx512,
+    Count,
+};
+
+constexpr const char* simd_isa_name(const SimdIsa isa) noexcept {
+    switch (isa) {
+    case SimdIsa::Baseline:
+        return "baseline";
+    case SimdIsa::Sse4:
+        return "sse4";
+    case SimdIsa::Avx2:
+        return "avx2";
+    case SimdIsa::Avx512:
+        return "avx512";
+    default:
+        return "Unknown";
+    }
+}
+
+tl::optional<SimdIsa> simd_isa_from_name(const std::string_view name) noexcept;
+
+/// Highest level the CPU (and the OS, for the AVX register state) supports.
+SimdIsa detect_simd_isa() noexcept;
+
+/// Highest level that has kernels built into this executable.
+SimdIsa max_built_simd_isa() noexcept;
+
+/// Selects the kernels used from now on: requested, capped to what the CPU supports and what was built. Returns the
+/// level actually selected. Call before the worker threads start, switching while rays are traced is harmless but
+/// mixes kernels.
+SimdIsa select_simd_isa(const SimdIsa requested) noexcept;
+
+/// Level selected by select_simd_isa(), Baseline until then.
+SimdIsa active_simd_isa() noexcept;